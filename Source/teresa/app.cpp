@@ -1,7 +1,25 @@
 
 #include "app.h"
+#include "basis_transcoder.h"
+#include "format_conversion.h"
+#include "glsl_translator.h"
+#include "host_memory_pool.h"
+#include "image_decoder.h"
+#include "index_range_cache.h"
+#include "ktx_container.h"
+#include "mapped_file.h"
+#include "pixel_format.h"
+#include "pixel_transfer.h"
+#include "std140_layout.h"
+#include "streaming_buffer.h"
+#include "texture_atlas.h"
 #include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <optional>
 #include <variant>
 
 namespace webgl
@@ -10,22 +28,129 @@ namespace webgl
 
     using Int32List = typed_array<std::int32_t>;
 
-    // The power preference settings are documented in the WebGLContextAttributes
-    // section of the specification.
-    enum PowerPreference { defaulted, low_power, high_performance };
+    void ContextAttributes::from_node(napi_env env_, napi_value object_)
+    {
+        read_node_property_if_present(env_, object_, alpha, u8"alpha");
+        read_node_property_if_present(env_, object_, depth, u8"depth");
+        read_node_property_if_present(env_, object_, stencil, u8"stencil");
+        read_node_property_if_present(env_, object_, antialias, u8"antialias");
+        read_node_property_if_present(env_, object_, premultipliedAlpha, u8"premultipliedAlpha");
+        read_node_property_if_present(env_, object_, preserveDrawingBuffer, u8"preserveDrawingBuffer");
+        read_node_property_if_present(env_, object_, failIfMajorPerformanceCaveat, u8"failIfMajorPerformanceCaveat");
 
-    struct ContextAttributes
-        :public node_compatible
+        std::string powerPreferenceName;
+        if (read_node_property_if_present(env_, object_, powerPreferenceName, u8"powerPreference")) {
+            if (powerPreferenceName == "low-power") {
+                powerPreference = PowerPreference::low_power;
+            }
+            else if (powerPreferenceName == "high-performance") {
+                powerPreference = PowerPreference::high_performance;
+            }
+            else {
+                powerPreference = PowerPreference::defaulted;
+            }
+        }
+
+        std::string validationName;
+        if (read_node_property_if_present(env_, object_, validationName, u8"validation")) {
+            if (validationName == "none") {
+                validation = Validation::none;
+            }
+            else if (validationName == "fast") {
+                validation = Validation::fast;
+            }
+            else if (validationName == "strict") {
+                validation = Validation::strict;
+            }
+            else {
+                throw std::runtime_error("Unknown validation level.");
+            }
+        }
+
+        read_node_property_if_present(env_, object_, pooledBuffers, u8"pooledBuffers");
+        read_node_property_if_present(env_, object_, stagingBufferSize, u8"stagingBufferSize");
+        read_node_property_if_present(env_, object_, headless, u8"headless");
+        read_node_property_if_present(env_, object_, virtualized, u8"virtualized");
+        read_node_property_if_present(env_, object_, width, u8"width");
+        read_node_property_if_present(env_, object_, height, u8"height");
+        if (width <= 0 || height <= 0) {
+            throw std::runtime_error("The canvas size must be positive.");
+        }
+    }
+
+    void ContextAttributes::to_node(napi_env env_, napi_value object_) const
     {
-        bool alpha = true;
-        bool depth = true;
-        bool stencil = false;
-        bool antialias = true;
-        bool premultipliedAlpha = true;
-        bool preserveDrawingBuffer = false;
-        PowerPreference powerPreference = PowerPreference::defaulted;
-        bool failIfMajorPerformanceCaveat = false;
-    };
+        static const char *powerPreferenceNames[] = { "default", "low-power", "high-performance" };
+        static const char *validationNames[] = { "none", "fast", "strict" };
+
+        node_compatible::to_node(env_, object_);
+        set_node_property(env_, object_, u8"alpha", alpha);
+        set_node_property(env_, object_, u8"depth", depth);
+        set_node_property(env_, object_, u8"stencil", stencil);
+        set_node_property(env_, object_, u8"antialias", antialias);
+        set_node_property(env_, object_, u8"premultipliedAlpha", premultipliedAlpha);
+        set_node_property(env_, object_, u8"preserveDrawingBuffer", preserveDrawingBuffer);
+        set_node_property(env_, object_, u8"powerPreference", std::string(powerPreferenceNames[powerPreference]));
+        set_node_property(env_, object_, u8"failIfMajorPerformanceCaveat", failIfMajorPerformanceCaveat);
+        set_node_property(env_, object_, u8"validation", std::string(validationNames[static_cast<int>(validation)]));
+        set_node_property(env_, object_, u8"pooledBuffers", pooledBuffers);
+        set_node_property(env_, object_, u8"stagingBufferSize", stagingBufferSize);
+        set_node_property(env_, object_, u8"headless", headless);
+        set_node_property(env_, object_, u8"virtualized", virtualized);
+        set_node_property(env_, object_, u8"width", width);
+        set_node_property(env_, object_, u8"height", height);
+    }
+
+    void PresentMode::from_node(napi_env env_, napi_value object_)
+    {
+        read_node_property_if_present(env_, object_, vsync, u8"vsync");
+        read_node_property_if_present(env_, object_, maxFramesInFlight, u8"maxFramesInFlight");
+        read_node_property_if_present(env_, object_, presentThread, u8"presentThread");
+    }
+
+    void PresentMode::to_node(napi_env env_, napi_value object_) const
+    {
+        node_compatible::to_node(env_, object_);
+        set_node_property(env_, object_, u8"vsync", vsync);
+        set_node_property(env_, object_, u8"maxFramesInFlight", maxFramesInFlight);
+        set_node_property(env_, object_, u8"presentThread", presentThread);
+    }
+
+    void CaptureOptions::from_node(napi_env env_, napi_value object_)
+    {
+        std::string formatName;
+        if (read_node_property_if_present(env_, object_, formatName, u8"format")) {
+            if (formatName == "rgba") {
+                format = teresa::capture_format::rgba;
+            }
+            else if (formatName == "yuv420") {
+                format = teresa::capture_format::yuv420;
+            }
+            else {
+                throw std::runtime_error("Unknown capture format.");
+            }
+        }
+
+        std::string sinkName;
+        if (read_node_property_if_present(env_, object_, sinkName, u8"sink")) {
+            if (sinkName == "stream") {
+                sink = teresa::capture_sink::queue;
+            }
+            else if (sinkName == "file") {
+                sink = teresa::capture_sink::file;
+            }
+            else if (sinkName == "fd") {
+                sink = teresa::capture_sink::descriptor;
+            }
+            else {
+                throw std::runtime_error("Unknown capture sink.");
+            }
+        }
+
+        read_node_property_if_present(env_, object_, path, u8"path");
+        read_node_property_if_present(env_, object_, fd, u8"fd");
+        read_node_property_if_present(env_, object_, queueLength, u8"queueLength");
+    }
 
     struct Object
         :public node_compatible
@@ -33,8 +158,16 @@ namespace webgl
     public:
         GLuint gl_handle;
 
+        bool deleted = false;
+
+        // Estimated GPU memory held by the object.
+        std::size_t memory_size = 0;
+
+        // The context the object was created in, the only one it may be used with.
+        teresa::native_webgl *context;
+
         Object(GLuint gl_handle_)
-            :gl_handle(gl_handle_)
+            :gl_handle(gl_handle_), context(&teresa::native_webgl::current())
         {
 
         }
@@ -51,6 +184,55 @@ namespace webgl
     {
     public:
         using Object::Object;
+
+        // Storage within an arena when the buffer is pooled; |gl_handle| then names the arena.
+        teresa::buffer_pool::block pool_block;
+
+        GLenum usage = GL_STATIC_DRAW;
+
+        // Once bound to a uniform buffer binding, the buffer stays out of arenas.
+        bool uniform = false;
+
+        // Set for buffers made by createStreamingBuffer(); |gl_handle| then names its storage.
+        // Shared with the ArrayBuffer of |contents|, which the mapping must outlive.
+        std::shared_ptr<teresa::streaming_buffer> stream;
+
+        // The canvas of a streaming buffer, which nextFrame() makes current.
+        std::weak_ptr<const teresa::webgl_canvas> canvas;
+
+        GLintptr base_offset() const
+        {
+            return pool_block.offset + (stream ? stream->frame_offset() : 0);
+        }
+
+        // Moves a streaming buffer on to its next frame, returns where the frame starts within |contents|.
+        GLintptr nextFrame();
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            Object::to_node(env_, object_);
+            if (stream) {
+                // Valid for as long as the ArrayBuffer is, even past deleteBuffer(); writes then go nowhere.
+                set_node_property(env_, object_, u8"contents", external_array_buffer{ stream->data(), stream->size(), [stream = stream](void *) mutable {
+                    stream.reset();
+                } });
+                set_node_property(env_, object_, u8"frameSize", static_cast<double>(stream->frame_size()));
+                set_node_property(env_, object_, u8"frameCount", static_cast<double>(teresa::streaming_buffer::frame_count));
+                set_node_property(env_, object_, u8"frameOffset", static_cast<double>(stream->frame_offset()));
+                set_node_property(env_, object_, u8"nextFrame", &Buffer::nextFrame);
+            }
+        }
+
+        // The following are maintained by the validating entry points only.
+
+        // The target the buffer was first bound to; WebGL forbids rebinding
+        // an element array buffer to another target and vice versa.
+        GLenum target = 0;
+
+        std::size_t byte_size = 0;
+
+        // Shadow of the contents of element array buffers.
+        teresa::index_range_cache indices;
     };
     std::list<node_ptr<Buffer>> buffers;
 
@@ -61,11 +243,48 @@ namespace webgl
     };
     std::list<node_ptr<Framebuffer>> framebuffers;
 
+    struct Shader
+        :public Object
+    {
+    public:
+        // The GL shader is only known once compiled, as it may be shared with other shaders.
+        Shader(GLenum type_)
+            :Object(0), type(type_)
+        {
+
+        }
+
+        GLenum type;
+
+        // As given to shaderSource(), before translation.
+        std::string source;
+
+        std::shared_ptr<const std::string> translated_source;
+
+        // The shared GL shader of the last compile, which gl_handle names.
+        teresa::shader_cache::entry *compiled = nullptr;
+    };
+
     struct Program
         :public Object
     {
     public:
         using Object::Object;
+
+        struct attachment
+        {
+            node_ptr<Shader> shader;
+
+            // The GL shader attached for |shader|, which changes when it is compiled again.
+            GLuint gl_handle = 0;
+        };
+
+        std::vector<attachment> attachments;
+
+        // The following are maintained by the validating entry points only.
+        bool linked = false;
+
+        std::vector<GLint> attrib_locations;
     };
     std::list<std::unique_ptr<Program>> programs;
 
@@ -76,33 +295,48 @@ namespace webgl
     };
     std::list<node_ptr<Renderbuffer>> renderbuffers;
 
-    struct Shader
+    struct Texture
         :public Object
     {
     public:
         using Object::Object;
+
+        // Estimated bytes of every level of every face; all but the first face are unused unless a cube map.
+        std::array<std::vector<std::size_t>, 6> level_sizes;
+
+        std::array<std::array<GLsizei, 2>, 6> base_extents = {};
+
+        // Set for textures of the transient pool, which have immutable storage.
+        std::optional<teresa::texture_desc> transient;
+
+        // A transient texture currently owned by the pool.
+        bool released = false;
     };
-    std::list<node_ptr<Shader>> shaders;
+    std::list<node_ptr<Texture>> textures;
 
-    struct Texture
+    struct VertexArrayObject
         :public Object
     {
     public:
         using Object::Object;
+
+        teresa::vertex_array_state state;
     };
-    std::list<node_ptr<Texture>> textures;
+    std::list<node_ptr<VertexArrayObject>> vertexArrays;
 
     struct UniformLocation
         :public node_compatible
     {
     public:
-        UniformLocation(GLint gl_location_)
-            :gl_location(gl_location_)
+        UniformLocation(GLint gl_location_, Program *program_)
+            :gl_location(gl_location_), program(program_)
         {
 
         }
 
         GLint gl_location;
+
+        Program *program;
     };
 
     struct ActiveInfo
@@ -166,165 +400,880 @@ namespace webgl
         }, buffersource_);
     }
 
-    node_ptr<ContextAttributes> getContextAttributes()
+    // See teresa::native_webgl::tracked_state.
+    teresa::virtual_state* tracked_state()
     {
-        return make_node_ptr<ContextAttributes>();
+        return teresa::native_webgl::current().tracked_state;
     }
 
-    bool isContextLost()
+    // Makes |canvas| current for objects whose methods are called on them rather than on the
+    // canvas, and so would run against whichever canvas was current last.
+    void make_current(const std::weak_ptr<const teresa::webgl_canvas> &canvas, const char *gone_message)
     {
-        return false;
+        auto owner = canvas.lock();
+        if (!owner) {
+            throw std::runtime_error(gone_message);
+        }
+        owner->make_current();
     }
 
-    std::vector<std::string> getSupportedExtensions()
+    node_ptr<VertexArrayObject> createVertexArrayOES()
     {
-        return {};
+        GLuint h;
+        glCreateVertexArrays(1, &h);
+        auto result = make_node_ptr<VertexArrayObject>(h);
+        vertexArrays.push_back(result);
+        return result;
     }
 
-    napi_value getExtension(std::string name)
+    void deleteVertexArrayOES(node_ptr<VertexArrayObject> arrayObject)
     {
-        return nullptr;
+        if (!arrayObject.get()) {
+            return;
+        }
+        auto &context = teresa::native_webgl::current();
+        if (context.is_vertex_array_bound(&arrayObject->state)) {
+            context.bind_vertex_array(nullptr);
+            // GL would fall back to vertex array 0 rather than the default one of the canvas.
+            glBindVertexArray(context.default_vertex_array_object);
+            if (auto state = tracked_state()) {
+                state->vertex_array = context.default_vertex_array_object;
+            }
+        }
+        arrayObject->deleted = true;
+        glDeleteVertexArrays(1, &arrayObject->gl_handle);
+        vertexArrays.remove_if([&arrayObject](auto &x) { return x.get() == arrayObject.get(); });
     }
 
-    void activeTexture(GLenum texture)
+    GLboolean isVertexArrayOES(node_ptr<VertexArrayObject> arrayObject)
     {
-        glActiveTexture(texture);
+        return arrayObject.get() && glIsVertexArray(arrayObject->gl_handle);
     }
 
-    void attachShader(node_ptr<Program> program, node_ptr<Shader> shader)
+    void bindVertexArrayOES(node_ptr<VertexArrayObject> arrayObject)
     {
-        glAttachShader(program->gl_handle, shader->gl_handle);
+        auto &context = teresa::native_webgl::current();
+        auto state = arrayObject.get() ? &arrayObject->state : nullptr;
+        if (context.is_vertex_array_bound(state)) {
+            return;
+        }
+        auto h = arrayObject.get() ? arrayObject->gl_handle : context.default_vertex_array_object;
+        glBindVertexArray(h);
+        context.bind_vertex_array(state);
+        if (auto tracked = context.tracked_state) {
+            tracked->vertex_array = h;
+        }
     }
 
-    void bindAttribLocation(node_ptr<Program> program, GLuint index, std::string name)
+    // One per canvas, whose methods make the canvas current as its own methods do.
+    struct OES_vertex_array_object
+        :public node_compatible
     {
-        glBindAttribLocation(program->gl_handle, index, name.c_str());
-    }
+        std::weak_ptr<const teresa::webgl_canvas> canvas;
 
-    void bindBuffer(GLenum target, node_ptr<Buffer> buffer)
-    {
-        glBindBuffer(target, buffer->gl_handle);
-    }
+        OES_vertex_array_object(std::weak_ptr<const teresa::webgl_canvas> canvas_)
+            :canvas(std::move(canvas_))
+        {
 
-    void bindFramebuffer(GLenum target, node_ptr<Framebuffer> framebuffer)
+        }
+
+        node_ptr<VertexArrayObject> create()
+        {
+            make_current(canvas, "The canvas of the extension was destroyed.");
+            return createVertexArrayOES();
+        }
+
+        void remove(node_ptr<VertexArrayObject> arrayObject)
+        {
+            make_current(canvas, "The canvas of the extension was destroyed.");
+            deleteVertexArrayOES(arrayObject);
+        }
+
+        GLboolean is(node_ptr<VertexArrayObject> arrayObject)
+        {
+            make_current(canvas, "The canvas of the extension was destroyed.");
+            return isVertexArrayOES(arrayObject);
+        }
+
+        void bind(node_ptr<VertexArrayObject> arrayObject)
+        {
+            make_current(canvas, "The canvas of the extension was destroyed.");
+            bindVertexArrayOES(arrayObject);
+        }
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            node_compatible::to_node(env_, object_);
+            set_node_property(env_, object_, u8"VERTEX_ARRAY_BINDING_OES", GL_VERTEX_ARRAY_BINDING);
+            set_node_property(env_, object_, u8"createVertexArrayOES", &OES_vertex_array_object::create);
+            set_node_property(env_, object_, u8"deleteVertexArrayOES", &OES_vertex_array_object::remove);
+            set_node_property(env_, object_, u8"isVertexArrayOES", &OES_vertex_array_object::is);
+            set_node_property(env_, object_, u8"bindVertexArrayOES", &OES_vertex_array_object::bind);
+        }
+    };
+
+    // Handed out so far, each for the canvas it holds; those of destroyed canvases are dropped.
+    std::list<node_ptr<OES_vertex_array_object>> vertexArrayExtensions;
+
+    using Extension = std::variant<
+        std::nullptr_t,
+        node_ptr<OES_vertex_array_object>
+    >;
+
+    bool isContextLost()
     {
-        glBindFramebuffer(target, framebuffer->gl_handle);
+        return false;
     }
 
-    void bindRenderbuffer(GLenum target, node_ptr<Renderbuffer> renderbuffer)
+    std::vector<std::string> getSupportedExtensions()
     {
-        glBindRenderbuffer(target, renderbuffer->gl_handle);
+        return { "OES_vertex_array_object" };
     }
 
-    void bindTexture(GLenum target, node_ptr<Texture> texture)
+    Extension getExtension(std::string name)
     {
-        glBindTexture(target, texture->gl_handle);
+        if (name == "OES_vertex_array_object") {
+            // The same object for every call on a canvas, as in WebGL.
+            auto canvas = &teresa::webgl_canvas::current();
+            vertexArrayExtensions.remove_if([](auto &x) { return x->canvas.expired(); });
+            for (auto &extension : vertexArrayExtensions) {
+                if (extension->canvas.lock().get() == canvas) {
+                    return extension;
+                }
+            }
+            auto extension = make_node_ptr<OES_vertex_array_object>(canvas->weak_from_this());
+            vertexArrayExtensions.push_back(extension);
+            return extension;
+        }
+        return nullptr;
     }
 
-    void blendColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)
+    // Keeps the context totals and V8's view of external memory in step with |new_size|.
+    void account_memory(teresa::memory_kind kind, std::size_t old_size, std::size_t new_size)
     {
-        glBlendColor(red, green, blue, alpha);
+        if (old_size == new_size) {
+            return;
+        }
+        teresa::native_webgl::current().account_memory(kind, old_size, new_size);
+        if (auto env = current_node_env()) {
+            std::int64_t adjusted = 0;
+            napi_adjust_external_memory(env, static_cast<std::int64_t>(new_size) - static_cast<std::int64_t>(old_size), &adjusted);
+        }
     }
 
-    void blendEquation(GLenum mode)
+    void account_memory(Object *object, teresa::memory_kind kind, std::size_t size)
     {
-        glBlendEquation(mode);
+        if (!object) {
+            return;
+        }
+        account_memory(kind, object->memory_size, size);
+        object->memory_size = size;
     }
 
-    void blendEquationSeparate(GLenum modeRGB, GLenum modeAlpha)
+    std::size_t face_index(GLenum target)
     {
-        glBlendEquationSeparate(modeRGB, modeAlpha);
+        if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z) {
+            return target - GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+        }
+        return 0;
     }
 
-    void blendFunc(GLenum sfactor, GLenum dfactor)
+    void account_texture_memory(Texture *texture)
     {
-        glBlendFunc(sfactor, dfactor);
+        std::size_t size = 0;
+        for (auto &levelSizes : texture->level_sizes) {
+            for (auto levelSize : levelSizes) {
+                size += levelSize;
+            }
+        }
+        account_memory(texture, teresa::memory_kind::texture, size);
     }
 
-    void blendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha)
+    // Records the estimated size of one level of the texture bound to |target|.
+    void account_texture_image(GLenum target, GLint level, GLsizei width, GLsizei height, std::size_t size)
     {
-        glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+        auto texture = teresa::native_webgl::current().texture_binding(target);
+        if (!texture || level < 0 || width < 0 || height < 0) {
+            return;
+        }
+        auto face = face_index(target);
+        auto &levelSizes = texture->level_sizes[face];
+        if (levelSizes.size() <= static_cast<std::size_t>(level)) {
+            levelSizes.resize(level + 1);
+        }
+        levelSizes[level] = size;
+        if (level == 0) {
+            texture->base_extents[face] = { width, height };
+        }
+        account_texture_memory(texture);
     }
 
-    void bufferData(GLenum target, BufferSource data, GLenum usage)
+    // Non-standard. Describes a transient texture, see acquireTransientTexture().
+    struct TransientTextureDescriptor
     {
-        glBufferData(target, get_byte_size(data), get_data(data), usage);
-    }
+        teresa::texture_desc desc;
 
-    void bufferSubData(GLenum target, GLintptr offset, BufferSource data)
+        void from_node(napi_env env_, napi_value object_)
+        {
+            read_node_property(env_, object_, desc.width, u8"width");
+            read_node_property(env_, object_, desc.height, u8"height");
+            read_node_property_if_present(env_, object_, desc.format, u8"format");
+            read_node_property_if_present(env_, object_, desc.type, u8"type");
+            read_node_property_if_present(env_, object_, desc.levels, u8"levels");
+        }
+    };
+
+    struct TransientTexturePoolOptions
     {
-        glBufferSubData(target, offset, get_byte_size(data), get_data(data));
-    }
+        double maxBytes = static_cast<double>(teresa::texture_pool::default_memory_cap);
 
-    GLenum checkFramebufferStatus(GLenum target)
+        double maxIdleFrames = static_cast<double>(teresa::texture_pool::default_max_idle_frames);
+
+        void from_node(napi_env env_, napi_value object_)
+        {
+            read_node_property_if_present(env_, object_, maxBytes, u8"maxBytes");
+            read_node_property_if_present(env_, object_, maxIdleFrames, u8"maxIdleFrames");
+        }
+    };
+
+    struct TransientTexturePoolStats
+        :public node_compatible
     {
-        return glCheckFramebufferStatus(target);
-    }
+        teresa::texture_pool::statistics statistics;
 
-    void clear(GLbitfield mask)
+        TransientTexturePoolStats(const teresa::texture_pool::statistics &statistics_)
+            :statistics(statistics_)
+        {
+
+        }
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            node_compatible::to_node(env_, object_);
+            set_node_property(env_, object_, u8"hits", static_cast<double>(statistics.hits));
+            set_node_property(env_, object_, u8"misses", static_cast<double>(statistics.misses));
+            set_node_property(env_, object_, u8"hitRate", statistics.hit_rate);
+            set_node_property(env_, object_, u8"evictions", static_cast<double>(statistics.evictions));
+            set_node_property(env_, object_, u8"idleCount", static_cast<double>(statistics.idle_count));
+            set_node_property(env_, object_, u8"idleBytes", static_cast<double>(statistics.idle_bytes));
+            set_node_property(env_, object_, u8"inUseCount", static_cast<double>(statistics.in_use_count));
+        }
+    };
+
+    void destroy_evicted_textures()
     {
-        glClear(mask);
+        auto &context = teresa::native_webgl::current();
+        for (auto texture : context.transient_textures().take_evicted()) {
+            context.on_texture_deleted(texture);
+            account_memory(texture, teresa::memory_kind::texture, 0);
+            texture->deleted = true;
+            glDeleteTextures(1, &texture->gl_handle);
+        }
     }
 
-    void clearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)
+    // Non-standard. A texture of the described size and format, recycled from earlier
+    // releases where possible. Its storage is immutable, so it is meant to be
+    // rendered to and sampled rather than re-specified with texImage2D.
+    node_ptr<Texture> acquireTransientTexture(TransientTextureDescriptor descriptor)
     {
-        glClearColor(red, green, blue, alpha);
+        auto &desc = descriptor.desc;
+        auto internalFormat = teresa::sized_internal_format(desc.format, desc.type);
+        if (desc.width <= 0 || desc.height <= 0 || desc.levels <= 0 || !internalFormat) {
+            throw std::runtime_error("Unsupported transient texture description.");
+        }
+        auto &pool = teresa::native_webgl::current().transient_textures();
+        if (auto texture = pool.acquire(desc)) {
+            texture->released = false;
+            return texture;
+        }
+
+        GLuint h;
+        glCreateTextures(GL_TEXTURE_2D, 1, &h);
+        glTextureStorage2D(h, desc.levels, internalFormat, desc.width, desc.height);
+        if (desc.levels == 1) {
+            glTextureParameteri(h, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        }
+        auto result = make_node_ptr<Texture>(h);
+        result->transient = desc;
+        auto width = desc.width;
+        auto height = desc.height;
+        for (GLint level = 0; level < desc.levels; ++level) {
+            result->level_sizes[0].push_back(static_cast<std::size_t>(width) * height * teresa::texel_size(internalFormat));
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+        result->base_extents[0] = { desc.width, desc.height };
+        account_texture_memory(result.get());
+        return result;
     }
 
-    void clearDepth(GLclampf depth)
+    // Non-standard. Hands a texture from acquireTransientTexture() back for reuse.
+    void releaseTransientTexture(node_ptr<Texture> texture)
     {
-        glClearDepth(depth);
+        if (!texture.get() || !texture->transient) {
+            throw std::runtime_error("Not a transient texture.");
+        }
+        if (texture->released || texture->deleted) {
+            return;
+        }
+        texture->released = true;
+        auto &pool = teresa::native_webgl::current().transient_textures();
+        pool.release(texture.get(), *texture->transient, texture->memory_size);
+        destroy_evicted_textures();
     }
 
-    void clearStencil(GLint s)
+    void configureTransientTexturePool(TransientTexturePoolOptions options)
     {
-        glClearStencil(s);
+        teresa::native_webgl::current().transient_textures().configure(
+            static_cast<std::size_t>(options.maxBytes), static_cast<std::size_t>(options.maxIdleFrames));
+        destroy_evicted_textures();
     }
 
-    void colorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+    node_ptr<TransientTexturePoolStats> getTransientTexturePoolStats()
     {
-        glColorMask(red, green, blue, alpha);
+        return make_node_ptr<TransientTexturePoolStats>(teresa::native_webgl::current().transient_textures().stats());
     }
 
-    void compileShader(node_ptr<Shader> shader)
+    // Called once per presented frame.
+    void end_frame()
     {
-        glCompileShader(shader->gl_handle);
+        auto &context = teresa::native_webgl::current();
+        context.transient_textures().end_frame();
+        destroy_evicted_textures();
+        if (auto staging = context.staging()) {
+            staging->end_frame();
+        }
     }
 
-    void compressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, data_view data)
+    void activeTexture(GLenum texture)
     {
-        glCompressedTexImage2D(target, level, internalformat, width, height, border, data.size, data.data);
+        auto &context = teresa::native_webgl::current();
+        if (!context.active_texture(texture)) {
+            context.synthesize_error(GL_INVALID_ENUM);
+            return;
+        }
+        glActiveTexture(texture);
+        if (auto state = tracked_state()) {
+            state->active_texture = texture;
+        }
     }
 
-    void compressedTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, data_view data)
+    void attachShader(node_ptr<Program> program, node_ptr<Shader> shader)
     {
-        glCompressedTexSubImage2D(target, level, xoffset, yoffset, width, height, format, data.size, data.data);
+        program->attachments.push_back({ shader, shader->gl_handle });
+        if (shader->gl_handle) {
+            glAttachShader(program->gl_handle, shader->gl_handle);
+        }
     }
 
-    void copyTexImage2D(GLenum target, GLint level, GLenum internalformat, GLint x, GLint y, GLsizei width, GLsizei height, GLint border)
+    void bindAttribLocation(node_ptr<Program> program, GLuint index, std::string name)
     {
-        glCopyTexImage2D(target, level, internalformat, x, y, width, height, border);
+        glBindAttribLocation(program->gl_handle, index, name.c_str());
     }
 
-    void copyTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint x, GLint y, GLsizei width, GLsizei height)
+    GLuint get_gl_handle(const Buffer *buffer_)
     {
-        glCopyTexSubImage2D(target, level, xoffset, yoffset, x, y, width, height);
+        return buffer_ ? buffer_->gl_handle : 0;
     }
 
-    node_ptr<Buffer> createBuffer()
+    // glBindBuffer(), tracked for the targets a virtual context switches.
+    void bind_gl_buffer(GLenum target, GLuint h)
     {
-        GLuint h;
-        glCreateBuffers(1, &h);
-        auto result = make_node_ptr<Buffer>(h);
-        return result;
+        glBindBuffer(target, h);
+        if (auto state = tracked_state()) {
+            if (target == GL_ARRAY_BUFFER) {
+                state->array_buffer = h;
+            }
+            else if (target == GL_UNIFORM_BUFFER) {
+                state->uniform_buffer = h;
+            }
+        }
     }
 
-    node_ptr<Framebuffer> createFramebuffer()
+    void bindBuffer(GLenum target, node_ptr<Buffer> buffer)
     {
-        GLuint h;
-        glCreateFramebuffers(1, &h);
-        auto result = make_node_ptr<Framebuffer>(h);
-        return result;
+        // Pooled buffers sharing an arena share the GL binding as well.
+        auto &context = teresa::native_webgl::current();
+        auto h = get_gl_handle(buffer.get());
+        switch (target) {
+        case GL_ARRAY_BUFFER: {
+            auto previous = context.array_buffer_binding();
+            context.bind_array_buffer(buffer.get());
+            if (previous == buffer.get() || get_gl_handle(previous) == h) {
+                return;
+            }
+            break;
+        }
+        case GL_ELEMENT_ARRAY_BUFFER: {
+            auto &previous = context.vertex_array_binding().element_array_buffer;
+            auto previousHandle = get_gl_handle(previous);
+            previous = buffer.get();
+            if (previousHandle == h) {
+                return;
+            }
+            break;
+        }
+        case GL_UNIFORM_BUFFER:
+            context.bind_uniform_buffer(buffer.get());
+            break;
+        default:
+            break;
+        }
+        bind_gl_buffer(target, h);
+    }
+
+    // Binds |size| bytes from |offset| of |buffer_|, or all of it if |size| is 0, to |index| of |target|.
+    void bind_buffer_range(GLenum target, GLuint index, const Buffer *buffer_, GLintptr offset, GLsizeiptr size)
+    {
+        auto state = target == GL_UNIFORM_BUFFER ? tracked_state() : nullptr;
+        if (!buffer_ || (!size && !buffer_->pool_block && !buffer_->stream)) {
+            glBindBufferBase(target, index, get_gl_handle(buffer_));
+            if (state) {
+                state->bind_uniform_buffer_range(index, get_gl_handle(buffer_), 0, 0);
+            }
+            return;
+        }
+        // Pooled blocks and streaming frames are ranges of a larger GL buffer.
+        if (!size) {
+            size = buffer_->stream ? buffer_->stream->frame_size() : buffer_->pool_block.size;
+        }
+        glBindBufferRange(target, index, buffer_->gl_handle, buffer_->base_offset() + offset, size);
+        if (state) {
+            state->bind_uniform_buffer_range(index, buffer_->gl_handle, buffer_->base_offset() + offset, size);
+        }
+    }
+
+    void move_out_of_arena(Buffer *buffer);
+
+    // As in WebGL 2, for UNIFORM_BUFFER.
+    void bindBufferBase(GLenum target, GLuint index, node_ptr<Buffer> buffer)
+    {
+        if (target == GL_UNIFORM_BUFFER) {
+            auto &context = teresa::native_webgl::current();
+            if (!context.bind_uniform_buffer_range(index, { buffer.get(), 0, 0 })) {
+                context.synthesize_error(GL_INVALID_VALUE);
+                return;
+            }
+            move_out_of_arena(buffer.get());
+        }
+        bind_buffer_range(target, index, buffer.get(), 0, 0);
+    }
+
+    // As in WebGL 2, for UNIFORM_BUFFER. |offset| must be a multiple of UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+    void bindBufferRange(GLenum target, GLuint index, node_ptr<Buffer> buffer, GLintptr offset, GLsizeiptr size)
+    {
+        if (target == GL_UNIFORM_BUFFER) {
+            auto &context = teresa::native_webgl::current();
+            if (!context.bind_uniform_buffer_range(index, { buffer.get(), offset, size })) {
+                context.synthesize_error(GL_INVALID_VALUE);
+                return;
+            }
+            move_out_of_arena(buffer.get());
+        }
+        bind_buffer_range(target, index, buffer.get(), offset, size);
+    }
+
+    void bindFramebuffer(GLenum target, node_ptr<Framebuffer> framebuffer)
+    {
+        // Framebuffer null is the drawing buffer of the canvas, which is an object of its own offscreen.
+        auto h = framebuffer.get() ? framebuffer->gl_handle : teresa::native_webgl::current().default_framebuffer;
+        glBindFramebuffer(target, h);
+        if (auto state = tracked_state()) {
+            if (target != GL_READ_FRAMEBUFFER) {
+                state->draw_framebuffer = h;
+            }
+            if (target != GL_DRAW_FRAMEBUFFER) {
+                state->read_framebuffer = h;
+            }
+        }
+    }
+
+    void bindRenderbuffer(GLenum target, node_ptr<Renderbuffer> renderbuffer)
+    {
+        teresa::native_webgl::current().bind_renderbuffer(renderbuffer.get());
+        glBindRenderbuffer(target, renderbuffer.get() ? renderbuffer->gl_handle : 0);
+        if (auto state = tracked_state()) {
+            state->renderbuffer = renderbuffer.get() ? renderbuffer->gl_handle : 0;
+        }
+    }
+
+    void bindTexture(GLenum target, node_ptr<Texture> texture)
+    {
+        teresa::native_webgl::current().bind_texture(target, texture.get());
+        glBindTexture(target, texture.get() ? texture->gl_handle : 0);
+        if (auto state = tracked_state()) {
+            state->bind_texture(target, texture.get() ? texture->gl_handle : 0);
+        }
+    }
+
+    void blendColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)
+    {
+        glBlendColor(red, green, blue, alpha);
+        if (auto state = tracked_state()) {
+            state->blend_color = { red, green, blue, alpha };
+        }
+    }
+
+    void blendEquation(GLenum mode)
+    {
+        glBlendEquation(mode);
+        if (auto state = tracked_state()) {
+            state->blend_equation_rgb = state->blend_equation_alpha = mode;
+        }
+    }
+
+    void blendEquationSeparate(GLenum modeRGB, GLenum modeAlpha)
+    {
+        glBlendEquationSeparate(modeRGB, modeAlpha);
+        if (auto state = tracked_state()) {
+            state->blend_equation_rgb = modeRGB;
+            state->blend_equation_alpha = modeAlpha;
+        }
+    }
+
+    void blendFunc(GLenum sfactor, GLenum dfactor)
+    {
+        glBlendFunc(sfactor, dfactor);
+        if (auto state = tracked_state()) {
+            state->blend_src_rgb = state->blend_src_alpha = sfactor;
+            state->blend_dst_rgb = state->blend_dst_alpha = dfactor;
+        }
+    }
+
+    void blendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha)
+    {
+        glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+        if (auto state = tracked_state()) {
+            state->blend_src_rgb = srcRGB;
+            state->blend_dst_rgb = dstRGB;
+            state->blend_src_alpha = srcAlpha;
+            state->blend_dst_alpha = dstAlpha;
+        }
+    }
+
+    // Points every binding and attribute of |buffer_| at its storage after it moved.
+    void rebind_buffer(Buffer *buffer_)
+    {
+        auto &context = teresa::native_webgl::current();
+        std::vector<std::pair<teresa::vertex_array_state*, GLuint>> vertexArrayStates;
+        vertexArrayStates.emplace_back(&context.default_vertex_array(), context.default_vertex_array_object);
+        for (auto &vertexArray : vertexArrays) {
+            if (vertexArray->context == &context && !vertexArray->deleted) {
+                vertexArrayStates.emplace_back(&vertexArray->state, vertexArray->gl_handle);
+            }
+        }
+
+        GLuint boundVertexArray = context.default_vertex_array_object;
+        bool touched = false;
+        for (auto[state, h] : vertexArrayStates) {
+            if (context.is_vertex_array_bound(state)) {
+                boundVertexArray = h;
+            }
+            auto referenced = state->element_array_buffer == buffer_ ||
+                std::any_of(state->attribs.begin(), state->attribs.end(), [buffer_](auto &attrib) { return attrib.buffer == buffer_; });
+            if (!referenced) {
+                continue;
+            }
+            glBindVertexArray(h);
+            touched = true;
+            if (state->element_array_buffer == buffer_) {
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer_->gl_handle);
+            }
+            for (GLuint index = 0; index < state->attribs.size(); ++index) {
+                auto &attrib = state->attribs[index];
+                if (attrib.buffer != buffer_) {
+                    continue;
+                }
+                glBindBuffer(GL_ARRAY_BUFFER, buffer_->gl_handle);
+                glVertexAttribPointer(index, attrib.size, attrib.type, attrib.normalized, attrib.stride,
+                    reinterpret_cast<const void*>(buffer_->base_offset() + attrib.offset));
+            }
+        }
+        if (touched) {
+            glBindVertexArray(boundVertexArray);
+        }
+        bind_gl_buffer(GL_ARRAY_BUFFER, get_gl_handle(context.array_buffer_binding()));
+
+        auto &uniformRanges = context.uniform_buffer_ranges();
+        touched = false;
+        for (GLuint index = 0; index < uniformRanges.size(); ++index) {
+            auto &range = uniformRanges[index];
+            if (range.buffer == buffer_) {
+                bind_buffer_range(GL_UNIFORM_BUFFER, index, buffer_, range.offset, range.size);
+                touched = true;
+            }
+        }
+        if (touched || context.buffer_binding(GL_UNIFORM_BUFFER) == buffer_) {
+            bind_gl_buffer(GL_UNIFORM_BUFFER, get_gl_handle(context.buffer_binding(GL_UNIFORM_BUFFER)));
+        }
+    }
+
+    GLintptr Buffer::nextFrame()
+    {
+        if (deleted) {
+            throw std::runtime_error("The streaming buffer was deleted.");
+        }
+        make_current(canvas, "The canvas of the streaming buffer was destroyed.");
+        stream->advance();
+        rebind_buffer(this);
+        return stream->frame_offset();
+    }
+
+    // Non-standard. A buffer for vertex data rewritten every frame: |contents| maps
+    // GPU-visible memory which is written in place, without bufferSubData copies.
+    // Attribute offsets are relative to the current frame.
+    node_ptr<Buffer> createStreamingBuffer(GLsizeiptr frameSize)
+    {
+        // Unmapped once neither the buffer nor the ArrayBuffer of |contents| holds it any longer,
+        // which may well be after the canvas is gone, so with the context it lives in current.
+        std::shared_ptr<teresa::streaming_buffer> stream(new teresa::streaming_buffer(frameSize),
+            [lease = teresa::native_webgl::current().context_lease](teresa::streaming_buffer *stream_) {
+                lease();
+                delete stream_;
+            });
+        auto result = make_node_ptr<Buffer>(stream->gl_handle());
+        result->target = GL_ARRAY_BUFFER;
+        result->usage = GL_STREAM_DRAW;
+        result->byte_size = stream->frame_size();
+        result->stream = std::move(stream);
+        result->canvas = teresa::webgl_canvas::current().weak_from_this();
+        account_memory(result.get(), teresa::memory_kind::buffer, result->stream->size());
+        return result;
+    }
+
+    // Places the data of a buffer of the pooled context either in an arena block or
+    // in storage of its own. Returns false if the buffer is not pooled.
+    bool pooledBufferData(Buffer *buffer, GLenum target, const void *data, std::size_t size, GLenum usage)
+    {
+        auto pool = teresa::native_webgl::current().pooled_buffers();
+        if (!pool || !buffer || buffer->stream) {
+            return false;
+        }
+        buffer->usage = usage;
+        auto reservedBytes = pool->reserved_bytes();
+        auto previousHandle = buffer->gl_handle;
+        auto previousOffset = buffer->base_offset();
+        // Uniform buffers are kept out of arenas, whose blocks ignore UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+        if (teresa::buffer_pool::is_poolable(size) && target != GL_UNIFORM_BUFFER && !buffer->uniform) {
+            if (!pool->try_resize(buffer->pool_block, size)) {
+                if (buffer->pool_block) {
+                    pool->free(buffer->pool_block);
+                }
+                else if (buffer->gl_handle) {
+                    glDeleteBuffers(1, &buffer->gl_handle);
+                }
+                buffer->pool_block = pool->allocate(size);
+                buffer->gl_handle = buffer->pool_block.gl_handle;
+            }
+            if (data) {
+                glNamedBufferSubData(buffer->gl_handle, buffer->base_offset(), size, data);
+            }
+        }
+        else {
+            if (buffer->pool_block) {
+                pool->free(buffer->pool_block);
+                buffer->gl_handle = 0;
+            }
+            if (!buffer->gl_handle) {
+                glCreateBuffers(1, &buffer->gl_handle);
+            }
+            glNamedBufferData(buffer->gl_handle, size, data, usage);
+        }
+        // Arenas are accounted as a whole, blocks within them are not.
+        account_memory(buffer, teresa::memory_kind::buffer, buffer->pool_block ? 0 : size);
+        account_memory(teresa::memory_kind::buffer, reservedBytes, pool->reserved_bytes());
+        if (buffer->gl_handle != previousHandle || buffer->base_offset() != previousOffset) {
+            rebind_buffer(buffer);
+        }
+        return true;
+    }
+
+    // Gives a pooled buffer storage of its own, with its contents, once it is bound to a uniform
+    // buffer binding; there its offset within the arena need not meet UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+    void move_out_of_arena(Buffer *buffer)
+    {
+        if (!buffer || buffer->uniform) {
+            return;
+        }
+        buffer->uniform = true;
+        if (!buffer->pool_block) {
+            return;
+        }
+        auto pool = teresa::native_webgl::current().pooled_buffers();
+        auto reservedBytes = pool->reserved_bytes();
+        GLuint h = 0;
+        glCreateBuffers(1, &h);
+        glNamedBufferData(h, buffer->pool_block.size, nullptr, buffer->usage);
+        glCopyNamedBufferSubData(buffer->gl_handle, h, buffer->pool_block.offset, 0, buffer->pool_block.size);
+        account_memory(buffer, teresa::memory_kind::buffer, buffer->pool_block.size);
+        pool->free(buffer->pool_block);
+        account_memory(teresa::memory_kind::buffer, reservedBytes, pool->reserved_bytes());
+        buffer->gl_handle = h;
+        rebind_buffer(buffer);
+    }
+
+    void buffer_data(GLenum target, const void *data, std::size_t size, GLenum usage)
+    {
+        auto buffer = teresa::native_webgl::current().buffer_binding(target);
+        if (pooledBufferData(buffer, target, data, size, usage)) {
+            return;
+        }
+        glBufferData(target, size, data, usage);
+        if (buffer && !buffer->stream) {
+            account_memory(buffer, teresa::memory_kind::buffer, size);
+        }
+    }
+
+    void bufferData(GLenum target, BufferSource data, GLenum usage)
+    {
+        buffer_data(target, get_data(data), get_byte_size(data), usage);
+    }
+
+    // Hands |data| converted by |kind| to |use| as a pointer and a byte size; null if it is empty.
+    template <typename Use>
+    void convert_buffer_source(teresa::conversion kind, const BufferSource &data, Use &&use)
+    {
+        auto count = get_byte_size(data) / teresa::source_element_size();
+        auto size = count * teresa::converted_element_size(kind);
+        if (!size) {
+            use(nullptr, 0);
+            return;
+        }
+        auto &pool = teresa::host_memory_pool::shared();
+        auto scratch = pool.allocate(size);
+        teresa::convert(kind, scratch, get_data(data), count);
+        use(static_cast<const void*>(scratch), size);
+        pool.free(scratch, size);
+    }
+
+    // Non-standard. bufferData() of |data| converted by |conversion| on the way, see teresa::conversion.
+    void bufferDataConverted(GLenum target, BufferSource data, GLenum usage, std::string conversion)
+    {
+        convert_buffer_source(teresa::parse_conversion(conversion), data, [&](const void *converted_, std::size_t size_) {
+            buffer_data(target, converted_, size_, usage);
+        });
+    }
+
+    void bufferSubData(GLenum target, GLintptr offset, BufferSource data)
+    {
+        auto &context = teresa::native_webgl::current();
+        auto buffer = context.buffer_binding(target);
+        auto baseOffset = buffer ? buffer->base_offset() : 0;
+        auto size = get_byte_size(data);
+        if (buffer && (buffer->pool_block || buffer->stream)) {
+            // A slice of a larger GL buffer, which GL would let the write run past into its neighbours.
+            auto sliceSize = buffer->stream ? buffer->stream->frame_size() : buffer->pool_block.size;
+            if (offset < 0 || static_cast<std::size_t>(offset) + size > sliceSize) {
+                context.synthesize_error(GL_INVALID_VALUE);
+                return;
+            }
+        }
+        if (auto staging = context.staging(); staging && buffer) {
+            // A GPU-side copy out of the ring instead of a driver-side copy of JS memory.
+            if (auto allocation = staging->allocate(size, 4)) {
+                std::memcpy(allocation.data, get_data(data), size);
+                glCopyNamedBufferSubData(staging->gl_handle(), buffer->gl_handle, allocation.offset, baseOffset + offset, size);
+                return;
+            }
+        }
+        glBufferSubData(target, baseOffset + offset, size, get_data(data));
+    }
+
+    GLenum checkFramebufferStatus(GLenum target)
+    {
+        return glCheckFramebufferStatus(target);
+    }
+
+    void clear(GLbitfield mask)
+    {
+        glClear(mask);
+    }
+
+    void clearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)
+    {
+        glClearColor(red, green, blue, alpha);
+        if (auto state = tracked_state()) {
+            state->clear_color = { red, green, blue, alpha };
+        }
+    }
+
+    void clearDepth(GLclampf depth)
+    {
+        glClearDepth(depth);
+        if (auto state = tracked_state()) {
+            state->clear_depth = std::clamp(depth, 0.0f, 1.0f);
+        }
+    }
+
+    void clearStencil(GLint s)
+    {
+        glClearStencil(s);
+        if (auto state = tracked_state()) {
+            state->clear_stencil = s;
+        }
+    }
+
+    void colorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+    {
+        glColorMask(red, green, blue, alpha);
+        if (auto state = tracked_state()) {
+            state->color_writemask = { red, green, blue, alpha };
+        }
+    }
+
+    void compileShader(node_ptr<Shader> shader)
+    {
+        static const auto empty = std::make_shared<const std::string>();
+        auto &cache = teresa::native_webgl::current().shaders();
+        // Acquired before the previous one is released, so that compiling the same source again is a hit.
+        auto previous = shader->compiled;
+        shader->compiled = cache.acquire(shader->type, shader->translated_source ? shader->translated_source : empty);
+        shader->gl_handle = shader->compiled->gl_handle;
+        if (previous) {
+            cache.release(previous);
+        }
+    }
+
+    void compressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, data_view data)
+    {
+        glCompressedTexImage2D(target, level, internalformat, width, height, border, data.size, data.data);
+        account_texture_image(target, level, width, height, data.size);
+    }
+
+    void compressedTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, data_view data)
+    {
+        glCompressedTexSubImage2D(target, level, xoffset, yoffset, width, height, format, data.size, data.data);
+    }
+
+    void copyTexImage2D(GLenum target, GLint level, GLenum internalformat, GLint x, GLint y, GLsizei width, GLsizei height, GLint border)
+    {
+        glCopyTexImage2D(target, level, internalformat, x, y, width, height, border);
+        account_texture_image(target, level, width, height,
+            static_cast<std::size_t>(width) * height * teresa::texel_size(internalformat));
+    }
+
+    void copyTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        glCopyTexSubImage2D(target, level, xoffset, yoffset, x, y, width, height);
+    }
+
+    node_ptr<Buffer> createBuffer()
+    {
+        // Storage of pooled buffers is picked once their size is known.
+        GLuint h = 0;
+        if (!teresa::native_webgl::current().pooled_buffers()) {
+            glCreateBuffers(1, &h);
+        }
+        auto result = make_node_ptr<Buffer>(h);
+        return result;
+    }
+
+    node_ptr<Framebuffer> createFramebuffer()
+    {
+        GLuint h;
+        glCreateFramebuffers(1, &h);
+        auto result = make_node_ptr<Framebuffer>(h);
+        return result;
     }
 
     node_ptr<Program> createProgram()
@@ -344,10 +1293,7 @@ namespace webgl
 
     node_ptr<Shader> createShader(GLenum type)
     {
-        GLuint h = glCreateShader(type);
-        auto result = make_node_ptr<Shader>(h);
-        shaders.push_back(result);
-        return result;
+        return make_node_ptr<Shader>(type);
     }
 
     node_ptr<Texture> createTexture()
@@ -360,66 +1306,160 @@ namespace webgl
 
     void cullFace(GLenum mode)
     {
-        return glCullFace(mode);
+        glCullFace(mode);
+        if (auto state = tracked_state()) {
+            state->cull_face_mode = mode;
+        }
     }
 
     void deleteBuffer(node_ptr<Buffer> buffer)
     {
-        glDeleteBuffers(1, &buffer->gl_handle);
+        auto &context = teresa::native_webgl::current();
+        account_memory(buffer.get(), teresa::memory_kind::buffer, 0);
+        buffer->deleted = true;
+        if (buffer->stream) {
+            // The mapping may outlive the buffer, so the binding is dropped by hand.
+            if (context.array_buffer_binding() == buffer.get()) {
+                bind_gl_buffer(GL_ARRAY_BUFFER, 0);
+            }
+            context.on_buffer_deleted(buffer.get());
+            buffer->stream.reset();
+            buffer->gl_handle = 0;
+            return;
+        }
+        if (!buffer->pool_block) {
+            context.on_buffer_deleted(buffer.get());
+            if (auto state = context.tracked_state) {
+                state->on_buffer_deleted(buffer->gl_handle);
+            }
+            glDeleteBuffers(1, &buffer->gl_handle);
+            return;
+        }
+        // The arena lives on, so the bindings are dropped by hand.
+        if (context.array_buffer_binding() == buffer.get()) {
+            bind_gl_buffer(GL_ARRAY_BUFFER, 0);
+        }
+        if (context.vertex_array_binding().element_array_buffer == buffer.get()) {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+        context.on_buffer_deleted(buffer.get());
+        context.pooled_buffers()->free(buffer->pool_block);
+        buffer->gl_handle = 0;
     }
 
     void deleteFramebuffer(node_ptr<Framebuffer> framebuffer)
     {
+        framebuffer->deleted = true;
         glDeleteFramebuffers(1, &framebuffer->gl_handle);
+        if (auto state = tracked_state()) {
+            // GL falls back to framebuffer 0, which is no framebuffer at all for the canvas.
+            auto drawingBuffer = static_cast<GLint>(teresa::native_webgl::current().default_framebuffer);
+            if (state->draw_framebuffer == static_cast<GLint>(framebuffer->gl_handle)) {
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawingBuffer);
+                state->draw_framebuffer = drawingBuffer;
+            }
+            if (state->read_framebuffer == static_cast<GLint>(framebuffer->gl_handle)) {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, drawingBuffer);
+                state->read_framebuffer = drawingBuffer;
+            }
+        }
     }
 
     void deleteProgram(node_ptr<Program> program)
     {
+        program->deleted = true;
+        program->attachments.clear();
         glDeleteProgram(program->gl_handle);
     }
 
     void deleteRenderbuffer(node_ptr<Renderbuffer> renderbuffer)
     {
+        teresa::native_webgl::current().on_renderbuffer_deleted(renderbuffer.get());
+        account_memory(renderbuffer.get(), teresa::memory_kind::renderbuffer, 0);
+        renderbuffer->deleted = true;
         glDeleteRenderbuffers(1, &renderbuffer->gl_handle);
+        if (auto state = tracked_state()) {
+            state->on_renderbuffer_deleted(renderbuffer->gl_handle);
+        }
     }
 
     void deleteShader(node_ptr<Shader> shader)
     {
-        glDeleteShader(shader->gl_handle);
+        shader->deleted = true;
+        if (shader->compiled) {
+            teresa::native_webgl::current().shaders().release(shader->compiled);
+            shader->compiled = nullptr;
+            shader->gl_handle = 0;
+        }
     }
 
     void deleteTexture(node_ptr<Texture> texture)
     {
+        if (texture->transient && !texture->deleted) {
+            teresa::native_webgl::current().transient_textures().forget(texture.get(), *texture->transient);
+        }
+        teresa::native_webgl::current().on_texture_deleted(texture.get());
+        account_memory(texture.get(), teresa::memory_kind::texture, 0);
+        texture->deleted = true;
         glDeleteTextures(1, &texture->gl_handle);
+        if (auto state = tracked_state()) {
+            state->on_texture_deleted(texture->gl_handle);
+        }
     }
 
     void depthFunc(GLenum func)
     {
         glDepthFunc(func);
+        if (auto state = tracked_state()) {
+            state->depth_func = func;
+        }
     }
 
     void depthMask(GLboolean flag)
     {
         glDepthMask(flag);
+        if (auto state = tracked_state()) {
+            state->depth_writemask = flag;
+        }
     }
 
     void depthRange(GLclampf zNear, GLclampf zFar)
     {
         glDepthRange(zNear, zFar);
+        if (auto state = tracked_state()) {
+            state->depth_range = { std::clamp(zNear, 0.0f, 1.0f), std::clamp(zFar, 0.0f, 1.0f) };
+        }
     }
 
     void detachShader(node_ptr<Program> program, node_ptr<Shader> shader)
     {
-        glDetachShader(program->gl_handle, shader->gl_handle);
+        auto &attachments = program->attachments;
+        auto attached = std::find_if(attachments.begin(), attachments.end(),
+            [&](auto &attachment_) { return attachment_.shader.get() == shader.get(); });
+        if (attached == attachments.end()) {
+            return;
+        }
+        if (attached->gl_handle) {
+            glDetachShader(program->gl_handle, attached->gl_handle);
+        }
+        attachments.erase(attached);
     }
 
     void disable(GLenum cap)
     {
         glDisable(cap);
+        if (auto state = tracked_state()) {
+            state->set_capability(cap, false);
+        }
     }
 
     void disableVertexAttribArray(GLuint index)
     {
+        auto &attrib = teresa::native_webgl::current().vertex_array_binding().attrib(index);
+        if (!attrib.enabled) {
+            return;
+        }
+        attrib.enabled = false;
         glDisableVertexAttribArray(index);
     }
 
@@ -430,16 +1470,26 @@ namespace webgl
 
     void drawElements(GLenum mode, GLsizei count, GLenum type, GLintptr offset)
     {
-        glDrawElements(mode, count, type, reinterpret_cast<const void*>(offset));
+        auto buffer = teresa::native_webgl::current().vertex_array_binding().element_array_buffer;
+        auto baseOffset = buffer ? buffer->base_offset() : 0;
+        glDrawElements(mode, count, type, reinterpret_cast<const void*>(baseOffset + offset));
     }
 
     void enable(GLenum cap)
     {
         glEnable(cap);
+        if (auto state = tracked_state()) {
+            state->set_capability(cap, true);
+        }
     }
 
     void enableVertexAttribArray(GLuint index)
     {
+        auto &attrib = teresa::native_webgl::current().vertex_array_binding().attrib(index);
+        if (attrib.enabled) {
+            return;
+        }
+        attrib.enabled = true;
         glEnableVertexAttribArray(index);
     }
 
@@ -455,22 +1505,45 @@ namespace webgl
 
     void framebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, node_ptr<Renderbuffer> renderbuffer)
     {
-        glFramebufferRenderbuffer(target, attachment, renderbuffertarget, renderbuffer->gl_handle);
+        // Null detaches whatever is attached.
+        glFramebufferRenderbuffer(target, attachment, renderbuffertarget, renderbuffer.get() ? renderbuffer->gl_handle : 0);
     }
 
     void framebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, node_ptr<Texture> texture, GLint level)
     {
-        glFramebufferTexture2D(target, attachment, textarget, texture->gl_handle, level);
+        glFramebufferTexture2D(target, attachment, textarget, texture.get() ? texture->gl_handle : 0, level);
     }
 
     void frontFace(GLenum mode)
     {
         glFrontFace(mode);
+        if (auto state = tracked_state()) {
+            state->front_face = mode;
+        }
     }
 
     void generateMipmap(GLenum target)
     {
         glGenerateMipmap(target);
+        auto texture = teresa::native_webgl::current().texture_binding(target);
+        if (!texture) {
+            return;
+        }
+        for (std::size_t face = 0; face < texture->level_sizes.size(); ++face) {
+            auto &levelSizes = texture->level_sizes[face];
+            auto[width, height] = texture->base_extents[face];
+            if (levelSizes.empty() || !width || !height) {
+                continue;
+            }
+            auto texelSize = levelSizes[0] / (static_cast<std::size_t>(width) * height);
+            levelSizes.resize(1);
+            while (width > 1 || height > 1) {
+                width = std::max(width / 2, 1);
+                height = std::max(height / 2, 1);
+                levelSizes.push_back(static_cast<std::size_t>(width) * height * texelSize);
+            }
+        }
+        account_texture_memory(texture);
     }
 
     node_ptr<ActiveInfo> getActiveAttrib(node_ptr<Program> program, GLuint index)
@@ -499,18 +1572,9 @@ namespace webgl
 
     std::vector<node_ptr<Shader>> getAttachedShaders(node_ptr<Program> program)
     {
-        GLsizei len = 0;
-        glGetProgramiv(program->gl_handle, GL_ATTACHED_SHADERS, &len);
-        std::vector<GLuint> buffer(len);
-
-        glGetAttachedShaders(program->gl_handle, buffer.size(), &len, buffer.data());
         std::vector<node_ptr<Shader>> result;
-        for (auto h : buffer) {
-            auto r = std::find_if(shaders.begin(), shaders.end(),
-                [h](auto &shader) { return shader->gl_handle == h; });
-            if (r != shaders.end()) {
-                result.push_back(*r);
-            }
+        for (auto &attachment : program->attachments) {
+            result.push_back(attachment.shader);
         }
         return result;
     }
@@ -522,6 +1586,17 @@ namespace webgl
 
     GLint getBufferParameter(GLenum target, GLenum pname)
     {
+        auto buffer = teresa::native_webgl::current().buffer_binding(target);
+        if (buffer && buffer->pool_block) {
+            switch (pname) {
+            case GL_BUFFER_SIZE:
+                return static_cast<GLint>(buffer->pool_block.size);
+            case GL_BUFFER_USAGE:
+                return static_cast<GLint>(buffer->usage);
+            default:
+                break;
+            }
+        }
         GLint result;
         glGetBufferParameteriv(target, pname, &result);
         return result;
@@ -537,7 +1612,9 @@ namespace webgl
 
     GLenum getError()
     {
-        return glGetError();
+        // Errors raised on the way to GL come first, as they would have been raised first.
+        auto error = teresa::native_webgl::current().take_synthesized_error();
+        return error != GL_NO_ERROR ? error : glGetError();
     }
 
     using GetFramebufferAttachmentParameterResult = std::variant<
@@ -580,8 +1657,20 @@ namespace webgl
 
     GLint getShaderParameter(node_ptr<Shader> shader, GLenum pname)
     {
-        GLint result;
-        glGetShaderiv(shader->gl_handle, pname, &result);
+        switch (pname) {
+        case GL_SHADER_TYPE:
+            return shader->type;
+        case GL_DELETE_STATUS:
+            return shader->deleted;
+        case GL_COMPILE_STATUS:
+            return shader->compiled && teresa::native_webgl::current().shaders().compile_status(shader->compiled);
+        default:
+            break;
+        }
+        GLint result = 0;
+        if (shader->gl_handle) {
+            glGetShaderiv(shader->gl_handle, pname, &result);
+        }
         return result;
     }
 
@@ -597,6 +1686,9 @@ namespace webgl
 
     std::string getShaderInfoLog(node_ptr<Shader> shader)
     {
+        if (!shader->gl_handle) {
+            return std::string();
+        }
         GLint len = 0;
         glGetShaderiv(shader->gl_handle, GL_INFO_LOG_LENGTH, &len);
         std::vector<char> buffer(len);
@@ -607,33 +1699,94 @@ namespace webgl
 
     std::string getShaderSource(node_ptr<Shader> shader)
     {
-        GLint len = 0;
-        glGetShaderiv(shader->gl_handle, GL_SHADER_SOURCE_LENGTH, &len);
-        std::vector<char> buffer(len);
-
-        glGetShaderSource(shader->gl_handle, buffer.size(), &len, buffer.data());
-        return std::string(buffer.begin(), buffer.end());
+        return shader->source;
     }
 
-    GLint getTexParameter(GLenum target, GLenum pname)
+    // The source as compiled, like WEBGL_debug_shaders.getTranslatedShaderSource().
+    std::string getTranslatedShaderSource(node_ptr<Shader> shader)
     {
-        GLint result;
-        glGetTexParameteriv(target, pname, &result);
-        return result;
+        return shader->translated_source ? *shader->translated_source : std::string();
     }
 
-    GLint getUniform(node_ptr<Program> program, node_ptr<UniformLocation> location)
+    struct ShaderTranslationStats
+        :public node_compatible
     {
-        GLint result;
-        glGetUniformiv(program->gl_handle, location->gl_location, &result);
-        return result;
-    }
+        teresa::glsl_cache_statistics statistics;
 
-    node_ptr<UniformLocation> getUniformLocation(node_ptr<Program> program, std::string name)
-    {
-        auto l = glGetUniformLocation(program->gl_handle, name.c_str());
-        return make_node_ptr<UniformLocation>(l);
-    }
+        ShaderTranslationStats(const teresa::glsl_cache_statistics &statistics_)
+            :statistics(statistics_)
+        {
+
+        }
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            node_compatible::to_node(env_, object_);
+            set_node_property(env_, object_, u8"hits", static_cast<double>(statistics.hits));
+            set_node_property(env_, object_, u8"misses", static_cast<double>(statistics.misses));
+            set_node_property(env_, object_, u8"evictions", static_cast<double>(statistics.evictions));
+            set_node_property(env_, object_, u8"entries", static_cast<double>(statistics.entries));
+        }
+    };
+
+    struct ShaderCacheStats
+        :public node_compatible
+    {
+        teresa::shader_cache::statistics statistics;
+
+        ShaderCacheStats(const teresa::shader_cache::statistics &statistics_)
+            :statistics(statistics_)
+        {
+
+        }
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            node_compatible::to_node(env_, object_);
+            set_node_property(env_, object_, u8"hits", static_cast<double>(statistics.hits));
+            set_node_property(env_, object_, u8"misses", static_cast<double>(statistics.misses));
+            set_node_property(env_, object_, u8"shaders", static_cast<double>(statistics.shaders));
+            set_node_property(env_, object_, u8"references", static_cast<double>(statistics.references));
+        }
+    };
+
+    // Non-standard. How often compileShader() found the GL shader of the context already compiled.
+    node_ptr<ShaderCacheStats> getShaderCacheStats()
+    {
+        return make_node_ptr<ShaderCacheStats>(teresa::native_webgl::current().shaders().stats());
+    }
+
+    // Non-standard. Counters of the translation cache shared by every canvas of the process.
+    node_ptr<ShaderTranslationStats> getShaderTranslationStats()
+    {
+        return make_node_ptr<ShaderTranslationStats>(teresa::glsl_cache_stats());
+    }
+
+    GLint getTexParameter(GLenum target, GLenum pname)
+    {
+        GLint result;
+        glGetTexParameteriv(target, pname, &result);
+        return result;
+    }
+
+    GLint getUniform(node_ptr<Program> program, node_ptr<UniformLocation> location)
+    {
+        GLint result;
+        glGetUniformiv(program->gl_handle, location->gl_location, &result);
+        return result;
+    }
+
+    // As in WebGL 2; INVALID_INDEX if the program has no active block of |uniformBlockName|.
+    GLuint getUniformBlockIndex(node_ptr<Program> program, std::string uniformBlockName)
+    {
+        return glGetUniformBlockIndex(program->gl_handle, uniformBlockName.c_str());
+    }
+
+    node_ptr<UniformLocation> getUniformLocation(node_ptr<Program> program, std::string name)
+    {
+        auto l = glGetUniformLocation(program->gl_handle, name.c_str());
+        return make_node_ptr<UniformLocation>(l, program.get());
+    }
 
     GLint getVertexAttrib(GLuint index, GLenum pname)
     {
@@ -642,300 +1795,2672 @@ namespace webgl
         return result;
     }
 
-    GLintptr getVertexAttribOffset(GLuint index, GLenum pname)
-    {
-        throw std::runtime_error("No impl");
-    }
+    GLintptr getVertexAttribOffset(GLuint index, GLenum pname)
+    {
+        if (pname != GL_VERTEX_ATTRIB_ARRAY_POINTER) {
+            return 0;
+        }
+        return teresa::native_webgl::current().vertex_array_binding().attrib(index).offset;
+    }
+
+    void hint(GLenum target, GLenum mode)
+    {
+        glHint(target, mode);
+        if (auto state = tracked_state(); state && target == GL_GENERATE_MIPMAP_HINT) {
+            state->generate_mipmap_hint = mode;
+        }
+    }
+
+    GLboolean isBuffer(node_ptr<Buffer> buffer)
+    {
+        if (buffer->pool_block || buffer->stream) {
+            return !buffer->deleted;
+        }
+        return glIsBuffer(buffer->gl_handle);
+    }
+
+    GLboolean isEnabled(GLenum cap)
+    {
+        return glIsEnabled(cap);
+    }
+
+    GLboolean isFramebuffer(node_ptr<Framebuffer> framebuffer)
+    {
+        return glIsFramebuffer(framebuffer->gl_handle);
+    }
+
+    GLboolean isProgram(node_ptr<Program> program)
+    {
+        return glIsProgram(program->gl_handle);
+    }
+
+    GLboolean isRenderbuffer(node_ptr<Renderbuffer> renderbuffer)
+    {
+        return glIsRenderbuffer(renderbuffer->gl_handle);
+    }
+
+    GLboolean isShader(node_ptr<Shader> shader)
+    {
+        return shader.get() && !shader->deleted;
+    }
+
+    GLboolean isTexture(node_ptr<Texture> texture)
+    {
+        return glIsTexture(texture->gl_handle);
+    }
+
+    void lineWidth(GLfloat width)
+    {
+        glLineWidth(width);
+        if (auto state = tracked_state(); state && width > 0) {
+            state->line_width = width;
+        }
+    }
+
+    void linkProgram(node_ptr<Program> program)
+    {
+        // Shaders compiled again since they were attached now name other GL shaders.
+        for (auto &attachment : program->attachments) {
+            if (attachment.gl_handle == attachment.shader->gl_handle) {
+                continue;
+            }
+            if (attachment.gl_handle) {
+                glDetachShader(program->gl_handle, attachment.gl_handle);
+            }
+            attachment.gl_handle = attachment.shader->gl_handle;
+            if (attachment.gl_handle) {
+                glAttachShader(program->gl_handle, attachment.gl_handle);
+            }
+        }
+        glLinkProgram(program->gl_handle);
+    }
+
+    // Records the outcome of the last link for the validating entry points.
+    void read_link_result(Program *program)
+    {
+        GLint linkStatus = GL_FALSE;
+        glGetProgramiv(program->gl_handle, GL_LINK_STATUS, &linkStatus);
+        program->linked = linkStatus == GL_TRUE;
+        program->attrib_locations.clear();
+        if (!program->linked) {
+            return;
+        }
+        GLint attribCount = 0, maxLength = 0;
+        glGetProgramiv(program->gl_handle, GL_ACTIVE_ATTRIBUTES, &attribCount);
+        glGetProgramiv(program->gl_handle, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        std::vector<char> name(maxLength + 1);
+        for (GLint i = 0; i < attribCount; ++i) {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveAttrib(program->gl_handle, i, static_cast<GLsizei>(name.size()), nullptr, &size, &type, name.data());
+            program->attrib_locations.push_back(glGetAttribLocation(program->gl_handle, name.data()));
+        }
+    }
+
+    struct PrecompiledVariants
+        :public node_compatible
+    {
+        // Programs keyed by their defines, joined by commas.
+        std::vector<std::pair<std::string, node_ptr<Program>>> programs;
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            node_compatible::to_node(env_, object_);
+            for (auto &[key, program] : programs) {
+                set_node_property(env_, object_, key.c_str(), program);
+            }
+        }
+    };
+
+    // |source| with a #define for each of |defines|, given as NAME or NAME=VALUE, after its #version if it has one.
+    std::string with_defines(const std::string &source, const std::vector<std::string> &defines)
+    {
+        std::string block;
+        for (auto &define : defines) {
+            auto equals = define.find('=');
+            block += "#define " + (equals == std::string::npos ? define : define.substr(0, equals) + " " + define.substr(equals + 1)) + "\n";
+        }
+        std::size_t position = 0;
+        auto version = source.find("#version");
+        auto lineStart = version == std::string::npos ? 0 : source.find_last_of('\n', version) + 1;
+        if (version != std::string::npos && source.find_first_not_of(" \t", lineStart) == version) {
+            auto lineEnd = source.find('\n', version);
+            position = lineEnd == std::string::npos ? source.size() : lineEnd + 1;
+        }
+        auto result = source;
+        if (position == source.size() && (source.empty() || source.back() != '\n')) {
+            result += '\n';
+            position = result.size();
+        }
+        return result.insert(position, block);
+    }
+
+    // Non-standard. Compiles and links |vertexSource| and |fragmentSource| for every combination of
+    // one define out of each of |defineSets|, an empty string defining nothing, on the threads of the
+    // context's shader compiler. Resolves to the linked programs keyed by their defines, joined by
+    // commas. The shaders stay in the shader cache, so compiling a variant later is a hit.
+    node_async<node_ptr<PrecompiledVariants>> precompileVariants(std::string vertexSource, std::string fragmentSource,
+        std::vector<std::vector<std::string>> defineSets)
+    {
+        constexpr std::size_t maxVariants = 4096;
+
+        auto context = &teresa::native_webgl::current();
+        std::vector<std::vector<std::string>> variants(1);
+        for (auto &set : defineSets) {
+            if (set.empty()) {
+                continue;
+            }
+            if (variants.size() * set.size() > maxVariants) {
+                throw std::runtime_error("Too many shader variants.");
+            }
+            std::vector<std::vector<std::string>> expanded;
+            for (auto &variant : variants) {
+                for (auto &define : set) {
+                    expanded.push_back(variant);
+                    if (!define.empty()) {
+                        expanded.back().push_back(define);
+                    }
+                }
+            }
+            variants = std::move(expanded);
+        }
+
+        struct shader_job
+        {
+            GLenum stage;
+            std::string original;
+            std::shared_ptr<const std::string> source;
+            teresa::shader_cache::entry *cached;
+            GLuint gl_handle;
+        };
+        struct program_job
+        {
+            std::string key;
+            std::size_t shaders[2];
+            GLuint gl_handle = 0;
+        };
+        struct batch
+        {
+            std::vector<shader_job> shaders;
+            std::vector<program_job> programs;
+        };
+        auto work = std::make_shared<batch>();
+        auto glslVersion = context->glsl_version();
+        // Shaders equal across variants or already compiled for the context are compiled once.
+        std::unordered_map<const std::string*, std::size_t> jobIndices;
+        auto add_shader = [&](GLenum stage, std::string source) {
+            auto translated = teresa::translate_glsl_cached(source, stage, glslVersion);
+            auto found = jobIndices.find(translated.get());
+            if (found != jobIndices.end()) {
+                return found->second;
+            }
+            auto cached = context->shaders().find(stage, translated);
+            work->shaders.push_back({ stage, std::move(source), translated, cached, cached ? cached->gl_handle : 0 });
+            jobIndices.emplace(translated.get(), work->shaders.size() - 1);
+            return work->shaders.size() - 1;
+        };
+        for (auto &defines : variants) {
+            program_job job;
+            for (auto &define : defines) {
+                job.key += (job.key.empty() ? "" : ",") + define;
+            }
+            job.shaders[0] = add_shader(GL_VERTEX_SHADER, with_defines(vertexSource, defines));
+            job.shaders[1] = add_shader(GL_FRAGMENT_SHADER, with_defines(fragmentSource, defines));
+            work->programs.push_back(std::move(job));
+        }
+
+        // The compiler outlives the canvas if need be, until the batch is done.
+        auto compiler = context->compiler();
+        node_async<node_ptr<PrecompiledVariants>> result;
+        result.execute = [work, compiler]() {
+            compiler->run(work->shaders.size(), [&](std::size_t i) {
+                auto &job = work->shaders[i];
+                if (job.cached) {
+                    return;
+                }
+                job.gl_handle = glCreateShader(job.stage);
+                const char *parts[] = { job.source->c_str() };
+                GLint partLengths[] = { static_cast<GLint>(job.source->size()) };
+                glShaderSource(job.gl_handle, 1, parts, partLengths);
+                glCompileShader(job.gl_handle);
+            });
+            compiler->run(work->programs.size(), [&](std::size_t i) {
+                auto &job = work->programs[i];
+                job.gl_handle = glCreateProgram();
+                glAttachShader(job.gl_handle, work->shaders[job.shaders[0]].gl_handle);
+                glAttachShader(job.gl_handle, work->shaders[job.shaders[1]].gl_handle);
+                glLinkProgram(job.gl_handle);
+            });
+        };
+        result.complete = [canvas = teresa::webgl_canvas::current().weak_from_this(), context, work]() {
+            auto owner = canvas.lock();
+            if (!owner) {
+                throw std::runtime_error("The canvas of the variants was destroyed.");
+            }
+            owner->make_current();
+            // Every variant attaches WebGL shaders of its own, each holding a reference of the cache.
+            std::vector<std::size_t> uses(work->shaders.size());
+            for (auto &job : work->programs) {
+                ++uses[job.shaders[0]];
+                ++uses[job.shaders[1]];
+            }
+            auto &cache = context->shaders();
+            for (std::size_t i = 0; i < work->shaders.size(); ++i) {
+                auto &job = work->shaders[i];
+                auto entry = job.cached ? job.cached : cache.adopt(job.stage, job.source, job.gl_handle);
+                for (std::size_t use = 1; use < uses[i]; ++use) {
+                    cache.find(job.stage, job.source);
+                }
+                job.cached = entry;
+            }
+
+            auto variants = make_node_ptr<PrecompiledVariants>();
+            for (auto &job : work->programs) {
+                auto program = make_node_ptr<Program>(job.gl_handle);
+                for (auto index : job.shaders) {
+                    auto &shaderJob = work->shaders[index];
+                    auto shader = make_node_ptr<Shader>(shaderJob.stage);
+                    shader->source = shaderJob.original;
+                    shader->translated_source = shaderJob.source;
+                    shader->compiled = shaderJob.cached;
+                    shader->gl_handle = shaderJob.gl_handle;
+                    program->attachments.push_back({ shader, shader->gl_handle });
+                }
+                read_link_result(program.get());
+                variants->programs.emplace_back(job.key, program);
+            }
+            return variants;
+        };
+        return result;
+    }
+
+    void pixelStorei(GLenum pname, GLint param)
+    {
+        auto &context = teresa::native_webgl::current();
+        // The WebGL-only parameters never reach GL.
+        switch (pname) {
+        case GL_UNPACK_FLIP_Y_WEBGL:
+            context.unpack_flip_y = param != 0;
+            return;
+        case GL_UNPACK_PREMULTIPLY_ALPHA_WEBGL:
+            context.unpack_premultiply_alpha = param != 0;
+            return;
+        case GL_UNPACK_COLORSPACE_CONVERSION_WEBGL:
+            context.unpack_colorspace_conversion = param;
+            return;
+        default:
+            break;
+        }
+        if (param == 1 || param == 2 || param == 4 || param == 8) {
+            if (pname == GL_UNPACK_ALIGNMENT) {
+                context.unpack_alignment = param;
+                if (auto state = context.tracked_state) {
+                    state->unpack_alignment = param;
+                }
+            }
+            else if (pname == GL_PACK_ALIGNMENT) {
+                context.pack_alignment = param;
+                if (auto state = context.tracked_state) {
+                    state->pack_alignment = param;
+                }
+            }
+        }
+        glPixelStorei(pname, param);
+    }
+
+    void polygonOffset(GLfloat factor, GLfloat units)
+    {
+        glPolygonOffset(factor, units);
+        if (auto state = tracked_state()) {
+            state->polygon_offset_factor = factor;
+            state->polygon_offset_units = units;
+        }
+    }
+
+    void readPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, data_view pixels)
+    {
+        glReadPixels(x, y, width, height, format, type, pixels.data);
+    }
+
+    // Non-standard. readPixels() into a new ArrayBuffer over recycled native memory,
+    // which goes back to the pool once the ArrayBuffer is collected.
+    external_array_buffer readPixelsToBuffer(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type)
+    {
+        auto packAlignment = teresa::native_webgl::current().pack_alignment;
+        if (width < 0 || height < 0 || !teresa::bytes_per_pixel(format, type)) {
+            throw std::runtime_error("Unsupported readPixelsToBuffer arguments.");
+        }
+        auto size = teresa::image_byte_size(width, height, format, type, packAlignment);
+        auto &pool = teresa::host_memory_pool::shared();
+        external_array_buffer result;
+        result.data = pool.allocate(size);
+        result.size = size;
+        result.release = [size](void *data_) {
+            teresa::host_memory_pool::shared().free(data_, size);
+        };
+        if (size) {
+            glReadPixels(x, y, width, height, format, type, result.data);
+        }
+        return result;
+    }
+
+    void renderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height)
+    {
+        glRenderbufferStorage(target, internalformat, width, height);
+        account_memory(teresa::native_webgl::current().renderbuffer_binding(), teresa::memory_kind::renderbuffer,
+            static_cast<std::size_t>(width) * height * teresa::texel_size(internalformat));
+    }
+
+    void sampleCoverage(GLclampf value, GLboolean invert)
+    {
+        glSampleCoverage(value, invert);
+        if (auto state = tracked_state()) {
+            state->sample_coverage_value = std::clamp(value, 0.0f, 1.0f);
+            state->sample_coverage_invert = invert;
+        }
+    }
+
+    void scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        glScissor(x, y, width, height);
+        if (auto state = tracked_state(); state && width >= 0 && height >= 0) {
+            state->scissor_box = { x, y, width, height };
+        }
+    }
+
+    void shaderSource(node_ptr<Shader> shader, std::string source)
+    {
+        auto &context = teresa::native_webgl::current();
+        shader->translated_source = teresa::translate_glsl_cached(source, shader->type, context.glsl_version());
+        shader->source = std::move(source);
+    }
+
+    // Applies |set| to the tracked stencil state of |face|, FRONT, BACK or FRONT_AND_BACK.
+    template <typename Set>
+    void track_stencil_face(GLenum face, Set set)
+    {
+        auto state = tracked_state();
+        if (!state || (face != GL_FRONT && face != GL_BACK && face != GL_FRONT_AND_BACK)) {
+            return;
+        }
+        if (face != GL_BACK) {
+            set(state->stencil_front);
+        }
+        if (face != GL_FRONT) {
+            set(state->stencil_back);
+        }
+    }
+
+    void stencilFuncSeparate(GLenum face, GLenum func, GLint ref, GLuint mask)
+    {
+        glStencilFuncSeparate(face, func, ref, mask);
+        track_stencil_face(face, [&](teresa::virtual_state::stencil_face &face_) {
+            face_.func = func;
+            face_.ref = ref;
+            face_.value_mask = static_cast<GLint>(mask);
+        });
+    }
+
+    void stencilFunc(GLenum func, GLint ref, GLuint mask)
+    {
+        stencilFuncSeparate(GL_FRONT_AND_BACK, func, ref, mask);
+    }
+
+    void stencilMaskSeparate(GLenum face, GLuint mask)
+    {
+        glStencilMaskSeparate(face, mask);
+        track_stencil_face(face, [&](teresa::virtual_state::stencil_face &face_) {
+            face_.writemask = static_cast<GLint>(mask);
+        });
+    }
+
+    void stencilMask(GLuint mask)
+    {
+        stencilMaskSeparate(GL_FRONT_AND_BACK, mask);
+    }
+
+    void stencilOpSeparate(GLenum face, GLenum fail, GLenum zfail, GLenum zpass)
+    {
+        glStencilOpSeparate(face, fail, zfail, zpass);
+        track_stencil_face(face, [&](teresa::virtual_state::stencil_face &face_) {
+            face_.fail = fail;
+            face_.pass_depth_fail = zfail;
+            face_.pass_depth_pass = zpass;
+        });
+    }
+
+    void stencilOp(GLenum fail, GLenum zfail, GLenum zpass)
+    {
+        stencilOpSeparate(GL_FRONT_AND_BACK, fail, zfail, zpass);
+    }
+
+    // Hands |pixels| to |upload| as GL should read them: transformed by the WebGL
+    // unpack flags, and through the staging ring if the context has one.
+    // |upload| receives either a client pointer or an offset into the bound pixel unpack buffer.
+    // |premultiplied| pixels are not premultiplied again.
+    template <typename Upload>
+    void unpack_and_upload(GLsizei width, GLsizei height, GLenum format, GLenum type, const data_view &pixels, Upload &&upload,
+        bool premultiplied = false)
+    {
+        auto &context = teresa::native_webgl::current();
+        teresa::unpack_options options;
+        options.alignment = context.unpack_alignment;
+        options.flip_y = context.unpack_flip_y;
+        options.premultiply_alpha = context.unpack_premultiply_alpha && !premultiplied;
+        auto staging = context.staging();
+        if (!pixels.data || (!options.transforms() && !staging)) {
+            upload(pixels.data);
+            return;
+        }
+        auto size = teresa::image_byte_size(width, height, format, type, options.alignment);
+        if (size > pixels.size || !teresa::bytes_per_pixel(format, type)) {
+            // Left to GL to reject.
+            upload(pixels.data);
+            return;
+        }
+        auto write = [&](void *destination_) {
+            if (options.transforms()) {
+                teresa::unpack_pixels(destination_, pixels.data, width, height, format, type, options);
+            }
+            else {
+                std::memcpy(destination_, pixels.data, size);
+            }
+        };
+        if (staging) {
+            // Offsets into pixel unpack buffers have to be aligned to the component size.
+            if (auto allocation = staging->allocate(size, 16)) {
+                write(allocation.data);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging->gl_handle());
+                upload(reinterpret_cast<const void*>(allocation.offset));
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                return;
+            }
+        }
+        if (!options.transforms()) {
+            upload(pixels.data);
+            return;
+        }
+        auto &pool = teresa::host_memory_pool::shared();
+        auto scratch = pool.allocate(size);
+        write(scratch);
+        upload(scratch);
+        pool.free(scratch, size);
+    }
+
+    void tex_image_2d(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border,
+        GLenum format, GLenum type, const data_view &pixels, bool premultiplied)
+    {
+        unpack_and_upload(width, height, format, type, pixels, [&](const void *data_) {
+            glTexImage2D(target, level, internalformat, width, height, border, format, type, data_);
+        }, premultiplied);
+        account_texture_image(target, level, width, height,
+            static_cast<std::size_t>(width) * height * teresa::bytes_per_pixel(format, type));
+    }
+
+    void texImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, data_view pixels)
+    {
+        tex_image_2d(target, level, internalformat, width, height, border, format, type, pixels, false);
+    }
+
+    // Non-standard. texImage2D() of float or RGBA8 |pixels| of |format| converted by |conversion|,
+    // which also picks the type; "rgb565" uploads RGB. The pixel store parameters apply as usual.
+    void texImage2DConverted(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border,
+        GLenum format, data_view pixels, std::string conversion)
+    {
+        auto kind = teresa::parse_conversion(conversion);
+        auto sourceType = teresa::source_type(kind);
+        auto packsPixels = sourceType == GL_UNSIGNED_BYTE;
+        if (width < 0 || height < 0 || !teresa::channel_count(format) || (packsPixels && format != GL_RGBA)) {
+            throw std::runtime_error("Unsupported texImage2DConverted arguments.");
+        }
+        auto &context = teresa::native_webgl::current();
+        auto alignment = context.unpack_alignment;
+        if (pixels.size < teresa::image_byte_size(width, height, format, sourceType, alignment)) {
+            throw std::runtime_error("Not enough pixels for texImage2DConverted.");
+        }
+
+        auto convertedFormat = teresa::converted_format(kind, format);
+        auto convertedType = teresa::converted_type(kind);
+        auto pitch = teresa::row_pitch(width, convertedFormat, convertedType, alignment);
+        auto size = pitch * height;
+        if (!size) {
+            texImage2D(target, level, internalformat, width, height, border, convertedFormat, convertedType, data_view{});
+            return;
+        }
+        auto &pool = teresa::host_memory_pool::shared();
+        auto scratch = pool.allocate(size);
+        auto sourcePitch = teresa::row_pitch(width, format, sourceType, alignment);
+        const void *source = pixels.data;
+        // Float sources are premultiplied before conversion, which the half float and snorm types
+        // of the converted pixels would not allow; packed pixels are premultiplied as usual.
+        auto premultiplied = context.unpack_premultiply_alpha && !packsPixels && (format == GL_RGBA || format == GL_LUMINANCE_ALPHA);
+        void *premultipliedSource = nullptr;
+        auto sourceSize = sourcePitch * height;
+        if (premultiplied) {
+            premultipliedSource = pool.allocate(sourceSize);
+            teresa::unpack_options options;
+            options.alignment = alignment;
+            options.premultiply_alpha = true;
+            teresa::unpack_pixels(premultipliedSource, pixels.data, width, height, format, sourceType, options);
+            source = premultipliedSource;
+        }
+        // Converted rows keep the unpack alignment, so texImage2D() reads them like client rows.
+        teresa::convert_rows(kind, scratch, pitch, source, sourcePitch,
+            packsPixels ? width : width * teresa::channel_count(format), height);
+        if (premultipliedSource) {
+            pool.free(premultipliedSource, sourceSize);
+        }
+        data_view converted;
+        converted.data = scratch;
+        converted.size = size;
+        tex_image_2d(target, level, internalformat, width, height, border, convertedFormat, convertedType, converted, premultiplied);
+        pool.free(scratch, size);
+    }
+
+    struct TexImageFromEncodedOptions
+    {
+        GLenum format = GL_RGBA;
+
+        // Default to the pixel store parameters in effect at the call.
+        std::optional<bool> flipY;
+
+        std::optional<bool> premultiplyAlpha;
+
+        void from_node(napi_env env_, napi_value object_)
+        {
+            read_node_property_if_present(env_, object_, format, u8"format");
+            bool value = false;
+            if (read_node_property_if_present(env_, object_, value, u8"flipY")) {
+                flipY = value;
+            }
+            if (read_node_property_if_present(env_, object_, value, u8"premultiplyAlpha")) {
+                premultiplyAlpha = value;
+            }
+        }
+    };
+
+    struct ImageInfo
+        :public node_compatible
+    {
+        GLsizei width;
+
+        GLsizei height;
+
+        ImageInfo(GLsizei width_, GLsizei height_)
+            :width(width_), height(height_)
+        {
+
+        }
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            node_compatible::to_node(env_, object_);
+            set_node_property(env_, object_, u8"width", width);
+            set_node_property(env_, object_, u8"height", height);
+        }
+    };
+
+    // Non-standard. Decodes a PNG or JPEG image on the libuv thread pool, applies the
+    // unpack flags there in place, and then uploads it into |level| of the texture
+    // bound to |target| at the time of the call. Resolves with the image size once
+    // the texture is populated.
+    node_async<node_ptr<ImageInfo>> texImageFromEncoded(GLenum target, GLint level, BufferSource buffer, TexImageFromEncodedOptions options)
+    {
+        auto context = &teresa::native_webgl::current();
+        auto texture = context->texture_binding(target);
+        if (!texture) {
+            throw std::runtime_error("No texture is bound to the target.");
+        }
+
+        // The encoded bytes are copied, as the JS buffer may change before the decode runs.
+        auto encoded = std::make_shared<std::vector<std::uint8_t>>(
+            static_cast<const std::uint8_t*>(get_data(buffer)), static_cast<const std::uint8_t*>(get_data(buffer)) + get_byte_size(buffer));
+        auto image = std::make_shared<teresa::decoded_image>();
+        auto format = options.format;
+        auto flipY = options.flipY.value_or(context->unpack_flip_y);
+        auto premultiplyAlpha = options.premultiplyAlpha.value_or(context->unpack_premultiply_alpha);
+
+        node_async<node_ptr<ImageInfo>> result;
+        result.execute = [encoded, image, format, flipY, premultiplyAlpha]() {
+            *image = teresa::decode_image(encoded->data(), encoded->size(), format);
+            encoded->clear();
+            encoded->shrink_to_fit();
+            auto rowPitch = teresa::row_pitch(image->width, format, GL_UNSIGNED_BYTE, 1);
+            if (flipY) {
+                teresa::flip_rows(image->pixels.get(), rowPitch, image->height);
+            }
+            if (premultiplyAlpha) {
+                auto count = static_cast<std::size_t>(image->width) * image->height;
+                teresa::premultiply_alpha(image->pixels.get(), image->pixels.get(), count, format, GL_UNSIGNED_BYTE);
+            }
+        };
+        result.complete = [canvas = teresa::webgl_canvas::current().weak_from_this(), context, texture, target, level, image]() {
+            auto owner = canvas.lock();
+            if (!owner) {
+                throw std::runtime_error("The canvas of the texture was destroyed.");
+            }
+            // Whichever canvas was used since, the upload goes to the one the call was made on.
+            owner->make_current();
+            if (texture->deleted) {
+                throw std::runtime_error("The texture was deleted.");
+            }
+            auto bindingTarget = target == GL_TEXTURE_2D ? GL_TEXTURE_2D : GL_TEXTURE_CUBE_MAP;
+            // The binding may have changed since the call, so the texture is bound for the upload only.
+            auto bound = context->texture_binding(bindingTarget);
+            glBindTexture(bindingTarget, texture->gl_handle);
+            context->bind_texture(bindingTarget, texture);
+            // Decoded rows are tightly packed.
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(target, level, image->format, image->width, image->height, 0, image->format, GL_UNSIGNED_BYTE, image->pixels.get());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, context->unpack_alignment);
+            account_texture_image(target, level, image->width, image->height,
+                static_cast<std::size_t>(image->width) * image->height * teresa::bytes_per_pixel(image->format, GL_UNSIGNED_BYTE));
+            glBindTexture(bindingTarget, bound ? bound->gl_handle : 0);
+            context->bind_texture(bindingTarget, bound);
+
+            auto info = make_node_ptr<ImageInfo>(image->width, image->height);
+            image->pixels.reset();
+            return info;
+        };
+        return result;
+    }
+
+    struct KTXTexture
+        :public node_compatible
+    {
+        node_ptr<Texture> texture;
+
+        // What the texture has to be bound to, depending on its faces, layers and depth.
+        GLenum target;
+
+        GLenum internalFormat;
+
+        GLsizei width;
+
+        GLsizei height;
+
+        GLsizei depth;
+
+        GLsizei levels;
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            node_compatible::to_node(env_, object_);
+            set_node_property(env_, object_, u8"texture", texture);
+            set_node_property(env_, object_, u8"target", target);
+            set_node_property(env_, object_, u8"internalFormat", internalFormat);
+            set_node_property(env_, object_, u8"width", width);
+            set_node_property(env_, object_, u8"height", height);
+            set_node_property(env_, object_, u8"depth", depth);
+            set_node_property(env_, object_, u8"levels", levels);
+        }
+    };
+
+    // Uploads every image of |ktx| into a new texture with immutable storage and describes it in |result|.
+    void upload_ktx(const teresa::ktx_texture &ktx, KTXTexture &result)
+    {
+        auto generateMipmaps = ktx.generate_mipmaps && !ktx.compressed();
+        auto levels = ktx.levels;
+        if (generateMipmaps) {
+            for (auto extent = std::max(ktx.width, ktx.height); extent > 1; extent >>= 1) {
+                ++levels;
+            }
+        }
+
+        GLuint h;
+        glCreateTextures(ktx.target, 1, &h);
+        auto texture = make_node_ptr<Texture>(h);
+        auto layered = ktx.target != GL_TEXTURE_2D && ktx.target != GL_TEXTURE_CUBE_MAP;
+        if (layered) {
+            glTextureStorage3D(h, levels, ktx.internalformat, ktx.width, ktx.height, ktx.depth);
+        }
+        else {
+            glTextureStorage2D(h, levels, ktx.internalformat, ktx.width, ktx.height);
+        }
+
+        auto &context = teresa::native_webgl::current();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, ktx.unpack_alignment);
+        auto &levelSizes = texture->level_sizes[0];
+        levelSizes.resize(levels);
+        for (auto &image : ktx.images) {
+            auto size = static_cast<GLsizei>(image.size);
+            if (ktx.target == GL_TEXTURE_2D) {
+                if (ktx.compressed()) {
+                    glCompressedTextureSubImage2D(h, image.level, 0, 0, image.width, image.height, ktx.internalformat, size, image.data);
+                }
+                else {
+                    glTextureSubImage2D(h, image.level, 0, 0, image.width, image.height, ktx.format, ktx.type, image.data);
+                }
+            }
+            else {
+                // Faces of cube maps are addressed as layers.
+                if (ktx.compressed()) {
+                    glCompressedTextureSubImage3D(h, image.level, 0, 0, image.zoffset, image.width, image.height, image.depth,
+                        ktx.internalformat, size, image.data);
+                }
+                else {
+                    glTextureSubImage3D(h, image.level, 0, 0, image.zoffset, image.width, image.height, image.depth,
+                        ktx.format, ktx.type, image.data);
+                }
+            }
+            levelSizes[image.level] += image.size;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, context.unpack_alignment);
+        if (generateMipmaps) {
+            glGenerateTextureMipmap(h);
+            for (GLsizei level = 1; level < levels; ++level) {
+                levelSizes[level] = std::max<std::size_t>(1, levelSizes[0] >> (2 * level));
+            }
+        }
+        texture->base_extents[0] = { ktx.width, ktx.height };
+        account_texture_memory(texture.get());
+
+        result.texture = texture;
+        result.target = ktx.target;
+        result.internalFormat = ktx.internalformat;
+        result.width = ktx.width;
+        result.height = ktx.height;
+        result.depth = ktx.depth;
+        result.levels = levels;
+    }
+
+    // Non-standard. Maps a KTX 1.1 or KTX 2.0 file and uploads every level, face and layer
+    // of it straight from the mapping into a new texture with immutable storage. Cube maps,
+    // arrays and 3D textures are created with the matching target. Bindings are left untouched.
+    node_ptr<KTXTexture> loadKTX(std::string path)
+    {
+        teresa::mapped_file file(path);
+        auto result = make_node_ptr<KTXTexture>();
+        upload_ktx(teresa::parse_ktx(file.data(), file.size()), *result.get());
+        return result;
+    }
+
+    struct TranscodedTexture
+        :public KTXTexture
+    {
+        // The format transcoded to, "RGBA8" when no compressed format was available.
+        std::string format;
+
+        double transcodeMilliseconds = 0;
+
+        double uploadMilliseconds = 0;
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            KTXTexture::to_node(env_, object_);
+            set_node_property(env_, object_, u8"format", format);
+            set_node_property(env_, object_, u8"transcodeMilliseconds", transcodeMilliseconds);
+            set_node_property(env_, object_, u8"uploadMilliseconds", uploadMilliseconds);
+        }
+    };
+
+    // Non-standard. Maps a .basis file or a KTX2 container of Basis Universal data and transcodes
+    // it on the libuv thread pool to the best compressed format the context supports, or to RGBA8
+    // otherwise. The texture is created and uploaded like by loadKTX() once transcoding is done.
+    node_async<node_ptr<TranscodedTexture>> loadBasis(std::string path)
+    {
+        using clock = std::chrono::steady_clock;
+        auto targets = teresa::transcode_targets::supported();
+        auto transcoded = std::make_shared<teresa::transcoded_texture>();
+        auto transcodeTime = std::make_shared<clock::duration>();
+
+        node_async<node_ptr<TranscodedTexture>> result;
+        result.execute = [path, targets, transcoded, transcodeTime]() {
+            auto start = clock::now();
+            teresa::mapped_file file(path);
+            *transcoded = teresa::transcode_basis(file.data(), file.size(), targets);
+            *transcodeTime = clock::now() - start;
+        };
+        result.complete = [canvas = teresa::webgl_canvas::current().weak_from_this(), transcoded, transcodeTime]() {
+            auto owner = canvas.lock();
+            if (!owner) {
+                throw std::runtime_error("The canvas of the texture was destroyed.");
+            }
+            owner->make_current();
+            auto start = clock::now();
+            auto texture = make_node_ptr<TranscodedTexture>();
+            upload_ktx(transcoded->texture, *texture.get());
+            using milliseconds = std::chrono::duration<double, std::milli>;
+            texture->format = transcoded->format_name;
+            texture->transcodeMilliseconds = milliseconds(*transcodeTime).count();
+            texture->uploadMilliseconds = milliseconds(clock::now() - start).count();
+            transcoded->storage.clear();
+            return texture;
+        };
+        return result;
+    }
+
+    struct AtlasOptions
+    {
+        std::size_t maxPages = 4;
+
+        // Texels repeated around every image so that filtering does not bleed into its neighbours.
+        GLsizei padding = 1;
+
+        void from_node(napi_env env_, napi_value object_)
+        {
+            read_node_property_if_present(env_, object_, maxPages, u8"maxPages");
+            read_node_property_if_present(env_, object_, padding, u8"padding");
+        }
+    };
+
+    struct AtlasRegion
+        :public node_compatible
+    {
+        GLuint id;
+
+        GLuint page;
+
+        GLint x;
+
+        GLint y;
+
+        GLsizei width;
+
+        GLsizei height;
+
+        GLfloat u0;
+
+        GLfloat v0;
+
+        GLfloat u1;
+
+        GLfloat v1;
+
+        AtlasRegion(const teresa::atlas_region &region_, GLsizei page_width_, GLsizei page_height_)
+            :id(region_.id), page(static_cast<GLuint>(region_.page)), x(region_.x), y(region_.y),
+            width(region_.width), height(region_.height),
+            u0(static_cast<GLfloat>(region_.x) / page_width_), v0(static_cast<GLfloat>(region_.y) / page_height_),
+            u1(static_cast<GLfloat>(region_.x + region_.width) / page_width_), v1(static_cast<GLfloat>(region_.y + region_.height) / page_height_)
+        {
+
+        }
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            node_compatible::to_node(env_, object_);
+            set_node_property(env_, object_, u8"id", id);
+            set_node_property(env_, object_, u8"page", page);
+            set_node_property(env_, object_, u8"x", x);
+            set_node_property(env_, object_, u8"y", y);
+            set_node_property(env_, object_, u8"width", width);
+            set_node_property(env_, object_, u8"height", height);
+            set_node_property(env_, object_, u8"u0", u0);
+            set_node_property(env_, object_, u8"v0", v0);
+            set_node_property(env_, object_, u8"u1", u1);
+            set_node_property(env_, object_, u8"v1", v1);
+        }
+    };
+
+    struct AtlasStats
+        :public node_compatible
+    {
+        teresa::texture_atlas::statistics stats;
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            node_compatible::to_node(env_, object_);
+            set_node_property(env_, object_, u8"pages", static_cast<double>(stats.pages));
+            set_node_property(env_, object_, u8"regions", static_cast<double>(stats.regions));
+            set_node_property(env_, object_, u8"occupancy", stats.occupancy);
+            set_node_property(env_, object_, u8"evictions", static_cast<double>(stats.evictions));
+            set_node_property(env_, object_, u8"uploads", static_cast<double>(stats.uploads));
+            set_node_property(env_, object_, u8"uploadedBytes", static_cast<double>(stats.uploaded_bytes));
+        }
+    };
+
+    // Non-standard. Packs images into a few pages, see teresa::texture_atlas.
+    // Additions reach the pages on flush(), which has to precede drawing with them.
+    struct Atlas
+        :public node_compatible
+    {
+    public:
+        Atlas(GLsizei width_, GLsizei height_, GLenum format_, const AtlasOptions &options_)
+            :atlas(width_, height_, format_, options_.maxPages, options_.padding), format(format_)
+        {
+
+        }
+
+        teresa::texture_atlas atlas;
+
+        GLenum format;
+
+        // Made current by the methods which reach GL.
+        std::weak_ptr<const teresa::webgl_canvas> canvas;
+
+        // WebGLTextures over the pages of |atlas|.
+        std::vector<node_ptr<Texture>> pages;
+
+        node_ptr<AtlasRegion> add(GLsizei width, GLsizei height, BufferSource pixels);
+
+        bool remove(GLuint id);
+
+        bool touch(GLuint id);
+
+        std::variant<std::nullptr_t, node_ptr<AtlasRegion>> getRegion(GLuint id);
+
+        std::vector<GLuint> takeEvicted();
+
+        void flush();
+
+        // Returns every region, as they may all have moved.
+        std::vector<node_ptr<AtlasRegion>> defragment();
+
+        node_ptr<Texture> getPage(GLuint page);
+
+        node_ptr<AtlasStats> getStats();
+
+        void destroy();
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            node_compatible::to_node(env_, object_);
+            set_node_property(env_, object_, u8"width", atlas.width());
+            set_node_property(env_, object_, u8"height", atlas.height());
+            set_node_property(env_, object_, u8"format", format);
+            set_node_property(env_, object_, u8"add", &Atlas::add);
+            set_node_property(env_, object_, u8"remove", &Atlas::remove);
+            set_node_property(env_, object_, u8"touch", &Atlas::touch);
+            set_node_property(env_, object_, u8"getRegion", &Atlas::getRegion);
+            set_node_property(env_, object_, u8"takeEvicted", &Atlas::takeEvicted);
+            set_node_property(env_, object_, u8"flush", &Atlas::flush);
+            set_node_property(env_, object_, u8"defragment", &Atlas::defragment);
+            set_node_property(env_, object_, u8"getPage", &Atlas::getPage);
+            set_node_property(env_, object_, u8"getStats", &Atlas::getStats);
+            set_node_property(env_, object_, u8"destroy", &Atlas::destroy);
+        }
+    private:
+        node_ptr<AtlasRegion> _to_region(const teresa::atlas_region &region_) const
+        {
+            return make_node_ptr<AtlasRegion>(region_, atlas.width(), atlas.height());
+        }
+
+        // Wraps the pages created since the previous call.
+        void _sync_pages()
+        {
+            for (auto i = pages.size(); i < atlas.page_count(); ++i) {
+                auto texture = make_node_ptr<Texture>(atlas.page_handle(i));
+                texture->level_sizes[0].assign(1,
+                    static_cast<std::size_t>(atlas.width()) * atlas.height() * teresa::bytes_per_pixel(format, GL_UNSIGNED_BYTE));
+                texture->base_extents[0] = { atlas.width(), atlas.height() };
+                account_texture_memory(texture.get());
+                pages.push_back(texture);
+            }
+        }
+    };
+
+    node_ptr<AtlasRegion> Atlas::add(GLsizei width, GLsizei height, BufferSource pixels)
+    {
+        make_current(canvas, "The canvas of the atlas was destroyed.");
+        auto alignment = teresa::native_webgl::current().unpack_alignment;
+        if (width <= 0 || height <= 0 || get_byte_size(pixels) < teresa::image_byte_size(width, height, format, GL_UNSIGNED_BYTE, alignment)) {
+            throw std::runtime_error("Not enough pixels for the atlas image.");
+        }
+        auto region = atlas.add(width, height, get_data(pixels), teresa::row_pitch(width, format, GL_UNSIGNED_BYTE, alignment));
+        _sync_pages();
+        return _to_region(region);
+    }
+
+    bool Atlas::remove(GLuint id)
+    {
+        return atlas.remove(id);
+    }
+
+    bool Atlas::touch(GLuint id)
+    {
+        return atlas.touch(id);
+    }
+
+    std::variant<std::nullptr_t, node_ptr<AtlasRegion>> Atlas::getRegion(GLuint id)
+    {
+        if (auto region = atlas.region(id)) {
+            return _to_region(*region);
+        }
+        return nullptr;
+    }
+
+    std::vector<GLuint> Atlas::takeEvicted()
+    {
+        return atlas.take_evicted();
+    }
+
+    void Atlas::flush()
+    {
+        make_current(canvas, "The canvas of the atlas was destroyed.");
+        atlas.flush(teresa::native_webgl::current().unpack_alignment);
+    }
+
+    std::vector<node_ptr<AtlasRegion>> Atlas::defragment()
+    {
+        make_current(canvas, "The canvas of the atlas was destroyed.");
+        atlas.defragment();
+        _sync_pages();
+        std::vector<node_ptr<AtlasRegion>> result;
+        for (auto &region : atlas.regions()) {
+            result.push_back(_to_region(region));
+        }
+        return result;
+    }
+
+    node_ptr<Texture> Atlas::getPage(GLuint page)
+    {
+        if (page >= pages.size()) {
+            throw std::runtime_error("No such atlas page.");
+        }
+        return pages[page];
+    }
+
+    node_ptr<AtlasStats> Atlas::getStats()
+    {
+        auto result = make_node_ptr<AtlasStats>();
+        result->stats = atlas.stats();
+        return result;
+    }
+
+    void Atlas::destroy()
+    {
+        make_current(canvas, "The canvas of the atlas was destroyed.");
+        auto &context = teresa::native_webgl::current();
+        for (auto &page : pages) {
+            context.on_texture_deleted(page.get());
+            account_memory(page.get(), teresa::memory_kind::texture, 0);
+            page->deleted = true;
+        }
+        pages.clear();
+        atlas.destroy();
+    }
+
+    node_ptr<Atlas> createAtlas(GLsizei width, GLsizei height, GLenum format, AtlasOptions options)
+    {
+        auto result = make_node_ptr<Atlas>(width, height, format, options);
+        result->canvas = teresa::webgl_canvas::current().weak_from_this();
+        return result;
+    }
+
+    void texParameterf(GLenum target, GLenum pname, GLfloat param)
+    {
+        glTexParameterf(target, pname, param);
+    }
+
+    void texParameteri(GLenum target, GLenum pname, GLint param)
+    {
+        glTexParameteri(target, pname, param);
+    }
+
+    void texSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, data_view pixels)
+    {
+        unpack_and_upload(width, height, format, type, pixels, [&](const void *data_) {
+            glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, data_);
+        });
+    }
+
+    void uniform1f(node_ptr<UniformLocation> location, GLfloat x)
+    {
+        glUniform1f(location->gl_location, x);
+    }
+
+    void uniform2f(node_ptr<UniformLocation> location, GLfloat x, GLfloat y)
+    {
+        glUniform2f(location->gl_location, x, y);
+    }
+
+    void uniform3f(node_ptr<UniformLocation> location, GLfloat x, GLfloat y, GLfloat z)
+    {
+        glUniform3f(location->gl_location, x, y, z);
+    }
+
+    void uniform4f(node_ptr<UniformLocation> location, GLfloat x, GLfloat y, GLfloat z, GLfloat w)
+    {
+        glUniform4f(location->gl_location, x, y, z, w);
+    }
+
+    void uniform1i(node_ptr<UniformLocation> location, GLint x)
+    {
+        glUniform1i(location->gl_location, x);
+    }
+    
+    void uniform2i(node_ptr<UniformLocation> location, GLint x, GLint y)
+    {
+        glUniform2i(location->gl_location, x, y);
+    }
+
+    void uniform3i(node_ptr<UniformLocation> location, GLint x, GLint y, GLint z)
+    {
+        glUniform3i(location->gl_location, x, y, z);
+    }
+
+    void uniform4i(node_ptr<UniformLocation> location, GLint x, GLint y, GLint z, GLint w)
+    {
+        glUniform4i(location->gl_location, x, y, z, w);
+    }
+
+    void uniform1fv(node_ptr<UniformLocation> location, Float32List v)
+    {
+        glUniform1fv(location->gl_location, 1, v.data);
+    }
+
+    void uniform2fv(node_ptr<UniformLocation> location, Float32List v)
+    {
+        glUniform2fv(location->gl_location, 1, v.data);
+    }
+
+    void uniform3fv(node_ptr<UniformLocation> location, Float32List v)
+    {
+        glUniform3fv(location->gl_location, 1, v.data);
+    }
+
+    void uniform4fv(node_ptr<UniformLocation> location, Float32List v)
+    {
+        glUniform4fv(location->gl_location, 1, v.data);
+    }
+
+    void uniform1iv(node_ptr<UniformLocation> location, Int32List v)
+    {
+        glUniform1iv(location->gl_location, 1, v.data);
+    }
+
+    void uniform2iv(node_ptr<UniformLocation> location, Int32List v)
+    {
+        glUniform2iv(location->gl_location, 1, v.data);
+    }
+
+    void uniform3iv(node_ptr<UniformLocation> location, Int32List v)
+    {
+        glUniform3iv(location->gl_location, 1, v.data);
+    }
+
+    void uniform4iv(node_ptr<UniformLocation> location, Int32List v)
+    {
+        glUniform4iv(location->gl_location, 1, v.data);
+    }
+
+    // As in WebGL 2. Blocks of every program bound to the same point read the same buffer range.
+    void uniformBlockBinding(node_ptr<Program> program, GLuint uniformBlockIndex, GLuint uniformBlockBinding)
+    {
+        glUniformBlockBinding(program->gl_handle, uniformBlockIndex, uniformBlockBinding);
+    }
+
+    struct Std140Member
+    {
+        std::string name;
+
+        GLenum type = GL_FLOAT;
+
+        // 0 for members which are not arrays.
+        std::size_t arrayLength = 0;
+
+        void from_node(napi_env env_, napi_value object_)
+        {
+            read_node_property(env_, object_, name, u8"name");
+            read_node_property(env_, object_, type, u8"type");
+            read_node_property_if_present(env_, object_, arrayLength, u8"arrayLength");
+        }
+    };
+
+    struct Std140MemberLayout
+        :public node_compatible
+    {
+        teresa::std140_member_layout layout;
+
+        Std140MemberLayout(const teresa::std140_member_layout &layout_)
+            :layout(layout_)
+        {
+
+        }
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            node_compatible::to_node(env_, object_);
+            set_node_property(env_, object_, u8"name", layout.name);
+            set_node_property(env_, object_, u8"type", layout.type);
+            set_node_property(env_, object_, u8"offset", static_cast<double>(layout.offset));
+            set_node_property(env_, object_, u8"size", static_cast<double>(layout.size));
+            set_node_property(env_, object_, u8"arrayStride", static_cast<double>(layout.array_stride));
+            set_node_property(env_, object_, u8"matrixStride", static_cast<double>(layout.matrix_stride));
+        }
+    };
+
+    struct Std140Layout
+        :public node_compatible
+    {
+        std::vector<node_ptr<Std140MemberLayout>> members;
+
+        std::size_t size = 0;
+
+        void to_node(napi_env env_, napi_value object_) const
+        {
+            node_compatible::to_node(env_, object_);
+            set_node_property(env_, object_, u8"members", members);
+            set_node_property(env_, object_, u8"size", static_cast<double>(size));
+        }
+    };
+
+    // Non-standard. Byte offsets and strides of the members of a std140 uniform block, described
+    // in declaration order like getActiveUniform() reports them, for filling its buffer from JS.
+    node_ptr<Std140Layout> layoutStd140(std::vector<Std140Member> members)
+    {
+        std::vector<teresa::std140_member> described;
+        for (auto &member : members) {
+            described.push_back({ member.name, member.type, member.arrayLength });
+        }
+        auto layout = teresa::layout_std140(described);
+        auto result = make_node_ptr<Std140Layout>();
+        for (auto &member : layout.members) {
+            result->members.push_back(make_node_ptr<Std140MemberLayout>(member));
+        }
+        result->size = layout.size;
+        return result;
+    }
+
+    void uniformMatrix2fv(node_ptr<UniformLocation> location, GLboolean transpose, Float32List v)
+    {
+        glUniformMatrix2fv(location->gl_location, 1, transpose, v.data);
+    }
+
+    void uniformMatrix3fv(node_ptr<UniformLocation> location, GLboolean transpose, Float32List v)
+    {
+        glUniformMatrix3fv(location->gl_location, 1, transpose, v.data);
+    }
+
+    void uniformMatrix4fv(node_ptr<UniformLocation> location, GLboolean transpose, Float32List v)
+    {
+        glUniformMatrix4fv(location->gl_location, 1, transpose, v.data);
+    }
+
+    void useProgram(node_ptr<Program> program)
+    {
+        auto h = program.get() ? program->gl_handle : 0;
+        glUseProgram(h);
+        if (auto state = tracked_state()) {
+            state->program = h;
+        }
+    }
+
+    void validateProgram(node_ptr<Program> program)
+    {
+        glValidateProgram(program->gl_handle);
+    }
+
+    // Sets the current value of a generic vertex attribute from |count| values, completed by (0, 0, 0, 1).
+    void vertex_attrib(GLuint index, const GLfloat *values, std::size_t count)
+    {
+        auto &context = teresa::native_webgl::current();
+        if (index >= static_cast<GLuint>(context.max_vertex_attribs())) {
+            context.synthesize_error(GL_INVALID_VALUE);
+            return;
+        }
+        std::array<GLfloat, 4> value = { 0, 0, 0, 1 };
+        std::copy_n(values, count, value.begin());
+        glVertexAttrib4fv(index, value.data());
+        if (auto state = context.tracked_state) {
+            state->set_vertex_attrib(index, value);
+        }
+    }
+
+    void vertex_attrib(GLuint index, const Float32List &values, std::size_t count)
+    {
+        if (values.size < count) {
+            teresa::native_webgl::current().synthesize_error(GL_INVALID_VALUE);
+            return;
+        }
+        vertex_attrib(index, values.data, count);
+    }
+
+    void vertexAttrib1f(GLuint index, GLfloat x)
+    {
+        const GLfloat values[] = { x };
+        vertex_attrib(index, values, 1);
+    }
+
+    void vertexAttrib2f(GLuint index, GLfloat x, GLfloat y)
+    {
+        const GLfloat values[] = { x, y };
+        vertex_attrib(index, values, 2);
+    }
+
+    void vertexAttrib3f(GLuint index, GLfloat x, GLfloat y, GLfloat z)
+    {
+        const GLfloat values[] = { x, y, z };
+        vertex_attrib(index, values, 3);
+    }
+
+    void vertexAttrib4f(GLuint index, GLfloat x, GLfloat y, GLfloat z, GLfloat w)
+    {
+        const GLfloat values[] = { x, y, z, w };
+        vertex_attrib(index, values, 4);
+    }
+
+    void vertexAttrib1fv(GLuint index, Float32List values)
+    {
+        vertex_attrib(index, values, 1);
+    }
+
+    void vertexAttrib2fv(GLuint index, Float32List values)
+    {
+        vertex_attrib(index, values, 2);
+    }
+
+    void vertexAttrib3fv(GLuint index, Float32List values)
+    {
+        vertex_attrib(index, values, 3);
+    }
+
+    void vertexAttrib4fv(GLuint index, Float32List values)
+    {
+        vertex_attrib(index, values, 4);
+    }
+
+    void vertexAttribPointer(GLuint indx, GLint size, GLenum type, GLboolean normalized, GLsizei stride, GLintptr offset)
+    {
+        auto &context = teresa::native_webgl::current();
+        auto &attrib = context.vertex_array_binding().attrib(indx);
+        attrib.buffer = context.array_buffer_binding();
+        attrib.size = size;
+        attrib.type = type;
+        attrib.normalized = normalized;
+        attrib.stride = stride;
+        attrib.offset = offset;
+        auto baseOffset = attrib.buffer ? attrib.buffer->base_offset() : 0;
+        glVertexAttribPointer(indx, size, type, normalized, stride, reinterpret_cast<const void*>(baseOffset + offset));
+    }
+
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        glViewport(x, y, width, height);
+        if (auto state = tracked_state(); state && width >= 0 && height >= 0) {
+            state->viewport = { x, y, width, height };
+        }
+    }
+}
+
+namespace webgl
+{
+    namespace validation
+    {
+        // Entry points which check the WebGL rules of |Level| before forwarding to
+        // their webgl:: counterparts. A violation is recorded as a GL error and the
+        // call is dropped. Contexts created with Validation::none never see these.
+
+        inline bool fail(GLenum error_)
+        {
+            teresa::native_webgl::current().synthesize_error(error_);
+            return false;
+        }
+
+        // Objects of another canvas; null is no object at all.
+        inline bool is_foreign(const Object *object_)
+        {
+            return object_ && object_->context != &teresa::native_webgl::current();
+        }
+
+        inline bool is_usable(const Object *object_)
+        {
+            return object_ && !object_->deleted && !is_foreign(object_);
+        }
+
+        // Null, or an object of this canvas which was not deleted yet.
+        inline bool check_bindable(const Object *object_)
+        {
+            if (object_ && (object_->deleted || is_foreign(object_))) {
+                return fail(GL_INVALID_OPERATION);
+            }
+            return true;
+        }
+
+        inline bool is_attachment(GLenum attachment_)
+        {
+            return attachment_ == GL_COLOR_ATTACHMENT0 || attachment_ == GL_DEPTH_ATTACHMENT ||
+                attachment_ == GL_STENCIL_ATTACHMENT || attachment_ == GL_DEPTH_STENCIL_ATTACHMENT;
+        }
+
+        inline bool is_texture_image_target(GLenum target_)
+        {
+            return target_ == GL_TEXTURE_2D || (target_ >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target_ <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z);
+        }
+
+        inline std::size_t type_size(GLenum type_)
+        {
+            switch (type_) {
+            case GL_BYTE:
+            case GL_UNSIGNED_BYTE:
+                return 1;
+            case GL_SHORT:
+            case GL_UNSIGNED_SHORT:
+                return 2;
+            case GL_INT:
+            case GL_UNSIGNED_INT:
+            case GL_FLOAT:
+                return 4;
+            default:
+                return 0;
+            }
+        }
+
+        inline bool is_draw_mode(GLenum mode_)
+        {
+            switch (mode_) {
+            case GL_POINTS:
+            case GL_LINES:
+            case GL_LINE_LOOP:
+            case GL_LINE_STRIP:
+            case GL_TRIANGLES:
+            case GL_TRIANGLE_STRIP:
+            case GL_TRIANGLE_FAN:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        inline bool is_buffer_target(GLenum target_)
+        {
+            return target_ == GL_ARRAY_BUFFER || target_ == GL_ELEMENT_ARRAY_BUFFER || target_ == GL_UNIFORM_BUFFER;
+        }
+
+        inline bool is_buffer_usage(GLenum usage_)
+        {
+            return usage_ == GL_STREAM_DRAW || usage_ == GL_STATIC_DRAW || usage_ == GL_DYNAMIC_DRAW;
+        }
+
+        // Number of vertices every enabled attribute consumed by the current program
+        // can supply, or nothing if some of them cannot be drawn from at all.
+        template <Validation Level>
+        std::optional<std::size_t> vertex_count_limit()
+        {
+            auto &context = teresa::native_webgl::current();
+            auto program = context.current_program;
+            if (!program) {
+                if constexpr (Level == Validation::strict) {
+                    return std::nullopt;
+                }
+                return std::numeric_limits<std::size_t>::max();
+            }
+            if constexpr (Level == Validation::strict) {
+                if (program->deleted || !program->linked) {
+                    return std::nullopt;
+                }
+            }
+
+            auto limit = std::numeric_limits<std::size_t>::max();
+            auto &vertexArray = context.vertex_array_binding();
+            for (auto location : program->attrib_locations) {
+                if (location < 0 || static_cast<std::size_t>(location) >= vertexArray.attribs.size()) {
+                    continue;
+                }
+                auto &attrib = vertexArray.attribs[location];
+                if (!attrib.enabled) {
+                    continue;
+                }
+                if (!attrib.buffer) {
+                    return std::nullopt;
+                }
+                auto elementSize = attrib.size * type_size(attrib.type);
+                auto stride = attrib.stride ? static_cast<std::size_t>(attrib.stride) : elementSize;
+                auto offset = static_cast<std::size_t>(attrib.offset);
+                auto bufferSize = attrib.buffer->byte_size;
+                if (bufferSize < offset + elementSize) {
+                    limit = 0;
+                }
+                else {
+                    limit = std::min(limit, (bufferSize - offset - elementSize) / stride + 1);
+                }
+            }
+            return limit;
+        }
+
+        template <Validation Level>
+        bool check_draw_state()
+        {
+            if constexpr (Level == Validation::strict) {
+                if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                    return fail(GL_INVALID_FRAMEBUFFER_OPERATION);
+                }
+            }
+            return true;
+        }
+
+        template <Validation Level>
+        bool check_pixels(GLsizei width, GLsizei height, GLenum format, GLenum type, GLint alignment, const data_view &pixels)
+        {
+            if (width < 0 || height < 0) {
+                return fail(GL_INVALID_VALUE);
+            }
+            if constexpr (Level == Validation::strict) {
+                if (!teresa::bytes_per_pixel(format, type)) {
+                    return fail(GL_INVALID_ENUM);
+                }
+            }
+            if (pixels.data && pixels.size < teresa::image_byte_size(width, height, format, type, alignment)) {
+                return fail(GL_INVALID_OPERATION);
+            }
+            return true;
+        }
+
+        template <Validation Level>
+        void attachShader(node_ptr<Program> program, node_ptr<Shader> shader)
+        {
+            if (!is_usable(program.get()) || !is_usable(shader.get())) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            webgl::attachShader(program, shader);
+        }
+
+        template <Validation Level>
+        void bindBuffer(GLenum target, node_ptr<Buffer> buffer)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (!is_buffer_target(target)) {
+                    fail(GL_INVALID_ENUM);
+                    return;
+                }
+            }
+            if (buffer.get()) {
+                if (!check_bindable(buffer.get())) {
+                    return;
+                }
+                // Only element array buffers are kept apart, as in WebGL 2.
+                if (buffer->target && (buffer->target == GL_ELEMENT_ARRAY_BUFFER) != (target == GL_ELEMENT_ARRAY_BUFFER)) {
+                    fail(GL_INVALID_OPERATION);
+                    return;
+                }
+                buffer->target = target;
+            }
+            webgl::bindBuffer(target, buffer);
+        }
+
+        template <Validation Level>
+        bool check_buffer_range(GLenum target, GLuint index, const Buffer *buffer)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (target != GL_UNIFORM_BUFFER) {
+                    return fail(GL_INVALID_ENUM);
+                }
+            }
+            if (index >= static_cast<GLuint>(teresa::native_webgl::current().max_uniform_buffer_bindings())) {
+                return fail(GL_INVALID_VALUE);
+            }
+            if (buffer && buffer->target == GL_ELEMENT_ARRAY_BUFFER) {
+                return fail(GL_INVALID_OPERATION);
+            }
+            return check_bindable(buffer);
+        }
+
+        template <Validation Level>
+        void bindFramebuffer(GLenum target, node_ptr<Framebuffer> framebuffer)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (target != GL_FRAMEBUFFER) {
+                    fail(GL_INVALID_ENUM);
+                    return;
+                }
+            }
+            if (check_bindable(framebuffer.get())) {
+                webgl::bindFramebuffer(target, framebuffer);
+            }
+        }
+
+        template <Validation Level>
+        void bindRenderbuffer(GLenum target, node_ptr<Renderbuffer> renderbuffer)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (target != GL_RENDERBUFFER) {
+                    fail(GL_INVALID_ENUM);
+                    return;
+                }
+            }
+            if (check_bindable(renderbuffer.get())) {
+                webgl::bindRenderbuffer(target, renderbuffer);
+            }
+        }
+
+        template <Validation Level>
+        void bindTexture(GLenum target, node_ptr<Texture> texture)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (target != GL_TEXTURE_2D && target != GL_TEXTURE_CUBE_MAP) {
+                    fail(GL_INVALID_ENUM);
+                    return;
+                }
+            }
+            if (check_bindable(texture.get())) {
+                webgl::bindTexture(target, texture);
+            }
+        }
+
+        template <Validation Level>
+        void bindBufferBase(GLenum target, GLuint index, node_ptr<Buffer> buffer)
+        {
+            if (!check_buffer_range<Level>(target, index, buffer.get())) {
+                return;
+            }
+            if (buffer.get()) {
+                buffer->target = buffer->target ? buffer->target : target;
+            }
+            webgl::bindBufferBase(target, index, buffer);
+        }
+
+        template <Validation Level>
+        void bindBufferRange(GLenum target, GLuint index, node_ptr<Buffer> buffer, GLintptr offset, GLsizeiptr size)
+        {
+            if (!check_buffer_range<Level>(target, index, buffer.get())) {
+                return;
+            }
+            if (buffer.get()) {
+                auto alignment = teresa::native_webgl::current().uniform_buffer_offset_alignment();
+                if (offset < 0 || size <= 0 || offset % alignment) {
+                    fail(GL_INVALID_VALUE);
+                    return;
+                }
+                buffer->target = buffer->target ? buffer->target : target;
+            }
+            webgl::bindBufferRange(target, index, buffer, offset, size);
+        }
+
+        // The buffer bufferData() would replace the storage of, or null after failing.
+        template <Validation Level>
+        Buffer* check_buffer_data(GLenum target, GLenum usage)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (!is_buffer_target(target) || !is_buffer_usage(usage)) {
+                    fail(GL_INVALID_ENUM);
+                    return nullptr;
+                }
+            }
+            auto buffer = teresa::native_webgl::current().buffer_binding(target);
+            if (!buffer || buffer->stream) {
+                // Streaming buffers have immutable storage.
+                fail(GL_INVALID_OPERATION);
+                return nullptr;
+            }
+            return buffer;
+        }
+
+        // Keeps the size and index shadow of |buffer| in step with new contents.
+        inline void shadow_buffer_data(Buffer *buffer, GLenum target, const void *data, std::size_t size)
+        {
+            buffer->byte_size = size;
+            if (target == GL_ELEMENT_ARRAY_BUFFER) {
+                buffer->indices.assign(data, size);
+            }
+        }
+
+        template <Validation Level>
+        void bufferData(GLenum target, BufferSource data, GLenum usage)
+        {
+            auto buffer = check_buffer_data<Level>(target, usage);
+            if (!buffer) {
+                return;
+            }
+            shadow_buffer_data(buffer, target, get_data(data), get_byte_size(data));
+            webgl::bufferData(target, data, usage);
+        }
+
+        template <Validation Level>
+        void bufferDataConverted(GLenum target, BufferSource data, GLenum usage, std::string conversion)
+        {
+            auto kind = teresa::parse_conversion(conversion);
+            auto buffer = check_buffer_data<Level>(target, usage);
+            if (!buffer) {
+                return;
+            }
+            webgl::convert_buffer_source(kind, data, [&](const void *converted_, std::size_t size_) {
+                shadow_buffer_data(buffer, target, converted_, size_);
+                webgl::buffer_data(target, converted_, size_, usage);
+            });
+        }
+
+        template <Validation Level>
+        void bufferSubData(GLenum target, GLintptr offset, BufferSource data)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (!is_buffer_target(target)) {
+                    fail(GL_INVALID_ENUM);
+                    return;
+                }
+            }
+            auto buffer = teresa::native_webgl::current().buffer_binding(target);
+            if (!buffer) {
+                fail(GL_INVALID_OPERATION);
+                return;
+            }
+            auto size = get_byte_size(data);
+            if (offset < 0 || static_cast<std::size_t>(offset) + size > buffer->byte_size) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            if (target == GL_ELEMENT_ARRAY_BUFFER) {
+                buffer->indices.update(static_cast<std::size_t>(offset), get_data(data), size);
+            }
+            webgl::bufferSubData(target, offset, data);
+        }
+
+        template <Validation Level>
+        void compileShader(node_ptr<Shader> shader)
+        {
+            if (!is_usable(shader.get())) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            webgl::compileShader(shader);
+        }
+
+        // Deleting null or a deleted object does nothing, as WebGL specifies.
+        template <Validation Level, typename Ty, void (*Delete)(node_ptr<Ty>)>
+        void delete_object(node_ptr<Ty> object)
+        {
+            if (!object.get() || object->deleted) {
+                return;
+            }
+            if (is_foreign(object.get())) {
+                fail(GL_INVALID_OPERATION);
+                return;
+            }
+            Delete(object);
+        }
+
+        template <Validation Level>
+        void detachShader(node_ptr<Program> program, node_ptr<Shader> shader)
+        {
+            if (!is_usable(program.get()) || !is_usable(shader.get())) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            webgl::detachShader(program, shader);
+        }
+
+        template <Validation Level>
+        void disableVertexAttribArray(GLuint index)
+        {
+            if (index >= static_cast<GLuint>(teresa::native_webgl::current().max_vertex_attribs())) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            webgl::disableVertexAttribArray(index);
+        }
+
+        template <Validation Level>
+        void drawArrays(GLenum mode, GLint first, GLsizei count)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (!is_draw_mode(mode)) {
+                    fail(GL_INVALID_ENUM);
+                    return;
+                }
+            }
+            if (first < 0 || count < 0) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            if (!check_draw_state<Level>()) {
+                return;
+            }
+            auto limit = vertex_count_limit<Level>();
+            if (!limit || static_cast<std::size_t>(first) + static_cast<std::size_t>(count) > *limit) {
+                fail(GL_INVALID_OPERATION);
+                return;
+            }
+            webgl::drawArrays(mode, first, count);
+        }
+
+        template <Validation Level>
+        void drawElements(GLenum mode, GLsizei count, GLenum type, GLintptr offset)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (!is_draw_mode(mode) || (type != GL_UNSIGNED_BYTE && type != GL_UNSIGNED_SHORT)) {
+                    fail(GL_INVALID_ENUM);
+                    return;
+                }
+            }
+            if (count < 0 || offset < 0) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            auto indexSize = type_size(type);
+            auto buffer = teresa::native_webgl::current().vertex_array_binding().element_array_buffer;
+            if (!buffer || !indexSize || offset % indexSize) {
+                fail(GL_INVALID_OPERATION);
+                return;
+            }
+            auto byteOffset = static_cast<std::size_t>(offset);
+            auto byteCount = static_cast<std::size_t>(count) * indexSize;
+            if (byteOffset + byteCount > buffer->indices.size()) {
+                fail(GL_INVALID_OPERATION);
+                return;
+            }
+            if (!check_draw_state<Level>()) {
+                return;
+            }
+            auto limit = vertex_count_limit<Level>();
+            if (!limit || (count && buffer->indices.range(type, byteOffset, count).max >= *limit)) {
+                fail(GL_INVALID_OPERATION);
+                return;
+            }
+            webgl::drawElements(mode, count, type, offset);
+        }
+
+        template <Validation Level>
+        void enableVertexAttribArray(GLuint index)
+        {
+            if (index >= static_cast<GLuint>(teresa::native_webgl::current().max_vertex_attribs())) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            webgl::enableVertexAttribArray(index);
+        }
+
+        template <Validation Level>
+        bool check_attachment(GLenum target, GLenum attachment, const Object *object)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (target != GL_FRAMEBUFFER || !is_attachment(attachment)) {
+                    return fail(GL_INVALID_ENUM);
+                }
+            }
+            return check_bindable(object);
+        }
+
+        template <Validation Level>
+        void framebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, node_ptr<Renderbuffer> renderbuffer)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (renderbuffertarget != GL_RENDERBUFFER) {
+                    fail(GL_INVALID_ENUM);
+                    return;
+                }
+            }
+            if (check_attachment<Level>(target, attachment, renderbuffer.get())) {
+                webgl::framebufferRenderbuffer(target, attachment, renderbuffertarget, renderbuffer);
+            }
+        }
 
-    void hint(GLenum target, GLenum mode)
-    {
-        glHint(target, mode);
-    }
+        template <Validation Level>
+        void framebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, node_ptr<Texture> texture, GLint level)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (!is_texture_image_target(textarget)) {
+                    fail(GL_INVALID_ENUM);
+                    return;
+                }
+                if (level != 0) {
+                    fail(GL_INVALID_VALUE);
+                    return;
+                }
+            }
+            if (check_attachment<Level>(target, attachment, texture.get())) {
+                webgl::framebufferTexture2D(target, attachment, textarget, texture, level);
+            }
+        }
 
-    GLboolean isBuffer(node_ptr<Buffer> buffer)
-    {
-        return glIsBuffer(buffer->gl_handle);
-    }
+        template <Validation Level>
+        bool check_linked(const Program *program)
+        {
+            if (!is_usable(program)) {
+                return fail(GL_INVALID_VALUE);
+            }
+            if constexpr (Level == Validation::strict) {
+                if (!program->linked) {
+                    return fail(GL_INVALID_OPERATION);
+                }
+            }
+            return true;
+        }
 
-    GLboolean isEnabled(GLenum cap)
-    {
-        return glIsEnabled(cap);
-    }
+        template <Validation Level>
+        GLint getAttribLocation(node_ptr<Program> program, std::string name)
+        {
+            if (!check_linked<Level>(program.get())) {
+                return -1;
+            }
+            return webgl::getAttribLocation(program, name);
+        }
 
-    GLboolean isFramebuffer(node_ptr<Framebuffer> framebuffer)
-    {
-        return glIsFramebuffer(framebuffer->gl_handle);
-    }
+        template <Validation Level>
+        node_ptr<UniformLocation> getUniformLocation(node_ptr<Program> program, std::string name)
+        {
+            if (!check_linked<Level>(program.get())) {
+                return nullptr;
+            }
+            return webgl::getUniformLocation(program, name);
+        }
 
-    GLboolean isProgram(node_ptr<Program> program)
-    {
-        return glIsProgram(program->gl_handle);
-    }
+        template <Validation Level>
+        void linkProgram(node_ptr<Program> program)
+        {
+            if (!is_usable(program.get())) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            webgl::linkProgram(program);
+            read_link_result(program.get());
+        }
 
-    GLboolean isRenderbuffer(node_ptr<Renderbuffer> renderbuffer)
-    {
-        return glIsRenderbuffer(renderbuffer->gl_handle);
-    }
+        template <Validation Level>
+        void pixelStorei(GLenum pname, GLint param)
+        {
+            if (pname == GL_UNPACK_ALIGNMENT || pname == GL_PACK_ALIGNMENT) {
+                if (param != 1 && param != 2 && param != 4 && param != 8) {
+                    fail(GL_INVALID_VALUE);
+                    return;
+                }
+            }
+            webgl::pixelStorei(pname, param);
+        }
 
-    GLboolean isShader(node_ptr<Shader> shader)
-    {
-        return glIsShader(shader->gl_handle);
-    }
+        template <Validation Level>
+        void readPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, data_view pixels)
+        {
+            if (!pixels.data) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            if (!check_pixels<Level>(width, height, format, type, teresa::native_webgl::current().pack_alignment, pixels)) {
+                return;
+            }
+            webgl::readPixels(x, y, width, height, format, type, pixels);
+        }
 
-    GLboolean isTexture(node_ptr<Texture> texture)
-    {
-        return glIsTexture(texture->gl_handle);
-    }
+        template <Validation Level>
+        void shaderSource(node_ptr<Shader> shader, std::string source)
+        {
+            if (!is_usable(shader.get())) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            webgl::shaderSource(shader, source);
+        }
 
-    void lineWidth(GLfloat width)
-    {
-        glLineWidth(width);
-    }
+        template <Validation Level>
+        void texImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, data_view pixels)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (level < 0 || border != 0) {
+                    fail(GL_INVALID_VALUE);
+                    return;
+                }
+                if (static_cast<GLenum>(internalformat) != format) {
+                    fail(GL_INVALID_OPERATION);
+                    return;
+                }
+            }
+            if (!check_pixels<Level>(width, height, format, type, teresa::native_webgl::current().unpack_alignment, pixels)) {
+                return;
+            }
+            webgl::texImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+        }
 
-    void linkProgram(node_ptr<Program> program)
-    {
-        glLinkProgram(program->gl_handle);
-    }
+        template <Validation Level>
+        void texImage2DConverted(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border,
+            GLenum format, data_view pixels, std::string conversion)
+        {
+            auto kind = teresa::parse_conversion(conversion);
+            auto sourceType = teresa::source_type(kind);
+            if constexpr (Level == Validation::strict) {
+                if (!teresa::channel_count(format)) {
+                    fail(GL_INVALID_ENUM);
+                    return;
+                }
+                if (level < 0 || border != 0) {
+                    fail(GL_INVALID_VALUE);
+                    return;
+                }
+                if (static_cast<GLenum>(internalformat) != teresa::converted_format(kind, format)) {
+                    fail(GL_INVALID_OPERATION);
+                    return;
+                }
+            }
+            if (sourceType == GL_UNSIGNED_BYTE && format != GL_RGBA) {
+                fail(GL_INVALID_OPERATION);
+                return;
+            }
+            if (!pixels.data) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            if (!check_pixels<Level>(width, height, format, sourceType, teresa::native_webgl::current().unpack_alignment, pixels)) {
+                return;
+            }
+            webgl::texImage2DConverted(target, level, internalformat, width, height, border, format, pixels, conversion);
+        }
 
-    void pixelStorei(GLenum pname, GLint param)
-    {
-        glPixelStorei(pname, param);
-    }
+        template <Validation Level>
+        void texSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, data_view pixels)
+        {
+            if constexpr (Level == Validation::strict) {
+                if (level < 0 || xoffset < 0 || yoffset < 0) {
+                    fail(GL_INVALID_VALUE);
+                    return;
+                }
+            }
+            if (!check_pixels<Level>(width, height, format, type, teresa::native_webgl::current().unpack_alignment, pixels)) {
+                return;
+            }
+            webgl::texSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+        }
 
-    void polygonOffset(GLfloat factor, GLfloat units)
-    {
-        glPolygonOffset(factor, units);
-    }
+        template <Validation Level>
+        void useProgram(node_ptr<Program> program)
+        {
+            if (program.get()) {
+                if (program->deleted) {
+                    fail(GL_INVALID_VALUE);
+                    return;
+                }
+                if (is_foreign(program.get())) {
+                    fail(GL_INVALID_OPERATION);
+                    return;
+                }
+                if constexpr (Level == Validation::strict) {
+                    if (!program->linked) {
+                        fail(GL_INVALID_OPERATION);
+                        return;
+                    }
+                }
+            }
+            teresa::native_webgl::current().current_program = program.get();
+            webgl::useProgram(program);
+        }
 
-    void readPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, data_view pixels)
-    {
-        glReadPixels(x, y, width, height, format, type, pixels.data);
-    }
+        template <Validation Level>
+        void vertexAttribPointer(GLuint indx, GLint size, GLenum type, GLboolean normalized, GLsizei stride, GLintptr offset)
+        {
+            auto &context = teresa::native_webgl::current();
+            if (indx >= static_cast<GLuint>(context.max_vertex_attribs())) {
+                fail(GL_INVALID_VALUE);
+                return;
+            }
+            if constexpr (Level == Validation::strict) {
+                auto typeSize = type_size(type);
+                if (!typeSize || type == GL_INT || type == GL_UNSIGNED_INT) {
+                    fail(GL_INVALID_ENUM);
+                    return;
+                }
+                if (size < 1 || size > 4 || stride < 0 || stride > 255 || offset < 0) {
+                    fail(GL_INVALID_VALUE);
+                    return;
+                }
+                if (offset % typeSize || stride % typeSize) {
+                    fail(GL_INVALID_OPERATION);
+                    return;
+                }
+            }
+            if (!context.array_buffer_binding() && offset != 0) {
+                fail(GL_INVALID_OPERATION);
+                return;
+            }
+            webgl::vertexAttribPointer(indx, size, type, normalized, stride, offset);
+        }
 
-    void renderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height)
-    {
-        glRenderbufferStorage(target, internalformat, width, height);
-    }
+        template <Validation Level, auto Fx, std::size_t Components = 0, typename = decltype(Fx)>
+        struct uniform;
 
-    void sampleCoverage(GLclampf value, GLboolean invert)
-    {
-        glSampleCoverage(value, invert);
-    }
+        // A null location is silently ignored, as WebGL specifies.
+        template <Validation Level, auto Fx, std::size_t Components, typename ...Args>
+        struct uniform<Level, Fx, Components, void (*)(node_ptr<UniformLocation>, Args...)>
+        {
+            static void invoke(node_ptr<UniformLocation> location, Args ...args)
+            {
+                if (!location.get()) {
+                    return;
+                }
+                if constexpr (Level == Validation::strict) {
+                    if (location->program != teresa::native_webgl::current().current_program) {
+                        fail(GL_INVALID_OPERATION);
+                        return;
+                    }
+                    if constexpr (Components != 0) {
+                        if (!(_check_length(args) && ...)) {
+                            fail(GL_INVALID_VALUE);
+                            return;
+                        }
+                    }
+                }
+                Fx(location, args...);
+            }
+        private:
+            template <typename Ty>
+            static bool _check_length(const Ty &arg_)
+            {
+                if constexpr (is_typed_array_v<Ty>) {
+                    return arg_.size && arg_.size % Components == 0;
+                }
+                else {
+                    return true;
+                }
+            }
+        };
 
-    void scissor(GLint x, GLint y, GLsizei width, GLsizei height)
-    {
-        glScissor(x, y, width, height);
+        template <Validation Level>
+        void register_methods(napi_env env_, napi_value object_, const std::function<void()> &prologue_)
+        {
+#define REGISTER_VALIDATED_GL_FUNCTION(webglName) set_node_property(env_, object_, u8 ## #webglName, create_node_function(env_, webglName<Level>, prologue_))
+#define REGISTER_VALIDATED_UNIFORM_FUNCTION(webglName, ...) set_node_property(env_, object_, u8 ## #webglName, create_node_function(env_, uniform<Level, webgl::webglName, ## __VA_ARGS__>::invoke, prologue_))
+#define REGISTER_VALIDATED_DELETE_FUNCTION(webglName, Type) set_node_property(env_, object_, u8 ## #webglName, create_node_function(env_, delete_object<Level, Type, webgl::webglName>, prologue_))
+
+            REGISTER_VALIDATED_GL_FUNCTION(attachShader);
+            REGISTER_VALIDATED_GL_FUNCTION(bindBuffer);
+            REGISTER_VALIDATED_GL_FUNCTION(bindBufferBase);
+            REGISTER_VALIDATED_GL_FUNCTION(bindBufferRange);
+            REGISTER_VALIDATED_GL_FUNCTION(bindFramebuffer);
+            REGISTER_VALIDATED_GL_FUNCTION(bindRenderbuffer);
+            REGISTER_VALIDATED_GL_FUNCTION(bindTexture);
+            REGISTER_VALIDATED_GL_FUNCTION(bufferData);
+            REGISTER_VALIDATED_GL_FUNCTION(bufferDataConverted);
+            REGISTER_VALIDATED_GL_FUNCTION(bufferSubData);
+            REGISTER_VALIDATED_GL_FUNCTION(compileShader);
+            REGISTER_VALIDATED_DELETE_FUNCTION(deleteBuffer, Buffer);
+            REGISTER_VALIDATED_DELETE_FUNCTION(deleteFramebuffer, Framebuffer);
+            REGISTER_VALIDATED_DELETE_FUNCTION(deleteProgram, Program);
+            REGISTER_VALIDATED_DELETE_FUNCTION(deleteRenderbuffer, Renderbuffer);
+            REGISTER_VALIDATED_DELETE_FUNCTION(deleteShader, Shader);
+            REGISTER_VALIDATED_DELETE_FUNCTION(deleteTexture, Texture);
+            REGISTER_VALIDATED_GL_FUNCTION(detachShader);
+            REGISTER_VALIDATED_GL_FUNCTION(disableVertexAttribArray);
+            REGISTER_VALIDATED_GL_FUNCTION(drawArrays);
+            REGISTER_VALIDATED_GL_FUNCTION(drawElements);
+            REGISTER_VALIDATED_GL_FUNCTION(enableVertexAttribArray);
+            REGISTER_VALIDATED_GL_FUNCTION(framebufferRenderbuffer);
+            REGISTER_VALIDATED_GL_FUNCTION(framebufferTexture2D);
+            REGISTER_VALIDATED_GL_FUNCTION(getAttribLocation);
+            REGISTER_VALIDATED_GL_FUNCTION(getUniformLocation);
+            REGISTER_VALIDATED_GL_FUNCTION(linkProgram);
+            REGISTER_VALIDATED_GL_FUNCTION(pixelStorei);
+            REGISTER_VALIDATED_GL_FUNCTION(readPixels);
+            REGISTER_VALIDATED_GL_FUNCTION(shaderSource);
+            REGISTER_VALIDATED_GL_FUNCTION(texImage2D);
+            REGISTER_VALIDATED_GL_FUNCTION(texImage2DConverted);
+            REGISTER_VALIDATED_GL_FUNCTION(texSubImage2D);
+            REGISTER_VALIDATED_GL_FUNCTION(useProgram);
+            REGISTER_VALIDATED_GL_FUNCTION(vertexAttribPointer);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform1f);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform2f);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform3f);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform4f);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform1i);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform2i);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform3i);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform4i);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform1fv, 1);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform2fv, 2);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform3fv, 3);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform4fv, 4);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform1iv, 1);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform2iv, 2);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform3iv, 3);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniform4iv, 4);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniformMatrix2fv, 4);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniformMatrix3fv, 9);
+            REGISTER_VALIDATED_UNIFORM_FUNCTION(uniformMatrix4fv, 16);
+
+#undef REGISTER_VALIDATED_DELETE_FUNCTION
+#undef REGISTER_VALIDATED_UNIFORM_FUNCTION
+#undef REGISTER_VALIDATED_GL_FUNCTION
+        }
     }
+}
 
-    void shaderSource(node_ptr<Shader> shader, std::string source)
-    {
-        static const std::string header = "#version 330 core\n";
-        static const std::string footer = "";
-        const char *parts[] = { header.c_str(), source.c_str(), footer.c_str() };
-        GLint partLengths[] = { header.size(), source.size(), footer.size() };
-        auto p = source.c_str();
-        GLint c = source.size();
-        glShaderSource(shader->gl_handle, 3, parts, partLengths);
-    }
+namespace teresa
+{
+    const webgl_canvas *webgl_canvas::_current = nullptr;
 
-    void stencilFunc(GLenum func, GLint ref, GLuint mask)
+    webgl_canvas::webgl_canvas(const webgl::ContextAttributes &context_attributes_)
+        :_contextAttributes(context_attributes_),
+        _nativeWebGL(std::make_unique<native_webgl>()),
+        _self(this, [](const webgl_canvas *) {})
     {
-        glStencilFunc(func, ref, mask);
+        if (_contextAttributes.virtualized) {
+            _virtualContext = virtual_context::acquire();
+            _virtualContext->make_current();
+        }
+        else if (_contextAttributes.headless) {
+            _headlessContext = std::make_shared<egl_context>();
+            _headlessContext->load_gl();
+        }
+        else {
+            _displayWindow = std::make_shared<glfw_window>(_contextAttributes.width, _contextAttributes.height, "Display screen");
+            _displayWindow->make_current();
+            if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+                throw std::runtime_error("Failed to initialize OpenGL context");
+            }
+        }
+        // Whichever canvas was current, its context no longer is.
+        _current = nullptr;
+        _nativeWebGL->context_lease = [window = _displayWindow, headlessContext = _headlessContext, virtualContext = _virtualContext]() {
+            _current = nullptr;
+            if (virtualContext) {
+                virtualContext->make_current();
+            }
+            else if (headlessContext) {
+                headlessContext->make_current();
+            }
+            else {
+                window->make_current();
+            }
+        };
+
+        if (_displayWindow) {
+            _nativeWebGL->set_window(_displayWindow->native_handle());
+            auto[width, height] = _displayWindow->framebuffer_size();
+            _width = static_cast<GLsizei>(width);
+            _height = static_cast<GLsizei>(height);
+            _displayWindow->add_framebuffer_resize_callback([this](unsigned width_, unsigned height_) {
+                _on_resize(static_cast<GLsizei>(width_), static_cast<GLsizei>(height_));
+            });
+            _eventPump = event_pump::acquire();
+        }
+        else {
+            offscreen_framebuffer::attributes attributes;
+            attributes.alpha = _contextAttributes.alpha;
+            attributes.depth = _contextAttributes.depth;
+            attributes.stencil = _contextAttributes.stencil;
+            attributes.antialias = _contextAttributes.antialias;
+            attributes.preserve_drawing_buffer = _contextAttributes.preserveDrawingBuffer;
+            _drawingBuffer = std::make_unique<offscreen_framebuffer>(_contextAttributes.width, _contextAttributes.height, attributes);
+            _nativeWebGL->default_framebuffer = _drawingBuffer->gl_handle();
+            _width = _drawingBuffer->width();
+            _height = _drawingBuffer->height();
+        }
+        if (_virtualContext) {
+            // Only objects are created here; the bindings are made by switching to the new state.
+            glCreateVertexArrays(1, &_nativeWebGL->default_vertex_array_object);
+            _virtualState = std::make_unique<virtual_state>();
+            _nativeWebGL->tracked_state = _virtualState.get();
+            _virtualState->draw_framebuffer = _virtualState->read_framebuffer = _drawingBuffer->gl_handle();
+            _virtualState->vertex_array = _nativeWebGL->default_vertex_array_object;
+            _virtualState->viewport = _virtualState->scissor_box = { 0, 0, _drawingBuffer->width(), _drawingBuffer->height() };
+        }
+        else if (_drawingBuffer) {
+            glBindFramebuffer(GL_FRAMEBUFFER, _drawingBuffer->gl_handle());
+        }
+        if (_contextAttributes.pooledBuffers) {
+            _nativeWebGL->enable_buffer_pool();
+        }
+        if (_contextAttributes.stagingBufferSize) {
+            _nativeWebGL->enable_staging(_contextAttributes.stagingBufferSize);
+        }
+        std::function<void()> swap;
+        std::function<void(bool)> makeCurrent;
+        if (_displayWindow) {
+            swap = [window = _displayWindow.get()]() { window->swap_buffers(); };
+            makeCurrent = [window = _displayWindow.get()](bool current_) {
+                glfwMakeContextCurrent(current_ ? window->native_handle() : nullptr);
+            };
+        }
+        _framePacer = std::make_unique<frame_pacer>(std::move(swap), std::move(makeCurrent));
+        set_present_mode(_presentMode);
     }
 
-    void stencilFuncSeparate(GLenum face, GLenum func, GLint ref, GLuint mask)
+    webgl_canvas::~webgl_canvas()
     {
-        glStencilFuncSeparate(face, func, ref, mask);
+        // Everything below which holds GL objects deletes them in whichever context is current.
+        make_current();
+        _end_capture();
+        _framePacer.reset();
+        if (_virtualContext) {
+            glDeleteVertexArrays(1, &_nativeWebGL->default_vertex_array_object);
+            _virtualContext->release(*_virtualState);
+        }
+        _nativeWebGL.reset();
+        _drawingBuffer.reset();
+        if (_displayWindow) {
+            // The window outlives the canvas while a context_lease holds it, and its resize callback refers to the canvas.
+            _displayWindow->retire();
+        }
+        _current = nullptr;
     }
 
-    void stencilMask(GLuint mask)
+    const webgl_canvas& webgl_canvas::current()
     {
-        glStencilMask(mask);
+        if (!_current) {
+            throw std::runtime_error("No current canvas.");
+        }
+        return *_current;
     }
 
-    void stencilMaskSeparate(GLenum face, GLuint mask)
+    void webgl_canvas::make_current() const
     {
-        glStencilMaskSeparate(face, mask);
+        if (_current == this) {
+            return;
+        }
+        if (_virtualContext) {
+            // Virtualized canvases differ in their state only.
+            if (!_current || _current->_virtualContext != _virtualContext) {
+                _virtualContext->make_current();
+            }
+            _virtualContext->switch_to(*_virtualState);
+        }
+        else if (_headlessContext) {
+            _headlessContext->make_current();
+        }
+        else {
+            // After a threaded present the context is with the present thread until it has swapped.
+            _framePacer->reclaim();
+            _displayWindow->make_current();
+        }
+        _nativeWebGL->make_current();
+        _current = this;
     }
 
-    void stencilOp(GLenum fail, GLenum zfail, GLenum zpass)
+    void webgl_canvas::flush()
     {
-        glStencilOp(fail, zfail, zpass);
+        make_current();
+        webgl::end_frame();
+        if (_frameCapture && _displayWindow) {
+            // The back buffer is undefined once swapped.
+            _frameCapture->read_framebuffer(0, _width, _height);
+        }
+        if (_drawingBuffer) {
+            _drawingBuffer->present();
+            if (_frameCapture) {
+                _frameCapture->read_texture(_drawingBuffer->front_texture(), _width, _height);
+            }
+        }
+        _framePacer->present();
+        if (_framePacer->threaded()) {
+            // The next call makes the context current again, once the swap is done.
+            _current = nullptr;
+        }
+        if (_eventPump) {
+            _eventPump->poll_if_stale();
+        }
+        else if (_displayWindow) {
+            _displayWindow->react();
+        }
     }
 
-    void stencilOpSeparate(GLenum face, GLenum fail, GLenum zfail, GLenum zpass)
+    void webgl_canvas::set_present_mode(webgl::PresentMode mode_)
     {
-        glStencilOpSeparate(face, fail, zfail, zpass);
+        make_current();
+        if (_displayWindow) {
+            glfwSwapInterval(mode_.vsync ? 1 : 0);
+        }
+        else {
+            mode_.vsync = false;
+            mode_.presentThread = false;
+        }
+        _framePacer->set_threaded(mode_.presentThread);
+        _framePacer->set_max_frames_in_flight(mode_.maxFramesInFlight);
+        _presentMode = mode_;
     }
 
-    void texImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, data_view pixels)
+    node_ptr<webgl::PresentMode> webgl_canvas::get_present_mode()
     {
-        glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels.data);
+        return make_node_ptr<webgl::PresentMode>(_presentMode);
     }
 
-    void texParameterf(GLenum target, GLenum pname, GLfloat param)
+    void webgl_canvas::read_frame(data_view pixels_)
     {
-        glTexParameterf(target, pname, param);
+        if (!_drawingBuffer) {
+            throw std::runtime_error("Only headless canvases can read their frames back.");
+        }
+        make_current();
+        _drawingBuffer->read_front(pixels_.data, pixels_.size);
     }
 
-    void texParameteri(GLenum target, GLenum pname, GLint param)
+    GLsizei webgl_canvas::get_width()
     {
-        glTexParameteri(target, pname, param);
+        return _width;
     }
 
-    void texSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, data_view pixels)
+    GLsizei webgl_canvas::get_height()
     {
-        glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels.data);
+        return _height;
     }
 
-    void uniform1f(node_ptr<UniformLocation> location, GLfloat x)
+    void webgl_canvas::set_width(GLsizei width_)
     {
-        glUniform1f(location->gl_location, x);
+        _resize(width_, _height);
     }
 
-    void uniform2f(node_ptr<UniformLocation> location, GLfloat x, GLfloat y)
+    void webgl_canvas::set_height(GLsizei height_)
     {
-        glUniform2f(location->gl_location, x, y);
+        _resize(_width, height_);
     }
 
-    void uniform3f(node_ptr<UniformLocation> location, GLfloat x, GLfloat y, GLfloat z)
+    GLsizei webgl_canvas::get_drawing_buffer_width()
     {
-        glUniform3f(location->gl_location, x, y, z);
+        return _width;
     }
 
-    void uniform4f(node_ptr<UniformLocation> location, GLfloat x, GLfloat y, GLfloat z, GLfloat w)
+    GLsizei webgl_canvas::get_drawing_buffer_height()
     {
-        glUniform4f(location->gl_location, x, y, z, w);
+        return _height;
     }
 
-    void uniform1i(node_ptr<UniformLocation> location, GLint x)
-    {
-        glUniform1i(location->gl_location, x);
-    }
-    
-    void uniform2i(node_ptr<UniformLocation> location, GLint x, GLint y)
+    node_ptr<resize_event> webgl_canvas::take_resize_event()
     {
-        glUniform2i(location->gl_location, x, y);
+        if (!_resized) {
+            return nullptr;
+        }
+        _resized = false;
+        return make_node_ptr<resize_event>(_width, _height);
     }
 
-    void uniform3i(node_ptr<UniformLocation> location, GLint x, GLint y, GLint z)
+    void resize_event::to_node(napi_env env_, napi_value object_) const
     {
-        glUniform3i(location->gl_location, x, y, z);
+        node_compatible::to_node(env_, object_);
+        set_node_property(env_, object_, u8"width", width);
+        set_node_property(env_, object_, u8"height", height);
     }
 
-    void uniform4i(node_ptr<UniformLocation> location, GLint x, GLint y, GLint z, GLint w)
+    void webgl_canvas::start_capture(webgl::CaptureOptions options_)
     {
-        glUniform4i(location->gl_location, x, y, z, w);
+        frame_capture::options options;
+        options.format = options_.format;
+        options.sink = options_.sink;
+        options.path = options_.path;
+        options.fd = options_.fd;
+        options.queue_length = options_.queueLength;
+        _end_capture();
+        _frameCapture = std::make_unique<frame_capture>(options);
     }
 
-    void uniform1fv(node_ptr<UniformLocation> location, Float32List v)
+    node_ptr<capture_stats> webgl_canvas::stop_capture()
     {
-        glUniform1fv(location->gl_location, 1, v.data);
+        auto stats = _end_capture();
+        if (!stats) {
+            return nullptr;
+        }
+        return make_node_ptr<capture_stats>(*stats);
     }
 
-    void uniform2fv(node_ptr<UniformLocation> location, Float32List v)
+    std::optional<frame_capture::statistics> webgl_canvas::_end_capture()
     {
-        glUniform2fv(location->gl_location, 1, v.data);
+        if (!_frameCapture) {
+            return std::nullopt;
+        }
+        // The pixel buffers and fences of the readbacks belong to the context of the canvas.
+        make_current();
+        _frameCapture->stop();
+        auto stats = _frameCapture->stats();
+        _frameCapture.reset();
+        return stats;
     }
 
-    void uniform3fv(node_ptr<UniformLocation> location, Float32List v)
+    node_ptr<captured_frame> webgl_canvas::take_captured_frame()
     {
-        glUniform3fv(location->gl_location, 1, v.data);
+        if (!_frameCapture) {
+            return nullptr;
+        }
+        auto frame = _frameCapture->take();
+        if (!frame) {
+            return nullptr;
+        }
+        return make_node_ptr<captured_frame>(*frame, _frameCapture->format());
     }
 
-    void uniform4fv(node_ptr<UniformLocation> location, Float32List v)
+    node_ptr<capture_stats> webgl_canvas::get_capture_stats()
     {
-        glUniform4fv(location->gl_location, 1, v.data);
+        if (!_frameCapture) {
+            return nullptr;
+        }
+        return make_node_ptr<capture_stats>(_frameCapture->stats());
     }
 
-    void uniform1iv(node_ptr<UniformLocation> location, Int32List v)
+    void captured_frame::to_node(napi_env env_, napi_value object_) const
     {
-        glUniform1iv(location->gl_location, 1, v.data);
-    }
+        static const char *formatNames[] = { "rgba", "yuv420" };
 
-    void uniform2iv(node_ptr<UniformLocation> location, Int32List v)
-    {
-        glUniform2iv(location->gl_location, 1, v.data);
+        node_compatible::to_node(env_, object_);
+        set_node_property(env_, object_, u8"width", frame.width);
+        set_node_property(env_, object_, u8"height", frame.height);
+        set_node_property(env_, object_, u8"format", std::string(formatNames[static_cast<int>(format)]));
+        set_node_property(env_, object_, u8"index", static_cast<double>(frame.index));
+        external_array_buffer pixels;
+        pixels.data = frame.pixels;
+        pixels.size = frame.size;
+        pixels.release = [size = frame.size](void *data_) {
+            host_memory_pool::shared().free(data_, size);
+        };
+        set_node_property(env_, object_, u8"data", pixels);
     }
 
-    void uniform3iv(node_ptr<UniformLocation> location, Int32List v)
+    node_ptr<event_batch> webgl_canvas::take_events()
     {
-        glUniform3iv(location->gl_location, 1, v.data);
+        if (!_displayWindow) {
+            return nullptr;
+        }
+        std::size_t dropped = 0;
+        auto events = _displayWindow->take_events(dropped);
+        if (events.empty()) {
+            return nullptr;
+        }
+        return make_node_ptr<event_batch>(std::move(events), dropped);
     }
 
-    void uniform4iv(node_ptr<UniformLocation> location, Int32List v)
+    void event_batch::to_node(napi_env env_, napi_value object_) const
     {
-        glUniform4iv(location->gl_location, 1, v.data);
+        node_compatible::to_node(env_, object_);
+        external_array_buffer buffer;
+        buffer.data = events->data();
+        buffer.size = events->size() * sizeof(double);
+        buffer.release = [events = events](void *) {
+            // Holds on to the numbers until the ArrayBuffer is collected.
+        };
+        napi_value data = nullptr;
+        napi_create_typedarray(env_, napi_float64_array, events->size(), create_node_value(env_, buffer), 0, &data);
+        set_node_property(env_, object_, u8"data", data);
+        set_node_property(env_, object_, u8"count", static_cast<double>(events->size() / glfw_window::event_stride));
+        set_node_property(env_, object_, u8"stride", static_cast<double>(glfw_window::event_stride));
+        set_node_property(env_, object_, u8"dropped", static_cast<double>(dropped));
     }
 
-    void uniformMatrix2fv(node_ptr<UniformLocation> location, GLboolean transpose, Float32List v)
+    void webgl_canvas::_registerEventTypes(napi_env env_, napi_value object_) const
     {
-        glUniformMatrix2fv(location->gl_location, 1, transpose, v.data);
-    }
+#define REGISTER_EVENT_TYPE(name, type) set_node_property(env_, object_, u8 ## #name, static_cast<int>(window_event::type))
 
-    void uniformMatrix3fv(node_ptr<UniformLocation> location, GLboolean transpose, Float32List v)
-    {
-        glUniformMatrix3fv(location->gl_location, 1, transpose, v.data);
-    }
+        REGISTER_EVENT_TYPE(KEY_EVENT, key);
+        REGISTER_EVENT_TYPE(CHARACTER_EVENT, character);
+        REGISTER_EVENT_TYPE(MOUSE_BUTTON_EVENT, mouse_button);
+        REGISTER_EVENT_TYPE(CURSOR_POSITION_EVENT, cursor_position);
+        REGISTER_EVENT_TYPE(CURSOR_ENTER_EVENT, cursor_enter);
+        REGISTER_EVENT_TYPE(SCROLL_EVENT, scroll);
+        REGISTER_EVENT_TYPE(FOCUS_EVENT, focus);
+        REGISTER_EVENT_TYPE(CLOSE_EVENT, close);
+        REGISTER_EVENT_TYPE(FRAMEBUFFER_SIZE_EVENT, framebuffer_size);
 
-    void uniformMatrix4fv(node_ptr<UniformLocation> location, GLboolean transpose, Float32List v)
-    {
-        glUniformMatrix4fv(location->gl_location, 1, transpose, v.data);
+#undef REGISTER_EVENT_TYPE
     }
 
-    void useProgram(node_ptr<Program> program)
+    void capture_stats::to_node(napi_env env_, napi_value object_) const
     {
-        glUseProgram(program->gl_handle);
+        node_compatible::to_node(env_, object_);
+        set_node_property(env_, object_, u8"frames", static_cast<double>(statistics.frames));
+        set_node_property(env_, object_, u8"delivered", static_cast<double>(statistics.delivered));
+        set_node_property(env_, object_, u8"dropped", static_cast<double>(statistics.dropped));
     }
 
-    void validateProgram(node_ptr<Program> program)
+    void webgl_canvas::_resize(GLsizei width_, GLsizei height_)
     {
-        glValidateProgram(program->gl_handle);
+        if (width_ <= 0 || height_ <= 0) {
+            throw std::runtime_error("The canvas size must be positive.");
+        }
+        if (_displayWindow) {
+            // The window takes its time, the framebuffer resize callback tells when it is done.
+            _displayWindow->resize_framebuffer(static_cast<unsigned>(width_), static_cast<unsigned>(height_));
+            return;
+        }
+        make_current();
+        _drawingBuffer->resize(width_, height_);
+        _on_resize(_drawingBuffer->width(), _drawingBuffer->height());
     }
 
-    void vertexAttrib1fv(GLuint index, Float32List values)
+    void webgl_canvas::_on_resize(GLsizei width_, GLsizei height_)
     {
-        glVertexAttrib1fv(index, values.data);
+        // Minimized windows report an empty framebuffer, which no drawing buffer can follow.
+        if ((width_ == _width && height_ == _height) || width_ <= 0 || height_ <= 0) {
+            return;
+        }
+        make_current();
+        // A viewport or scissor box over the whole drawing buffer keeps covering it, those the
+        // application chose stay as they are.
+        GLint box[4] = {};
+        glGetIntegerv(GL_VIEWPORT, box);
+        if (box[0] == 0 && box[1] == 0 && box[2] == _width && box[3] == _height) {
+            webgl::viewport(0, 0, width_, height_);
+        }
+        glGetIntegerv(GL_SCISSOR_BOX, box);
+        if (box[0] == 0 && box[1] == 0 && box[2] == _width && box[3] == _height) {
+            webgl::scissor(0, 0, width_, height_);
+        }
+        _width = width_;
+        _height = height_;
+        _resized = true;
     }
 
-    void vertexAttrib2fv(GLuint index, Float32List values)
+    node_ptr<webgl::ContextAttributes> webgl_canvas::get_context_attributes()
     {
-        glVertexAttrib2fv(index, values.data);
+        return make_node_ptr<webgl::ContextAttributes>(_contextAttributes);
     }
 
-    void vertexAttrib3fv(GLuint index, Float32List values)
+    node_ptr<memory_stats> webgl_canvas::get_memory_stats()
     {
-        glVertexAttrib3fv(index, values.data);
+        return make_node_ptr<memory_stats>(_nativeWebGL->memory_usage());
     }
 
-    void vertexAttrib4fv(GLuint index, Float32List values)
+    void memory_stats::to_node(napi_env env_, napi_value object_) const
     {
-        glVertexAttrib4fv(index, values.data);
+        static const char *kindNames[] = { "buffer", "texture", "renderbuffer" };
+
+        node_compatible::to_node(env_, object_);
+        for (std::size_t kind = 0; kind < memory_kind_count; ++kind) {
+            std::string name = kindNames[kind];
+            set_node_property(env_, object_, (name + "Bytes").c_str(), static_cast<double>(usage.kinds[kind].bytes));
+            set_node_property(env_, object_, (name + "Count").c_str(), static_cast<double>(usage.kinds[kind].objects));
+        }
+        set_node_property(env_, object_, u8"totalBytes", static_cast<double>(usage.total_bytes));
+        set_node_property(env_, object_, u8"peakTotalBytes", static_cast<double>(usage.peak_total_bytes));
     }
-}
 
-namespace teresa
-{
-    webgl_canvas::webgl_canvas()
-        :_displayWindow(std::make_unique<glfw_window>(640, 480, "Display screen"))
+    node_ptr<buffer_pool_stats> webgl_canvas::get_buffer_pool_stats()
     {
-        _displayWindow->make_current();
-        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-            throw std::runtime_error("Failed to initialize OpenGL context");
-        }
+        auto pool = _nativeWebGL->pooled_buffers();
+        return make_node_ptr<buffer_pool_stats>(pool ? pool->stats() : buffer_pool::statistics());
     }
 
-    void webgl_canvas::flush()
+    void buffer_pool_stats::to_node(napi_env env_, napi_value object_) const
     {
-        _displayWindow->swap_buffers();
-        _displayWindow->react();
+        node_compatible::to_node(env_, object_);
+        set_node_property(env_, object_, u8"arenaCount", static_cast<double>(statistics.arena_count));
+        set_node_property(env_, object_, u8"arenaSize", static_cast<double>(statistics.arena_size));
+        set_node_property(env_, object_, u8"reservedBytes", static_cast<double>(statistics.reserved_bytes));
+        set_node_property(env_, object_, u8"committedBytes", static_cast<double>(statistics.committed_bytes));
+        set_node_property(env_, object_, u8"allocatedBytes", static_cast<double>(statistics.allocated_bytes));
+        set_node_property(env_, object_, u8"requestedBytes", static_cast<double>(statistics.requested_bytes));
+        set_node_property(env_, object_, u8"blockCount", static_cast<double>(statistics.block_count));
+        std::vector<double> blocksPerClass(statistics.blocks_per_class.begin(), statistics.blocks_per_class.end());
+        set_node_property(env_, object_, u8"blocksPerSizeClass", blocksPerClass);
+        set_node_property(env_, object_, u8"occupancy", statistics.occupancy);
+        set_node_property(env_, object_, u8"internalFragmentation", statistics.internal_fragmentation);
+        set_node_property(env_, object_, u8"externalFragmentation", statistics.external_fragmentation);
     }
 
     void webgl_canvas::_registerWebGL_1_0_methods(napi_env env_, napi_value object_) const
     { // from WebGL specification 1.0
-#define REGISTER_GL_FUNCTION(webglName, glFunc) set_node_property(env_, object_, u8 ## #webglName, glFunc)
+        // Every call first makes this canvas current, since the functions themselves work on the current one.
+        std::function<void()> prologue = [this]() { make_current(); };
+#define REGISTER_GL_FUNCTION(webglName, glFunc) set_node_property(env_, object_, u8 ## #webglName, create_node_function(env_, glFunc, prologue))
 
-        REGISTER_GL_FUNCTION(getContextAttributes, webgl::getContextAttributes);
         REGISTER_GL_FUNCTION(isContextLost, webgl::isContextLost);
         REGISTER_GL_FUNCTION(getSupportedExtensions, webgl::getSupportedExtensions);
         REGISTER_GL_FUNCTION(getExtension, webgl::getExtension);
@@ -943,6 +4468,8 @@ namespace teresa
         REGISTER_GL_FUNCTION(attachShader, webgl::attachShader);
         REGISTER_GL_FUNCTION(bindAttribLocation, webgl::bindAttribLocation);
         REGISTER_GL_FUNCTION(bindBuffer, webgl::bindBuffer);
+        REGISTER_GL_FUNCTION(bindBufferBase, webgl::bindBufferBase);
+        REGISTER_GL_FUNCTION(bindBufferRange, webgl::bindBufferRange);
         REGISTER_GL_FUNCTION(bindFramebuffer, webgl::bindFramebuffer);
         REGISTER_GL_FUNCTION(bindRenderbuffer, webgl::bindRenderbuffer);
         REGISTER_GL_FUNCTION(bindTexture, webgl::bindTexture);
@@ -952,6 +4479,12 @@ namespace teresa
         REGISTER_GL_FUNCTION(blendFunc, webgl::blendFunc);
         REGISTER_GL_FUNCTION(blendFuncSeparate, webgl::blendFuncSeparate);
         REGISTER_GL_FUNCTION(bufferData, webgl::bufferData);
+        REGISTER_GL_FUNCTION(bufferDataConverted, webgl::bufferDataConverted);
+        REGISTER_GL_FUNCTION(createStreamingBuffer, webgl::createStreamingBuffer);
+        REGISTER_GL_FUNCTION(acquireTransientTexture, webgl::acquireTransientTexture);
+        REGISTER_GL_FUNCTION(releaseTransientTexture, webgl::releaseTransientTexture);
+        REGISTER_GL_FUNCTION(configureTransientTexturePool, webgl::configureTransientTexturePool);
+        REGISTER_GL_FUNCTION(getTransientTexturePoolStats, webgl::getTransientTexturePoolStats);
         REGISTER_GL_FUNCTION(bufferSubData, webgl::bufferSubData);
         REGISTER_GL_FUNCTION(checkFramebufferStatus, webgl::checkFramebufferStatus);
         REGISTER_GL_FUNCTION(clear, webgl::clear);
@@ -964,6 +4497,7 @@ namespace teresa
         REGISTER_GL_FUNCTION(compressedTexSubImage2D, webgl::compressedTexSubImage2D);
         REGISTER_GL_FUNCTION(copyTexImage2D, webgl::copyTexImage2D);
         REGISTER_GL_FUNCTION(copyTexSubImage2D, webgl::copyTexSubImage2D);
+        REGISTER_GL_FUNCTION(createAtlas, webgl::createAtlas);
         REGISTER_GL_FUNCTION(createBuffer, webgl::createBuffer);
         REGISTER_GL_FUNCTION(createFramebuffer, webgl::createFramebuffer);
         REGISTER_GL_FUNCTION(createProgram, webgl::createProgram);
@@ -1004,12 +4538,16 @@ namespace teresa
         REGISTER_GL_FUNCTION(getProgramParameter, webgl::getProgramParameter);
         REGISTER_GL_FUNCTION(getProgramInfoLog, webgl::getProgramInfoLog);
         REGISTER_GL_FUNCTION(getRenderbufferParameter, webgl::getRenderbufferParameter);
+        REGISTER_GL_FUNCTION(getShaderCacheStats, webgl::getShaderCacheStats);
         REGISTER_GL_FUNCTION(getShaderParameter, webgl::getShaderParameter);
         REGISTER_GL_FUNCTION(getShaderPrecisionFormat, webgl::getShaderPrecisionFormat);
         REGISTER_GL_FUNCTION(getShaderInfoLog, webgl::getShaderInfoLog);
         REGISTER_GL_FUNCTION(getShaderSource, webgl::getShaderSource);
+        REGISTER_GL_FUNCTION(getShaderTranslationStats, webgl::getShaderTranslationStats);
         REGISTER_GL_FUNCTION(getTexParameter, webgl::getTexParameter);
+        REGISTER_GL_FUNCTION(getTranslatedShaderSource, webgl::getTranslatedShaderSource);
         REGISTER_GL_FUNCTION(getUniform, webgl::getUniform);
+        REGISTER_GL_FUNCTION(getUniformBlockIndex, webgl::getUniformBlockIndex);
         REGISTER_GL_FUNCTION(getUniformLocation, webgl::getUniformLocation);
         REGISTER_GL_FUNCTION(getVertexAttrib, webgl::getVertexAttrib);
         REGISTER_GL_FUNCTION(getVertexAttribOffset, webgl::getVertexAttribOffset);
@@ -1021,11 +4559,18 @@ namespace teresa
         REGISTER_GL_FUNCTION(isRenderbuffer, webgl::isRenderbuffer);
         REGISTER_GL_FUNCTION(isShader, webgl::isShader);
         REGISTER_GL_FUNCTION(isTexture, webgl::isTexture);
+        REGISTER_GL_FUNCTION(layoutStd140, webgl::layoutStd140);
         REGISTER_GL_FUNCTION(lineWidth, webgl::lineWidth);
+        REGISTER_GL_FUNCTION(loadBasis, webgl::loadBasis);
+        REGISTER_GL_FUNCTION(loadKTX, webgl::loadKTX);
         REGISTER_GL_FUNCTION(linkProgram, webgl::linkProgram);
         REGISTER_GL_FUNCTION(pixelStorei, webgl::pixelStorei);
+        REGISTER_GL_FUNCTION(precompileVariants, webgl::precompileVariants);
         REGISTER_GL_FUNCTION(polygonOffset, webgl::polygonOffset);
         REGISTER_GL_FUNCTION(readPixels, webgl::readPixels);
+        REGISTER_GL_FUNCTION(readPixelsToBuffer, webgl::readPixelsToBuffer);
+        REGISTER_GL_FUNCTION(texImage2DConverted, webgl::texImage2DConverted);
+        REGISTER_GL_FUNCTION(texImageFromEncoded, webgl::texImageFromEncoded);
         REGISTER_GL_FUNCTION(renderbufferStorage, webgl::renderbufferStorage);
         REGISTER_GL_FUNCTION(sampleCoverage, webgl::sampleCoverage);
         REGISTER_GL_FUNCTION(scissor, webgl::scissor);
@@ -1056,23 +4601,37 @@ namespace teresa
         REGISTER_GL_FUNCTION(uniform2iv, webgl::uniform2iv);
         REGISTER_GL_FUNCTION(uniform3iv, webgl::uniform3iv);
         REGISTER_GL_FUNCTION(uniform4iv, webgl::uniform4iv);
+        REGISTER_GL_FUNCTION(uniformBlockBinding, webgl::uniformBlockBinding);
         REGISTER_GL_FUNCTION(uniformMatrix2fv, webgl::uniformMatrix2fv);
         REGISTER_GL_FUNCTION(uniformMatrix3fv, webgl::uniformMatrix3fv);
         REGISTER_GL_FUNCTION(uniformMatrix4fv, webgl::uniformMatrix4fv);
         REGISTER_GL_FUNCTION(useProgram, webgl::useProgram);
         REGISTER_GL_FUNCTION(validateProgram, webgl::validateProgram);
-        REGISTER_GL_FUNCTION(vertexAttrib1f, glVertexAttrib1f);
-        REGISTER_GL_FUNCTION(vertexAttrib2f, glVertexAttrib2f);
-        REGISTER_GL_FUNCTION(vertexAttrib3f, glVertexAttrib3f);
-        REGISTER_GL_FUNCTION(vertexAttrib4f, glVertexAttrib4f);
+        REGISTER_GL_FUNCTION(vertexAttrib1f, webgl::vertexAttrib1f);
+        REGISTER_GL_FUNCTION(vertexAttrib2f, webgl::vertexAttrib2f);
+        REGISTER_GL_FUNCTION(vertexAttrib3f, webgl::vertexAttrib3f);
+        REGISTER_GL_FUNCTION(vertexAttrib4f, webgl::vertexAttrib4f);
         REGISTER_GL_FUNCTION(vertexAttrib1fv, webgl::vertexAttrib1fv);
         REGISTER_GL_FUNCTION(vertexAttrib2fv, webgl::vertexAttrib2fv);
         REGISTER_GL_FUNCTION(vertexAttrib3fv, webgl::vertexAttrib3fv);
         REGISTER_GL_FUNCTION(vertexAttrib4fv, webgl::vertexAttrib4fv);
-        REGISTER_GL_FUNCTION(vertexAttribPointer, glVertexAttribPointer);
-        REGISTER_GL_FUNCTION(viewport, glViewport);
+        REGISTER_GL_FUNCTION(vertexAttribPointer, webgl::vertexAttribPointer);
+        REGISTER_GL_FUNCTION(viewport, webgl::viewport);
 
 #undef REGISTER_GL_FUNCTION
+
+        // Validating entry points replace the plain ones, so that a context
+        // without validation pays nothing for it.
+        switch (_contextAttributes.validation) {
+        case webgl::Validation::fast:
+            webgl::validation::register_methods<webgl::Validation::fast>(env_, object_, prologue);
+            break;
+        case webgl::Validation::strict:
+            webgl::validation::register_methods<webgl::Validation::strict>(env_, object_, prologue);
+            break;
+        default:
+            break;
+        }
     }
 
     void webgl_canvas::_registerWebGL_1_0_properties(napi_env env_, napi_value object_) const
@@ -1151,6 +4710,16 @@ namespace teresa
         REGISTER_GL_ENUM(ARRAY_BUFFER_BINDING);
         REGISTER_GL_ENUM(ELEMENT_ARRAY_BUFFER_BINDING);
 
+        /* Uniform Buffer Objects, as in WebGL 2 */
+        REGISTER_GL_ENUM(UNIFORM_BUFFER);
+        REGISTER_GL_ENUM(UNIFORM_BUFFER_BINDING);
+        REGISTER_GL_ENUM(UNIFORM_BUFFER_START);
+        REGISTER_GL_ENUM(UNIFORM_BUFFER_SIZE);
+        REGISTER_GL_ENUM(MAX_UNIFORM_BUFFER_BINDINGS);
+        REGISTER_GL_ENUM(MAX_UNIFORM_BLOCK_SIZE);
+        REGISTER_GL_ENUM(UNIFORM_BUFFER_OFFSET_ALIGNMENT);
+        REGISTER_GL_ENUM(INVALID_INDEX);
+
         REGISTER_GL_ENUM(STREAM_DRAW);
         REGISTER_GL_ENUM(STATIC_DRAW);
         REGISTER_GL_ENUM(DYNAMIC_DRAW);
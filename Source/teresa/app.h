@@ -1,7 +1,13 @@
 
+#include "egl_context.h"
+#include "event_pump.h"
+#include "frame_capture.h"
+#include "frame_pacer.h"
 #include "glfw_window.h"
 #include "native_webgl.h"
 #include "napi_utils.h"
+#include "offscreen_framebuffer.h"
+#include "virtual_context.h"
 #include <memory>
 #include <thread>
 
@@ -13,18 +19,281 @@ namespace webgl
     using clampf_t = GLfloat;
     using int_t = GLint;
     using uint_t = GLuint;
+
+    // The power preference settings are documented in the WebGLContextAttributes
+    // section of the specification.
+    enum PowerPreference { defaulted, low_power, high_performance };
+
+    // How much of the WebGL rules is checked before a call reaches GL. Only the entry points
+    // of webgl::validation are checked, the others go straight through at every level.
+    enum class Validation
+    {
+        // Calls go straight through to GL.
+        none,
+
+        // Objects which were deleted or belong to another canvas, indices against the context
+        // limits, and buffer and index ranges, e.g. those of drawElements.
+        fast,
+
+        // As fast, plus the WebGL 1.0 enums and parameter values of those entry points, the
+        // link status of programs, and framebuffer completeness at draws.
+        strict,
+    };
+
+    struct ContextAttributes
+        :public node_compatible
+    {
+        bool alpha = true;
+        bool depth = true;
+        bool stencil = false;
+        bool antialias = true;
+        bool premultipliedAlpha = true;
+        bool preserveDrawingBuffer = false;
+        PowerPreference powerPreference = PowerPreference::defaulted;
+        bool failIfMajorPerformanceCaveat = false;
+        Validation validation = Validation::none;
+
+        // Sub-allocates small buffers out of shared arenas, see teresa::buffer_pool.
+        bool pooledBuffers = false;
+
+        // Bytes of the ring uploads are staged through, see teresa::staging_ring; 0 uploads directly.
+        std::size_t stagingBufferSize = 0;
+
+        // Renders into an offscreen drawing buffer of a surfaceless context instead of a window.
+        bool headless = false;
+
+        // Renders offscreen as well, on the one context all virtualized canvases share,
+        // see teresa::virtual_context. Cheap to create and to switch between in numbers.
+        bool virtualized = false;
+
+        // Size of the window or of the offscreen drawing buffer.
+        GLsizei width = 640;
+        GLsizei height = 480;
+
+        void from_node(napi_env env_, napi_value object_);
+
+        void to_node(napi_env env_, napi_value object_) const;
+    };
+}
+
+namespace webgl
+{
+    // Non-standard. How a canvas ends its frames, see webgl_canvas::set_present_mode().
+    struct PresentMode
+        :public node_compatible
+    {
+        // Swaps on the vertical blank. Windowed canvases only.
+        bool vsync = true;
+
+        // Frames the CPU may be ahead of the GPU, the one just flushed included; 0 for no limit.
+        std::size_t maxFramesInFlight = 2;
+
+        // Swaps on a thread of its own, so that flush() returns without waiting for the vertical blank;
+        // the next call on the canvas waits for the swap instead. Windowed canvases only.
+        bool presentThread = false;
+
+        void from_node(napi_env env_, napi_value object_);
+
+        void to_node(napi_env env_, napi_value object_) const;
+    };
+
+    // Non-standard. Where webgl_canvas::start_capture() streams the frames to.
+    struct CaptureOptions
+    {
+        // "rgba" or "yuv420".
+        teresa::capture_format format = teresa::capture_format::rgba;
+
+        // "stream" queues the frames for takeCapturedFrame(), "file" writes them to |path|
+        // and "fd" to the file descriptor |fd|.
+        teresa::capture_sink sink = teresa::capture_sink::queue;
+
+        std::string path;
+
+        int fd = -1;
+
+        // Frames waiting for conversion, and for takeCapturedFrame(), each at most.
+        std::size_t queueLength = 4;
+
+        void from_node(napi_env env_, napi_value object_);
+    };
 }
 
 namespace teresa
 {
+    // Buffer pool occupancy as seen from JavaScript; all zeros if the canvas does not pool buffers.
+    struct buffer_pool_stats
+        :public node_compatible
+    {
+        buffer_pool::statistics statistics;
+
+        buffer_pool_stats(const buffer_pool::statistics &statistics_)
+            :statistics(statistics_)
+        {
+
+        }
+
+        void to_node(napi_env env_, napi_value object_) const;
+    };
+
+    // Snapshot of the estimated GPU memory of a canvas, see native_webgl::memory_usage().
+    struct memory_stats
+        :public node_compatible
+    {
+        teresa::memory_usage usage;
+
+        memory_stats(const teresa::memory_usage &usage_)
+            :usage(usage_)
+        {
+
+        }
+
+        void to_node(napi_env env_, napi_value object_) const;
+    };
+
+    // The size a canvas was resized to, see webgl_canvas::take_resize_event().
+    struct resize_event
+        :public node_compatible
+    {
+        GLsizei width = 0;
+
+        GLsizei height = 0;
+
+        resize_event(GLsizei width_, GLsizei height_)
+            :width(width_), height(height_)
+        {
+
+        }
+
+        void to_node(napi_env env_, napi_value object_) const;
+    };
+
+    // A frame streamed by webgl_canvas::start_capture(), over pooled memory.
+    struct captured_frame
+        :public node_compatible
+    {
+        frame_capture::frame frame;
+
+        capture_format format;
+
+        captured_frame(const frame_capture::frame &frame_, capture_format format_)
+            :frame(frame_), format(format_)
+        {
+
+        }
+
+        void to_node(napi_env env_, napi_value object_) const;
+    };
+
+    struct capture_stats
+        :public node_compatible
+    {
+        frame_capture::statistics statistics;
+
+        capture_stats(const frame_capture::statistics &statistics_)
+            :statistics(statistics_)
+        {
+
+        }
+
+        void to_node(napi_env env_, napi_value object_) const;
+    };
+
+    // The input and window events of a windowed canvas since the last take, see
+    // webgl_canvas::take_events(). One Float64Array holds them all, |stride| numbers each.
+    struct event_batch
+        :public node_compatible
+    {
+        // Shared with the ArrayBuffer handed out, rather than copied into it.
+        std::shared_ptr<std::vector<double>> events;
+
+        // Events lost before this batch, see glfw_window::max_event_count.
+        std::size_t dropped = 0;
+
+        event_batch(std::vector<double> &&events_, std::size_t dropped_)
+            :events(std::make_shared<std::vector<double>>(std::move(events_))), dropped(dropped_)
+        {
+
+        }
+
+        void to_node(napi_env env_, napi_value object_) const;
+    };
+
     class webgl_canvas
         :public node_compatible
     {
     public:
-        webgl_canvas();
+        webgl_canvas(const webgl::ContextAttributes &context_attributes_);
+
+        webgl_canvas(const webgl_canvas &) = delete;
+
+        webgl_canvas& operator=(const webgl_canvas &) = delete;
+
+        // Frees the GL objects of the canvas in its own context.
+        ~webgl_canvas();
 
         void flush();
 
+        // Non-standard. Fields missing from |mode_| keep their defaults.
+        void set_present_mode(webgl::PresentMode mode_);
+
+        node_ptr<webgl::PresentMode> get_present_mode();
+
+        // Makes the context and the state of the canvas current, unless they are already.
+        void make_current() const;
+
+        // The canvas of the call in progress, which every call makes current first.
+        static const webgl_canvas& current();
+
+        // Expires with the canvas; for work which completes later and makes the canvas current again.
+        std::weak_ptr<const webgl_canvas> weak_from_this() const
+        {
+            return _self;
+        }
+
+        node_ptr<webgl::ContextAttributes> get_context_attributes();
+
+        node_ptr<buffer_pool_stats> get_buffer_pool_stats();
+
+        node_ptr<memory_stats> get_memory_stats();
+
+        // Non-standard. Copies the frame last flushed by a headless canvas into |pixels_|
+        // as RGBA8, top row first, for whatever consumes the frames instead of a screen.
+        void read_frame(data_view pixels_);
+
+        GLsizei get_width();
+
+        GLsizei get_height();
+
+        // Resize the drawing buffer, or the window of a windowed canvas.
+        void set_width(GLsizei width_);
+
+        void set_height(GLsizei height_);
+
+        GLsizei get_drawing_buffer_width();
+
+        GLsizei get_drawing_buffer_height();
+
+        // Non-standard. The latest size the drawing buffer changed to since the last call, or null.
+        // Resizes coalesce, so a canvas dragged through many sizes reports only where it ended.
+        node_ptr<resize_event> take_resize_event();
+
+        // Non-standard. Streams every frame flushed from now on to |options_|.sink, replacing
+        // the capture in progress, if any. See teresa::frame_capture.
+        void start_capture(webgl::CaptureOptions options_);
+
+        // Non-standard. Delivers the frames still in flight and ends the capture; returns its
+        // statistics, or null if there was none.
+        node_ptr<capture_stats> stop_capture();
+
+        // Non-standard. The oldest frame captured for the "stream" sink which was not taken yet, or null.
+        node_ptr<captured_frame> take_captured_frame();
+
+        node_ptr<capture_stats> get_capture_stats();
+
+        // Non-standard. The input and window events received since the last call, or null if there
+        // were none. Events are polled from the libuv loop between ticks, not by flush().
+        node_ptr<event_batch> take_events();
+
         void bind_buffer()
         {
 
@@ -36,30 +305,69 @@ namespace teresa
             _registerWebGL_1_0_properties(env_, object_);
             _registerWebGL_1_0_methods(env_, object_);
             // set_node_property(env_, object_, u8"activeTexture", );
+            set_node_property(env_, object_, u8"getContextAttributes", &webgl_canvas::get_context_attributes);
             set_node_property(env_, object_, u8"flush", &webgl_canvas::flush);
+            set_node_property(env_, object_, u8"getBufferPoolStats", &webgl_canvas::get_buffer_pool_stats);
+            set_node_property(env_, object_, u8"getMemoryStats", &webgl_canvas::get_memory_stats);
+            set_node_property(env_, object_, u8"readFrame", &webgl_canvas::read_frame);
+            set_node_property(env_, object_, u8"takeResizeEvent", &webgl_canvas::take_resize_event);
+            set_node_property(env_, object_, u8"setPresentMode", &webgl_canvas::set_present_mode);
+            set_node_property(env_, object_, u8"getPresentMode", &webgl_canvas::get_present_mode);
+            set_node_property(env_, object_, u8"startCapture", &webgl_canvas::start_capture);
+            set_node_property(env_, object_, u8"stopCapture", &webgl_canvas::stop_capture);
+            set_node_property(env_, object_, u8"takeCapturedFrame", &webgl_canvas::take_captured_frame);
+            set_node_property(env_, object_, u8"getCaptureStats", &webgl_canvas::get_capture_stats);
+            set_node_property(env_, object_, u8"takeEvents", &webgl_canvas::take_events);
+            _registerEventTypes(env_, object_);
+            set_node_accessor(env_, object_, u8"width", &webgl_canvas::get_width, &webgl_canvas::set_width);
+            set_node_accessor(env_, object_, u8"height", &webgl_canvas::get_height, &webgl_canvas::set_height);
+            set_node_accessor(env_, object_, u8"drawingBufferWidth", &webgl_canvas::get_drawing_buffer_width);
+            set_node_accessor(env_, object_, u8"drawingBufferHeight", &webgl_canvas::get_drawing_buffer_height);
         }
     private:
-        std::unique_ptr<glfw_window> _displayWindow;
+        webgl::ContextAttributes _contextAttributes;
+        // The contexts are shared with native_webgl::context_lease.
+        std::shared_ptr<glfw_window> _displayWindow;
+        // Windowed canvases only, and only within a libuv loop.
+        std::shared_ptr<event_pump> _eventPump;
+        // Headless canvases only; the drawing buffer goes before the context it lives in.
+        std::shared_ptr<egl_context> _headlessContext;
+        // Virtualized canvases only, in place of a context of their own.
+        std::shared_ptr<virtual_context> _virtualContext;
+        std::unique_ptr<offscreen_framebuffer> _drawingBuffer;
+        std::unique_ptr<virtual_state> _virtualState;
+        // Swaps the window, so it goes before.
+        std::unique_ptr<frame_pacer> _framePacer;
+        webgl::PresentMode _presentMode;
+        // Reads back through the context, so it goes before.
+        std::unique_ptr<frame_capture> _frameCapture;
         std::unique_ptr<native_webgl> _nativeWebGL;
         int _flushCount = 0;
 
-        void _registerWebGL_1_0_methods(napi_env env_, napi_value object_) const;
+        // The size of the drawing buffer as last seen.
+        GLsizei _width = 0;
+        GLsizei _height = 0;
 
-        void _registerWebGL_1_0_properties(napi_env env_, napi_value object_) const;
+        bool _resized = false;
 
-        // Flips the source data along its vertical axis if true.
-        bool GL_UNPACK_FLIP_Y_WEBGL = false;
+        // Owns nothing, it only hands out weak_from_this().
+        std::shared_ptr<const webgl_canvas> _self;
 
-        // 	Multiplies the alpha channel into the other color channels
-        bool GL_UNPACK_PREMULTIPLY_ALPHA_WEBGL = false;
+        static const webgl_canvas *_current;
 
+        void _resize(GLsizei width_, GLsizei height_);
 
-        bool GL_CONTEXT_LOST_WEBGL = false;
+        // Stops the capture in progress and frees it in the context of the canvas; its final
+        // statistics, or none if there was no capture.
+        std::optional<frame_capture::statistics> _end_capture();
 
+        // Follows a drawing buffer which has changed its size.
+        void _on_resize(GLsizei width_, GLsizei height_);
 
-        webgl::enum_t GL_BROWSER_DEFAULT_WEBGL = 0x9244;
+        void _registerWebGL_1_0_methods(napi_env env_, napi_value object_) const;
+
+        void _registerEventTypes(napi_env env_, napi_value object_) const;
 
-        // Default color space conversion or no color space conversion.
-        webgl::enum_t GL_UNPACK_COLORSPACE_CONVERSION_WEBGL = GL_BROWSER_DEFAULT_WEBGL;
+        void _registerWebGL_1_0_properties(napi_env env_, napi_value object_) const;
     };
 }
\ No newline at end of file
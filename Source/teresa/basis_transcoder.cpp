@@ -0,0 +1,229 @@
+
+#include "basis_transcoder.h"
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <transcoder/basisu_transcoder.h>
+
+namespace teresa
+{
+    transcode_targets transcode_targets::supported()
+    {
+        transcode_targets result;
+        result.astc = GLAD_GL_KHR_texture_compression_astc_ldr != 0;
+        result.bptc = GLAD_GL_ARB_texture_compression_bptc != 0 || GLAD_GL_VERSION_4_2 != 0;
+        result.etc2 = GLAD_GL_ARB_ES3_compatibility != 0 || GLAD_GL_VERSION_4_3 != 0;
+        result.s3tc = GLAD_GL_EXT_texture_compression_s3tc != 0;
+        return result;
+    }
+
+    namespace
+    {
+        using basist::transcoder_texture_format;
+
+        struct target_format
+        {
+            transcoder_texture_format format;
+
+            GLenum internalformat;
+
+            GLenum srgb_internalformat;
+
+            const char *name;
+        };
+
+        // Best first. UASTC maps to ASTC 4x4 and BC7 nearly losslessly, ETC1S to ETC1 without
+        // any loss, which ETC2 decoders read as is.
+        target_format choose_format(const transcode_targets &targets_, bool uastc_, bool alpha_)
+        {
+            if (targets_.astc && uastc_) {
+                return { transcoder_texture_format::cTFASTC_4x4_RGBA,
+                    GL_COMPRESSED_RGBA_ASTC_4x4_KHR, GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR, "ASTC_4x4" };
+            }
+            if (targets_.bptc) {
+                return { transcoder_texture_format::cTFBC7_RGBA,
+                    GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, "BC7" };
+            }
+            if (targets_.etc2) {
+                if (alpha_) {
+                    return { transcoder_texture_format::cTFETC2_RGBA,
+                        GL_COMPRESSED_RGBA8_ETC2_EAC, GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC, "ETC2_RGBA" };
+                }
+                return { transcoder_texture_format::cTFETC1_RGB,
+                    GL_COMPRESSED_RGB8_ETC2, GL_COMPRESSED_SRGB8_ETC2, "ETC1" };
+            }
+            if (targets_.s3tc) {
+                if (alpha_) {
+                    return { transcoder_texture_format::cTFBC3_RGBA,
+                        GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, "BC3" };
+                }
+                return { transcoder_texture_format::cTFBC1_RGB,
+                    GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, "BC1" };
+            }
+            return { transcoder_texture_format::cTFRGBA32, GL_RGBA8, GL_SRGB8_ALPHA8, "RGBA8" };
+        }
+
+        void init_transcoder()
+        {
+            static std::once_flag once;
+            std::call_once(once, []() { basist::basisu_transcoder_init(); });
+        }
+
+        void describe(transcoded_texture &result_, const target_format &format_, bool srgb_,
+            std::uint32_t width_, std::uint32_t height_, std::uint32_t layers_, std::uint32_t faces_, std::uint32_t levels_)
+        {
+            auto &texture = result_.texture;
+            if (faces_ == 6) {
+                texture.target = layers_ ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP;
+            }
+            else {
+                texture.target = layers_ ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+            }
+            texture.internalformat = srgb_ ? format_.srgb_internalformat : format_.internalformat;
+            if (format_.format == transcoder_texture_format::cTFRGBA32) {
+                texture.format = GL_RGBA;
+                texture.type = GL_UNSIGNED_BYTE;
+            }
+            texture.width = static_cast<GLsizei>(width_);
+            texture.height = static_cast<GLsizei>(height_);
+            texture.depth = static_cast<GLsizei>(std::max<std::uint32_t>(1, layers_) * faces_);
+            texture.levels = static_cast<GLsizei>(std::max<std::uint32_t>(1, levels_));
+            texture.unpack_alignment = 1;
+            result_.format_name = format_.name;
+        }
+
+        // Room for one transcoded image, in blocks or in pixels as the transcoder counts them.
+        std::vector<std::uint8_t> allocate_image(const target_format &format_, std::uint32_t width_, std::uint32_t height_,
+            std::uint32_t total_blocks_, std::uint32_t &capacity_)
+        {
+            capacity_ = basist::basis_transcoder_format_is_uncompressed(format_.format) ? width_ * height_ : total_blocks_;
+            return std::vector<std::uint8_t>(static_cast<std::size_t>(capacity_) * basist::basis_get_bytes_per_block_or_pixel(format_.format));
+        }
+
+        void add_image(transcoded_texture &result_, std::vector<std::uint8_t> &&data_,
+            std::uint32_t level_, std::uint32_t zoffset_, std::uint32_t width_, std::uint32_t height_)
+        {
+            ktx_image image;
+            image.level = static_cast<GLint>(level_);
+            image.zoffset = static_cast<GLint>(zoffset_);
+            image.width = static_cast<GLsizei>(width_);
+            image.height = static_cast<GLsizei>(height_);
+            image.size = data_.size();
+            result_.storage.push_back(std::move(data_));
+            image.data = result_.storage.back().data();
+            result_.texture.images.push_back(image);
+        }
+
+        transcoded_texture transcode_ktx2(const std::uint8_t *data_, std::uint32_t size_, const transcode_targets &targets_)
+        {
+            basist::ktx2_transcoder transcoder;
+            if (!transcoder.init(data_, size_)) {
+                throw std::runtime_error("Invalid KTX2 container.");
+            }
+            if (!transcoder.is_etc1s() && !transcoder.is_uastc()) {
+                throw std::runtime_error("KTX2 container holds neither ETC1S nor UASTC data.");
+            }
+            if (!transcoder.start_transcoding()) {
+                throw std::runtime_error("Failed to start transcoding.");
+            }
+
+            auto format = choose_format(targets_, transcoder.is_uastc(), transcoder.get_has_alpha());
+            auto srgb = transcoder.get_dfd_transfer_func() == basist::KTX2_KHR_DF_TRANSFER_SRGB;
+            auto layers = transcoder.get_layers();
+            auto faces = transcoder.get_faces();
+            transcoded_texture result;
+            describe(result, format, srgb, transcoder.get_width(), transcoder.get_height(), layers, faces, transcoder.get_levels());
+
+            for (std::uint32_t level = 0; level < transcoder.get_levels(); ++level) {
+                for (std::uint32_t layer = 0; layer < std::max<std::uint32_t>(1, layers); ++layer) {
+                    for (std::uint32_t face = 0; face < faces; ++face) {
+                        basist::ktx2_image_level_info info;
+                        if (!transcoder.get_image_level_info(info, level, layer, face)) {
+                            throw std::runtime_error("Invalid KTX2 level.");
+                        }
+                        std::uint32_t capacity = 0;
+                        auto image = allocate_image(format, info.m_orig_width, info.m_orig_height, info.m_total_blocks, capacity);
+                        if (!transcoder.transcode_image_level(level, layer, face, image.data(), capacity, format.format)) {
+                            throw std::runtime_error("Failed to transcode KTX2 image.");
+                        }
+                        add_image(result, std::move(image), level, layer * faces + face, info.m_orig_width, info.m_orig_height);
+                    }
+                }
+            }
+            return result;
+        }
+
+        transcoded_texture transcode_basis_file(const std::uint8_t *data_, std::uint32_t size_, const transcode_targets &targets_)
+        {
+            basist::basisu_transcoder transcoder;
+            basist::basisu_file_info file;
+            if (!transcoder.validate_header(data_, size_) || !transcoder.get_file_info(data_, size_, file)) {
+                throw std::runtime_error("Invalid Basis file.");
+            }
+            if (file.m_tex_type != basist::cBASISTexType2D && file.m_tex_type != basist::cBASISTexType2DArray &&
+                file.m_tex_type != basist::cBASISTexTypeCubemapArray) {
+                throw std::runtime_error("Unsupported Basis texture type.");
+            }
+            if (!transcoder.start_transcoding(data_, size_)) {
+                throw std::runtime_error("Failed to start transcoding.");
+            }
+
+            // Every image of a file has to share its size and level count to make one texture.
+            basist::basisu_image_info first;
+            if (!file.m_total_images || !transcoder.get_image_info(data_, size_, first, 0)) {
+                throw std::runtime_error("Basis file has no images.");
+            }
+            auto cube = file.m_tex_type == basist::cBASISTexTypeCubemapArray;
+            auto faces = cube ? 6u : 1u;
+            auto layers = file.m_total_images / faces;
+            if (cube && file.m_total_images % 6) {
+                throw std::runtime_error("Basis cube map array has a partial cube map.");
+            }
+            // A single cube map is a plain one, not an array.
+            auto arrayLayers = file.m_tex_type == basist::cBASISTexType2D || (cube && layers == 1) ? 0 : layers;
+            auto uastc = file.m_tex_format == basist::basis_tex_format::cUASTC4x4;
+            auto format = choose_format(targets_, uastc, file.m_has_alpha_slices);
+            auto header = reinterpret_cast<const basist::basis_file_header*>(data_);
+            auto srgb = (static_cast<std::uint32_t>(header->m_flags) & basist::cBASISHeaderFlagSRGB) != 0;
+            transcoded_texture result;
+            describe(result, format, srgb, first.m_orig_width, first.m_orig_height, arrayLayers, faces, first.m_total_levels);
+
+            for (std::uint32_t index = 0; index < file.m_total_images; ++index) {
+                basist::basisu_image_info info;
+                if (!transcoder.get_image_info(data_, size_, info, index) ||
+                    info.m_orig_width != first.m_orig_width || info.m_orig_height != first.m_orig_height || info.m_total_levels != first.m_total_levels) {
+                    throw std::runtime_error("Basis images differ in size.");
+                }
+                for (std::uint32_t level = 0; level < info.m_total_levels; ++level) {
+                    std::uint32_t width = 0;
+                    std::uint32_t height = 0;
+                    std::uint32_t totalBlocks = 0;
+                    if (!transcoder.get_image_level_desc(data_, size_, index, level, width, height, totalBlocks)) {
+                        throw std::runtime_error("Invalid Basis level.");
+                    }
+                    std::uint32_t capacity = 0;
+                    auto image = allocate_image(format, width, height, totalBlocks, capacity);
+                    if (!transcoder.transcode_image_level(data_, size_, index, level, image.data(), capacity, format.format)) {
+                        throw std::runtime_error("Failed to transcode Basis image.");
+                    }
+                    add_image(result, std::move(image), level, index, width, height);
+                }
+            }
+            return result;
+        }
+    }
+
+    transcoded_texture transcode_basis(const std::uint8_t *data_, std::size_t size_, const transcode_targets &targets_)
+    {
+        if (size_ > 0xFFFFFFFF) {
+            throw std::runtime_error("Basis texture is too large.");
+        }
+        init_transcoder();
+        auto size = static_cast<std::uint32_t>(size_);
+        const std::uint8_t ktx2Identifier[] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB };
+        if (size >= sizeof(ktx2Identifier) && std::equal(ktx2Identifier, ktx2Identifier + sizeof(ktx2Identifier), data_)) {
+            return transcode_ktx2(data_, size, targets_);
+        }
+        return transcode_basis_file(data_, size, targets_);
+    }
+}
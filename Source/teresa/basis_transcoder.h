@@ -0,0 +1,40 @@
+
+#pragma once
+
+#include "ktx_container.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace teresa
+{
+    // Compressed formats the context can sample, which Basis Universal textures may be transcoded to.
+    struct transcode_targets
+    {
+        bool astc = false;
+
+        bool bptc = false;
+
+        bool etc2 = false;
+
+        bool s3tc = false;
+
+        // Reads the extensions of the current context.
+        static transcode_targets supported();
+    };
+
+    struct transcoded_texture
+    {
+        // Its images point into |storage|.
+        ktx_texture texture;
+
+        std::vector<std::vector<std::uint8_t>> storage;
+
+        // Name of the format transcoded to, such as "BC7" or "RGBA8" for the software fallback.
+        const char *format_name = "";
+    };
+
+    // Transcodes a .basis file, or a KTX2 container of ETC1S or UASTC data, to the best of
+    // |targets_|, falling back to uncompressed RGBA8. Safe to call from any thread.
+    transcoded_texture transcode_basis(const std::uint8_t *data_, std::size_t size_, const transcode_targets &targets_);
+}
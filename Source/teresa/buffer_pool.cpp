@@ -0,0 +1,156 @@
+
+#include "buffer_pool.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace teresa
+{
+    buffer_pool::buffer_pool(std::size_t arena_size_)
+        :_arenaSize(std::max(arena_size_ / page_size, std::size_t(1)) * page_size)
+    {
+
+    }
+
+    buffer_pool::~buffer_pool()
+    {
+        if (!_arenas.empty()) {
+            glDeleteBuffers(static_cast<GLsizei>(_arenas.size()), _arenas.data());
+        }
+    }
+
+    bool buffer_pool::try_resize(block &block_, std::size_t size_)
+    {
+        if (!block_ || !is_poolable(size_) || _size_class_of(size_) != _pages[block_.page].size_class) {
+            return false;
+        }
+        _requestedBytes = _requestedBytes - block_.size + size_;
+        block_.size = size_;
+        return true;
+    }
+
+    buffer_pool::block buffer_pool::allocate(std::size_t size_)
+    {
+        if (!is_poolable(size_)) {
+            throw std::runtime_error("Allocation is too large for the buffer pool.");
+        }
+        auto sizeClass = _size_class_of(size_);
+        auto &partialPages = _partialPages[sizeClass];
+        if (partialPages.empty()) {
+            partialPages.push_back(_acquire_page(sizeClass));
+        }
+
+        auto pageIndex = partialPages.back();
+        auto &page = _pages[pageIndex];
+        block result;
+        result.gl_handle = page.gl_handle;
+        result.slot = page.free_slots.back();
+        result.offset = page.offset + static_cast<GLintptr>(result.slot * _block_size_of(sizeClass));
+        result.size = size_;
+        result.page = pageIndex;
+        page.free_slots.pop_back();
+        ++page.used;
+        if (page.free_slots.empty()) {
+            partialPages.pop_back();
+        }
+        _requestedBytes += size_;
+        return result;
+    }
+
+    void buffer_pool::free(block &block_)
+    {
+        if (!block_) {
+            return;
+        }
+        auto &page = _pages[block_.page];
+        auto &partialPages = _partialPages[page.size_class];
+        if (page.free_slots.empty()) {
+            partialPages.push_back(block_.page);
+        }
+        page.free_slots.push_back(block_.slot);
+        --page.used;
+        _requestedBytes -= block_.size;
+
+        if (!page.used) {
+            partialPages.erase(std::find(partialPages.begin(), partialPages.end(), block_.page));
+            page.free_slots.clear();
+            _freePages.push_back(block_.page);
+        }
+        block_ = block();
+    }
+
+    buffer_pool::statistics buffer_pool::stats() const
+    {
+        statistics result;
+        result.arena_count = _arenas.size();
+        result.arena_size = _arenaSize;
+        result.reserved_bytes = _arenas.size() * _arenaSize;
+        result.requested_bytes = _requestedBytes;
+
+        std::size_t freeBytesInUsedPages = 0;
+        for (auto &page : _pages) {
+            if (!page.used) {
+                continue;
+            }
+            auto blockSize = _block_size_of(page.size_class);
+            result.committed_bytes += page_size;
+            result.allocated_bytes += page.used * blockSize;
+            result.block_count += page.used;
+            result.blocks_per_class[page.size_class] += page.used;
+            freeBytesInUsedPages += page.free_slots.size() * blockSize;
+        }
+        if (result.reserved_bytes) {
+            result.occupancy = static_cast<double>(result.allocated_bytes) / result.reserved_bytes;
+        }
+        if (result.allocated_bytes) {
+            result.internal_fragmentation = 1.0 - static_cast<double>(result.requested_bytes) / result.allocated_bytes;
+        }
+        if (result.committed_bytes) {
+            result.external_fragmentation = static_cast<double>(freeBytesInUsedPages) / result.committed_bytes;
+        }
+        return result;
+    }
+
+    std::size_t buffer_pool::_size_class_of(std::size_t size_)
+    {
+        std::size_t sizeClass = 0;
+        while (_block_size_of(sizeClass) < size_) {
+            ++sizeClass;
+        }
+        return sizeClass;
+    }
+
+    std::size_t buffer_pool::_acquire_page(std::size_t size_class_)
+    {
+        std::size_t pageIndex = 0;
+        if (!_freePages.empty()) {
+            pageIndex = _freePages.back();
+            _freePages.pop_back();
+        }
+        else {
+            if (!_arenaTail) {
+                GLuint h;
+                glCreateBuffers(1, &h);
+                glNamedBufferData(h, static_cast<GLsizeiptr>(_arenaSize), nullptr, GL_DYNAMIC_DRAW);
+                _arenas.push_back(h);
+                _arenaTail = _arenaSize;
+            }
+            _page page;
+            page.gl_handle = _arenas.back();
+            page.offset = static_cast<GLintptr>(_arenaSize - _arenaTail);
+            _arenaTail -= page_size;
+            pageIndex = _pages.size();
+            _pages.push_back(page);
+        }
+
+        auto &page = _pages[pageIndex];
+        auto blockCount = static_cast<std::uint32_t>(page_size / _block_size_of(size_class_));
+        page.size_class = size_class_;
+        page.used = 0;
+        page.free_slots.resize(blockCount);
+        for (std::uint32_t slot = 0; slot < blockCount; ++slot) {
+            // Hand out low slots first.
+            page.free_slots[slot] = blockCount - 1 - slot;
+        }
+        return pageIndex;
+    }
+}
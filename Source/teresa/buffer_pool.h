@@ -0,0 +1,144 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace teresa
+{
+    // Carves small buffers out of a few large GL buffers ("arenas").
+    //
+    // Arenas are split into pages, every page serves a single size class
+    // (powers of two from |min_block_size| to |max_block_size|) and is split
+    // into equal blocks. Pages whose blocks are all free go back to the arena.
+    class buffer_pool
+    {
+    public:
+        constexpr static std::size_t min_block_size = 256;
+
+        constexpr static std::size_t max_block_size = 64 * 1024;
+
+        constexpr static std::size_t page_size = max_block_size;
+
+        constexpr static std::size_t default_arena_size = 4 * 1024 * 1024;
+
+        constexpr static std::size_t size_class_count = 9;
+
+        struct block
+        {
+            // The arena, or 0 if this block is not allocated.
+            GLuint gl_handle = 0;
+
+            // Where the block starts within the arena.
+            GLintptr offset = 0;
+
+            // Bytes requested by the owner.
+            std::size_t size = 0;
+
+            std::size_t page = 0;
+
+            std::uint32_t slot = 0;
+
+            explicit operator bool() const
+            {
+                return gl_handle != 0;
+            }
+        };
+
+        struct statistics
+        {
+            std::size_t arena_count = 0;
+
+            std::size_t arena_size = 0;
+
+            // Bytes of GL buffer storage owned by the pool.
+            std::size_t reserved_bytes = 0;
+
+            // Bytes of pages handed to some size class.
+            std::size_t committed_bytes = 0;
+
+            // Bytes of blocks in use, rounded up to their size class.
+            std::size_t allocated_bytes = 0;
+
+            // Bytes the owners of the blocks asked for.
+            std::size_t requested_bytes = 0;
+
+            std::size_t block_count = 0;
+
+            std::array<std::size_t, size_class_count> blocks_per_class = {};
+
+            // allocated / reserved.
+            double occupancy = 0;
+
+            // Share of allocated bytes lost to size class rounding.
+            double internal_fragmentation = 0;
+
+            // Share of committed bytes sitting in free blocks of partially used pages.
+            double external_fragmentation = 0;
+        };
+
+        explicit buffer_pool(std::size_t arena_size_ = default_arena_size);
+
+        buffer_pool(const buffer_pool &) = delete;
+
+        buffer_pool& operator=(const buffer_pool &) = delete;
+
+        ~buffer_pool();
+
+        static bool is_poolable(std::size_t size_)
+        {
+            return size_ <= max_block_size;
+        }
+
+        // Lets |block_| hold |size_| bytes without moving, if its size class allows.
+        bool try_resize(block &block_, std::size_t size_);
+
+        block allocate(std::size_t size_);
+
+        void free(block &block_);
+
+        statistics stats() const;
+
+        // GL buffer storage owned by the pool, cheaper than stats().
+        std::size_t reserved_bytes() const
+        {
+            return _arenas.size() * _arenaSize;
+        }
+    private:
+        struct _page
+        {
+            GLuint gl_handle = 0;
+            GLintptr offset = 0;
+            std::size_t size_class = 0;
+            std::size_t used = 0;
+            std::vector<std::uint32_t> free_slots;
+        };
+
+        std::size_t _arenaSize;
+
+        std::vector<GLuint> _arenas;
+
+        // Bytes of the last arena which were never handed to a page.
+        std::size_t _arenaTail = 0;
+
+        std::vector<_page> _pages;
+
+        std::vector<std::size_t> _freePages;
+
+        // Pages of each size class which have free blocks.
+        std::array<std::vector<std::size_t>, size_class_count> _partialPages;
+
+        std::size_t _requestedBytes = 0;
+
+        static std::size_t _size_class_of(std::size_t size_);
+
+        static std::size_t _block_size_of(std::size_t size_class_)
+        {
+            return min_block_size << size_class_;
+        }
+
+        std::size_t _acquire_page(std::size_t size_class_);
+    };
+}
@@ -0,0 +1,73 @@
+
+#include "cpu_features.h"
+
+#if defined(TERESA_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace teresa
+{
+    namespace
+    {
+#if defined(TERESA_X86)
+        void cpuid(int leaf_, int subleaf_, unsigned registers_[4])
+        {
+#if defined(_MSC_VER)
+            int result[4];
+            __cpuidex(result, leaf_, subleaf_);
+            for (int i = 0; i < 4; ++i) {
+                registers_[i] = static_cast<unsigned>(result[i]);
+            }
+#else
+            __cpuid_count(leaf_, subleaf_, registers_[0], registers_[1], registers_[2], registers_[3]);
+#endif
+        }
+
+        // Whether the OS saves the YMM registers on context switches.
+        bool os_saves_ymm()
+        {
+#if defined(_MSC_VER)
+            auto xcr0 = _xgetbv(0);
+#else
+            unsigned eax = 0;
+            unsigned edx = 0;
+            __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            auto xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+            return (xcr0 & 0x6) == 0x6;
+        }
+#endif
+
+        cpu_features detect()
+        {
+            cpu_features result;
+#if defined(TERESA_X86)
+            unsigned registers[4] = {};
+            cpuid(0, 0, registers);
+            auto maxLeaf = registers[0];
+
+            cpuid(1, 0, registers);
+            auto ecx = registers[2];
+            result.sse41 = (ecx >> 19) & 1;
+            auto avx = ((ecx >> 28) & 1) && ((ecx >> 27) & 1) && os_saves_ymm();
+            result.f16c = avx && ((ecx >> 29) & 1);
+
+            if (avx && maxLeaf >= 7) {
+                cpuid(7, 0, registers);
+                result.avx2 = (registers[1] >> 5) & 1;
+            }
+#endif
+            return result;
+        }
+    }
+
+    const cpu_features& cpu_features::get()
+    {
+        static const cpu_features features = detect();
+        return features;
+    }
+}
@@ -0,0 +1,30 @@
+
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TERESA_X86 1
+#include <immintrin.h>
+#endif
+
+// Marks a function as compiled for an instruction set beyond the baseline, so
+// that its intrinsics may be used. MSVC accepts intrinsics anywhere.
+#if defined(TERESA_X86) && !defined(_MSC_VER)
+#define TERESA_TARGET(isa) __attribute__((target(isa)))
+#else
+#define TERESA_TARGET(isa)
+#endif
+
+namespace teresa
+{
+    // Instruction sets usable on this machine, detected once.
+    struct cpu_features
+    {
+        bool sse41 = false;
+
+        bool avx2 = false;
+
+        bool f16c = false;
+
+        static const cpu_features& get();
+    };
+}
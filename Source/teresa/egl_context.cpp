@@ -0,0 +1,156 @@
+
+#include "egl_context.h"
+#include <glad/glad.h>
+#include <map>
+#include <stdexcept>
+
+#if defined(TERESA_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+namespace teresa
+{
+    namespace
+    {
+        // Contexts per initialized display. eglInitialize() on an initialized display hands out
+        // the same one again, and eglTerminate() would pull it from under every other context.
+        std::map<EGLDisplay, std::size_t> display_references;
+
+        EGLDisplay initialize_display()
+        {
+            // Mesa's surfaceless platform needs neither a display server nor a GPU.
+            auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+            if (getPlatformDisplay) {
+                auto display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+                if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) {
+                    return display;
+                }
+            }
+            auto display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+                throw std::runtime_error("Couldn't initialize EGL.");
+            }
+            return display;
+        }
+
+        EGLDisplay open_display()
+        {
+            auto display = initialize_display();
+            ++display_references[display];
+            return display;
+        }
+
+        void close_display(EGLDisplay display_)
+        {
+            auto reference = display_references.find(display_);
+            if (reference == display_references.end() || --reference->second) {
+                return;
+            }
+            display_references.erase(reference);
+            eglTerminate(display_);
+        }
+    }
+
+    egl_context::egl_context()
+    {
+        auto display = open_display();
+        _display = display;
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            close_display(display);
+            throw std::runtime_error("EGL doesn't support desktop OpenGL.");
+        }
+
+        // Any surface type, as the default asks for windows, which surfaceless configs lack.
+        const EGLint configAttributes[] = { EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config = nullptr;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || !configCount) {
+            close_display(display);
+            throw std::runtime_error("No EGL config supports desktop OpenGL.");
+        }
+
+        // The direct state access the canvas relies on is GL 4.5; the compatibility profile
+        // matches the contexts GLFW creates for windows.
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 5,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+            EGL_NONE,
+        };
+        auto context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT) {
+            context = eglCreateContext(display, config, EGL_NO_CONTEXT, nullptr);
+        }
+        if (context == EGL_NO_CONTEXT) {
+            close_display(display);
+            throw std::runtime_error("Couldn't create an EGL context.");
+        }
+        _context = context;
+    }
+
+    egl_context::~egl_context()
+    {
+        if (eglGetCurrentContext() == _context) {
+            eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        }
+        eglDestroyContext(_display, _context);
+        close_display(_display);
+    }
+
+    void egl_context::make_current() const
+    {
+        // Surfaceless, as all drawing goes to framebuffer objects.
+        if (!eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context)) {
+            throw std::runtime_error("Couldn't make the EGL context current.");
+        }
+    }
+
+    void egl_context::load_gl() const
+    {
+        make_current();
+        if (!gladLoadGLLoader((GLADloadproc)get_proc_address)) {
+            throw std::runtime_error("Failed to initialize OpenGL context");
+        }
+        if (!GLAD_GL_VERSION_4_5) {
+            throw std::runtime_error("headless GL 4.5 unavailable");
+        }
+    }
+
+    void* egl_context::get_proc_address(const char *name_)
+    {
+        return reinterpret_cast<void*>(eglGetProcAddress(name_));
+    }
+}
+#else
+namespace teresa
+{
+    egl_context::egl_context()
+    {
+        throw std::runtime_error("Headless canvases need a build with EGL.");
+    }
+
+    egl_context::~egl_context()
+    {
+
+    }
+
+    void egl_context::make_current() const
+    {
+
+    }
+
+    void egl_context::load_gl() const
+    {
+
+    }
+
+    void* egl_context::get_proc_address(const char *name_)
+    {
+        return nullptr;
+    }
+}
+#endif
@@ -0,0 +1,34 @@
+
+#pragma once
+
+namespace teresa
+{
+    // A GL context of its own without any surface, for canvases rendering offscreen on machines
+    // without a display, e.g. on Mesa's llvmpipe. Needs a build with EGL, see TERESA_EGL.
+    class egl_context
+    {
+    public:
+        egl_context();
+
+        egl_context(const egl_context &) = delete;
+
+        egl_context& operator=(const egl_context &) = delete;
+
+        ~egl_context();
+
+        void make_current() const;
+
+        // Makes the context current and loads the GL entry points from it. Throws if the
+        // context falls short of GL 4.5, which the fallback without version attributes may.
+        void load_gl() const;
+
+        // For loading GL entry points, as glfwGetProcAddress() is for windows.
+        static void* get_proc_address(const char *name_);
+    private:
+        // EGLDisplay and EGLContext, kept opaque so that EGL headers stay out of the build without it.
+        // The display is shared by every context and only terminated with the last of them.
+        void *_display = nullptr;
+
+        void *_context = nullptr;
+    };
+}
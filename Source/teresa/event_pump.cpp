@@ -0,0 +1,124 @@
+
+#include "event_pump.h"
+#include <GLFW/glfw3.h>
+#include <uv.h>
+
+#if defined(TERESA_X11)
+#define GLFW_EXPOSE_NATIVE_X11
+#endif
+#if defined(TERESA_WAYLAND)
+#define GLFW_EXPOSE_NATIVE_WAYLAND
+#include <wayland-client.h>
+#endif
+#if defined(TERESA_X11) || defined(TERESA_WAYLAND)
+#include <GLFW/glfw3native.h>
+#endif
+
+namespace teresa
+{
+    namespace
+    {
+        // The file descriptor of the connection to the display server, or -1 if there is none to wait on.
+        int display_fd()
+        {
+#if defined(TERESA_WAYLAND)
+            if (auto display = glfwGetWaylandDisplay()) {
+                return wl_display_get_fd(display);
+            }
+#endif
+#if defined(TERESA_X11)
+            if (auto display = glfwGetX11Display()) {
+                return ConnectionNumber(display);
+            }
+#endif
+            return -1;
+        }
+
+        template <typename Handle>
+        void close_handle(Handle *handle_)
+        {
+            uv_close(reinterpret_cast<uv_handle_t*>(handle_), [](uv_handle_t *closed_) {
+                delete reinterpret_cast<Handle*>(closed_);
+            });
+        }
+    }
+
+    uv_loop_s *event_pump::_loop = nullptr;
+
+    void event_pump::set_loop(uv_loop_s *loop_)
+    {
+        _loop = loop_;
+    }
+
+    std::shared_ptr<event_pump> event_pump::acquire()
+    {
+        static std::weak_ptr<event_pump> shared;
+        if (!_loop) {
+            return nullptr;
+        }
+        auto pump = shared.lock();
+        if (!pump) {
+            pump.reset(new event_pump(_loop));
+            shared = pump;
+        }
+        return pump;
+    }
+
+    event_pump::event_pump(uv_loop_s *loop_)
+        :_loopTime(uv_now(loop_))
+    {
+        auto interval = poll_interval;
+        auto fd = display_fd();
+        if (fd >= 0) {
+            _displayPoll = new uv_poll_t;
+            uv_poll_init(loop_, _displayPoll, fd);
+            _displayPoll->data = this;
+            uv_poll_start(_displayPoll, UV_READABLE, [](uv_poll_t *poll_, int status_, int events_) {
+                if (status_ < 0) {
+                    // The connection broke; the timer keeps polling.
+                    uv_poll_stop(poll_);
+                    return;
+                }
+                static_cast<event_pump*>(poll_->data)->_poll();
+            });
+            // Pending events keep nothing alive, the application decides when to exit.
+            uv_unref(reinterpret_cast<uv_handle_t*>(_displayPoll));
+            interval = fallback_poll_interval;
+        }
+
+        _timer = new uv_timer_t;
+        uv_timer_init(loop_, _timer);
+        _timer->data = this;
+        auto milliseconds = static_cast<std::uint64_t>(interval.count());
+        uv_timer_start(_timer, [](uv_timer_t *timer_) {
+            static_cast<event_pump*>(timer_->data)->_poll();
+        }, milliseconds, milliseconds);
+        uv_unref(reinterpret_cast<uv_handle_t*>(_timer));
+    }
+
+    event_pump::~event_pump()
+    {
+        // The handles go once the loop is done with them.
+        uv_timer_stop(_timer);
+        close_handle(_timer);
+        if (_displayPoll) {
+            uv_poll_stop(_displayPoll);
+            close_handle(_displayPoll);
+        }
+    }
+
+    void event_pump::poll_if_stale()
+    {
+        auto loopTime = uv_now(_loop);
+        if (loopTime != _loopTime) {
+            _loopTime = loopTime;
+            return;
+        }
+        _poll();
+    }
+
+    void event_pump::_poll()
+    {
+        glfwPollEvents();
+    }
+}
@@ -0,0 +1,57 @@
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+struct uv_loop_s;
+struct uv_timer_s;
+struct uv_poll_s;
+
+namespace teresa
+{
+    // Polls GLFW from the libuv loop of the JavaScript thread, so that input and window events
+    // are handled between ticks instead of inside flush(). Polls at most every |poll_interval|;
+    // where GLFW exposes its display connection (X11, Wayland), waits for the connection to
+    // become readable instead, polling rarely as a fallback. One pump serves every window, as
+    // GLFW polls them all at once.
+    class event_pump
+    {
+    public:
+        constexpr static std::chrono::milliseconds poll_interval{ 4 };
+
+        // Polls while waiting on the display connection, for events already read off it
+        // by someone else, such as a buffer swap.
+        constexpr static std::chrono::milliseconds fallback_poll_interval{ 16 };
+
+        // The loop to run on, given by the module on initialization.
+        static void set_loop(uv_loop_s *loop_);
+
+        // The pump of the loop, started by the first windowed canvas; null if there is no loop.
+        static std::shared_ptr<event_pump> acquire();
+
+        event_pump(const event_pump &) = delete;
+
+        event_pump& operator=(const event_pump &) = delete;
+
+        ~event_pump();
+
+        // Polls unless the loop has run since the last call. For flush(), so that a render
+        // loop which never yields to the libuv loop still has its events polled.
+        void poll_if_stale();
+    private:
+        uv_timer_s *_timer = nullptr;
+
+        uv_poll_s *_displayPoll = nullptr;
+
+        // uv_now() at the last poll_if_stale(), which only changes as the loop runs.
+        std::uint64_t _loopTime = 0;
+
+        static uv_loop_s *_loop;
+
+        explicit event_pump(uv_loop_s *loop_);
+
+        void _poll();
+    };
+}
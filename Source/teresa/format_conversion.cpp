@@ -0,0 +1,338 @@
+
+#include "format_conversion.h"
+#include "cpu_features.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace teresa
+{
+    namespace
+    {
+        // Below this many elements a conversion is not worth splitting across threads.
+        constexpr std::size_t parallel_grain = 64 * 1024;
+
+        std::uint32_t float_bits(float value_)
+        {
+            std::uint32_t bits;
+            std::memcpy(&bits, &value_, sizeof(bits));
+            return bits;
+        }
+
+        float bits_float(std::uint32_t bits_)
+        {
+            float value;
+            std::memcpy(&value, &bits_, sizeof(value));
+            return value;
+        }
+
+        // Rounds to nearest even like F16C, with subnormals, infinities and NaNs.
+        std::uint16_t float_to_half(float value_)
+        {
+            auto bits = float_bits(value_);
+            auto sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000);
+            bits &= 0x7FFFFFFF;
+            if (bits >= 0x7F800000) {
+                // Infinity, or NaN kept quiet.
+                return sign | 0x7C00 | (bits > 0x7F800000 ? 0x200 | ((bits >> 13) & 0x3FF) : 0);
+            }
+            if (bits >= 0x477FF000) {
+                // Rounds up to infinity.
+                return sign | 0x7C00;
+            }
+            if (bits < 0x38800000) {
+                // Subnormal or zero: adding 0.5 lines the half mantissa up with the bottom bits and rounds it.
+                return sign | static_cast<std::uint16_t>(float_bits(bits_float(bits) + 0.5f) - float_bits(0.5f));
+            }
+            auto odd = (bits >> 13) & 1;
+            bits += (static_cast<std::uint32_t>(15 - 127) << 23) + 0xFFF + odd;
+            return sign | static_cast<std::uint16_t>(bits >> 13);
+        }
+
+        void float16_scalar(std::uint16_t *destination_, const float *source_, std::size_t count_)
+        {
+            for (std::size_t i = 0; i < count_; ++i) {
+                destination_[i] = float_to_half(source_[i]);
+            }
+        }
+
+        void unorm8_scalar(std::uint8_t *destination_, const float *source_, std::size_t count_)
+        {
+            for (std::size_t i = 0; i < count_; ++i) {
+                // NaN becomes 0, as with the vector kernel.
+                auto value = source_[i] > 0.0f ? std::min(source_[i], 1.0f) : 0.0f;
+                destination_[i] = static_cast<std::uint8_t>(std::nearbyint(value * 255.0f));
+            }
+        }
+
+        void snorm16_scalar(std::int16_t *destination_, const float *source_, std::size_t count_)
+        {
+            for (std::size_t i = 0; i < count_; ++i) {
+                auto value = source_[i] > -1.0f ? std::min(source_[i], 1.0f) : -1.0f;
+                destination_[i] = static_cast<std::int16_t>(std::nearbyint(value * 32767.0f));
+            }
+        }
+
+        void rgb565_scalar(std::uint16_t *destination_, const std::uint8_t *source_, std::size_t count_)
+        {
+            for (std::size_t i = 0; i < count_; ++i, source_ += 4) {
+                destination_[i] = static_cast<std::uint16_t>(((source_[0] >> 3) << 11) | ((source_[1] >> 2) << 5) | (source_[2] >> 3));
+            }
+        }
+
+        void rgba4444_scalar(std::uint16_t *destination_, const std::uint8_t *source_, std::size_t count_)
+        {
+            for (std::size_t i = 0; i < count_; ++i, source_ += 4) {
+                destination_[i] = static_cast<std::uint16_t>(
+                    ((source_[0] >> 4) << 12) | ((source_[1] >> 4) << 8) | ((source_[2] >> 4) << 4) | (source_[3] >> 4));
+            }
+        }
+
+#if defined(TERESA_X86)
+        TERESA_TARGET("avx,f16c")
+        std::size_t float16_f16c(std::uint16_t *destination_, const float *source_, std::size_t count_)
+        {
+            std::size_t i = 0;
+            for (; i + 8 <= count_; i += 8) {
+                auto halves = _mm256_cvtps_ph(_mm256_loadu_ps(source_ + i), _MM_FROUND_TO_NEAREST_INT);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(destination_ + i), halves);
+            }
+            return i;
+        }
+
+        // Clamps and scales, NaN ending up at |low_| as max() returns its second operand; rounds to nearest even.
+        TERESA_TARGET("avx2")
+        inline __m256i normalize_avx2(__m256 values_, __m256 low_, __m256 high_, __m256 scale_)
+        {
+            auto clamped = _mm256_min_ps(_mm256_max_ps(values_, low_), high_);
+            return _mm256_cvtps_epi32(_mm256_mul_ps(clamped, scale_));
+        }
+
+        TERESA_TARGET("avx2")
+        std::size_t unorm8_avx2(std::uint8_t *destination_, const float *source_, std::size_t count_)
+        {
+            auto low = _mm256_setzero_ps();
+            auto high = _mm256_set1_ps(1.0f);
+            auto scale = _mm256_set1_ps(255.0f);
+            // Packing works within 128-bit lanes, this puts the 4-byte groups back in order.
+            auto order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+            std::size_t i = 0;
+            for (; i + 32 <= count_; i += 32) {
+                auto a = normalize_avx2(_mm256_loadu_ps(source_ + i), low, high, scale);
+                auto b = normalize_avx2(_mm256_loadu_ps(source_ + i + 8), low, high, scale);
+                auto c = normalize_avx2(_mm256_loadu_ps(source_ + i + 16), low, high, scale);
+                auto d = normalize_avx2(_mm256_loadu_ps(source_ + i + 24), low, high, scale);
+                auto bytes = _mm256_packus_epi16(_mm256_packus_epi32(a, b), _mm256_packus_epi32(c, d));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination_ + i), _mm256_permutevar8x32_epi32(bytes, order));
+            }
+            return i;
+        }
+
+        TERESA_TARGET("avx2")
+        std::size_t snorm16_avx2(std::int16_t *destination_, const float *source_, std::size_t count_)
+        {
+            auto low = _mm256_set1_ps(-1.0f);
+            auto high = _mm256_set1_ps(1.0f);
+            auto scale = _mm256_set1_ps(32767.0f);
+            std::size_t i = 0;
+            for (; i + 16 <= count_; i += 16) {
+                auto a = normalize_avx2(_mm256_loadu_ps(source_ + i), low, high, scale);
+                auto b = normalize_avx2(_mm256_loadu_ps(source_ + i + 8), low, high, scale);
+                auto shorts = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination_ + i), shorts);
+            }
+            return i;
+        }
+
+        // Packs eight 32-bit lanes of 16-bit values and eight more into sixteen shorts, in order.
+        TERESA_TARGET("avx2")
+        inline __m256i pack_shorts_avx2(__m256i a_, __m256i b_)
+        {
+            return _mm256_permute4x64_epi64(_mm256_packus_epi32(a_, b_), 0xD8);
+        }
+
+        TERESA_TARGET("avx2")
+        inline __m256i rgb565_pixels_avx2(__m256i pixels_)
+        {
+            auto r = _mm256_slli_epi32(_mm256_and_si256(pixels_, _mm256_set1_epi32(0xF8)), 8);
+            auto g = _mm256_srli_epi32(_mm256_and_si256(pixels_, _mm256_set1_epi32(0xFC00)), 5);
+            auto b = _mm256_srli_epi32(_mm256_and_si256(pixels_, _mm256_set1_epi32(0xF80000)), 19);
+            return _mm256_or_si256(_mm256_or_si256(r, g), b);
+        }
+
+        TERESA_TARGET("avx2")
+        inline __m256i rgba4444_pixels_avx2(__m256i pixels_)
+        {
+            auto r = _mm256_slli_epi32(_mm256_and_si256(pixels_, _mm256_set1_epi32(0xF0)), 8);
+            auto g = _mm256_srli_epi32(_mm256_and_si256(pixels_, _mm256_set1_epi32(0xF000)), 4);
+            auto b = _mm256_srli_epi32(_mm256_and_si256(pixels_, _mm256_set1_epi32(0xF00000)), 16);
+            auto a = _mm256_srli_epi32(pixels_, 28);
+            return _mm256_or_si256(_mm256_or_si256(r, g), _mm256_or_si256(b, a));
+        }
+
+        TERESA_TARGET("avx2")
+        inline __m256i pack_pixels_avx2(conversion conversion_, __m256i pixels_)
+        {
+            return conversion_ == conversion::rgb565 ? rgb565_pixels_avx2(pixels_) : rgba4444_pixels_avx2(pixels_);
+        }
+
+        TERESA_TARGET("avx2")
+        std::size_t pack_pixels_avx2(conversion conversion_, std::uint16_t *destination_, const std::uint8_t *source_, std::size_t count_)
+        {
+            std::size_t i = 0;
+            for (; i + 16 <= count_; i += 16) {
+                auto a = pack_pixels_avx2(conversion_, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source_ + i * 4)));
+                auto b = pack_pixels_avx2(conversion_, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source_ + i * 4 + 32)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination_ + i), pack_shorts_avx2(a, b));
+            }
+            return i;
+        }
+#endif
+
+        void convert_serial(conversion conversion_, void *destination_, const void *source_, std::size_t count_)
+        {
+            auto floats = static_cast<const float*>(source_);
+            auto pixels = static_cast<const std::uint8_t*>(source_);
+            std::size_t done = 0;
+#if defined(TERESA_X86)
+            auto &features = cpu_features::get();
+#endif
+            switch (conversion_) {
+            case conversion::float16: {
+                auto destination = static_cast<std::uint16_t*>(destination_);
+#if defined(TERESA_X86)
+                if (features.f16c) {
+                    done = float16_f16c(destination, floats, count_);
+                }
+#endif
+                float16_scalar(destination + done, floats + done, count_ - done);
+                break;
+            }
+            case conversion::unorm8: {
+                auto destination = static_cast<std::uint8_t*>(destination_);
+#if defined(TERESA_X86)
+                if (features.avx2) {
+                    done = unorm8_avx2(destination, floats, count_);
+                }
+#endif
+                unorm8_scalar(destination + done, floats + done, count_ - done);
+                break;
+            }
+            case conversion::snorm16: {
+                auto destination = static_cast<std::int16_t*>(destination_);
+#if defined(TERESA_X86)
+                if (features.avx2) {
+                    done = snorm16_avx2(destination, floats, count_);
+                }
+#endif
+                snorm16_scalar(destination + done, floats + done, count_ - done);
+                break;
+            }
+            case conversion::rgb565: {
+                auto destination = static_cast<std::uint16_t*>(destination_);
+#if defined(TERESA_X86)
+                if (features.avx2) {
+                    done = pack_pixels_avx2(conversion_, destination, pixels, count_);
+                }
+#endif
+                rgb565_scalar(destination + done, pixels + done * 4, count_ - done);
+                break;
+            }
+            case conversion::rgba4444: {
+                auto destination = static_cast<std::uint16_t*>(destination_);
+#if defined(TERESA_X86)
+                if (features.avx2) {
+                    done = pack_pixels_avx2(conversion_, destination, pixels, count_);
+                }
+#endif
+                rgba4444_scalar(destination + done, pixels + done * 4, count_ - done);
+                break;
+            }
+            }
+        }
+    }
+
+    conversion parse_conversion(const std::string &name_)
+    {
+        if (name_ == "float16") {
+            return conversion::float16;
+        }
+        if (name_ == "unorm8") {
+            return conversion::unorm8;
+        }
+        if (name_ == "snorm16") {
+            return conversion::snorm16;
+        }
+        if (name_ == "rgb565") {
+            return conversion::rgb565;
+        }
+        if (name_ == "rgba4444") {
+            return conversion::rgba4444;
+        }
+        throw std::runtime_error("Unknown conversion.");
+    }
+
+    std::size_t source_element_size()
+    {
+        // A float, or four bytes of a pixel.
+        return 4;
+    }
+
+    GLenum source_type(conversion conversion_)
+    {
+        return conversion_ == conversion::rgb565 || conversion_ == conversion::rgba4444 ? GL_UNSIGNED_BYTE : GL_FLOAT;
+    }
+
+    std::size_t converted_element_size(conversion conversion_)
+    {
+        return conversion_ == conversion::unorm8 ? 1 : 2;
+    }
+
+    GLenum converted_format(conversion conversion_, GLenum format_)
+    {
+        return conversion_ == conversion::rgb565 ? GL_RGB : format_;
+    }
+
+    GLenum converted_type(conversion conversion_)
+    {
+        switch (conversion_) {
+        case conversion::float16:
+            return GL_HALF_FLOAT;
+        case conversion::unorm8:
+            return GL_UNSIGNED_BYTE;
+        case conversion::snorm16:
+            return GL_SHORT;
+        case conversion::rgb565:
+            return GL_UNSIGNED_SHORT_5_6_5;
+        default:
+            return GL_UNSIGNED_SHORT_4_4_4_4;
+        }
+    }
+
+    void convert(conversion conversion_, void *destination_, const void *source_, std::size_t count_)
+    {
+        auto destination = static_cast<std::uint8_t*>(destination_);
+        auto source = static_cast<const std::uint8_t*>(source_);
+        auto destinationSize = converted_element_size(conversion_);
+        auto sourceSize = source_element_size();
+        worker_pool::shared().parallel_for(count_, parallel_grain, [&](std::size_t begin_, std::size_t end_) {
+            convert_serial(conversion_, destination + begin_ * destinationSize, source + begin_ * sourceSize, end_ - begin_);
+        });
+    }
+
+    void convert_rows(conversion conversion_, void *destination_, std::size_t destination_pitch_,
+        const void *source_, std::size_t source_pitch_, std::size_t row_elements_, std::size_t rows_)
+    {
+        auto destination = static_cast<std::uint8_t*>(destination_);
+        auto source = static_cast<const std::uint8_t*>(source_);
+        auto grain = std::max<std::size_t>(1, parallel_grain / std::max<std::size_t>(1, row_elements_));
+        worker_pool::shared().parallel_for(rows_, grain, [&](std::size_t begin_, std::size_t end_) {
+            for (auto row = begin_; row < end_; ++row) {
+                convert_serial(conversion_, destination + row * destination_pitch_, source + row * source_pitch_, row_elements_);
+            }
+        });
+    }
+}
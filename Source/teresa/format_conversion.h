@@ -0,0 +1,53 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <string>
+
+namespace teresa
+{
+    // Conversions applied to client data on upload, so that it can be kept as
+    // Float32Array or RGBA8 in JS and still be stored compactly on the GPU.
+    enum class conversion
+    {
+        // float32 to IEEE half, rounding to nearest even.
+        float16,
+
+        // float32 clamped to [0, 1] to unsigned normalized bytes.
+        unorm8,
+
+        // float32 clamped to [-1, 1] to signed normalized shorts.
+        snorm16,
+
+        // RGBA8 pixels to UNSIGNED_SHORT_5_6_5, dropping alpha.
+        rgb565,
+
+        // RGBA8 pixels to UNSIGNED_SHORT_4_4_4_4.
+        rgba4444,
+    };
+
+    // Parses the JS name of a conversion, "float16", "unorm8", "snorm16", "rgb565" or "rgba4444".
+    conversion parse_conversion(const std::string &name_);
+
+    // Bytes of one element the conversion reads: a float, or an RGBA8 pixel.
+    std::size_t source_element_size();
+
+    // The client type of the pixels the conversion reads: FLOAT, or UNSIGNED_BYTE for RGBA8 pixels.
+    GLenum source_type(conversion conversion_);
+
+    // Bytes of one element the conversion writes.
+    std::size_t converted_element_size(conversion conversion_);
+
+    // The client format and type of the converted pixels, given the |format_| of the source.
+    GLenum converted_format(conversion conversion_, GLenum format_);
+
+    GLenum converted_type(conversion conversion_);
+
+    // Converts |count_| elements. Large inputs are split across the worker pool.
+    void convert(conversion conversion_, void *destination_, const void *source_, std::size_t count_);
+
+    // Converts |rows_| rows of |row_elements_| elements each, with the given row pitches in bytes.
+    void convert_rows(conversion conversion_, void *destination_, std::size_t destination_pitch_,
+        const void *source_, std::size_t source_pitch_, std::size_t row_elements_, std::size_t rows_);
+}
@@ -0,0 +1,291 @@
+
+#include "frame_capture.h"
+#include "host_memory_pool.h"
+#include "pixel_transfer.h"
+#include "yuv_conversion.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace teresa
+{
+    frame_capture::frame_capture(const options &options_)
+        :_options(options_)
+    {
+        _options.queue_length = std::max<std::size_t>(_options.queue_length, 1);
+        if (_options.sink == capture_sink::file) {
+            _file = std::fopen(_options.path.c_str(), "wb");
+            if (!_file) {
+                throw std::runtime_error("Failed to create " + _options.path + ".");
+            }
+        }
+        else if (_options.sink == capture_sink::descriptor && _options.fd < 0) {
+            throw std::runtime_error("Frames can not be written to a negative file descriptor.");
+        }
+        _thread = std::thread([this]() { _run(); });
+    }
+
+    frame_capture::~frame_capture()
+    {
+        stop();
+        for (auto &readback : _readbacks) {
+            if (readback.buffer) {
+                glDeleteBuffers(1, &readback.buffer);
+            }
+        }
+        for (auto &frame : _delivered) {
+            _release(frame);
+        }
+        if (_file) {
+            std::fclose(_file);
+        }
+    }
+
+    void frame_capture::read_framebuffer(GLuint framebuffer_, GLsizei width_, GLsizei height_)
+    {
+        _read(width_, height_, [&](GLsizei) {
+            GLint readFramebuffer = 0;
+            glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+            glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(readFramebuffer));
+        });
+    }
+
+    void frame_capture::read_texture(GLuint texture_, GLsizei width_, GLsizei height_)
+    {
+        _read(width_, height_, [&](GLsizei size_) {
+            glGetTextureSubImage(texture_, 0, 0, 0, 0, width_, height_, 1, GL_RGBA, GL_UNSIGNED_BYTE, size_, nullptr);
+        });
+    }
+
+    std::optional<frame_capture::frame> frame_capture::take()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_delivered.empty()) {
+            return std::nullopt;
+        }
+        auto frame = _delivered.front();
+        _delivered.pop_front();
+        return frame;
+    }
+
+    frame_capture::statistics frame_capture::stats()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _stats;
+    }
+
+    void frame_capture::stop()
+    {
+        if (!_thread.joinable()) {
+            return;
+        }
+        _collect(true);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        // The frames read back are still delivered before the thread ends.
+        _wake.notify_one();
+        _thread.join();
+        if (_file) {
+            std::fflush(_file);
+        }
+    }
+
+    template <typename Read>
+    void frame_capture::_read(GLsizei width_, GLsizei height_, Read read_)
+    {
+        if (!_thread.joinable()) {
+            return;
+        }
+        // Whatever finished since the last frame makes room first.
+        _collect(false);
+        std::uint64_t index = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            index = _stats.frames++;
+            if (_inFlight == readback_count || width_ <= 0 || height_ <= 0) {
+                ++_stats.dropped;
+                return;
+            }
+        }
+
+        auto &readback = _readbacks[(_oldest + _inFlight) % readback_count];
+        auto size = static_cast<std::size_t>(width_) * static_cast<std::size_t>(height_) * 4;
+        if (readback.capacity < size) {
+            if (!readback.buffer) {
+                glCreateBuffers(1, &readback.buffer);
+            }
+            glNamedBufferData(readback.buffer, static_cast<GLsizeiptr>(size), nullptr, GL_STREAM_READ);
+            readback.capacity = size;
+        }
+
+        // Rows of RGBA8 are tightly packed at any alignment up to 4.
+        GLint packBuffer = 0;
+        GLint packAlignment = 4;
+        glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer);
+        glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        if (packAlignment > 4) {
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        }
+        read_(static_cast<GLsizei>(size));
+        if (packAlignment > 4) {
+            glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, static_cast<GLuint>(packBuffer));
+
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readback.width = width_;
+        readback.height = height_;
+        readback.index = index;
+        ++_inFlight;
+    }
+
+    void frame_capture::_collect(bool wait_)
+    {
+        while (_inFlight) {
+            auto &readback = _readbacks[_oldest];
+            if (wait_) {
+                while (glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+
+                }
+            }
+            else {
+                // Flushes as well, so that the fence is sure to be reached without a swap.
+                auto status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+                if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                    break;
+                }
+            }
+            glDeleteSync(readback.fence);
+            readback.fence = nullptr;
+            _oldest = (_oldest + 1) % readback_count;
+            --_inFlight;
+
+            bool full = false;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                full = _pending.size() >= _options.queue_length;
+                if (full) {
+                    ++_stats.dropped;
+                }
+            }
+            if (full) {
+                continue;
+            }
+            frame frame;
+            frame.width = readback.width;
+            frame.height = readback.height;
+            frame.index = readback.index;
+            frame.size = static_cast<std::size_t>(frame.width) * static_cast<std::size_t>(frame.height) * 4;
+            auto mapped = glMapNamedBufferRange(readback.buffer, 0, static_cast<GLsizeiptr>(frame.size), GL_MAP_READ_BIT);
+            if (mapped) {
+                frame.pixels = static_cast<std::uint8_t*>(host_memory_pool::shared().allocate(frame.size));
+                std::memcpy(frame.pixels, mapped, frame.size);
+                glUnmapNamedBuffer(readback.buffer);
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (frame.pixels) {
+                _pending.push_back(frame);
+                _wake.notify_one();
+            }
+            else {
+                ++_stats.dropped;
+            }
+        }
+    }
+
+    void frame_capture::_run()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _wake.wait(lock, [this]() { return _stopping || !_pending.empty(); });
+            if (_pending.empty()) {
+                return;
+            }
+            auto frame = _pending.front();
+            _pending.pop_front();
+            lock.unlock();
+            _convert(frame);
+            auto written = _options.sink == capture_sink::queue || _write(frame);
+            lock.lock();
+
+            if (_options.sink == capture_sink::queue && _delivered.size() < _options.queue_length) {
+                _delivered.push_back(frame);
+                ++_stats.delivered;
+                continue;
+            }
+            // While the older frames are not taken, the queue sink drops the newer ones.
+            if (_options.sink == capture_sink::queue || !written) {
+                ++_stats.dropped;
+            }
+            else {
+                ++_stats.delivered;
+            }
+            _release(frame);
+        }
+    }
+
+    void frame_capture::_convert(frame &frame_)
+    {
+        auto pitch = static_cast<std::size_t>(frame_.width) * 4;
+        auto height = static_cast<std::size_t>(frame_.height);
+        if (_options.format == capture_format::rgba) {
+            flip_rows(frame_.pixels, pitch, height);
+            return;
+        }
+        // Converting from the top row up flips as well.
+        auto &pool = host_memory_pool::shared();
+        auto size = yuv420_size(static_cast<std::size_t>(frame_.width), height);
+        auto converted = static_cast<std::uint8_t*>(pool.allocate(size));
+        rgba_to_yuv420(converted, frame_.pixels + (height - 1) * pitch, -static_cast<std::ptrdiff_t>(pitch),
+            static_cast<std::size_t>(frame_.width), height);
+        pool.free(frame_.pixels, frame_.size);
+        frame_.pixels = converted;
+        frame_.size = size;
+    }
+
+    bool frame_capture::_write(const frame &frame_)
+    {
+        if (_file) {
+            return std::fwrite(frame_.pixels, 1, frame_.size, _file) == frame_.size;
+        }
+        auto data = frame_.pixels;
+        auto remaining = frame_.size;
+        while (remaining) {
+#if defined(_WIN32)
+            auto written = ::_write(_options.fd, data, static_cast<unsigned>(std::min<std::size_t>(remaining, INT_MAX)));
+#else
+            auto written = ::write(_options.fd, data, remaining);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+#endif
+            if (written <= 0) {
+                return false;
+            }
+            data += written;
+            remaining -= static_cast<std::size_t>(written);
+        }
+        return true;
+    }
+
+    void frame_capture::_release(frame &frame_)
+    {
+        if (frame_.pixels) {
+            host_memory_pool::shared().free(frame_.pixels, frame_.size);
+            frame_.pixels = nullptr;
+        }
+    }
+}
@@ -0,0 +1,180 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace teresa
+{
+    enum class capture_format
+    {
+        // RGBA8, top row first.
+        rgba,
+
+        // I420, see rgba_to_yuv420().
+        yuv420,
+    };
+
+    enum class capture_sink
+    {
+        // Frames queue up for frame_capture::take().
+        queue,
+
+        // Frames are appended to the file at |path|, truncated first.
+        file,
+
+        // Frames are written to |fd|, such as the pipe into an encoder. It stays open.
+        descriptor,
+    };
+
+    // Streams the frames of a canvas out of GL: each frame is read back into a pixel buffer of
+    // a small ring and fenced, then picked up by a later frame once the GPU is done with it, so
+    // rendering never waits for a readback. A thread of its own converts and delivers the frames.
+    // Whichever stage is full drops frames rather than waiting, which throttles the capture to
+    // whatever the consumer keeps up with.
+    class frame_capture
+    {
+    public:
+        // Readbacks in flight at most; frames come out this many flushes late at the latest.
+        constexpr static std::size_t readback_count = 3;
+
+        struct options
+        {
+            capture_format format = capture_format::rgba;
+
+            capture_sink sink = capture_sink::queue;
+
+            std::string path;
+
+            int fd = -1;
+
+            // Frames read back but not yet delivered, and frames delivered but not yet taken,
+            // each at most.
+            std::size_t queue_length = 4;
+        };
+
+        struct frame
+        {
+            // A block of host_memory_pool::shared(), of |size| bytes.
+            std::uint8_t *pixels = nullptr;
+
+            std::size_t size = 0;
+
+            GLsizei width = 0;
+
+            GLsizei height = 0;
+
+            // Counts the frames offered to the capture, so gaps tell of dropped frames.
+            std::uint64_t index = 0;
+        };
+
+        struct statistics
+        {
+            // Frames offered, whether or not they made it.
+            std::uint64_t frames = 0;
+
+            std::uint64_t delivered = 0;
+
+            // Frames dropped by a full stage, or lost to a failed write.
+            std::uint64_t dropped = 0;
+        };
+
+        // Throws if the file can not be created.
+        explicit frame_capture(const options &options_);
+
+        frame_capture(const frame_capture &) = delete;
+
+        frame_capture& operator=(const frame_capture &) = delete;
+
+        // See stop(). The context of the reads must be current.
+        ~frame_capture();
+
+        // Captures |width_| x |height_| pixels of the read buffer of |framebuffer_|, such as
+        // the back buffer of a window before it is swapped.
+        void read_framebuffer(GLuint framebuffer_, GLsizei width_, GLsizei height_);
+
+        // Captures the lower left |width_| x |height_| pixels of level 0 of |texture_|.
+        void read_texture(GLuint texture_, GLsizei width_, GLsizei height_);
+
+        capture_format format() const
+        {
+            return _options.format;
+        }
+
+        // The oldest frame queued for take(), if any; its pixels go back to the pool once consumed.
+        std::optional<frame> take();
+
+        statistics stats();
+
+        // Waits for the frames in flight and delivers them, after which stats() are final and
+        // nothing more is captured. The context of the reads must be current.
+        void stop();
+    private:
+        struct _readback
+        {
+            GLuint buffer = 0;
+
+            std::size_t capacity = 0;
+
+            GLsync fence = nullptr;
+
+            GLsizei width = 0;
+
+            GLsizei height = 0;
+
+            std::uint64_t index = 0;
+        };
+
+        options _options;
+
+        std::FILE *_file = nullptr;
+
+        // A ring, in flight from |_oldest| on.
+        std::array<_readback, readback_count> _readbacks;
+
+        std::size_t _inFlight = 0;
+
+        std::size_t _oldest = 0;
+
+        std::thread _thread;
+
+        std::mutex _mutex;
+
+        std::condition_variable _wake;
+
+        // Read back, bottom row first, waiting for the thread.
+        std::deque<frame> _pending;
+
+        // Delivered to the queue sink.
+        std::deque<frame> _delivered;
+
+        statistics _stats;
+
+        bool _stopping = false;
+
+        // Reads back through the next free buffer of the ring, or drops the frame.
+        template <typename Read>
+        void _read(GLsizei width_, GLsizei height_, Read read_);
+
+        // Hands the finished readbacks over to the thread; waits for all of them if |wait_|.
+        void _collect(bool wait_);
+
+        void _run();
+
+        // Turns a frame as read back into one of the capture format, in place if it can.
+        void _convert(frame &frame_);
+
+        // Writes a frame to the file or descriptor, false if that failed.
+        bool _write(const frame &frame_);
+
+        static void _release(frame &frame_);
+    };
+}
@@ -0,0 +1,124 @@
+
+#include "frame_pacer.h"
+
+namespace teresa
+{
+    frame_pacer::frame_pacer(std::function<void()> swap_, std::function<void(bool)> make_current_)
+        :_swap(std::move(swap_)),
+        _makeCurrent(std::move(make_current_))
+    {
+
+    }
+
+    frame_pacer::~frame_pacer()
+    {
+        _stop_thread();
+        for (auto fence : _frames) {
+            glDeleteSync(fence);
+        }
+    }
+
+    void frame_pacer::set_max_frames_in_flight(std::size_t frames_)
+    {
+        _maxFramesInFlight = frames_;
+        _wait_for_gpu();
+    }
+
+    void frame_pacer::set_threaded(bool threaded_)
+    {
+        if (!_swap || !_makeCurrent || threaded_ == _presentThread.joinable()) {
+            return;
+        }
+        if (threaded_) {
+            _stopping = false;
+            _presentThread = std::thread([this]() { _run(); });
+        }
+        else {
+            _stop_thread();
+        }
+    }
+
+    void frame_pacer::present()
+    {
+        ++_stats.frames;
+        if (_presentThread.joinable()) {
+            // The frame has to reach the GPU before another thread swaps it.
+            _frames.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+            glFlush();
+            _wait_for_gpu();
+            // EGL and GLX swap only the surface of the context current on the calling thread,
+            // so the context goes along with the frame.
+            _makeCurrent(false);
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_pendingSwaps;
+            _swapRequested.notify_one();
+            return;
+        }
+        if (_swap) {
+            _swap();
+        }
+        _frames.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        _wait_for_gpu();
+    }
+
+    void frame_pacer::reclaim()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_pendingSwaps) {
+            ++_stats.present_stalls;
+            _swapDone.wait(lock, [this]() { return !_pendingSwaps; });
+        }
+    }
+
+    void frame_pacer::_wait_for_gpu()
+    {
+        // Frames the GPU is done with go regardless of the limit.
+        while (!_frames.empty()) {
+            auto fence = _frames.front();
+            auto status = glClientWaitSync(fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                if (!_maxFramesInFlight || _frames.size() <= _maxFramesInFlight) {
+                    break;
+                }
+                ++_stats.gpu_stalls;
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+
+                }
+            }
+            glDeleteSync(fence);
+            _frames.pop_front();
+        }
+    }
+
+    void frame_pacer::_run()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _swapRequested.wait(lock, [this]() { return _stopping || _pendingSwaps; });
+            if (!_pendingSwaps) {
+                return;
+            }
+            lock.unlock();
+            _makeCurrent(true);
+            _swap();
+            _makeCurrent(false);
+            lock.lock();
+            --_pendingSwaps;
+            _swapDone.notify_one();
+        }
+    }
+
+    void frame_pacer::_stop_thread()
+    {
+        if (!_presentThread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        // Frames handed over are still swapped before the thread ends.
+        _swapRequested.notify_one();
+        _presentThread.join();
+    }
+}
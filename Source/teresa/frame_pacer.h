@@ -0,0 +1,97 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace teresa
+{
+    // Ends the frames of a canvas: keeps the CPU from running more than a set number of frames
+    // ahead of the GPU, by fencing each frame, and swaps buffers, optionally on a thread of its
+    // own so that a swap waiting for the vertical blank only blocks the next GL call rather than
+    // the caller.
+    class frame_pacer
+    {
+    public:
+        struct statistics
+        {
+            std::uint64_t frames = 0;
+
+            // Frames which had to wait for the GPU to finish an earlier one.
+            std::uint64_t gpu_stalls = 0;
+
+            // Calls of reclaim() which had to wait for the present thread to swap.
+            std::uint64_t present_stalls = 0;
+        };
+
+        // |swap_| shows a finished frame; null for drawing buffers which need no swap. |make_current_|
+        // makes the context of the swaps current on the calling thread, or no context at all if false;
+        // null if the swaps can not move to another thread.
+        frame_pacer(std::function<void()> swap_, std::function<void(bool)> make_current_);
+
+        frame_pacer(const frame_pacer &) = delete;
+
+        frame_pacer& operator=(const frame_pacer &) = delete;
+
+        ~frame_pacer();
+
+        // Frames which may be in flight at once, the one just ended included; 0 for no limit.
+        void set_max_frames_in_flight(std::size_t frames_);
+
+        // Swaps on a thread of its own if true, which takes the context along for the swap.
+        void set_threaded(bool threaded_);
+
+        bool threaded() const
+        {
+            return _presentThread.joinable();
+        }
+
+        // Ends the frame drawn since the previous call. When threaded, the context is no longer
+        // current afterwards: see reclaim().
+        void present();
+
+        // Waits until the present thread is done swapping and has let go of the context, which the
+        // caller may then make current again. Comes before any GL call following a threaded present().
+        void reclaim();
+
+        const statistics& stats() const
+        {
+            return _stats;
+        }
+    private:
+        std::function<void()> _swap;
+
+        std::function<void(bool)> _makeCurrent;
+
+        std::size_t _maxFramesInFlight = 0;
+
+        std::deque<GLsync> _frames;
+
+        statistics _stats;
+
+        std::thread _presentThread;
+
+        std::mutex _mutex;
+
+        std::condition_variable _swapRequested;
+
+        std::condition_variable _swapDone;
+
+        // Frames handed to the present thread but not swapped yet; one at most, as nothing is drawn
+        // until the context is back.
+        std::size_t _pendingSwaps = 0;
+
+        bool _stopping = false;
+
+        void _run();
+
+        void _stop_thread();
+
+        void _wait_for_gpu();
+    };
+}
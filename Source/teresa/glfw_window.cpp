@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include <map>
 #include "glfw_window.h"
 
@@ -37,8 +38,57 @@ namespace teresa
                 if (r == _glfwWindowMap.end()) {
                     return;
                 }
+                record_event(window, window_event::framebuffer_size, width, height);
                 r->second->_on_framebuffer_resize(width, height);
             }
+
+            static void record_event(GLFWwindow* window, window_event type, double a, double b, double c, double d) {
+                auto r = _glfwWindowMap.find(window);
+                if (r == _glfwWindowMap.end()) {
+                    return;
+                }
+                auto &self = *r->second;
+                auto &events = self._events;
+                if (events.size() >= glfw_window::max_event_count * glfw_window::event_stride) {
+                    // Nobody takes them, so the oldest go rather than memory growing without bound.
+                    auto dropped = glfw_window::max_event_count / 4;
+                    events.erase(events.begin(), events.begin() + dropped * glfw_window::event_stride);
+                    self._droppedEvents += dropped;
+                }
+                events.insert(events.end(), { static_cast<double>(type), glfwGetTime(), a, b, c, d });
+            }
+
+            static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+                record_event(window, window_event::key, key, scancode, action, mods);
+            }
+
+            static void char_callback(GLFWwindow* window, unsigned codepoint) {
+                record_event(window, window_event::character, codepoint);
+            }
+
+            static void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+                record_event(window, window_event::mouse_button, button, action, mods);
+            }
+
+            static void cursor_position_callback(GLFWwindow* window, double x, double y) {
+                record_event(window, window_event::cursor_position, x, y);
+            }
+
+            static void cursor_enter_callback(GLFWwindow* window, int entered) {
+                record_event(window, window_event::cursor_enter, entered);
+            }
+
+            static void scroll_callback(GLFWwindow* window, double x, double y) {
+                record_event(window, window_event::scroll, x, y);
+            }
+
+            static void focus_callback(GLFWwindow* window, int focused) {
+                record_event(window, window_event::focus, focused);
+            }
+
+            static void close_callback(GLFWwindow* window) {
+                record_event(window, window_event::close);
+            }
         }
     }
 
@@ -54,6 +104,14 @@ namespace teresa
             throw std::runtime_error("Couldn't create GLFW window.");
         impl::glfw::_glfwWindowMap.insert({ _glfwWindow, this });
         glfwSetFramebufferSizeCallback(_glfwWindow, impl::glfw::framebuffer_resize_calback);
+        glfwSetKeyCallback(_glfwWindow, impl::glfw::key_callback);
+        glfwSetCharCallback(_glfwWindow, impl::glfw::char_callback);
+        glfwSetMouseButtonCallback(_glfwWindow, impl::glfw::mouse_button_callback);
+        glfwSetCursorPosCallback(_glfwWindow, impl::glfw::cursor_position_callback);
+        glfwSetCursorEnterCallback(_glfwWindow, impl::glfw::cursor_enter_callback);
+        glfwSetScrollCallback(_glfwWindow, impl::glfw::scroll_callback);
+        glfwSetWindowFocusCallback(_glfwWindow, impl::glfw::focus_callback);
+        glfwSetWindowCloseCallback(_glfwWindow, impl::glfw::close_callback);
     }
 
     std::pair<glfw_window::width_type, glfw_window::height_type> glfw_window::size() const
@@ -75,6 +133,30 @@ namespace teresa
         glfwMakeContextCurrent(_glfwWindow);
     }
 
+    void glfw_window::resize(width_type w, height_type h)
+    {
+        glfwSetWindowSize(_glfwWindow, static_cast<int>(w), static_cast<int>(h));
+    }
+
+    void glfw_window::resize_framebuffer(width_type w, height_type h)
+    {
+        auto[windowWidth, windowHeight] = size();
+        auto[framebufferWidth, framebufferHeight] = framebuffer_size();
+        // Minimized windows report an empty framebuffer, the content scale stands in for the ratio then.
+        float scaleX = 1, scaleY = 1;
+        if (windowWidth && windowHeight && framebufferWidth && framebufferHeight) {
+            scaleX = static_cast<float>(framebufferWidth) / windowWidth;
+            scaleY = static_cast<float>(framebufferHeight) / windowHeight;
+        }
+        else {
+            glfwGetWindowContentScale(_glfwWindow, &scaleX, &scaleY);
+        }
+        auto toScreen = [](unsigned pixels_, float scale_) {
+            return std::max(1, static_cast<int>(std::lround(pixels_ / (scale_ > 0 ? scale_ : 1))));
+        };
+        glfwSetWindowSize(_glfwWindow, toScreen(w, scaleX), toScreen(h, scaleY));
+    }
+
     void glfw_window::swap_buffers() const
     {
         glfwSwapBuffers(_glfwWindow);
@@ -95,6 +177,21 @@ namespace teresa
         _framebufferResizeCallbacks.push_back(callback_);
     }
 
+    void glfw_window::retire()
+    {
+        glfwHideWindow(_glfwWindow);
+        _framebufferResizeCallbacks.clear();
+    }
+
+    std::vector<double> glfw_window::take_events(std::size_t &dropped_)
+    {
+        std::vector<double> events;
+        events.swap(_events);
+        dropped_ = _droppedEvents;
+        _droppedEvents = 0;
+        return events;
+    }
+
     bool glfw_window::should_close() const
     {
         return glfwWindowShouldClose(_glfwWindow);
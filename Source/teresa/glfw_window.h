@@ -10,6 +10,38 @@
 
 namespace teresa
 {
+    // The events a glfw_window records, see glfw_window::take_events().
+    enum class window_event
+    {
+        // key, scancode, action, mods
+        key = 1,
+
+        // Unicode code point
+        character,
+
+        // button, action, mods
+        mouse_button,
+
+        // x, y in screen coordinates
+        cursor_position,
+
+        // 1 if entered, 0 if left
+        cursor_enter,
+
+        // x offset, y offset
+        scroll,
+
+        // 1 if focused, 0 if not
+        focus,
+
+        close,
+
+        // width, height in pixels
+        framebuffer_size,
+    };
+
+    class glfw_window;
+
     namespace impl
     {
         class glfw_component
@@ -23,6 +55,8 @@ namespace teresa
         namespace glfw
         {
             static void framebuffer_resize_calback(GLFWwindow* window, int width, int height);
+
+            static void record_event(GLFWwindow* window, window_event type, double a = 0, double b = 0, double c = 0, double d = 0);
         }
     }
 
@@ -30,11 +64,18 @@ namespace teresa
         :public impl::glfw_component
     {
         friend void impl::glfw::framebuffer_resize_calback(GLFWwindow* window, int width, int height);
+        friend void impl::glfw::record_event(GLFWwindow* window, window_event type, double a, double b, double c, double d);
     public:
         using width_type = unsigned;
 
         using height_type = unsigned;
 
+        // Numbers per recorded event: the window_event, the glfwGetTime() it arrived at, and four arguments.
+        constexpr static std::size_t event_stride = 6;
+
+        // Events kept until taken; past that the oldest ones make room, a quarter at a time.
+        constexpr static std::size_t max_event_count = 4096;
+
         glfw_window(width_type w, height_type h, const std::string &title, bool use_vulkan_ = false);
 
         std::pair<width_type, height_type> size() const;
@@ -43,6 +84,18 @@ namespace teresa
 
         void make_current() const;
 
+        // Asks for a new window size; the framebuffer resize callbacks follow once it is applied.
+        void resize(width_type w, height_type h);
+
+        // As resize(), for a framebuffer of |w| x |h| pixels, which on high DPI screens are
+        // more than the screen coordinates the window is sized in.
+        void resize_framebuffer(width_type w, height_type h);
+
+        GLFWwindow* native_handle() const
+        {
+            return _glfwWindow;
+        }
+
         void swap_buffers() const;
 
         bool should_close() const;
@@ -57,12 +110,24 @@ namespace teresa
 
         void add_framebuffer_resize_callback(std::function<void(unsigned, unsigned)> callback_);
 
+        // Hides the window and drops its framebuffer resize callbacks, for a window whose canvas
+        // is gone while its context still has objects to serve.
+        void retire();
+
+        // The events recorded since the last call, |event_stride| numbers each, oldest first.
+        // |dropped_| is set to how many older ones were dropped for want of room.
+        std::vector<double> take_events(std::size_t &dropped_);
+
         ~glfw_window();
     private:
         GLFWwindow * _glfwWindow;
 
         std::list<std::function<void(unsigned, unsigned)>> _framebufferResizeCallbacks;
 
+        std::vector<double> _events;
+
+        std::size_t _droppedEvents = 0;
+
         void _on_framebuffer_resize(int width_, int height_);
     };
 }
\ No newline at end of file
@@ -0,0 +1,479 @@
+
+#include "glsl_translator.h"
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <list>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace teresa
+{
+    namespace
+    {
+        // Keywords and built-in functions of desktop GLSL which are plain identifiers in GLSL ES 1.00.
+        const std::unordered_set<std::string>& desktop_only_names()
+        {
+            static const std::unordered_set<std::string> names = {
+                "active", "atomic_uint", "buffer", "case", "centroid", "coherent", "common", "filter", "layout",
+                "noperspective", "partition", "patch", "precise", "readonly", "resource", "restrict", "sample",
+                "shared", "smooth", "subroutine", "writeonly", "uint", "uvec2", "uvec3", "uvec4",
+                "mat2x2", "mat2x3", "mat2x4", "mat3x2", "mat3x3", "mat3x4", "mat4x2", "mat4x3", "mat4x4",
+                "dmat2", "dmat3", "dmat4", "isampler2D", "usampler2D", "sampler2DArray", "samplerCubeShadow",
+                "samplerBuffer", "image2D",
+                "texture", "textureProj", "textureLod", "textureProjLod", "textureGrad", "textureProjGrad",
+                "textureOffset", "textureSize", "texelFetch", "textureGather",
+                "round", "roundEven", "trunc", "modf", "fma", "frexp", "ldexp", "sinh", "cosh", "tanh",
+                "asinh", "acosh", "atanh", "isnan", "isinf", "inverse", "transpose", "determinant", "outerProduct",
+                "floatBitsToInt", "floatBitsToUint", "intBitsToFloat", "uintBitsToFloat",
+                "packHalf2x16", "unpackHalf2x16", "packUnorm2x16", "unpackUnorm2x16", "packSnorm2x16",
+                "unpackSnorm2x16", "packUnorm4x8", "unpackUnorm4x8", "packSnorm4x8", "unpackSnorm4x8",
+                "bitfieldExtract", "bitfieldInsert", "bitfieldReverse", "bitCount", "findLSB", "findMSB",
+                "uaddCarry", "usubBorrow", "umulExtended", "imulExtended",
+                "dFdxFine", "dFdyFine", "fwidthFine", "dFdxCoarse", "dFdyCoarse", "fwidthCoarse",
+                "interpolateAtCentroid", "interpolateAtSample", "interpolateAtOffset",
+                "noise1", "noise2", "noise3", "noise4", "ftransform", "shadow2D", "shadow2DProj",
+                "EmitVertex", "EndPrimitive", "barrier", "memoryBarrier",
+            };
+            return names;
+        }
+
+        // Texture lookups of GLSL ES 1.00 and EXT_shader_texture_lod by their GLSL 1.30 names.
+        const std::unordered_map<std::string, const char*>& texture_functions()
+        {
+            static const std::unordered_map<std::string, const char*> functions = {
+                { "texture2D", "texture" },
+                { "texture2DProj", "textureProj" },
+                { "textureCube", "texture" },
+                { "texture2DLod", "textureLod" },
+                { "texture2DProjLod", "textureProjLod" },
+                { "textureCubeLod", "textureLod" },
+                { "texture2DLodEXT", "textureLod" },
+                { "texture2DProjLodEXT", "textureProjLod" },
+                { "textureCubeLodEXT", "textureLod" },
+                { "texture2DGradEXT", "textureGrad" },
+                { "texture2DProjGradEXT", "textureProjGrad" },
+                { "textureCubeGradEXT", "textureGrad" },
+            };
+            return functions;
+        }
+
+        // The same before GLSL 1.30, where ARB_shader_texture_lod provides them.
+        const std::unordered_map<std::string, const char*>& legacy_texture_functions()
+        {
+            static const std::unordered_map<std::string, const char*> functions = {
+                { "texture2DLodEXT", "texture2DLod" },
+                { "texture2DProjLodEXT", "texture2DProjLod" },
+                { "textureCubeLodEXT", "textureCubeLod" },
+                { "texture2DGradEXT", "texture2DGradARB" },
+                { "texture2DProjGradEXT", "texture2DProjGradARB" },
+                { "textureCubeGradEXT", "textureCubeGradARB" },
+            };
+            return functions;
+        }
+
+        // Predefined macros of WebGL. Macros starting with GL_ cannot be defined by shaders,
+        // so they are renamed to webgl_ ones.
+        const std::set<std::string>& webgl_macros()
+        {
+            static const std::set<std::string> macros = {
+                "GL_ES", "GL_FRAGMENT_PRECISION_HIGH", "GL_OES_standard_derivatives",
+                "GL_EXT_shader_texture_lod", "GL_EXT_frag_depth", "GL_EXT_draw_buffers",
+            };
+            return macros;
+        }
+
+        // Extensions desktop GLSL has built in.
+        bool is_builtin_extension(const std::string &name_)
+        {
+            return name_ == "GL_OES_standard_derivatives" || name_ == "GL_EXT_shader_texture_lod" ||
+                name_ == "GL_EXT_frag_depth" || name_ == "GL_EXT_draw_buffers";
+        }
+
+        bool is_identifier_start(char c_)
+        {
+            return std::isalpha(static_cast<unsigned char>(c_)) || c_ == '_';
+        }
+
+        bool is_identifier_char(char c_)
+        {
+            return std::isalnum(static_cast<unsigned char>(c_)) || c_ == '_';
+        }
+
+        class translator
+        {
+        public:
+            translator(const std::string &source_, GLenum stage_, int version_)
+                :_source(source_), _fragment(stage_ == GL_FRAGMENT_SHADER), _version(version_)
+            {
+
+            }
+
+            std::string run()
+            {
+                _scan(0, _source.size(), false);
+                if (_passthrough) {
+                    return _source;
+                }
+                std::string result = "#version " + std::to_string(_version) + "\n";
+                for (auto &extension : _extensions) {
+                    result += extension + "\n";
+                }
+                if (_usesLegacyLod) {
+                    result += "#extension GL_ARB_shader_texture_lod : enable\n";
+                }
+                for (auto &macro : webgl_macros()) {
+                    result += "#define webgl_" + macro.substr(3) + " 1\n";
+                }
+                auto layout = _version >= 330 ? "layout(location = 0) " : "";
+                if (_usesFragColor) {
+                    result += std::string(layout) + "out vec4 webgl_FragColor;\n";
+                }
+                if (_usesFragData) {
+                    result += std::string(layout) + "out vec4 webgl_FragData[gl_MaxDrawBuffers];\n";
+                }
+                // From GLSL 3.30 on, #line names the number of the next line rather than of itself.
+                result += _version >= 330 ? "#line 1\n" : "#line 0\n";
+                return result + _body;
+            }
+        private:
+            const std::string &_source;
+
+            bool _fragment;
+
+            int _version;
+
+            std::string _body;
+
+            // #extension directives to be hoisted above the declarations added.
+            std::vector<std::string> _extensions;
+
+            bool _passthrough = false;
+
+            bool _usesFragColor = false;
+
+            bool _usesFragData = false;
+
+            bool _usesLegacyLod = false;
+
+            bool _modern() const
+            {
+                return _version >= 130;
+            }
+
+            std::string _rename(const std::string &name_)
+            {
+                if (webgl_macros().count(name_)) {
+                    return "webgl_" + name_.substr(3);
+                }
+                if (name_ == "gl_FragDepthEXT") {
+                    return "gl_FragDepth";
+                }
+                if (!_modern()) {
+                    auto legacy = legacy_texture_functions().find(name_);
+                    if (legacy != legacy_texture_functions().end()) {
+                        _usesLegacyLod = _usesLegacyLod || _fragment;
+                        return legacy->second;
+                    }
+                    return name_;
+                }
+                if (name_ == "attribute") {
+                    return "in";
+                }
+                if (name_ == "varying") {
+                    return _fragment ? "in" : "out";
+                }
+                if (name_ == "gl_FragColor") {
+                    _usesFragColor = true;
+                    return "webgl_FragColor";
+                }
+                if (name_ == "gl_FragData") {
+                    _usesFragData = true;
+                    return "webgl_FragData";
+                }
+                auto function = texture_functions().find(name_);
+                if (function != texture_functions().end()) {
+                    return function->second;
+                }
+                if (desktop_only_names().count(name_)) {
+                    return "webgl_" + name_;
+                }
+                return name_;
+            }
+
+            // Copies the newlines of [begin_, end_) only, keeping the line count.
+            void _blank(std::size_t begin_, std::size_t end_)
+            {
+                for (auto i = begin_; i < end_; ++i) {
+                    if (_source[i] == '\n') {
+                        _body += '\n';
+                    }
+                }
+            }
+
+            // The end of the logical line starting at |begin_|, before its newline.
+            std::size_t _line_end(std::size_t begin_) const
+            {
+                auto i = begin_;
+                while (i < _source.size() && _source[i] != '\n') {
+                    if (_source[i] == '\\' && i + 1 < _source.size() && _source[i + 1] == '\n') {
+                        ++i;
+                    }
+                    else if (_source[i] == '\\' && i + 2 < _source.size() && _source[i + 1] == '\r' && _source[i + 2] == '\n') {
+                        i += 2;
+                    }
+                    ++i;
+                }
+                return i;
+            }
+
+            void _directive(std::size_t begin_, std::size_t end_)
+            {
+                auto i = begin_ + 1;
+                while (i < end_ && (_source[i] == ' ' || _source[i] == '\t')) {
+                    ++i;
+                }
+                auto nameBegin = i;
+                while (i < end_ && is_identifier_char(_source[i])) {
+                    ++i;
+                }
+                auto name = _source.substr(nameBegin, i - nameBegin);
+                auto argument = [&]() {
+                    while (i < end_ && std::isspace(static_cast<unsigned char>(_source[i]))) {
+                        ++i;
+                    }
+                    auto argumentBegin = i;
+                    while (i < end_ && is_identifier_char(_source[i])) {
+                        ++i;
+                    }
+                    return _source.substr(argumentBegin, i - argumentBegin);
+                };
+
+                if (name == "version") {
+                    if (argument() != "100") {
+                        _passthrough = true;
+                    }
+                    _blank(begin_, end_);
+                    return;
+                }
+                if (name == "extension") {
+                    // Built-in extensions are dropped; EXT_shader_texture_lod before GLSL 1.30 is
+                    // replaced by ARB_shader_texture_lod once a lookup needs it.
+                    if (!is_builtin_extension(argument())) {
+                        _extensions.push_back(_source.substr(begin_, end_ - begin_));
+                    }
+                    _blank(begin_, end_);
+                    return;
+                }
+                _body += '#';
+                _scan(begin_ + 1, end_, true);
+            }
+
+            void _scan(std::size_t begin_, std::size_t end_, bool directive_)
+            {
+                auto lineStart = !directive_;
+                auto i = begin_;
+                while (i < end_ && !_passthrough) {
+                    auto c = _source[i];
+                    if (c == '\n') {
+                        _body += c;
+                        ++i;
+                        lineStart = !directive_;
+                        continue;
+                    }
+                    if (c == ' ' || c == '\t' || c == '\r' || c == '\\') {
+                        _body += c;
+                        ++i;
+                        continue;
+                    }
+                    if (lineStart && c == '#') {
+                        auto lineEnd = _line_end(i);
+                        _directive(i, lineEnd);
+                        i = lineEnd;
+                        continue;
+                    }
+                    lineStart = false;
+
+                    if (c == '/' && i + 1 < end_ && _source[i + 1] == '/') {
+                        auto commentEnd = directive_ ? end_ : _source.find('\n', i);
+                        commentEnd = commentEnd == std::string::npos ? end_ : commentEnd;
+                        _body.append(_source, i, commentEnd - i);
+                        i = commentEnd;
+                        continue;
+                    }
+                    if (c == '/' && i + 1 < end_ && _source[i + 1] == '*') {
+                        auto commentEnd = _source.find("*/", i + 2);
+                        commentEnd = commentEnd == std::string::npos || commentEnd + 2 > end_ ? end_ : commentEnd + 2;
+                        _body.append(_source, i, commentEnd - i);
+                        i = commentEnd;
+                        continue;
+                    }
+                    if (std::isdigit(static_cast<unsigned char>(c)) || (c == '.' && i + 1 < end_ && std::isdigit(static_cast<unsigned char>(_source[i + 1])))) {
+                        // Numbers are copied whole, so that exponents and suffixes are not taken for identifiers.
+                        auto numberEnd = i + 1;
+                        while (numberEnd < end_) {
+                            auto n = _source[numberEnd];
+                            auto exponentSign = (n == '+' || n == '-') && (_source[numberEnd - 1] == 'e' || _source[numberEnd - 1] == 'E') &&
+                                !(i + 1 < end_ && (_source[i + 1] == 'x' || _source[i + 1] == 'X'));
+                            if (!is_identifier_char(n) && n != '.' && !exponentSign) {
+                                break;
+                            }
+                            ++numberEnd;
+                        }
+                        _body.append(_source, i, numberEnd - i);
+                        i = numberEnd;
+                        continue;
+                    }
+                    if (is_identifier_start(c)) {
+                        auto identifierEnd = i + 1;
+                        while (identifierEnd < end_ && is_identifier_char(_source[identifierEnd])) {
+                            ++identifierEnd;
+                        }
+                        auto identifier = _source.substr(i, identifierEnd - i);
+                        if (!_modern() && (identifier == "lowp" || identifier == "mediump" || identifier == "highp")) {
+                            // No precision qualifiers before GLSL 1.30.
+                            i = identifierEnd;
+                            continue;
+                        }
+                        if (!_modern() && !directive_ && identifier == "precision") {
+                            auto statementEnd = _source.find(';', identifierEnd);
+                            statementEnd = statementEnd == std::string::npos ? end_ : statementEnd + 1;
+                            _blank(i, statementEnd);
+                            i = statementEnd;
+                            continue;
+                        }
+                        _body += _rename(identifier);
+                        i = identifierEnd;
+                        continue;
+                    }
+                    _body += c;
+                    ++i;
+                }
+            }
+        };
+
+        std::uint64_t hash_source(const std::string &source_, GLenum stage_, int version_)
+        {
+            // FNV-1a.
+            std::uint64_t hash = 14695981039346656037ull;
+            for (auto c : source_) {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+            }
+            hash = (hash ^ stage_) * 1099511628211ull;
+            return (hash ^ static_cast<std::uint64_t>(version_)) * 1099511628211ull;
+        }
+
+        class translation_cache
+        {
+        public:
+            constexpr static std::size_t capacity = 512;
+
+            std::shared_ptr<const std::string> find(std::uint64_t hash_, const std::string &source_, GLenum stage_, int version_)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto found = _index.find(hash_);
+                if (found == _index.end() || found->second->source != source_ ||
+                    found->second->stage != stage_ || found->second->version != version_) {
+                    ++_stats.misses;
+                    return nullptr;
+                }
+                ++_stats.hits;
+                _entries.splice(_entries.begin(), _entries, found->second);
+                return found->second->translated;
+            }
+
+            void insert(std::uint64_t hash_, const std::string &source_, GLenum stage_, int version_, std::shared_ptr<const std::string> translated_)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto found = _index.find(hash_);
+                if (found != _index.end()) {
+                    // Raced with another translation, or a hash collision which the newer source wins.
+                    _entries.erase(found->second);
+                    _index.erase(found);
+                }
+                _entries.push_front({ hash_, source_, stage_, version_, std::move(translated_) });
+                _index.emplace(hash_, _entries.begin());
+                while (_entries.size() > capacity) {
+                    _index.erase(_entries.back().hash);
+                    _entries.pop_back();
+                    ++_stats.evictions;
+                }
+            }
+
+            glsl_cache_statistics stats()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto result = _stats;
+                result.entries = _entries.size();
+                return result;
+            }
+        private:
+            struct _entry
+            {
+                std::uint64_t hash;
+
+                std::string source;
+
+                GLenum stage;
+
+                int version;
+
+                std::shared_ptr<const std::string> translated;
+            };
+
+            std::mutex _mutex;
+
+            // Most recently used first.
+            std::list<_entry> _entries;
+
+            std::unordered_map<std::uint64_t, std::list<_entry>::iterator> _index;
+
+            glsl_cache_statistics _stats;
+        };
+
+        translation_cache& shared_cache()
+        {
+            static translation_cache cache;
+            return cache;
+        }
+    }
+
+    std::string translate_glsl(const std::string &source_, GLenum stage_, int version_)
+    {
+        return translator(source_, stage_, version_).run();
+    }
+
+    std::shared_ptr<const std::string> translate_glsl_cached(const std::string &source_, GLenum stage_, int version_)
+    {
+        auto hash = hash_source(source_, stage_, version_);
+        auto &cache = shared_cache();
+        if (auto translated = cache.find(hash, source_, stage_, version_)) {
+            return translated;
+        }
+        auto translated = std::make_shared<const std::string>(translate_glsl(source_, stage_, version_));
+        cache.insert(hash, source_, stage_, version_, translated);
+        return translated;
+    }
+
+    glsl_cache_statistics glsl_cache_stats()
+    {
+        return shared_cache().stats();
+    }
+
+    int parse_glsl_version(const char *version_)
+    {
+        if (!version_) {
+            return 330;
+        }
+        char *end = nullptr;
+        auto major = std::strtol(version_, &end, 10);
+        if (end == version_ || *end != '.') {
+            return 330;
+        }
+        auto minor = std::strtol(end + 1, nullptr, 10);
+        return static_cast<int>(major * 100 + minor);
+    }
+}
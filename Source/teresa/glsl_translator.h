@@ -0,0 +1,43 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace teresa
+{
+    // Rewrites a GLSL ES 1.00 shader of |stage_|, GL_VERTEX_SHADER or GL_FRAGMENT_SHADER,
+    // into desktop GLSL of |version_|, such as 120 or 460:
+    // - attribute and varying become in and out of the stage, and the fragment outputs
+    //   are declared in place of gl_FragColor and gl_FragData, from GLSL 1.30 on;
+    // - texture lookups take their overloaded names, including those of EXT_shader_texture_lod;
+    // - identifiers that are keywords or built-ins of desktop GLSL only get a webgl_ prefix;
+    // - the predefined macros of WebGL, GL_ES and those of the supported extensions, are
+    //   provided, and #extension directives of extensions desktop GLSL has built in are dropped;
+    // - precision qualifiers are dropped before GLSL 1.30.
+    // Line numbers are kept, so compile errors point into the original source.
+    // Shaders with a #version other than 100 are returned as they are.
+    std::string translate_glsl(const std::string &source_, GLenum stage_, int version_);
+
+    struct glsl_cache_statistics
+    {
+        std::uint64_t hits = 0;
+
+        std::uint64_t misses = 0;
+
+        std::uint64_t evictions = 0;
+
+        std::size_t entries = 0;
+    };
+
+    // translate_glsl() memoized in a process-wide LRU keyed by a hash of the source,
+    // so that shaders shared by many canvases are translated once. Thread-safe.
+    std::shared_ptr<const std::string> translate_glsl_cached(const std::string &source_, GLenum stage_, int version_);
+
+    glsl_cache_statistics glsl_cache_stats();
+
+    // The desktop GLSL version of a GL_SHADING_LANGUAGE_VERSION string, such as 460 for "4.60 NVIDIA".
+    int parse_glsl_version(const char *version_);
+}
@@ -0,0 +1,56 @@
+
+#include "host_memory_pool.h"
+#include <cstdlib>
+#include <new>
+
+namespace teresa
+{
+    host_memory_pool& host_memory_pool::shared()
+    {
+        static host_memory_pool pool;
+        return pool;
+    }
+
+    host_memory_pool::~host_memory_pool()
+    {
+        for (auto &[bin, blocks] : _free) {
+            for (auto block : blocks) {
+                std::free(block);
+            }
+        }
+    }
+
+    void* host_memory_pool::allocate(std::size_t size_)
+    {
+        auto bin = _bin_of(size_);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto blocks = _free.find(bin);
+            if (blocks != _free.end() && !blocks->second.empty()) {
+                auto result = blocks->second.back();
+                blocks->second.pop_back();
+                _retainedBytes -= bin;
+                return result;
+            }
+        }
+        auto result = std::malloc(bin);
+        if (!result) {
+            throw std::bad_alloc();
+        }
+        return result;
+    }
+
+    void host_memory_pool::free(void *data_, std::size_t size_)
+    {
+        auto bin = _bin_of(size_);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_retainedBytes + bin <= default_retained_cap) {
+                _free[bin].push_back(data_);
+                _retainedBytes += bin;
+                return;
+            }
+        }
+        std::free(data_);
+    }
+}
@@ -0,0 +1,53 @@
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace teresa
+{
+    // Recycles large host allocations, such as the targets of pixel readbacks
+    // handed to JavaScript as external ArrayBuffers. Blocks are binned by their
+    // size rounded up to |granularity|, so equally sized requests reuse each other.
+    //
+    // Blocks may come back from ArrayBuffer finalizers after every context is
+    // gone, which is why the pool is process-wide.
+    class host_memory_pool
+    {
+    public:
+        constexpr static std::size_t granularity = 64 * 1024;
+
+        constexpr static std::size_t default_retained_cap = 64 * 1024 * 1024;
+
+        static host_memory_pool& shared();
+
+        host_memory_pool() = default;
+
+        host_memory_pool(const host_memory_pool &) = delete;
+
+        host_memory_pool& operator=(const host_memory_pool &) = delete;
+
+        ~host_memory_pool();
+
+        // At least |size_| bytes.
+        void* allocate(std::size_t size_);
+
+        // Takes back a block from allocate() of the same |size_|. Blocks beyond
+        // the retained cap are returned to the system.
+        void free(void *data_, std::size_t size_);
+    private:
+        std::mutex _mutex;
+
+        std::map<std::size_t, std::vector<void*>> _free;
+
+        std::size_t _retainedBytes = 0;
+
+        static std::size_t _bin_of(std::size_t size_)
+        {
+            return (std::max<std::size_t>(size_, 1) + granularity - 1) / granularity * granularity;
+        }
+    };
+}
@@ -0,0 +1,57 @@
+
+#include "image_decoder.h"
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#define STBI_NO_STDIO
+#include <stb_image.h>
+
+namespace teresa
+{
+    void decoded_image::pixels_deleter::operator()(std::uint8_t *pixels_) const
+    {
+        stbi_image_free(pixels_);
+    }
+
+    decoded_image decode_image(const void *data_, std::size_t size_, GLenum format_)
+    {
+        int channels = 0;
+        switch (format_) {
+        case GL_LUMINANCE:
+            channels = 1;
+            break;
+        case GL_LUMINANCE_ALPHA:
+            channels = 2;
+            break;
+        case GL_RGB:
+            channels = 3;
+            break;
+        case GL_RGBA:
+            channels = 4;
+            break;
+        default:
+            throw std::runtime_error("Unsupported format to decode images into.");
+        }
+        if (size_ > static_cast<std::size_t>(std::numeric_limits<int>::max())) {
+            throw std::runtime_error("Encoded image is too large.");
+        }
+
+        decoded_image result;
+        int width = 0;
+        int height = 0;
+        int fileChannels = 0;
+        result.pixels.reset(stbi_load_from_memory(static_cast<const stbi_uc*>(data_), static_cast<int>(size_),
+            &width, &height, &fileChannels, channels));
+        if (!result.pixels) {
+            throw std::runtime_error(std::string("Failed to decode image: ") + stbi_failure_reason());
+        }
+        result.width = width;
+        result.height = height;
+        result.format = format_;
+        return result;
+    }
+}
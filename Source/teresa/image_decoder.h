@@ -0,0 +1,30 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <memory>
+
+namespace teresa
+{
+    struct decoded_image
+    {
+        struct pixels_deleter
+        {
+            void operator()(std::uint8_t *pixels_) const;
+        };
+
+        // Tightly packed rows, top row first.
+        std::unique_ptr<std::uint8_t, pixels_deleter> pixels;
+
+        GLsizei width = 0;
+
+        GLsizei height = 0;
+
+        // RGBA, RGB, LUMINANCE_ALPHA or LUMINANCE, of unsigned bytes.
+        GLenum format = GL_RGBA;
+    };
+
+    // Decodes a PNG or JPEG image into |format_|. Safe to call from any thread.
+    decoded_image decode_image(const void *data_, std::size_t size_, GLenum format_);
+}
@@ -0,0 +1,204 @@
+
+#include "index_range_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace teresa
+{
+    namespace
+    {
+        constexpr index_range empty_range = { std::numeric_limits<GLuint>::max(), 0 };
+
+        index_range merge(const index_range &lhs_, const index_range &rhs_)
+        {
+            return { std::min(lhs_.min, rhs_.min), std::max(lhs_.max, rhs_.max) };
+        }
+
+        std::size_t tree_slot(GLenum type_)
+        {
+            switch (type_) {
+            case GL_UNSIGNED_BYTE:
+                return 0;
+            case GL_UNSIGNED_SHORT:
+                return 1;
+            default:
+                return 2;
+            }
+        }
+    }
+
+    void index_range_cache::assign(const void *data_, std::size_t size_)
+    {
+        auto bytes = static_cast<const std::uint8_t*>(data_);
+        if (bytes) {
+            _data.assign(bytes, bytes + size_);
+        }
+        else {
+            _data.assign(size_, 0);
+        }
+        for (auto &tree : _trees) {
+            tree = _segment_tree();
+        }
+        _ranges.clear();
+    }
+
+    void index_range_cache::update(std::size_t offset_, const void *data_, std::size_t size_)
+    {
+        if (!size_) {
+            return;
+        }
+        std::memcpy(_data.data() + offset_, data_, size_);
+
+        auto end = offset_ + size_;
+        for (auto r = _ranges.begin(); r != _ranges.end(); ) {
+            auto &key = r->first;
+            auto typeSize = std::size_t(1) << tree_slot(key.type);
+            if (key.offset < end && offset_ < key.offset + key.count * typeSize) {
+                r = _ranges.erase(r);
+            }
+            else {
+                ++r;
+            }
+        }
+
+        for (std::size_t slot = 0; slot < _trees.size(); ++slot) {
+            auto &tree = _trees[slot];
+            if (!tree.built || !tree.element_count) {
+                continue;
+            }
+            auto typeSize = std::size_t(1) << slot;
+            auto firstElement = offset_ / typeSize;
+            auto lastElement = std::min((end + typeSize - 1) / typeSize, tree.element_count);
+            if (firstElement >= lastElement) {
+                continue;
+            }
+            auto firstChunk = firstElement / _chunkSize;
+            auto lastChunk = (lastElement - 1) / _chunkSize + 1;
+            switch (slot) {
+            case 0:
+                _refresh<std::uint8_t>(tree, firstChunk, lastChunk);
+                break;
+            case 1:
+                _refresh<std::uint16_t>(tree, firstChunk, lastChunk);
+                break;
+            default:
+                _refresh<std::uint32_t>(tree, firstChunk, lastChunk);
+                break;
+            }
+        }
+    }
+
+    index_range index_range_cache::range(GLenum type_, std::size_t offset_, std::size_t count_)
+    {
+        _range_key key = { type_, offset_, count_ };
+        auto r = _ranges.find(key);
+        if (r != _ranges.end()) {
+            return r->second;
+        }
+
+        index_range result;
+        if (count_) {
+            auto &tree = _trees[tree_slot(type_)];
+            switch (type_) {
+            case GL_UNSIGNED_BYTE:
+                result = _query<std::uint8_t>(tree, offset_, offset_ + count_);
+                break;
+            case GL_UNSIGNED_SHORT:
+                result = _query<std::uint16_t>(tree, offset_ / 2, offset_ / 2 + count_);
+                break;
+            case GL_UNSIGNED_INT:
+                result = _query<std::uint32_t>(tree, offset_ / 4, offset_ / 4 + count_);
+                break;
+            default:
+                break;
+            }
+        }
+        // Draws of sub-ranges at moving offsets would otherwise grow the map for good,
+        // the tree answers whatever was dropped.
+        if (_ranges.size() >= _maxRanges) {
+            _ranges.clear();
+        }
+        _ranges.emplace(key, result);
+        return result;
+    }
+
+    // Elements [first_, last_) of type |Ty|. Written as a plain reduction so that
+    // the compiler turns it into packed min/max instructions.
+    template <typename Ty>
+    index_range index_range_cache::_scan(std::size_t first_, std::size_t last_) const
+    {
+        auto elements = reinterpret_cast<const Ty*>(_data.data());
+        Ty lo = std::numeric_limits<Ty>::max(), hi = 0;
+        for (auto i = first_; i < last_; ++i) {
+            lo = std::min(lo, elements[i]);
+            hi = std::max(hi, elements[i]);
+        }
+        if (first_ >= last_) {
+            return empty_range;
+        }
+        return { static_cast<GLuint>(lo), static_cast<GLuint>(hi) };
+    }
+
+    template <typename Ty>
+    void index_range_cache::_build(_segment_tree &tree_)
+    {
+        tree_.element_count = _data.size() / sizeof(Ty);
+        auto chunkCount = (tree_.element_count + _chunkSize - 1) / _chunkSize;
+        tree_.leaf_count = 1;
+        while (tree_.leaf_count < chunkCount) {
+            tree_.leaf_count *= 2;
+        }
+        tree_.nodes.assign(tree_.leaf_count * 2, empty_range);
+        tree_.built = true;
+        _refresh<Ty>(tree_, 0, chunkCount);
+    }
+
+    // Rescans chunks [first_chunk_, last_chunk_) and the summaries above them.
+    template <typename Ty>
+    void index_range_cache::_refresh(_segment_tree &tree_, std::size_t first_chunk_, std::size_t last_chunk_)
+    {
+        for (auto chunk = first_chunk_; chunk < last_chunk_; ++chunk) {
+            auto first = chunk * _chunkSize;
+            auto last = std::min(first + _chunkSize, tree_.element_count);
+            tree_.nodes[tree_.leaf_count + chunk] = _scan<Ty>(first, last);
+        }
+        auto lo = (tree_.leaf_count + first_chunk_) / 2;
+        auto hi = (tree_.leaf_count + last_chunk_ - 1) / 2;
+        while (lo >= 1) {
+            for (auto node = lo; node <= hi; ++node) {
+                tree_.nodes[node] = merge(tree_.nodes[node * 2], tree_.nodes[node * 2 + 1]);
+            }
+            lo /= 2;
+            hi /= 2;
+        }
+    }
+
+    // Elements [first_, last_) of type |Ty|: the partial chunks at both ends are
+    // scanned, the whole chunks in between are summarized by the tree.
+    template <typename Ty>
+    index_range index_range_cache::_query(_segment_tree &tree_, std::size_t first_, std::size_t last_)
+    {
+        if (!tree_.built) {
+            _build<Ty>(tree_);
+        }
+        auto firstChunk = (first_ + _chunkSize - 1) / _chunkSize;
+        auto chunkCount = (tree_.element_count + _chunkSize - 1) / _chunkSize;
+        auto lastChunk = last_ == tree_.element_count ? chunkCount : last_ / _chunkSize;
+        if (firstChunk >= lastChunk) {
+            return _scan<Ty>(first_, last_);
+        }
+
+        auto result = merge(_scan<Ty>(first_, firstChunk * _chunkSize),
+            _scan<Ty>(std::min(lastChunk * _chunkSize, last_), last_));
+        for (auto lo = tree_.leaf_count + firstChunk, hi = tree_.leaf_count + lastChunk; lo < hi; lo /= 2, hi /= 2) {
+            if (lo & 1) {
+                result = merge(result, tree_.nodes[lo++]);
+            }
+            if (hi & 1) {
+                result = merge(result, tree_.nodes[--hi]);
+            }
+        }
+        return result;
+    }
+}
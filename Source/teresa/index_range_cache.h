@@ -0,0 +1,103 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace teresa
+{
+    struct index_range
+    {
+        GLuint min = 0;
+        GLuint max = 0;
+    };
+
+    // Shadow copy of an element array buffer which answers
+    // "which indices does this draw use" without touching the driver.
+    //
+    // Ranges already asked for are remembered per (type, offset, count), so a
+    // steady-state draw costs a single lookup; a few hundred at most, past which
+    // they are forgotten all at once. Ranges which were not seen yet are
+    // answered in logarithmic time from a segment tree over per-chunk min/max
+    // summaries, built lazily per index type. Updates only rescan the chunks and
+    // forget the remembered ranges they overlap.
+    class index_range_cache
+    {
+    public:
+        std::size_t size() const
+        {
+            return _data.size();
+        }
+
+        void assign(const void *data_, std::size_t size_);
+
+        void update(std::size_t offset_, const void *data_, std::size_t size_);
+
+        // The range of |count_| indices of |type_| starting at byte |offset_|.
+        // The range must lie within the buffer and |offset_| must be aligned to |type_|.
+        index_range range(GLenum type_, std::size_t offset_, std::size_t count_);
+    private:
+        // Indices summarized by one leaf of a segment tree.
+        constexpr static std::size_t _chunkSize = 128;
+
+        // Remembered ranges kept at most, enough for the draws of a frame.
+        constexpr static std::size_t _maxRanges = 256;
+
+        struct _segment_tree
+        {
+            bool built = false;
+
+            std::size_t element_count = 0;
+
+            std::size_t leaf_count = 0;
+
+            // Implicit binary tree, node i has children 2i and 2i + 1; leaves start at |leaf_count|.
+            std::vector<index_range> nodes;
+        };
+
+        struct _range_key
+        {
+            GLenum type;
+            std::size_t offset;
+            std::size_t count;
+
+            bool operator==(const _range_key &other_) const
+            {
+                return type == other_.type && offset == other_.offset && count == other_.count;
+            }
+        };
+
+        struct _range_key_hash
+        {
+            std::size_t operator()(const _range_key &key_) const
+            {
+                auto h = std::hash<std::size_t>()(key_.offset);
+                h ^= std::hash<std::size_t>()(key_.count) + 0x9e3779b9 + (h << 6) + (h >> 2);
+                h ^= std::hash<GLenum>()(key_.type) + 0x9e3779b9 + (h << 6) + (h >> 2);
+                return h;
+            }
+        };
+
+        std::vector<std::uint8_t> _data;
+
+        std::array<_segment_tree, 3> _trees;
+
+        std::unordered_map<_range_key, index_range, _range_key_hash> _ranges;
+
+        template <typename Ty>
+        index_range _scan(std::size_t first_, std::size_t last_) const;
+
+        template <typename Ty>
+        void _build(_segment_tree &tree_);
+
+        template <typename Ty>
+        void _refresh(_segment_tree &tree_, std::size_t first_chunk_, std::size_t last_chunk_);
+
+        template <typename Ty>
+        index_range _query(_segment_tree &tree_, std::size_t first_, std::size_t last_);
+    };
+}
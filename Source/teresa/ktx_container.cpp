@@ -0,0 +1,413 @@
+
+#include "ktx_container.h"
+#include "pixel_format.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace teresa
+{
+    namespace
+    {
+        const std::uint8_t ktx1_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+        const std::uint8_t ktx2_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+        // Bounds-checked little-endian reads, optionally byte swapped.
+        class reader
+        {
+        public:
+            reader(const std::uint8_t *data_, std::size_t size_)
+                :_data(data_), _size(size_)
+            {
+
+            }
+
+            bool swap = false;
+
+            void require(std::uint64_t offset_, std::uint64_t size_) const
+            {
+                if (offset_ > _size || size_ > _size - offset_) {
+                    throw std::runtime_error("Truncated KTX container.");
+                }
+            }
+
+            std::uint32_t u32(std::uint64_t offset_) const
+            {
+                require(offset_, 4);
+                std::uint32_t value;
+                std::memcpy(&value, _data + offset_, 4);
+                if (swap) {
+                    value = (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+                }
+                return value;
+            }
+
+            std::uint64_t u64(std::uint64_t offset_) const
+            {
+                return u32(offset_) | (static_cast<std::uint64_t>(u32(offset_ + 4)) << 32);
+            }
+
+            const std::uint8_t* at(std::uint64_t offset_, std::uint64_t size_) const
+            {
+                require(offset_, size_);
+                return _data + offset_;
+            }
+        private:
+            const std::uint8_t *_data;
+
+            std::size_t _size;
+        };
+
+        std::uint64_t align4(std::uint64_t offset_)
+        {
+            return (offset_ + 3) & ~std::uint64_t(3);
+        }
+
+        GLsizei mip_extent(std::uint32_t extent_, GLint level_)
+        {
+            return static_cast<GLsizei>(std::max<std::uint32_t>(1, extent_ >> level_));
+        }
+
+        GLsizei full_mip_count(std::uint32_t width_, std::uint32_t height_, std::uint32_t depth_)
+        {
+            GLsizei count = 1;
+            for (auto extent = std::max({ width_, height_, depth_ }); extent > 1; extent >>= 1) {
+                ++count;
+            }
+            return count;
+        }
+
+        // Everything but the images, shared by both container versions.
+        void describe(ktx_texture &texture_, std::uint32_t width_, std::uint32_t height_, std::uint32_t depth_,
+            std::uint32_t layers_, std::uint32_t faces_, std::uint32_t levels_)
+        {
+            if (!width_ || !height_) {
+                throw std::runtime_error("One-dimensional KTX textures are not supported.");
+            }
+            if (faces_ != 1 && (faces_ != 6 || depth_ || width_ != height_)) {
+                throw std::runtime_error("Invalid KTX cube map.");
+            }
+            if (depth_ && layers_) {
+                throw std::runtime_error("Arrays of 3D KTX textures are not supported.");
+            }
+            if (width_ > 0x7FFFFFFF || height_ > 0x7FFFFFFF || depth_ > 0x7FFFFFFF || layers_ > 0xFFFFFF) {
+                throw std::runtime_error("KTX texture is too large.");
+            }
+            if (depth_) {
+                texture_.target = GL_TEXTURE_3D;
+            }
+            else if (faces_ == 6) {
+                texture_.target = layers_ ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP;
+            }
+            else {
+                texture_.target = layers_ ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+            }
+            texture_.width = static_cast<GLsizei>(width_);
+            texture_.height = static_cast<GLsizei>(height_);
+            texture_.depth = depth_ ? static_cast<GLsizei>(depth_) : static_cast<GLsizei>(std::max<std::uint32_t>(1, layers_) * faces_);
+
+            auto fullLevels = full_mip_count(width_, height_, depth_);
+            if (levels_ > static_cast<std::uint32_t>(fullLevels)) {
+                throw std::runtime_error("KTX texture has more levels than its size allows.");
+            }
+            texture_.generate_mipmaps = levels_ == 0;
+            texture_.levels = levels_ ? static_cast<GLsizei>(levels_) : 1;
+        }
+
+        struct compressed_block
+        {
+            GLsizei width = 0;
+
+            GLsizei height = 0;
+
+            // 0 for formats whose blocks are unknown.
+            std::uint64_t size = 0;
+        };
+
+        compressed_block find_compressed_block(GLenum internalformat_)
+        {
+            // The 14 ASTC block sizes, in the order of their GL enums; every block is 16 bytes.
+            static const GLsizei astc_blocks[14][2] = {
+                { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+                { 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 },
+            };
+            for (GLenum first : { GL_COMPRESSED_RGBA_ASTC_4x4_KHR, GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR }) {
+                if (internalformat_ >= first && internalformat_ < first + 14) {
+                    auto &block = astc_blocks[internalformat_ - first];
+                    return { block[0], block[1], 16 };
+                }
+            }
+            switch (internalformat_) {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_RED_RGTC1:
+            case GL_COMPRESSED_SIGNED_RED_RGTC1:
+            case GL_COMPRESSED_RGB8_ETC2:
+            case GL_COMPRESSED_SRGB8_ETC2:
+            case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+            case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+            case GL_COMPRESSED_R11_EAC:
+            case GL_COMPRESSED_SIGNED_R11_EAC:
+                return { 4, 4, 8 };
+            case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+            case GL_COMPRESSED_RG_RGTC2:
+            case GL_COMPRESSED_SIGNED_RG_RGTC2:
+            case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+            case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+            case GL_COMPRESSED_RGBA_BPTC_UNORM:
+            case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+            case GL_COMPRESSED_RGBA8_ETC2_EAC:
+            case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+            case GL_COMPRESSED_RG11_EAC:
+            case GL_COMPRESSED_SIGNED_RG11_EAC:
+                return { 4, 4, 16 };
+            default:
+                return {};
+            }
+        }
+
+        // |a_| * |b_|, or the largest value there is if that overflows, which no image size matches.
+        std::uint64_t saturating_multiply(std::uint64_t a_, std::uint64_t b_)
+        {
+            constexpr auto max = std::numeric_limits<std::uint64_t>::max();
+            return b_ && a_ > max / b_ ? max : a_ * b_;
+        }
+
+        // Rejects an image whose size in the container is not exactly what its extents and format
+        // make: blocks for compressed formats, rows padded to the unpack alignment for the others.
+        void check_image_size(const ktx_texture &texture_, const ktx_image &image_, std::uint64_t size_)
+        {
+            std::uint64_t rows, rowSize;
+            if (texture_.compressed()) {
+                auto block = find_compressed_block(texture_.internalformat);
+                if (!block.size) {
+                    throw std::runtime_error("Unsupported KTX format.");
+                }
+                rows = (static_cast<std::uint64_t>(image_.height) + block.height - 1) / block.height;
+                rowSize = (static_cast<std::uint64_t>(image_.width) + block.width - 1) / block.width * block.size;
+            }
+            else {
+                if (!bytes_per_pixel(texture_.format, texture_.type)) {
+                    throw std::runtime_error("Unsupported KTX format.");
+                }
+                rows = static_cast<std::uint64_t>(image_.height);
+                rowSize = row_pitch(image_.width, texture_.format, texture_.type, texture_.unpack_alignment);
+            }
+            auto expected = saturating_multiply(saturating_multiply(rowSize, rows), static_cast<std::uint64_t>(image_.depth));
+            if (size_ != expected) {
+                throw std::runtime_error("KTX image size does not match its extents and format.");
+            }
+        }
+
+        // The depth an image of |level_| covers when it holds every layer or slice of the level.
+        GLsizei level_depth(const ktx_texture &texture_, GLint level_)
+        {
+            return texture_.target == GL_TEXTURE_3D ? mip_extent(texture_.depth, level_) : texture_.depth;
+        }
+
+        ktx_texture parse_ktx1(const reader &reader_)
+        {
+            auto endianness = reader_.u32(12);
+            reader swapped = reader_;
+            if (endianness == 0x01020304) {
+                swapped.swap = true;
+            }
+            else if (endianness != 0x04030201) {
+                throw std::runtime_error("Invalid KTX endianness.");
+            }
+            auto &in = swapped;
+
+            auto glType = in.u32(16);
+            auto glTypeSize = in.u32(20);
+            auto glFormat = in.u32(24);
+            auto glInternalFormat = in.u32(28);
+            auto width = in.u32(36);
+            auto height = in.u32(40);
+            auto depth = in.u32(44);
+            auto layers = in.u32(48);
+            auto faces = in.u32(52);
+            auto levels = in.u32(56);
+            auto keyValueBytes = in.u32(60);
+
+            ktx_texture result;
+            describe(result, width, height, depth, layers, faces, levels);
+            if (glType) {
+                if (in.swap && glTypeSize > 1) {
+                    throw std::runtime_error("Byte-swapped KTX images are not supported.");
+                }
+                result.format = glFormat;
+                result.type = glType;
+                // Immutable storage needs a sized format in place of an unsized one.
+                result.internalformat = glInternalFormat;
+                if (glInternalFormat == glFormat) {
+                    result.internalformat = sized_internal_format(glFormat, glType);
+                    if (!result.internalformat) {
+                        throw std::runtime_error("Unsupported KTX format.");
+                    }
+                }
+            }
+            else {
+                result.internalformat = glInternalFormat;
+            }
+            // Rows of uncompressed images are padded to 4 bytes.
+            result.unpack_alignment = 4;
+
+            // Faces of a cube map that is not an array are stored, and padded, one by one.
+            auto separateFaces = result.target == GL_TEXTURE_CUBE_MAP;
+            std::uint64_t offset = 64 + static_cast<std::uint64_t>(keyValueBytes);
+            for (GLint level = 0; level < result.levels; ++level) {
+                auto imageSize = in.u32(offset);
+                offset += 4;
+                ktx_image image;
+                image.level = level;
+                image.width = mip_extent(width, level);
+                image.height = mip_extent(height, level);
+                image.size = imageSize;
+                if (separateFaces) {
+                    check_image_size(result, image, imageSize);
+                    for (GLint face = 0; face < 6; ++face) {
+                        image.zoffset = face;
+                        image.data = in.at(offset, imageSize);
+                        result.images.push_back(image);
+                        offset = align4(offset + imageSize);
+                    }
+                }
+                else {
+                    image.depth = level_depth(result, level);
+                    check_image_size(result, image, imageSize);
+                    image.data = in.at(offset, imageSize);
+                    result.images.push_back(image);
+                    offset = align4(offset + imageSize);
+                }
+            }
+            return result;
+        }
+
+        struct vk_format_info
+        {
+            std::uint32_t vk_format;
+            GLenum internalformat;
+            GLenum format;
+            GLenum type;
+        };
+
+        const vk_format_info vk_formats[] = {
+            { 9, GL_R8, GL_RED, GL_UNSIGNED_BYTE },
+            { 16, GL_RG8, GL_RG, GL_UNSIGNED_BYTE },
+            { 23, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE },
+            { 29, GL_SRGB8, GL_RGB, GL_UNSIGNED_BYTE },
+            { 37, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE },
+            { 43, GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE },
+            { 76, GL_R16F, GL_RED, GL_HALF_FLOAT },
+            { 83, GL_RG16F, GL_RG, GL_HALF_FLOAT },
+            { 97, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT },
+            { 100, GL_R32F, GL_RED, GL_FLOAT },
+            { 103, GL_RG32F, GL_RG, GL_FLOAT },
+            { 109, GL_RGBA32F, GL_RGBA, GL_FLOAT },
+            { 131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 0, 0 },
+            { 132, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 0, 0 },
+            { 133, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 0, 0 },
+            { 134, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 0, 0 },
+            { 135, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 0, 0 },
+            { 136, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 0, 0 },
+            { 137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0, 0 },
+            { 138, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 0, 0 },
+            { 139, GL_COMPRESSED_RED_RGTC1, 0, 0 },
+            { 140, GL_COMPRESSED_SIGNED_RED_RGTC1, 0, 0 },
+            { 141, GL_COMPRESSED_RG_RGTC2, 0, 0 },
+            { 142, GL_COMPRESSED_SIGNED_RG_RGTC2, 0, 0 },
+            { 143, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 0, 0 },
+            { 144, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT, 0, 0 },
+            { 145, GL_COMPRESSED_RGBA_BPTC_UNORM, 0, 0 },
+            { 146, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, 0, 0 },
+            { 147, GL_COMPRESSED_RGB8_ETC2, 0, 0 },
+            { 148, GL_COMPRESSED_SRGB8_ETC2, 0, 0 },
+            { 149, GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2, 0, 0 },
+            { 150, GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2, 0, 0 },
+            { 151, GL_COMPRESSED_RGBA8_ETC2_EAC, 0, 0 },
+            { 152, GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC, 0, 0 },
+            { 153, GL_COMPRESSED_R11_EAC, 0, 0 },
+            { 154, GL_COMPRESSED_SIGNED_R11_EAC, 0, 0 },
+            { 155, GL_COMPRESSED_RG11_EAC, 0, 0 },
+            { 156, GL_COMPRESSED_SIGNED_RG11_EAC, 0, 0 },
+        };
+
+        vk_format_info find_vk_format(std::uint32_t vk_format_)
+        {
+            // The 14 ASTC block sizes come in UNORM and SRGB pairs, in the same order as the GL enums.
+            if (vk_format_ >= 157 && vk_format_ <= 184) {
+                auto index = (vk_format_ - 157) / 2;
+                auto srgb = (vk_format_ - 157) % 2;
+                return { vk_format_, (srgb ? GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR : GL_COMPRESSED_RGBA_ASTC_4x4_KHR) + index, 0, 0 };
+            }
+            for (auto &info : vk_formats) {
+                if (info.vk_format == vk_format_) {
+                    return info;
+                }
+            }
+            throw std::runtime_error("Unsupported KTX2 format.");
+        }
+
+        ktx_texture parse_ktx2(const reader &in_)
+        {
+            auto vkFormat = in_.u32(12);
+            auto width = in_.u32(20);
+            auto height = in_.u32(24);
+            auto depth = in_.u32(28);
+            auto layers = in_.u32(32);
+            auto faces = in_.u32(36);
+            auto levels = in_.u32(40);
+            auto supercompression = in_.u32(44);
+            if (supercompression || !vkFormat) {
+                throw std::runtime_error("Supercompressed and Basis Universal KTX2 textures are not supported.");
+            }
+
+            ktx_texture result;
+            describe(result, width, height, depth, layers, faces, levels);
+            auto format = find_vk_format(vkFormat);
+            result.internalformat = format.internalformat;
+            result.format = format.format;
+            result.type = format.type;
+            // Rows are tightly packed.
+            result.unpack_alignment = 1;
+
+            // Every level holds all of its layers, faces and slices back to back.
+            const std::uint64_t levelIndex = 80;
+            for (GLint level = 0; level < result.levels; ++level) {
+                auto entry = levelIndex + static_cast<std::uint64_t>(level) * 24;
+                auto offset = in_.u64(entry);
+                auto length = in_.u64(entry + 8);
+                ktx_image image;
+                image.level = level;
+                image.width = mip_extent(width, level);
+                image.height = mip_extent(height, level);
+                image.depth = level_depth(result, level);
+                check_image_size(result, image, length);
+                image.data = in_.at(offset, length);
+                image.size = static_cast<std::size_t>(length);
+                result.images.push_back(image);
+            }
+            return result;
+        }
+    }
+
+    ktx_texture parse_ktx(const std::uint8_t *data_, std::size_t size_)
+    {
+        reader in(data_, size_);
+        auto identifier = in.at(0, 12);
+        if (std::equal(identifier, identifier + 12, ktx1_identifier)) {
+            return parse_ktx1(in);
+        }
+        if (std::equal(identifier, identifier + 12, ktx2_identifier)) {
+            return parse_ktx2(in);
+        }
+        throw std::runtime_error("Not a KTX container.");
+    }
+}
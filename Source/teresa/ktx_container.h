@@ -0,0 +1,88 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compressed formats of extensions, which the GL headers may lack.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT 0x8C4E
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+#define GL_COMPRESSED_RGBA_ASTC_4x4_KHR 0x93B0
+#define GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR 0x93D0
+#endif
+
+namespace teresa
+{
+    // One upload of a KTX texture: a mip level of one cube face, or of a run of layers or slices.
+    struct ktx_image
+    {
+        GLint level = 0;
+
+        // First layer, cube face (layer * 6 + face for cube arrays) or depth slice the image covers.
+        GLint zoffset = 0;
+
+        GLsizei width = 0;
+
+        GLsizei height = 0;
+
+        GLsizei depth = 1;
+
+        // Points into the parsed container.
+        const std::uint8_t *data = nullptr;
+
+        std::size_t size = 0;
+    };
+
+    struct ktx_texture
+    {
+        // TEXTURE_2D, TEXTURE_CUBE_MAP, TEXTURE_2D_ARRAY, TEXTURE_CUBE_MAP_ARRAY or TEXTURE_3D.
+        GLenum target = GL_TEXTURE_2D;
+
+        // Always sized, so it suits immutable storage.
+        GLenum internalformat = 0;
+
+        // Client format and type of uncompressed images; both 0 for compressed ones.
+        GLenum format = 0;
+
+        GLenum type = 0;
+
+        GLsizei width = 0;
+
+        GLsizei height = 0;
+
+        // Slices of a 3D texture, or layers times faces of an array or cube map.
+        GLsizei depth = 1;
+
+        GLsizei levels = 1;
+
+        // The container asks for the mip chain to be generated rather than storing it.
+        bool generate_mipmaps = false;
+
+        // Row alignment of uncompressed images.
+        GLint unpack_alignment = 4;
+
+        std::vector<ktx_image> images;
+
+        bool compressed() const
+        {
+            return type == 0;
+        }
+    };
+
+    // Parses a KTX 1.1 or KTX 2.0 container without copying its images.
+    // Throws on malformed containers and on supercompressed or unknown formats.
+    ktx_texture parse_ktx(const std::uint8_t *data_, std::size_t size_);
+}
@@ -9,9 +9,9 @@
 #include "napi_utils.h"
 #include "app.h"
 
-node_ptr<teresa::webgl_canvas> create_canvas()
+node_ptr<teresa::webgl_canvas> create_canvas(webgl::ContextAttributes context_attributes_)
 {
-    return make_node_ptr<teresa::webgl_canvas>();
+    return make_node_ptr<teresa::webgl_canvas>(context_attributes_);
 }
 
 void destroy_canvas(node_ptr<teresa::webgl_canvas> canvas_)
@@ -21,6 +21,10 @@ void destroy_canvas(node_ptr<teresa::webgl_canvas> canvas_)
 
 napi_value Init(napi_env env_, napi_value exports_)
 {
+    uv_loop_s *loop = nullptr;
+    if (napi_get_uv_event_loop(env_, &loop) == napi_ok) {
+        teresa::event_pump::set_loop(loop);
+    }
     set_node_property(env_, exports_, u8"createCanvas", create_canvas);
     set_node_property(env_, exports_, u8"destroyCanvas", destroy_canvas);
     return exports_;
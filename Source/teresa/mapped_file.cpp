@@ -0,0 +1,85 @@
+
+#include "mapped_file.h"
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace teresa
+{
+#if defined(_WIN32)
+    mapped_file::mapped_file(const std::string &path_)
+    {
+        auto length = MultiByteToWideChar(CP_UTF8, 0, path_.data(), static_cast<int>(path_.size()), nullptr, 0);
+        std::wstring path(length, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, path_.data(), static_cast<int>(path_.size()), path.data(), length);
+
+        auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to open " + path_ + ".");
+        }
+        _file = file;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to map " + path_ + ", it is empty or unreadable.");
+        }
+        _size = static_cast<std::size_t>(size.QuadPart);
+
+        _mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (_mapping) {
+            _data = static_cast<const std::uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+        if (!_data) {
+            if (_mapping) {
+                CloseHandle(_mapping);
+            }
+            CloseHandle(file);
+            throw std::runtime_error("Failed to map " + path_ + ".");
+        }
+    }
+
+    mapped_file::~mapped_file()
+    {
+        UnmapViewOfFile(_data);
+        CloseHandle(_mapping);
+        CloseHandle(_file);
+    }
+#else
+    mapped_file::mapped_file(const std::string &path_)
+    {
+        auto file = open(path_.c_str(), O_RDONLY);
+        if (file < 0) {
+            throw std::runtime_error("Failed to open " + path_ + ".");
+        }
+        struct stat status;
+        if (fstat(file, &status) != 0 || status.st_size == 0) {
+            close(file);
+            throw std::runtime_error("Failed to map " + path_ + ", it is empty or unreadable.");
+        }
+        _size = static_cast<std::size_t>(status.st_size);
+
+        auto data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, file, 0);
+        // The mapping outlives the descriptor.
+        close(file);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("Failed to map " + path_ + ".");
+        }
+        _data = static_cast<const std::uint8_t*>(data);
+    }
+
+    mapped_file::~mapped_file()
+    {
+        munmap(const_cast<std::uint8_t*>(_data), _size);
+    }
+#endif
+}
@@ -0,0 +1,43 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace teresa
+{
+    // A whole file mapped read-only into memory for as long as the object lives.
+    class mapped_file
+    {
+    public:
+        // |path_| is UTF-8. Throws if the file cannot be opened or mapped.
+        explicit mapped_file(const std::string &path_);
+
+        mapped_file(const mapped_file &) = delete;
+
+        mapped_file& operator=(const mapped_file &) = delete;
+
+        ~mapped_file();
+
+        const std::uint8_t* data() const
+        {
+            return _data;
+        }
+
+        std::size_t size() const
+        {
+            return _size;
+        }
+    private:
+        const std::uint8_t *_data = nullptr;
+
+        std::size_t _size = 0;
+
+#if defined(_WIN32)
+        void *_file = nullptr;
+
+        void *_mapping = nullptr;
+#endif
+    };
+}
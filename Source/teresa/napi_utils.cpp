@@ -9,12 +9,65 @@ void node_compatible::to_node(napi_env env_, napi_value object_) const
     set_node_property(env_, object_, native_handle_property_name, this);
 }
 
+static napi_env current_node_env_ = nullptr;
+
+napi_env current_node_env()
+{
+    return current_node_env_;
+}
+
+node_env_scope::node_env_scope(napi_env env_)
+    :_outerEnv(current_node_env_)
+{
+    current_node_env_ = env_;
+}
+
+node_env_scope::~node_env_scope()
+{
+    current_node_env_ = _outerEnv;
+}
+
 napi_value global_napi_callback(napi_env env_, napi_callback_info callback_info_)
 {
     void *dataraw = nullptr;
     napi_get_cb_info(env_, callback_info_, nullptr, nullptr, nullptr, &dataraw);
 
+    node_env_scope envScope(env_);
     auto data = static_cast<global_napi_callback_data_t>(dataraw);
     auto retval = data->unpacker(env_, callback_info_);
     return retval;
 }
+
+napi_value global_napi_getter(napi_env env_, napi_callback_info callback_info_)
+{
+    void *dataraw = nullptr;
+    napi_get_cb_info(env_, callback_info_, nullptr, nullptr, nullptr, &dataraw);
+
+    node_env_scope envScope(env_);
+    auto data = static_cast<global_napi_accessor_data*>(dataraw);
+    return data->getter->unpacker(env_, callback_info_);
+}
+
+napi_value global_napi_setter(napi_env env_, napi_callback_info callback_info_)
+{
+    void *dataraw = nullptr;
+    napi_get_cb_info(env_, callback_info_, nullptr, nullptr, nullptr, &dataraw);
+
+    node_env_scope envScope(env_);
+    auto data = static_cast<global_napi_accessor_data*>(dataraw);
+    return data->setter->unpacker(env_, callback_info_);
+}
+
+void _define_node_accessor(napi_env env_, napi_value object_, const char *property_name_,
+    global_napi_callback_data_t getter_, global_napi_callback_data_t setter_)
+{
+    napi_property_descriptor descriptor = {};
+    descriptor.utf8name = property_name_;
+    descriptor.getter = global_napi_getter;
+    descriptor.setter = setter_ ? global_napi_setter : nullptr;
+    descriptor.attributes = napi_enumerable;
+    descriptor.data = new global_napi_accessor_data{ getter_, setter_ };
+    if (napi_define_properties(env_, object_, 1, &descriptor) != napi_ok) {
+        napi_throw_error(env_, nullptr, "Unable to define accessor property.");
+    }
+}
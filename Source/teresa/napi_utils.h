@@ -9,6 +9,9 @@
 #include <functional>
 #include <utility>
 #include <charconv>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
 #include <variant>
 
 static_assert(sizeof(std::intptr_t) <= sizeof(std::int64_t));
@@ -97,6 +100,7 @@ template <typename Ty>
 void destroy_node_ptr(node_ptr<Ty> ptr_)
 {
     node_objects.remove(ptr_.get());
+    delete ptr_.get();
     ptr_.reset();
 }
 
@@ -138,6 +142,52 @@ struct array_buffer
     std::size_t size = 0;
 };
 
+// ArrayBuffer over memory owned by native code, nothing is copied.
+// |release| (if any) is called with |data| once the ArrayBuffer is collected.
+struct external_array_buffer
+{
+    void *data = nullptr;
+    std::size_t size = 0;
+    std::function<void(void*)> release;
+};
+
+// Work handed to JavaScript as a Promise: |execute| runs on the libuv thread pool,
+// then |complete| runs on the JavaScript thread and its result resolves the promise.
+// An exception thrown by either rejects the promise instead.
+template <typename Ty>
+struct node_async
+{
+    std::function<void()> execute;
+    std::function<Ty()> complete;
+};
+
+template <typename Ty>
+struct is_node_async
+    :public std::false_type
+{
+
+};
+
+template <typename Ty>
+struct is_node_async<node_async<Ty>>
+    :public std::true_type
+{
+
+};
+
+template <typename Ty>
+constexpr bool is_node_async_v = is_node_async<Ty>::value;
+
+template <typename Ty>
+napi_value _create_node_async(napi_env env_, const node_async<Ty> &async_);
+
+inline void _finalize_external_array_buffer(napi_env env_, void *data_, void *hint_)
+{
+    auto release = static_cast<std::function<void(void*)>*>(hint_);
+    (*release)(data_);
+    delete release;
+}
+
 template <typename Ty>
 struct typed_array
 {
@@ -220,6 +270,24 @@ struct data_view
     array_buffer underlying_buffer;
 };
 
+// Plain dictionaries read from JS objects member by member through |from_node|.
+template <typename Ty, typename = void>
+struct is_node_dictionary
+    :public std::false_type
+{
+
+};
+
+template <typename Ty>
+struct is_node_dictionary<Ty, std::void_t<decltype(std::declval<Ty&>().from_node(std::declval<napi_env>(), std::declval<napi_value>()))>>
+    :public std::true_type
+{
+
+};
+
+template <typename Ty>
+constexpr bool is_node_dictionary_v = is_node_dictionary<Ty>::value;
+
 template <typename Ty>
 struct is_node_variant
     :public std::false_type
@@ -274,6 +342,35 @@ extern std::list<global_napi_callback_data_t*> global_napi_callback_datas;
 
 napi_value global_napi_callback(napi_env env_, napi_callback_info callback_info_);
 
+// The getter and setter of an accessor property, which N-API hands a single data pointer.
+struct global_napi_accessor_data {
+    global_napi_callback_data_t getter;
+    global_napi_callback_data_t setter;
+};
+
+napi_value global_napi_getter(napi_env env_, napi_callback_info callback_info_);
+
+napi_value global_napi_setter(napi_env env_, napi_callback_info callback_info_);
+
+// The environment of the innermost call from JavaScript into native code, null outside of such calls.
+napi_env current_node_env();
+
+// Makes |env_| the current_node_env() while alive, for native code entered by other
+// means than a call, such as the completion of async work.
+class node_env_scope
+{
+public:
+    explicit node_env_scope(napi_env env_);
+
+    node_env_scope(const node_env_scope &) = delete;
+
+    node_env_scope& operator=(const node_env_scope &) = delete;
+
+    ~node_env_scope();
+private:
+    napi_env _outerEnv;
+};
+
 template <typename ...Tys, std::size_t ...Is>
 std::tuple<Tys...> _read_node_function_args_impl(napi_env env_, napi_value *args_, std::index_sequence<Is...>)
 {
@@ -290,7 +387,14 @@ std::tuple<Args...> _read_node_function_args(napi_env env_, napi_callback_info c
     void *data = nullptr;
     napi_get_cb_info(env_, callback_info_, &argc, args.data(), &thisArg, &data);
 
-    if (args.size() != argc) {
+    // Trailing dictionaries may be omitted, they are read from undefined then.
+    constexpr bool isOptional[] = { is_node_dictionary_v<Args>..., false };
+    std::size_t requiredArgc = args.size();
+    while (requiredArgc > 0 && isOptional[requiredArgc - 1]) {
+        --requiredArgc;
+    }
+
+    if (argc > args.size() || argc < requiredArgc) {
         napi_throw_error(env_, nullptr, "Unmatched arguments count.");
     }
 
@@ -304,7 +408,7 @@ template <typename ReturnTy, typename ...Args>
 using _bound_fx_getter_t = std::function<_bound_fx_t<ReturnTy, Args...>(napi_env, napi_callback_info)>;
 
 template <typename ReturnTy, typename ...Args>
-napi_value _create_node_function_like(napi_env env_, _bound_fx_getter_t<ReturnTy, Args...> bound_fx_getter_)
+global_napi_callback_data_t _create_node_callback_data(_bound_fx_getter_t<ReturnTy, Args...> bound_fx_getter_)
 {
     auto invoker = [bound_fx_getter_](napi_env env_, napi_callback_info callback_info_) {
         auto boundFx = bound_fx_getter_(env_, callback_info_);
@@ -319,7 +423,13 @@ napi_value _create_node_function_like(napi_env env_, _bound_fx_getter_t<ReturnTy
         }
     };
 
-    global_napi_callback_data_t data = new global_napi_callback_data{ invoker };
+    return new global_napi_callback_data{ invoker };
+}
+
+template <typename ReturnTy, typename ...Args>
+napi_value _create_node_function_like(napi_env env_, _bound_fx_getter_t<ReturnTy, Args...> bound_fx_getter_)
+{
+    auto data = _create_node_callback_data(bound_fx_getter_);
     napi_value result;
     auto status = napi_create_function(env_, nullptr, 0, global_napi_callback, static_cast<void*>(data), &result);
     if (status != napi_ok) {
@@ -342,8 +452,24 @@ napi_value _create_node_function(napi_env env_, ReturnTy (*fx_)(Args...))
     return _create_node_function_like(env_, boundFxGetter);
 }
 
+// A function which runs |prologue_| before every call, e.g. to make current what |fx_| works on.
+template <typename ReturnTy, typename ...Args>
+napi_value create_node_function(napi_env env_, ReturnTy (*fx_)(Args...), std::function<void()> prologue_)
+{
+    std::function<ReturnTy(Args...)> fx(fx_);
+
+    _bound_fx_getter_t<ReturnTy, Args...> boundFxGetter =
+        [fx, prologue_](napi_env env_, napi_callback_info callback_info_)
+    {
+        prologue_();
+        return fx;
+    };
+
+    return _create_node_function_like(env_, boundFxGetter);
+}
+
 template <typename ThisTy, typename ReturnTy, typename ...Args, typename = std::enable_if_t<std::is_base_of_v<node_compatible, ThisTy>>>
-napi_value _create_node_method(napi_env env_, ReturnTy (ThisTy::*fx_)(Args...))
+_bound_fx_getter_t<ReturnTy, Args...> _bind_node_method(ReturnTy (ThisTy::*fx_)(Args...))
 {
     std::function<ReturnTy(ThisTy*, Args...)> fx(fx_);
 
@@ -362,7 +488,33 @@ napi_value _create_node_method(napi_env env_, ReturnTy (ThisTy::*fx_)(Args...))
         };
     };
 
-    return _create_node_function_like(env_, boundFxGetter);
+    return boundFxGetter;
+}
+
+template <typename ThisTy, typename ReturnTy, typename ...Args, typename = std::enable_if_t<std::is_base_of_v<node_compatible, ThisTy>>>
+napi_value _create_node_method(napi_env env_, ReturnTy (ThisTy::*fx_)(Args...))
+{
+    return _create_node_function_like(env_, _bind_node_method(fx_));
+}
+
+void _define_node_accessor(napi_env env_, napi_value object_, const char *property_name_,
+    global_napi_callback_data_t getter_, global_napi_callback_data_t setter_);
+
+// Defines |property_name_| on |object_| as an accessor property, read through the member function
+// |getter_| and written through |setter_| of the native object behind |object_|.
+template <typename ThisTy, typename ValueTy, typename SetterArgTy>
+void set_node_accessor(napi_env env_, napi_value object_, const char *property_name_,
+    ValueTy (ThisTy::*getter_)(), void (ThisTy::*setter_)(SetterArgTy))
+{
+    _define_node_accessor(env_, object_, property_name_,
+        _create_node_callback_data(_bind_node_method(getter_)), _create_node_callback_data(_bind_node_method(setter_)));
+}
+
+// A read-only accessor property.
+template <typename ThisTy, typename ValueTy>
+void set_node_accessor(napi_env env_, napi_value object_, const char *property_name_, ValueTy (ThisTy::*getter_)())
+{
+    _define_node_accessor(env_, object_, property_name_, _create_node_callback_data(_bind_node_method(getter_)), nullptr);
 }
 
 template <std::size_t I, typename Ty>
@@ -451,13 +603,20 @@ Ty read_node_value(napi_env env_, napi_value value_)
             return Ty();
         }
 
-        std::vector<char> buf(512);
+        // Measured first, as shader sources easily exceed any fixed buffer.
         std::size_t actualLength = 0;
+        napi_get_value_string_utf8(env_, coercedValue, nullptr, 0, &actualLength);
+        std::vector<char> buf(actualLength + 1);
         napi_get_value_string_utf8(env_, coercedValue, buf.data(), buf.size(), &actualLength);
         return Ty(buf.data(), buf.data() + actualLength);
     }
     else if constexpr (is_node_ptr_v<Ty>)
     {
+        napi_valuetype valueType = napi_valuetype::napi_undefined;
+        napi_typeof(env_, value_, &valueType);
+        if (valueType == napi_valuetype::napi_null || valueType == napi_valuetype::napi_undefined) {
+            return Ty();
+        }
         using ThisTy = typename Ty::value_type;
         ThisTy *this_ = nullptr;
         read_node_property<ThisTy*>(env_, value_, this_, node_compatible::native_handle_property_name);
@@ -503,9 +662,31 @@ Ty read_node_value(napi_env env_, napi_value value_)
         result.underlying_buffer = read_node_value<array_buffer>(env_, ab);
         return result;
     }
+    else if constexpr (is_node_array_v<Ty>) {
+        bool isArray = false;
+        napi_is_array(env_, value_, &isArray);
+        if (!isArray) {
+            throw std::runtime_error("Type mismatch, expect Array.");
+        }
+        std::uint32_t length = 0;
+        napi_get_array_length(env_, value_, &length);
+        Ty result;
+        result.reserve(length);
+        for (std::uint32_t i = 0; i < length; ++i) {
+            napi_value element = nullptr;
+            napi_get_element(env_, value_, i, &element);
+            result.push_back(read_node_value<typename Ty::value_type>(env_, element));
+        }
+        return result;
+    }
     else if constexpr (is_node_variant_v<Ty>) {
         return _read_variant_node_value<Ty>(env_, value_);
     }
+    else if constexpr (is_node_dictionary_v<Ty>) {
+        Ty result;
+        result.from_node(env_, value_);
+        return result;
+    }
     else if constexpr (std::is_pointer_v<Ty>) {
         std::int64_t i = 0;
         napi_get_value_int64(env_, value_, &i);
@@ -531,11 +712,26 @@ void read_node_property(napi_env env_, napi_value value_, Ty &result_, const cha
     result_ = read_node_value<Ty>(env_, property);
 }
 
+template <typename Ty>
+bool read_node_property_if_present(napi_env env_, napi_value object_, Ty &result_, const char *property_name_)
+{
+    bool hasProperty = false;
+    napi_has_named_property(env_, object_, property_name_, &hasProperty);
+    if (!hasProperty) {
+        return false;
+    }
+    read_node_property(env_, object_, result_, property_name_);
+    return true;
+}
+
 template <typename Ty>
 napi_value create_node_value(napi_env env_, const Ty &value_)
 {
     napi_value result = nullptr;
-    if constexpr (std::is_same_v<Ty, std::int64_t>) {
+    if constexpr (std::is_same_v<Ty, napi_value>) {
+        result = value_;
+    }
+    else if constexpr (std::is_same_v<Ty, std::int64_t>) {
         napi_create_int64(env_, value_, &result);
     }
     else if constexpr (std::is_same_v<Ty, std::int32_t>) {
@@ -565,9 +761,22 @@ napi_value create_node_value(napi_env env_, const Ty &value_)
             napi_set_element(env_, result, i, create_node_value<ElementType>(env_, value_[i]));
         }
     }
+    else if constexpr (std::is_same_v<Ty, std::nullptr_t>) {
+        napi_get_null(env_, &result);
+    }
     else if constexpr (is_node_ptr_v<Ty>) {
-        napi_create_object(env_, &result);
-        value_->to_node(env_, result);
+        if (!value_.get()) {
+            napi_get_null(env_, &result);
+        }
+        else {
+            napi_create_object(env_, &result);
+            value_->to_node(env_, result);
+        }
+    }
+    else if constexpr (is_node_variant_v<Ty>) {
+        result = std::visit([env_](const auto &alternative) {
+            return create_node_value(env_, alternative);
+        }, value_);
     }
     else if constexpr (std::is_function_v<Ty>) {
         result = _create_node_function(env_, value_);
@@ -576,7 +785,19 @@ napi_value create_node_value(napi_env env_, const Ty &value_)
         result = _create_node_method(env_, value_);
     }
     else if constexpr (std::is_same_v<Ty, array_buffer>) {
-        napi_create_arraybuffer(env_, value_.size, &value.data, &result);
+        void *data = nullptr;
+        napi_create_arraybuffer(env_, value_.size, &data, &result);
+        if (value_.data && value_.size) {
+            std::memcpy(data, value_.data, value_.size);
+        }
+    }
+    else if constexpr (is_node_async_v<Ty>) {
+        result = _create_node_async(env_, value_);
+    }
+    else if constexpr (std::is_same_v<Ty, external_array_buffer>) {
+        auto release = value_.release ? new std::function<void(void*)>(value_.release) : nullptr;
+        napi_create_external_arraybuffer(env_, value_.data, value_.size,
+            release ? _finalize_external_array_buffer : nullptr, release, &result);
     }
     else if constexpr (std::is_pointer_v<Ty>) {
         using ElementType = std::remove_pointer_t<Ty>;
@@ -600,3 +821,71 @@ void set_node_property(napi_env env_, napi_value object_, const char *property_n
 {
     napi_set_named_property(env_, object_, property_name_, create_node_value(env_, value_));
 }
+
+template <typename Ty>
+napi_value _create_node_async(napi_env env_, const node_async<Ty> &async_)
+{
+    struct state
+    {
+        node_async<Ty> async;
+        napi_deferred deferred = nullptr;
+        napi_async_work work = nullptr;
+        std::string error;
+    };
+
+    auto executor = [](napi_env env_, void *data_) {
+        auto s = static_cast<state*>(data_);
+        try {
+            if (s->async.execute) {
+                s->async.execute();
+            }
+        }
+        catch (const std::exception &exception) {
+            s->error = exception.what();
+        }
+    };
+
+    auto completer = [](napi_env env_, napi_status status_, void *data_) {
+        std::unique_ptr<state> s(static_cast<state*>(data_));
+        napi_delete_async_work(env_, s->work);
+        node_env_scope envScope(env_);
+        napi_value outcome = nullptr;
+        if (status_ != napi_ok) {
+            s->error = "Async work was cancelled.";
+        }
+        else if (s->error.empty()) {
+            try {
+                if constexpr (std::is_void_v<Ty>) {
+                    if (s->async.complete) {
+                        s->async.complete();
+                    }
+                    napi_get_undefined(env_, &outcome);
+                }
+                else {
+                    outcome = create_node_value(env_, s->async.complete());
+                }
+            }
+            catch (const std::exception &exception) {
+                s->error = exception.what();
+            }
+        }
+        if (outcome) {
+            napi_resolve_deferred(env_, s->deferred, outcome);
+            return;
+        }
+        napi_value message = nullptr;
+        napi_create_string_utf8(env_, s->error.c_str(), s->error.size(), &message);
+        napi_value error = nullptr;
+        napi_create_error(env_, nullptr, message, &error);
+        napi_reject_deferred(env_, s->deferred, error);
+    };
+
+    auto s = new state{ async_ };
+    napi_value promise = nullptr;
+    napi_create_promise(env_, &s->deferred, &promise);
+    napi_value resourceName = nullptr;
+    napi_create_string_utf8(env_, "teresa::node_async", NAPI_AUTO_LENGTH, &resourceName);
+    napi_create_async_work(env_, nullptr, resourceName, executor, completer, s, &s->work);
+    napi_queue_async_work(env_, s->work);
+    return promise;
+}
@@ -1,7 +1,264 @@
 
+#include "native_webgl.h"
+#include "glsl_translator.h"
+#include <algorithm>
+#include <stdexcept>
 #include <thread>
 
 namespace teresa
 {
+    vertex_attrib_state& vertex_array_state::attrib(GLuint index_)
+    {
+        if (index_ >= attribs.size()) {
+            attribs.resize(index_ + 1);
+        }
+        return attribs[index_];
+    }
 
-}
\ No newline at end of file
+    native_webgl *native_webgl::_current = nullptr;
+
+    native_webgl::native_webgl()
+        :_vertexArrayBinding(&_defaultVertexArray)
+    {
+
+    }
+
+    native_webgl::~native_webgl()
+    {
+        if (_current == this) {
+            _current = nullptr;
+        }
+    }
+
+    native_webgl& native_webgl::current()
+    {
+        if (!_current) {
+            throw std::runtime_error("No current WebGL context.");
+        }
+        return *_current;
+    }
+
+    void native_webgl::make_current()
+    {
+        _current = this;
+    }
+
+    void native_webgl::bind_vertex_array(vertex_array_state *state_)
+    {
+        _vertexArrayBinding = state_ ? state_ : &_defaultVertexArray;
+    }
+
+    bool native_webgl::is_vertex_array_bound(const vertex_array_state *state_) const
+    {
+        return _vertexArrayBinding == (state_ ? state_ : &_defaultVertexArray);
+    }
+
+    webgl::Buffer* native_webgl::buffer_binding(GLenum target_)
+    {
+        switch (target_) {
+        case GL_ARRAY_BUFFER:
+            return _arrayBufferBinding;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return _vertexArrayBinding->element_array_buffer;
+        case GL_UNIFORM_BUFFER:
+            return _uniformBufferBinding;
+        default:
+            return nullptr;
+        }
+    }
+
+    GLint native_webgl::max_vertex_attribs()
+    {
+        if (!_maxVertexAttribs) {
+            glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &_maxVertexAttribs);
+        }
+        return _maxVertexAttribs;
+    }
+
+    GLint native_webgl::max_uniform_buffer_bindings()
+    {
+        if (!_maxUniformBufferBindings) {
+            glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &_maxUniformBufferBindings);
+        }
+        return _maxUniformBufferBindings;
+    }
+
+    GLint native_webgl::max_combined_texture_image_units()
+    {
+        if (!_maxCombinedTextureImageUnits) {
+            glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &_maxCombinedTextureImageUnits);
+        }
+        return _maxCombinedTextureImageUnits;
+    }
+
+    GLint native_webgl::uniform_buffer_offset_alignment()
+    {
+        if (!_uniformBufferOffsetAlignment) {
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &_uniformBufferOffsetAlignment);
+        }
+        return _uniformBufferOffsetAlignment;
+    }
+
+    bool native_webgl::bind_uniform_buffer_range(GLuint index_, const uniform_buffer_range &range_)
+    {
+        if (index_ >= static_cast<GLuint>(max_uniform_buffer_bindings())) {
+            return false;
+        }
+        if (index_ >= _uniformBufferRanges.size()) {
+            _uniformBufferRanges.resize(index_ + 1);
+        }
+        _uniformBufferRanges[index_] = range_;
+        _uniformBufferBinding = range_.buffer;
+        return true;
+    }
+
+    std::shared_ptr<shader_compiler> native_webgl::compiler()
+    {
+        if (!_compiler) {
+            if (!_window) {
+                throw std::runtime_error("The context has no window to share objects with.");
+            }
+            // Drivers compile on threads of their own as well, so a few contexts are enough.
+            auto threads = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+            _compiler = std::make_shared<shader_compiler>(_window, threads);
+        }
+        return _compiler;
+    }
+
+    int native_webgl::glsl_version()
+    {
+        if (!_glslVersion) {
+            _glslVersion = parse_glsl_version(reinterpret_cast<const char*>(glGetString(GL_SHADING_LANGUAGE_VERSION)));
+        }
+        return _glslVersion;
+    }
+
+    namespace
+    {
+        std::size_t texture_slot(GLenum target_)
+        {
+            if (target_ == GL_TEXTURE_2D) {
+                return 0;
+            }
+            if (target_ == GL_TEXTURE_CUBE_MAP ||
+                (target_ >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target_ <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)) {
+                return 1;
+            }
+            return 2;
+        }
+    }
+
+    bool native_webgl::active_texture(GLenum texture_)
+    {
+        if (texture_ < GL_TEXTURE0 || texture_ - GL_TEXTURE0 >= static_cast<GLuint>(max_combined_texture_image_units())) {
+            return false;
+        }
+        _activeTexture = texture_ - GL_TEXTURE0;
+        return true;
+    }
+
+    webgl::Texture* native_webgl::texture_binding(GLenum target_)
+    {
+        auto slot = texture_slot(target_);
+        if (slot > 1 || _activeTexture >= _textureUnits.size()) {
+            return nullptr;
+        }
+        return _textureUnits[_activeTexture][slot];
+    }
+
+    void native_webgl::bind_texture(GLenum target_, webgl::Texture *texture_)
+    {
+        auto slot = texture_slot(target_);
+        if (slot > 1) {
+            return;
+        }
+        if (_activeTexture >= _textureUnits.size()) {
+            _textureUnits.resize(_activeTexture + 1);
+        }
+        _textureUnits[_activeTexture][slot] = texture_;
+    }
+
+    void native_webgl::on_texture_deleted(const webgl::Texture *texture_)
+    {
+        for (auto &unit : _textureUnits) {
+            for (auto &binding : unit) {
+                if (binding == texture_) {
+                    binding = nullptr;
+                }
+            }
+        }
+    }
+
+    void native_webgl::on_renderbuffer_deleted(const webgl::Renderbuffer *renderbuffer_)
+    {
+        if (_renderbufferBinding == renderbuffer_) {
+            _renderbufferBinding = nullptr;
+        }
+    }
+
+    void native_webgl::account_memory(memory_kind kind_, std::size_t old_size_, std::size_t new_size_)
+    {
+        auto &kind = _memoryUsage.kinds[static_cast<std::size_t>(kind_)];
+        kind.bytes = kind.bytes - old_size_ + new_size_;
+        if (!old_size_ && new_size_) {
+            ++kind.objects;
+        }
+        else if (old_size_ && !new_size_) {
+            --kind.objects;
+        }
+        _memoryUsage.total_bytes = _memoryUsage.total_bytes - old_size_ + new_size_;
+        _memoryUsage.peak_total_bytes = std::max(_memoryUsage.peak_total_bytes, _memoryUsage.total_bytes);
+    }
+
+    void native_webgl::enable_buffer_pool()
+    {
+        if (!_pooledBuffers) {
+            _pooledBuffers = std::make_unique<buffer_pool>();
+        }
+    }
+
+    void native_webgl::enable_staging(std::size_t capacity_)
+    {
+        if (!_staging) {
+            _staging = std::make_unique<staging_ring>(capacity_);
+        }
+    }
+
+    void native_webgl::synthesize_error(GLenum error_)
+    {
+        if (_synthesizedError == GL_NO_ERROR) {
+            _synthesizedError = error_;
+        }
+    }
+
+    GLenum native_webgl::take_synthesized_error()
+    {
+        auto result = _synthesizedError;
+        _synthesizedError = GL_NO_ERROR;
+        return result;
+    }
+
+    void native_webgl::on_buffer_deleted(const webgl::Buffer *buffer_)
+    {
+        if (_arrayBufferBinding == buffer_) {
+            _arrayBufferBinding = nullptr;
+        }
+        if (_uniformBufferBinding == buffer_) {
+            _uniformBufferBinding = nullptr;
+        }
+        for (auto &range : _uniformBufferRanges) {
+            if (range.buffer == buffer_) {
+                range = uniform_buffer_range();
+            }
+        }
+        auto &vertexArray = vertex_array_binding();
+        if (vertexArray.element_array_buffer == buffer_) {
+            vertexArray.element_array_buffer = nullptr;
+        }
+        for (auto &attrib : vertexArray.attribs) {
+            if (attrib.buffer == buffer_) {
+                attrib.buffer = nullptr;
+            }
+        }
+    }
+}
@@ -1,11 +1,320 @@
 
+#pragma once
+
+#include "buffer_pool.h"
+#include "shader_cache.h"
+#include "shader_compiler.h"
+#include "staging_ring.h"
+#include "texture_pool.h"
+#include <glad/glad.h>
+#include <array>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// WebGL-only enums, which the GL headers lack.
+#define GL_UNPACK_FLIP_Y_WEBGL 0x9240
+#define GL_UNPACK_PREMULTIPLY_ALPHA_WEBGL 0x9241
+#define GL_CONTEXT_LOST_WEBGL 0x9242
+#define GL_UNPACK_COLORSPACE_CONVERSION_WEBGL 0x9243
+#define GL_BROWSER_DEFAULT_WEBGL 0x9244
+
+namespace webgl
+{
+    struct Buffer;
+    struct Program;
+    struct Renderbuffer;
+    struct Texture;
+}
 
 namespace teresa
 {
+    struct virtual_state;
+
+    struct vertex_attrib_state
+    {
+        bool enabled = false;
+        webgl::Buffer *buffer = nullptr;
+        GLint size = 4;
+        GLenum type = GL_FLOAT;
+        GLboolean normalized = GL_FALSE;
+        GLsizei stride = 0;
+        GLintptr offset = 0;
+    };
+
+    // Everything a vertex array object captures.
+    struct vertex_array_state
+    {
+        webgl::Buffer *element_array_buffer = nullptr;
+        std::vector<vertex_attrib_state> attribs;
+
+        vertex_attrib_state& attrib(GLuint index_);
+    };
+
+    enum class memory_kind
+    {
+        buffer,
+        texture,
+        renderbuffer,
+    };
+
+    constexpr std::size_t memory_kind_count = 3;
+
+    // Estimated GPU memory held by the objects of one context.
+    struct memory_usage
+    {
+        struct kind_usage
+        {
+            std::size_t bytes = 0;
+
+            // Objects holding any memory.
+            std::size_t objects = 0;
+        };
+
+        std::array<kind_usage, memory_kind_count> kinds;
+
+        std::size_t total_bytes = 0;
+
+        std::size_t peak_total_bytes = 0;
+    };
+
+    // Native shadow of the GL state of one WebGL context,
+    // so that redundant state changes never reach the driver.
     class native_webgl
     {
     public:
+        native_webgl();
+
+        native_webgl(const native_webgl &) = delete;
+
+        native_webgl& operator=(const native_webgl &) = delete;
+
+        ~native_webgl();
+
+        // The state of the context which was made current most recently.
+        static native_webgl& current();
+
+        void make_current();
+
+        webgl::Buffer* array_buffer_binding() const
+        {
+            return _arrayBufferBinding;
+        }
+
+        void bind_array_buffer(webgl::Buffer *buffer_)
+        {
+            _arrayBufferBinding = buffer_;
+        }
+
+        vertex_array_state& vertex_array_binding()
+        {
+            return *_vertexArrayBinding;
+        }
+
+        vertex_array_state& default_vertex_array()
+        {
+            return _defaultVertexArray;
+        }
+
+        // Binds |state_|, or the default vertex array if |state_| is null.
+        void bind_vertex_array(vertex_array_state *state_);
+
+        bool is_vertex_array_bound(const vertex_array_state *state_) const;
+
+        // The buffer bound to |target_|, for the targets which are shadowed.
+        webgl::Buffer* buffer_binding(GLenum target_);
+
+        void bind_uniform_buffer(webgl::Buffer *buffer_)
+        {
+            _uniformBufferBinding = buffer_;
+        }
+
+        // Drops every binding the deleted buffer still occupies.
+        void on_buffer_deleted(const webgl::Buffer *buffer_);
+
+        GLint max_vertex_attribs();
+
+        GLint max_uniform_buffer_bindings();
+
+        GLint max_combined_texture_image_units();
+
+        GLint uniform_buffer_offset_alignment();
+
+        // A range of a buffer bound to an indexed UNIFORM_BUFFER binding point; an empty
+        // range stands for the whole buffer.
+        struct uniform_buffer_range
+        {
+            webgl::Buffer *buffer = nullptr;
+
+            GLintptr offset = 0;
+
+            GLsizeiptr size = 0;
+        };
+
+        const std::vector<uniform_buffer_range>& uniform_buffer_ranges() const
+        {
+            return _uniformBufferRanges;
+        }
+
+        // Binding a range binds the generic UNIFORM_BUFFER binding as well. False, binding
+        // nothing, if |index_| is past MAX_UNIFORM_BUFFER_BINDINGS.
+        bool bind_uniform_buffer_range(GLuint index_, const uniform_buffer_range &range_);
+
+        // The desktop GLSL version shaders are translated to, such as 460.
+        int glsl_version();
+
+        // False, leaving the active unit as it was, if |texture_| names no unit of the context.
+        bool active_texture(GLenum texture_);
+
+        // The texture bound to |target_| of the active unit; cube map faces name the cube map.
+        webgl::Texture* texture_binding(GLenum target_);
+
+        void bind_texture(GLenum target_, webgl::Texture *texture_);
+
+        void on_texture_deleted(const webgl::Texture *texture_);
+
+        // Units up to the last one a texture was bound to.
+        std::size_t texture_unit_count() const
+        {
+            return _textureUnits.size();
+        }
+
+        webgl::Renderbuffer* renderbuffer_binding() const
+        {
+            return _renderbufferBinding;
+        }
+
+        void bind_renderbuffer(webgl::Renderbuffer *renderbuffer_)
+        {
+            _renderbufferBinding = renderbuffer_;
+        }
+
+        void on_renderbuffer_deleted(const webgl::Renderbuffer *renderbuffer_);
+
+        // Records that an object of |kind_| went from |old_size_| to |new_size_| bytes.
+        void account_memory(memory_kind kind_, std::size_t old_size_, std::size_t new_size_);
+
+        const teresa::memory_usage& memory_usage() const
+        {
+            return _memoryUsage;
+        }
+
+        // Small buffers are sub-allocated from this pool if it exists.
+        buffer_pool* pooled_buffers()
+        {
+            return _pooledBuffers.get();
+        }
+
+        void enable_buffer_pool();
+
+        // Uploads are copied through this ring if it exists.
+        staging_ring* staging()
+        {
+            return _staging.get();
+        }
+
+        void enable_staging(std::size_t capacity_);
+
+        // Recycles the textures handed out by acquireTransientTexture().
+        texture_pool& transient_textures()
+        {
+            return _transientTextures;
+        }
+
+        // GL shaders shared by the WebGL shaders of equal source.
+        shader_cache& shaders()
+        {
+            return _shaders;
+        }
+
+        // The window of the canvas, whose context others are made to share objects with.
+        void set_window(GLFWwindow *window_)
+        {
+            _window = window_;
+        }
+
+        // Compiles and links on threads of their own, started on first use. Shared with the work in flight.
+        std::shared_ptr<shader_compiler> compiler();
+
+        // Records an error raised on behalf of GL; only the first one is kept
+        // until it is taken, as GL itself does.
+        void synthesize_error(GLenum error_);
+
+        GLenum take_synthesized_error();
+
+        GLint unpack_alignment = 4;
+
+        GLint pack_alignment = 4;
+
+        // Flips the source data along its vertical axis if true.
+        bool unpack_flip_y = false;
+
+        // Multiplies the alpha channel into the other color channels if true.
+        bool unpack_premultiply_alpha = false;
+
+        // Only the default conversion is implemented, which is none for client data.
+        GLenum unpack_colorspace_conversion = GL_BROWSER_DEFAULT_WEBGL;
+
+        // What binding framebuffer null binds: 0 for a window, the drawing buffer of a headless canvas.
+        GLuint default_framebuffer = 0;
+
+        // What binding vertex array null binds: 0, or a vertex array of a virtualized canvas its own.
+        GLuint default_vertex_array_object = 0;
+
+        // The state which the virtual context of a virtualized canvas switches from and to; every
+        // entry point changing that state keeps it up to date. Null unless the canvas is virtualized.
+        virtual_state *tracked_state = nullptr;
+
+        // Makes the context of this state current from wherever, keeping the context alive for as long
+        // as a copy of it is; for GL objects whose lifetime JavaScript decides, such as mapped buffers.
+        std::function<void()> context_lease;
+
+        // The following are maintained by the validating entry points only.
+        webgl::Program *current_program = nullptr;
     private:
+        static native_webgl *_current;
+
+        webgl::Buffer *_arrayBufferBinding = nullptr;
+
+        vertex_array_state _defaultVertexArray;
+
+        vertex_array_state *_vertexArrayBinding;
+
+        GLint _maxVertexAttribs = 0;
+
+        GLint _maxUniformBufferBindings = 0;
+
+        GLint _maxCombinedTextureImageUnits = 0;
+
+        GLint _uniformBufferOffsetAlignment = 0;
+
+        webgl::Buffer *_uniformBufferBinding = nullptr;
+
+        std::vector<uniform_buffer_range> _uniformBufferRanges;
+
+        int _glslVersion = 0;
+
+        std::size_t _activeTexture = 0;
+
+        // TEXTURE_2D and TEXTURE_CUBE_MAP bindings of every unit used so far.
+        std::vector<std::array<webgl::Texture*, 2>> _textureUnits;
+
+        webgl::Renderbuffer *_renderbufferBinding = nullptr;
+
+        teresa::memory_usage _memoryUsage;
+
+        GLenum _synthesizedError = GL_NO_ERROR;
+
+        std::unique_ptr<buffer_pool> _pooledBuffers;
+
+        texture_pool _transientTextures;
+
+        shader_cache _shaders;
+
+        GLFWwindow *_window = nullptr;
+
+        std::shared_ptr<shader_compiler> _compiler;
 
+        std::unique_ptr<staging_ring> _staging;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,193 @@
+
+#include "offscreen_framebuffer.h"
+#include "pixel_transfer.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace teresa
+{
+    namespace
+    {
+        // A quarter more than asked for, in steps of 64 pixels.
+        GLsizei padded_capacity(GLsizei size_)
+        {
+            auto padded = size_ + size_ / 4;
+            return (padded + 63) / 64 * 64;
+        }
+
+        // Too small images must grow; images are given up only when even twice the size
+        // would get smaller ones.
+        bool fits(GLsizei size_, GLsizei capacity_)
+        {
+            return size_ <= capacity_ && capacity_ <= padded_capacity(size_ * 2);
+        }
+
+        void attach(GLuint framebuffer_, GLenum attachment_, GLuint texture_)
+        {
+            glNamedFramebufferTexture(framebuffer_, attachment_, texture_, 0);
+        }
+    }
+
+    offscreen_framebuffer::offscreen_framebuffer(GLsizei width_, GLsizei height_, const attributes &attributes_)
+        :_attributes(attributes_), _width(std::max(1, width_)), _height(std::max(1, height_))
+    {
+        if (_attributes.antialias) {
+            GLint maxSamples = 0;
+            glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+            _samples = std::min(4, maxSamples);
+        }
+        // Canvases are mostly never resized, so the first images are of the exact size.
+        _capacityWidth = _width;
+        _capacityHeight = _height;
+        glCreateFramebuffers(1, &_framebuffer);
+        glCreateFramebuffers(1, &_resolveFramebuffer);
+        _allocate();
+        _clear();
+    }
+
+    offscreen_framebuffer::~offscreen_framebuffer()
+    {
+        _release();
+        glDeleteFramebuffers(1, &_resolveFramebuffer);
+        glDeleteFramebuffers(1, &_framebuffer);
+    }
+
+    void offscreen_framebuffer::resize(GLsizei width_, GLsizei height_)
+    {
+        width_ = std::max(1, width_);
+        height_ = std::max(1, height_);
+        if (width_ == _width && height_ == _height) {
+            return;
+        }
+        _width = width_;
+        _height = height_;
+        if (!fits(_width, _capacityWidth) || !fits(_height, _capacityHeight)) {
+            _release();
+            _capacityWidth = padded_capacity(_width);
+            _capacityHeight = padded_capacity(_height);
+            _allocate();
+        }
+        _clear();
+    }
+
+    void offscreen_framebuffer::_allocate()
+    {
+        auto colorFormat = _attributes.alpha ? GL_RGBA8 : GL_RGB8;
+        glCreateTextures(GL_TEXTURE_2D, 2, _colors.data());
+        for (auto color : _colors) {
+            glTextureStorage2D(color, 1, colorFormat, _capacityWidth, _capacityHeight);
+            glTextureParameteri(color, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTextureParameteri(color, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        if (_samples) {
+            glCreateTextures(GL_TEXTURE_2D_MULTISAMPLE, 1, &_multisampledColor);
+            glTextureStorage2DMultisample(_multisampledColor, _samples, colorFormat, _capacityWidth, _capacityHeight, GL_TRUE);
+            attach(_framebuffer, GL_COLOR_ATTACHMENT0, _multisampledColor);
+        }
+        else {
+            attach(_framebuffer, GL_COLOR_ATTACHMENT0, _back());
+        }
+
+        if (_attributes.depth || _attributes.stencil) {
+            auto format = _attributes.stencil ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24;
+            auto attachment = _attributes.stencil ? (_attributes.depth ? GL_DEPTH_STENCIL_ATTACHMENT : GL_STENCIL_ATTACHMENT) : GL_DEPTH_ATTACHMENT;
+            if (_samples) {
+                glCreateTextures(GL_TEXTURE_2D_MULTISAMPLE, 1, &_depthStencil);
+                glTextureStorage2DMultisample(_depthStencil, _samples, format, _capacityWidth, _capacityHeight, GL_TRUE);
+            }
+            else {
+                glCreateTextures(GL_TEXTURE_2D, 1, &_depthStencil);
+                glTextureStorage2D(_depthStencil, 1, format, _capacityWidth, _capacityHeight);
+            }
+            attach(_framebuffer, attachment, _depthStencil);
+        }
+
+        if (glCheckNamedFramebufferStatus(_framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error("The offscreen drawing buffer is incomplete.");
+        }
+    }
+
+    void offscreen_framebuffer::_release()
+    {
+        glDeleteTextures(2, _colors.data());
+        _colors = {};
+        glDeleteTextures(1, &_multisampledColor);
+        _multisampledColor = 0;
+        glDeleteTextures(1, &_depthStencil);
+        _depthStencil = 0;
+    }
+
+    void offscreen_framebuffer::_clear()
+    {
+        // Null data clears to zero, which leaves only the depth to be cleared to 1.
+        for (auto color : _colors) {
+            glClearTexImage(color, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+        if (_multisampledColor) {
+            glClearTexImage(_multisampledColor, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+        if (_depthStencil) {
+            if (_attributes.stencil) {
+                struct
+                {
+                    GLfloat depth = 1;
+                    GLuint stencil = 0;
+                } depthStencil;
+                glClearTexImage(_depthStencil, 0, GL_DEPTH_STENCIL, GL_FLOAT_32_UNSIGNED_INT_24_8_REV, &depthStencil);
+            }
+            else {
+                GLfloat depth = 1;
+                glClearTexImage(_depthStencil, 0, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
+            }
+        }
+    }
+
+    void offscreen_framebuffer::present()
+    {
+        if (!_samples && !_attributes.preserve_drawing_buffer) {
+            _front = 1 - _front;
+            attach(_framebuffer, GL_COLOR_ATTACHMENT0, _back());
+            return;
+        }
+        // Resolves or copies into the front texture, the drawing buffer stays as it is.
+        // Blits are scissored like draws.
+        attach(_resolveFramebuffer, GL_COLOR_ATTACHMENT0, front_texture());
+        auto scissored = glIsEnabled(GL_SCISSOR_TEST);
+        if (scissored) {
+            glDisable(GL_SCISSOR_TEST);
+        }
+        glBlitNamedFramebuffer(_framebuffer, _resolveFramebuffer, 0, 0, _width, _height, 0, 0, _width, _height,
+            GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        if (scissored) {
+            glEnable(GL_SCISSOR_TEST);
+        }
+    }
+
+    void offscreen_framebuffer::read_front(void *pixels_, std::size_t size_) const
+    {
+        auto rowPitch = static_cast<std::size_t>(_width) * 4;
+        if (size_ < rowPitch * _height) {
+            throw std::runtime_error("The buffer is too small for the frame.");
+        }
+        // The pixels are tightly packed into client memory, whatever the pack state of the caller.
+        GLint packBuffer = 0;
+        GLint packAlignment = 4;
+        glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer);
+        glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+        if (packBuffer) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        if (packAlignment > 4) {
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        }
+        glGetTextureSubImage(front_texture(), 0, 0, 0, 0, _width, _height, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+            static_cast<GLsizei>(size_), pixels_);
+        if (packAlignment > 4) {
+            glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+        }
+        if (packBuffer) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+        }
+        flip_rows(pixels_, rowPitch, _height);
+    }
+}
@@ -0,0 +1,121 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+
+namespace teresa
+{
+    // The drawing buffer of a canvas without a window: a framebuffer object standing in for
+    // framebuffer 0, and the image last presented from it. All GL calls are direct state access,
+    // so no binding of the caller is disturbed.
+    class offscreen_framebuffer
+    {
+    public:
+        struct attributes
+        {
+            bool alpha = true;
+
+            bool depth = true;
+
+            bool stencil = false;
+
+            // Multisampled drawing, resolved on present.
+            bool antialias = false;
+
+            bool preserve_drawing_buffer = false;
+        };
+
+        offscreen_framebuffer(GLsizei width_, GLsizei height_, const attributes &attributes_);
+
+        offscreen_framebuffer(const offscreen_framebuffer &) = delete;
+
+        offscreen_framebuffer& operator=(const offscreen_framebuffer &) = delete;
+
+        ~offscreen_framebuffer();
+
+        // The framebuffer to draw into.
+        GLuint gl_handle() const
+        {
+            return _framebuffer;
+        }
+
+        GLsizei width() const
+        {
+            return _width;
+        }
+
+        GLsizei height() const
+        {
+            return _height;
+        }
+
+        // The size of the images, which the drawing buffer covers from their lower left corner.
+        GLsizei capacity_width() const
+        {
+            return _capacityWidth;
+        }
+
+        GLsizei capacity_height() const
+        {
+            return _capacityHeight;
+        }
+
+        // Changes the size and clears every image, as WebGL does. The images are reallocated only
+        // if they are too small, with room to grow, or far too large, so that a canvas resized
+        // a little at a time mostly reuses them.
+        void resize(GLsizei width_, GLsizei height_);
+
+        // Makes what was drawn the presented image. Without multisampling or a preserved
+        // drawing buffer, the two color images just trade places rather than being copied.
+        void present();
+
+        // The texture holding the presented image, bottom row first.
+        GLuint front_texture() const
+        {
+            return _colors[_front];
+        }
+
+        // Copies the presented image into |pixels_| as RGBA8, top row first.
+        void read_front(void *pixels_, std::size_t size_) const;
+    private:
+        attributes _attributes;
+
+        GLsizei _width = 0;
+
+        GLsizei _height = 0;
+
+        GLsizei _capacityWidth = 0;
+
+        GLsizei _capacityHeight = 0;
+
+        GLsizei _samples = 0;
+
+        GLuint _framebuffer = 0;
+
+        // Presented, and drawn into unless multisampled.
+        std::array<GLuint, 2> _colors = {};
+
+        std::size_t _front = 0;
+
+        // Multisampled color and depth/stencil, whichever are in use. Textures rather than
+        // renderbuffers, so that they can be cleared without touching the pipeline state.
+        GLuint _multisampledColor = 0;
+
+        GLuint _depthStencil = 0;
+
+        // Reads the front texture for the resolving blit.
+        GLuint _resolveFramebuffer = 0;
+
+        void _allocate();
+
+        void _release();
+
+        void _clear();
+
+        GLuint _back() const
+        {
+            return _colors[1 - _front];
+        }
+    };
+}
@@ -0,0 +1,131 @@
+
+#include "pixel_format.h"
+
+namespace teresa
+{
+    std::size_t channel_count(GLenum format_)
+    {
+        switch (format_) {
+        case GL_ALPHA:
+        case GL_LUMINANCE:
+        case GL_RED:
+        case GL_DEPTH_COMPONENT:
+            return 1;
+        case GL_LUMINANCE_ALPHA:
+        case GL_RG:
+        case GL_DEPTH_STENCIL:
+            return 2;
+        case GL_RGB:
+            return 3;
+        case GL_RGBA:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    std::size_t bytes_per_pixel(GLenum format_, GLenum type_)
+    {
+        switch (type_) {
+        case GL_UNSIGNED_SHORT_5_6_5:
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+            return 2;
+        case GL_UNSIGNED_INT_24_8:
+            return 4;
+        case GL_UNSIGNED_BYTE:
+        case GL_BYTE:
+            return channel_count(format_);
+        case GL_UNSIGNED_SHORT:
+        case GL_SHORT:
+        case GL_HALF_FLOAT:
+            return channel_count(format_) * 2;
+        case GL_UNSIGNED_INT:
+        case GL_INT:
+        case GL_FLOAT:
+            return channel_count(format_) * 4;
+        default:
+            return 0;
+        }
+    }
+
+    std::size_t texel_size(GLenum internalformat_)
+    {
+        switch (internalformat_) {
+        case GL_STENCIL_INDEX8:
+        case GL_R8:
+            return 1;
+        case GL_RGBA4:
+        case GL_RGB565:
+        case GL_RGB5_A1:
+        case GL_DEPTH_COMPONENT16:
+        case GL_RG8:
+            return 2;
+        case GL_DEPTH_COMPONENT:
+        case GL_DEPTH_STENCIL:
+        case GL_DEPTH24_STENCIL8:
+        case GL_RGBA8:
+            return 4;
+        case GL_RGB8:
+            // Drivers pad three channel formats.
+            return 4;
+        default:
+            return channel_count(internalformat_) == 3 ? 4 : channel_count(internalformat_);
+        }
+    }
+
+    GLenum sized_internal_format(GLenum format_, GLenum type_)
+    {
+        constexpr GLenum halfFloatOES = 0x8D61;
+        switch (type_) {
+        case GL_UNSIGNED_BYTE:
+            switch (format_) {
+            case GL_RGBA:
+                return GL_RGBA8;
+            case GL_RGB:
+                return GL_RGB8;
+            case GL_RG:
+                return GL_RG8;
+            case GL_RED:
+                return GL_R8;
+            default:
+                return 0;
+            }
+        case GL_FLOAT:
+            return format_ == GL_RGBA ? GL_RGBA32F : format_ == GL_RGB ? GL_RGB32F : 0;
+        case GL_HALF_FLOAT:
+        case halfFloatOES:
+            return format_ == GL_RGBA ? GL_RGBA16F : format_ == GL_RGB ? GL_RGB16F : 0;
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+            return format_ == GL_RGBA ? GL_RGBA4 : 0;
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+            return format_ == GL_RGBA ? GL_RGB5_A1 : 0;
+        case GL_UNSIGNED_SHORT_5_6_5:
+            return format_ == GL_RGB ? GL_RGB565 : 0;
+        case GL_UNSIGNED_SHORT:
+            return format_ == GL_DEPTH_COMPONENT ? GL_DEPTH_COMPONENT16 : 0;
+        case GL_UNSIGNED_INT:
+            return format_ == GL_DEPTH_COMPONENT ? GL_DEPTH_COMPONENT24 : 0;
+        case GL_UNSIGNED_INT_24_8:
+            return format_ == GL_DEPTH_STENCIL ? GL_DEPTH24_STENCIL8 : 0;
+        default:
+            return 0;
+        }
+    }
+
+    std::size_t row_pitch(GLsizei width_, GLenum format_, GLenum type_, GLint alignment_)
+    {
+        auto rowSize = static_cast<std::size_t>(width_) * bytes_per_pixel(format_, type_);
+        auto alignment = static_cast<std::size_t>(alignment_ > 0 ? alignment_ : 1);
+        return (rowSize + alignment - 1) / alignment * alignment;
+    }
+
+    std::size_t image_byte_size(GLsizei width_, GLsizei height_, GLenum format_, GLenum type_, GLint alignment_)
+    {
+        if (width_ <= 0 || height_ <= 0) {
+            return 0;
+        }
+        auto rowSize = static_cast<std::size_t>(width_) * bytes_per_pixel(format_, type_);
+        return row_pitch(width_, format_, type_, alignment_) * (height_ - 1) + rowSize;
+    }
+}
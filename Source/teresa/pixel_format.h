@@ -0,0 +1,26 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+
+namespace teresa
+{
+    // Number of channels of a client pixel format, or 0 if unknown.
+    std::size_t channel_count(GLenum format_);
+
+    // Size of one client pixel of |format_| and |type_|, or 0 if unknown.
+    std::size_t bytes_per_pixel(GLenum format_, GLenum type_);
+
+    // Estimated size of one texel of a renderable or copyable internal format, or 0 if unknown.
+    std::size_t texel_size(GLenum internalformat_);
+
+    // The sized internal format storing client pixels of |format_| and |type_|, or 0 if there is none.
+    GLenum sized_internal_format(GLenum format_, GLenum type_);
+
+    // Size of one row once padded to |alignment_| bytes.
+    std::size_t row_pitch(GLsizei width_, GLenum format_, GLenum type_, GLint alignment_);
+
+    // Bytes GL reads or writes for an image, the last row being unpadded.
+    std::size_t image_byte_size(GLsizei width_, GLsizei height_, GLenum format_, GLenum type_, GLint alignment_);
+}
@@ -0,0 +1,220 @@
+
+#include "pixel_transfer.h"
+#include "cpu_features.h"
+#include "pixel_format.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace teresa
+{
+    namespace
+    {
+        // round(c * a / 255), exact for all 8-bit inputs.
+        inline std::uint8_t multiply_unorm8(unsigned c_, unsigned a_)
+        {
+            auto t = c_ * a_ + 128;
+            return static_cast<std::uint8_t>((t + (t >> 8)) >> 8);
+        }
+
+        void premultiply_rgba8_scalar(std::uint8_t *destination_, const std::uint8_t *source_, std::size_t count_)
+        {
+            for (std::size_t i = 0; i < count_; ++i, destination_ += 4, source_ += 4) {
+                auto a = source_[3];
+                destination_[0] = multiply_unorm8(source_[0], a);
+                destination_[1] = multiply_unorm8(source_[1], a);
+                destination_[2] = multiply_unorm8(source_[2], a);
+                destination_[3] = a;
+            }
+        }
+
+#if defined(TERESA_X86)
+        // The same rounding as multiply_unorm8() on the 16-bit lanes of |c_| and |m_|.
+        TERESA_TARGET("sse4.1")
+        inline __m128i multiply_unorm8_sse(__m128i c_, __m128i m_)
+        {
+            auto t = _mm_add_epi16(_mm_mullo_epi16(c_, m_), _mm_set1_epi16(128));
+            return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        }
+
+        // Alpha of every pixel in the color lanes, 255 in the alpha lanes, so alpha multiplies to itself.
+        TERESA_TARGET("sse4.1")
+        inline __m128i alpha_multiplier_sse(__m128i pixels_)
+        {
+            auto broadcast = _mm_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+            return _mm_blend_epi16(_mm_shuffle_epi8(pixels_, broadcast), _mm_set1_epi16(255), 0x88);
+        }
+
+        TERESA_TARGET("sse4.1")
+        std::size_t premultiply_rgba8_sse41(std::uint8_t *destination_, const std::uint8_t *source_, std::size_t count_)
+        {
+            auto zero = _mm_setzero_si128();
+            std::size_t i = 0;
+            for (; i + 4 <= count_; i += 4) {
+                auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source_ + i * 4));
+                auto lo = _mm_unpacklo_epi8(pixels, zero);
+                auto hi = _mm_unpackhi_epi8(pixels, zero);
+                lo = multiply_unorm8_sse(lo, alpha_multiplier_sse(lo));
+                hi = multiply_unorm8_sse(hi, alpha_multiplier_sse(hi));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(destination_ + i * 4), _mm_packus_epi16(lo, hi));
+            }
+            return i;
+        }
+
+        TERESA_TARGET("avx2")
+        inline __m256i multiply_unorm8_avx2(__m256i c_, __m256i m_)
+        {
+            auto t = _mm256_add_epi16(_mm256_mullo_epi16(c_, m_), _mm256_set1_epi16(128));
+            return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+        }
+
+        TERESA_TARGET("avx2")
+        inline __m256i alpha_multiplier_avx2(__m256i pixels_)
+        {
+            auto broadcast = _mm256_setr_epi8(
+                6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15,
+                6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+            return _mm256_blend_epi16(_mm256_shuffle_epi8(pixels_, broadcast), _mm256_set1_epi16(255), 0x88);
+        }
+
+        TERESA_TARGET("avx2")
+        std::size_t premultiply_rgba8_avx2(std::uint8_t *destination_, const std::uint8_t *source_, std::size_t count_)
+        {
+            auto zero = _mm256_setzero_si256();
+            std::size_t i = 0;
+            for (; i + 8 <= count_; i += 8) {
+                // Unpacking and packing both work within 128-bit lanes, so pixel order is preserved.
+                auto pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source_ + i * 4));
+                auto lo = _mm256_unpacklo_epi8(pixels, zero);
+                auto hi = _mm256_unpackhi_epi8(pixels, zero);
+                lo = multiply_unorm8_avx2(lo, alpha_multiplier_avx2(lo));
+                hi = multiply_unorm8_avx2(hi, alpha_multiplier_avx2(hi));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination_ + i * 4), _mm256_packus_epi16(lo, hi));
+            }
+            return i;
+        }
+#endif
+
+        void premultiply_rgba8(std::uint8_t *destination_, const std::uint8_t *source_, std::size_t count_)
+        {
+            std::size_t done = 0;
+#if defined(TERESA_X86)
+            auto &features = cpu_features::get();
+            if (features.avx2) {
+                done = premultiply_rgba8_avx2(destination_, source_, count_);
+            }
+            else if (features.sse41) {
+                done = premultiply_rgba8_sse41(destination_, source_, count_);
+            }
+#endif
+            premultiply_rgba8_scalar(destination_ + done * 4, source_ + done * 4, count_ - done);
+        }
+
+        void premultiply_luminance_alpha8(std::uint8_t *destination_, const std::uint8_t *source_, std::size_t count_)
+        {
+            for (std::size_t i = 0; i < count_; ++i, destination_ += 2, source_ += 2) {
+                destination_[0] = multiply_unorm8(source_[0], source_[1]);
+                destination_[1] = source_[1];
+            }
+        }
+
+        void premultiply_rgba4444(std::uint16_t *destination_, const std::uint16_t *source_, std::size_t count_)
+        {
+            for (std::size_t i = 0; i < count_; ++i) {
+                auto pixel = source_[i];
+                unsigned a = pixel & 0xF;
+                auto multiply = [a](unsigned c_) { return (c_ * a + 7) / 15; };
+                destination_[i] = static_cast<std::uint16_t>(
+                    (multiply((pixel >> 12) & 0xF) << 12) | (multiply((pixel >> 8) & 0xF) << 8) | (multiply((pixel >> 4) & 0xF) << 4) | a);
+            }
+        }
+
+        void premultiply_rgba5551(std::uint16_t *destination_, const std::uint16_t *source_, std::size_t count_)
+        {
+            // One bit of alpha either keeps or clears the color.
+            for (std::size_t i = 0; i < count_; ++i) {
+                destination_[i] = (source_[i] & 1) ? source_[i] : 0;
+            }
+        }
+
+        void premultiply_rgba32f(float *destination_, const float *source_, std::size_t count_)
+        {
+            for (std::size_t i = 0; i < count_; ++i, destination_ += 4, source_ += 4) {
+                auto a = source_[3];
+                destination_[0] = source_[0] * a;
+                destination_[1] = source_[1] * a;
+                destination_[2] = source_[2] * a;
+                destination_[3] = a;
+            }
+        }
+
+        void premultiply_luminance_alpha32f(float *destination_, const float *source_, std::size_t count_)
+        {
+            for (std::size_t i = 0; i < count_; ++i, destination_ += 2, source_ += 2) {
+                destination_[0] = source_[0] * source_[1];
+                destination_[1] = source_[1];
+            }
+        }
+    }
+
+    void premultiply_alpha(void *destination_, const void *source_, std::size_t count_, GLenum format_, GLenum type_)
+    {
+        auto destination = static_cast<std::uint8_t*>(destination_);
+        auto source = static_cast<const std::uint8_t*>(source_);
+        if (format_ == GL_RGBA && type_ == GL_UNSIGNED_BYTE) {
+            premultiply_rgba8(destination, source, count_);
+        }
+        else if (format_ == GL_LUMINANCE_ALPHA && type_ == GL_UNSIGNED_BYTE) {
+            premultiply_luminance_alpha8(destination, source, count_);
+        }
+        else if (format_ == GL_RGBA && type_ == GL_UNSIGNED_SHORT_4_4_4_4) {
+            premultiply_rgba4444(static_cast<std::uint16_t*>(destination_), static_cast<const std::uint16_t*>(source_), count_);
+        }
+        else if (format_ == GL_RGBA && type_ == GL_UNSIGNED_SHORT_5_5_5_1) {
+            premultiply_rgba5551(static_cast<std::uint16_t*>(destination_), static_cast<const std::uint16_t*>(source_), count_);
+        }
+        else if (format_ == GL_RGBA && type_ == GL_FLOAT) {
+            premultiply_rgba32f(static_cast<float*>(destination_), static_cast<const float*>(source_), count_);
+        }
+        else if (format_ == GL_LUMINANCE_ALPHA && type_ == GL_FLOAT) {
+            premultiply_luminance_alpha32f(static_cast<float*>(destination_), static_cast<const float*>(source_), count_);
+        }
+        else if (destination_ != source_) {
+            std::memmove(destination_, source_, count_ * bytes_per_pixel(format_, type_));
+        }
+    }
+
+    void flip_rows(void *data_, std::size_t row_pitch_, std::size_t rows_)
+    {
+        if (rows_ < 2) {
+            return;
+        }
+        auto data = static_cast<std::uint8_t*>(data_);
+        for (std::size_t top = 0, bottom = rows_ - 1; top < bottom; ++top, --bottom) {
+            std::swap_ranges(data + top * row_pitch_, data + (top + 1) * row_pitch_, data + bottom * row_pitch_);
+        }
+    }
+
+    void unpack_pixels(void *destination_, const void *source_, GLsizei width_, GLsizei height_,
+        GLenum format_, GLenum type_, const unpack_options &options_)
+    {
+        if (width_ <= 0 || height_ <= 0) {
+            return;
+        }
+        auto pitch = row_pitch(width_, format_, type_, options_.alignment);
+        auto rowSize = static_cast<std::size_t>(width_) * bytes_per_pixel(format_, type_);
+        auto destination = static_cast<std::uint8_t*>(destination_);
+        auto source = static_cast<const std::uint8_t*>(source_);
+        for (GLsizei row = 0; row < height_; ++row) {
+            auto sourceRow = options_.flip_y ? height_ - 1 - row : row;
+            auto to = destination + row * pitch;
+            auto from = source + sourceRow * pitch;
+            if (options_.premultiply_alpha) {
+                premultiply_alpha(to, from, static_cast<std::size_t>(width_), format_, type_);
+            }
+            else {
+                std::memcpy(to, from, rowSize);
+            }
+        }
+    }
+}
@@ -0,0 +1,36 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+
+namespace teresa
+{
+    // How client pixels are transformed on their way to GL, from the WebGL-only pixel store parameters.
+    struct unpack_options
+    {
+        GLint alignment = 4;
+
+        bool flip_y = false;
+
+        bool premultiply_alpha = false;
+
+        bool transforms() const
+        {
+            return flip_y || premultiply_alpha;
+        }
+    };
+
+    // Copies an image of |width_| x |height_| client pixels from |source_| to |destination_|,
+    // both laid out with |options_|.alignment, applying the flip and premultiplication.
+    // Rows are streamed in their destination order, so this runs close to memcpy speed.
+    void unpack_pixels(void *destination_, const void *source_, GLsizei width_, GLsizei height_,
+        GLenum format_, GLenum type_, const unpack_options &options_);
+
+    // Reverses the order of |rows_| rows of |row_pitch_| bytes by swapping them in place.
+    void flip_rows(void *data_, std::size_t row_pitch_, std::size_t rows_);
+
+    // Multiplies the alpha channel into the color channels of |count_| pixels.
+    // Formats without both color and alpha are copied as they are. |destination_| may be |source_|.
+    void premultiply_alpha(void *destination_, const void *source_, std::size_t count_, GLenum format_, GLenum type_);
+}
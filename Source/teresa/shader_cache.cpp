@@ -0,0 +1,94 @@
+
+#include "shader_cache.h"
+
+namespace teresa
+{
+    namespace
+    {
+        std::uint64_t hash_shader(GLenum stage_, const std::string &source_)
+        {
+            // FNV-1a.
+            std::uint64_t hash = 14695981039346656037ull;
+            for (auto c : source_) {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+            }
+            return (hash ^ stage_) * 1099511628211ull;
+        }
+    }
+
+    shader_cache::entry* shader_cache::acquire(GLenum stage_, std::shared_ptr<const std::string> source_)
+    {
+        if (auto cached = find(stage_, source_)) {
+            return cached;
+        }
+        auto glHandle = glCreateShader(stage_);
+        const char *parts[] = { source_->c_str() };
+        GLint partLengths[] = { static_cast<GLint>(source_->size()) };
+        glShaderSource(glHandle, 1, parts, partLengths);
+        glCompileShader(glHandle);
+        return adopt(stage_, std::move(source_), glHandle);
+    }
+
+    shader_cache::entry* shader_cache::find(GLenum stage_, const std::shared_ptr<const std::string> &source_)
+    {
+        auto range = _entries.equal_range(hash_shader(stage_, *source_));
+        for (auto i = range.first; i != range.second; ++i) {
+            auto &cached = *i->second;
+            // Translations come from a shared cache, so equal sources are usually the same string.
+            if (cached.stage == stage_ && (cached.source == source_ || *cached.source == *source_)) {
+                ++cached.references;
+                ++_stats.hits;
+                ++_stats.references;
+                return &cached;
+            }
+        }
+        return nullptr;
+    }
+
+    shader_cache::entry* shader_cache::adopt(GLenum stage_, std::shared_ptr<const std::string> source_, GLuint gl_handle_)
+    {
+        auto created = std::make_unique<entry>();
+        created->gl_handle = gl_handle_;
+        created->stage = stage_;
+        created->hash = hash_shader(stage_, *source_);
+        created->source = std::move(source_);
+        created->references = 1;
+        ++_stats.misses;
+        ++_stats.references;
+        auto hash = created->hash;
+        return _entries.emplace(hash, std::move(created))->second.get();
+    }
+
+    void shader_cache::release(entry *entry_)
+    {
+        --_stats.references;
+        if (--entry_->references) {
+            return;
+        }
+        auto range = _entries.equal_range(entry_->hash);
+        for (auto i = range.first; i != range.second; ++i) {
+            if (i->second.get() == entry_) {
+                glDeleteShader(entry_->gl_handle);
+                _entries.erase(i);
+                return;
+            }
+        }
+    }
+
+    bool shader_cache::compile_status(entry *entry_)
+    {
+        if (!entry_->compile_status) {
+            GLint status = GL_FALSE;
+            glGetShaderiv(entry_->gl_handle, GL_COMPILE_STATUS, &status);
+            entry_->compile_status = status == GL_TRUE;
+        }
+        return *entry_->compile_status;
+    }
+
+    shader_cache::statistics shader_cache::stats() const
+    {
+        auto result = _stats;
+        result.shaders = _entries.size();
+        return result;
+    }
+}
@@ -0,0 +1,72 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace teresa
+{
+    // GL shader objects compiled once per context for every stage and translated source,
+    // and shared by the WebGL shaders with that source. Entries are reference-counted;
+    // the GL shader is deleted with the last reference, which GL defers while it is attached.
+    class shader_cache
+    {
+    public:
+        struct entry
+        {
+            GLuint gl_handle = 0;
+
+            GLenum stage = 0;
+
+            std::uint64_t hash = 0;
+
+            std::shared_ptr<const std::string> source;
+
+            std::size_t references = 0;
+
+            // Queried on first use rather than after compiling, so that drivers may compile in the background.
+            std::optional<bool> compile_status;
+        };
+
+        struct statistics
+        {
+            std::uint64_t hits = 0;
+
+            std::uint64_t misses = 0;
+
+            std::size_t shaders = 0;
+
+            std::size_t references = 0;
+        };
+
+        shader_cache() = default;
+
+        shader_cache(const shader_cache&) = delete;
+
+        shader_cache& operator=(const shader_cache&) = delete;
+
+        // The shader of |stage_| compiled from |source_|, compiled here if no other holds it.
+        // Adds a reference to be dropped with release().
+        entry* acquire(GLenum stage_, std::shared_ptr<const std::string> source_);
+
+        // The shader of |stage_| compiled from |source_| if one is held, with a reference added.
+        entry* find(GLenum stage_, const std::shared_ptr<const std::string> &source_);
+
+        // Takes |gl_handle_|, compiled from |source_| elsewhere, with one reference.
+        entry* adopt(GLenum stage_, std::shared_ptr<const std::string> source_, GLuint gl_handle_);
+
+        void release(entry *entry_);
+
+        bool compile_status(entry *entry_);
+
+        statistics stats() const;
+    private:
+        std::unordered_multimap<std::uint64_t, std::unique_ptr<entry>> _entries;
+
+        statistics _stats;
+    };
+}
@@ -0,0 +1,95 @@
+
+#include "shader_compiler.h"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+namespace teresa
+{
+    shader_compiler::shader_compiler(GLFWwindow *share_, std::size_t threads_)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        for (std::size_t i = 0; i < threads_; ++i) {
+            auto context = glfwCreateWindow(1, 1, "", nullptr, share_);
+            if (!context) {
+                break;
+            }
+            _contexts.push_back(context);
+        }
+        glfwDefaultWindowHints();
+        if (_contexts.empty()) {
+            throw std::runtime_error("Couldn't create a shared context for compiling shaders.");
+        }
+        for (auto context : _contexts) {
+            _threads.emplace_back([this, context]() { _run(context); });
+        }
+    }
+
+    shader_compiler::~shader_compiler()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _wake.notify_all();
+        for (auto &thread : _threads) {
+            thread.join();
+        }
+        for (auto context : _contexts) {
+            glfwDestroyWindow(context);
+        }
+    }
+
+    void shader_compiler::_run(GLFWwindow *context_)
+    {
+        glfwMakeContextCurrent(context_);
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wake.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+                // Queued work is finished first, as callers are waiting on it.
+                if (_tasks.empty()) {
+                    break;
+                }
+                task = std::move(_tasks.front());
+                _tasks.pop_front();
+            }
+            task();
+        }
+        glfwMakeContextCurrent(nullptr);
+    }
+
+    void shader_compiler::run(std::size_t count_, const std::function<void(std::size_t)> &task_)
+    {
+        if (!count_) {
+            return;
+        }
+        // One task per thread pulling indices, so that each context finishes once rather than per index.
+        std::atomic<std::size_t> next = 0;
+        std::mutex doneMutex;
+        std::condition_variable done;
+        auto workers = std::min(concurrency(), count_);
+        auto remaining = workers;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (std::size_t i = 0; i < workers; ++i) {
+                _tasks.emplace_back([&]() {
+                    for (auto index = next++; index < count_; index = next++) {
+                        task_(index);
+                    }
+                    // Completes the commands before other contexts use the objects.
+                    glFinish();
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    if (--remaining == 0) {
+                        done.notify_one();
+                    }
+                });
+            }
+        }
+        _wake.notify_all();
+        std::unique_lock<std::mutex> lock(doneMutex);
+        done.wait(lock, [&]() { return remaining == 0; });
+    }
+}
@@ -0,0 +1,55 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct GLFWwindow;
+
+namespace teresa
+{
+    // Threads with hidden GL contexts sharing objects with a canvas, for compiling and linking
+    // away from the JavaScript thread. The contexts are created and destroyed by the thread
+    // owning the canvas, as GLFW requires, and use the GL entry points loaded for the canvas.
+    class shader_compiler
+    {
+    public:
+        shader_compiler(GLFWwindow *share_, std::size_t threads_);
+
+        shader_compiler(const shader_compiler &) = delete;
+
+        shader_compiler& operator=(const shader_compiler &) = delete;
+
+        ~shader_compiler();
+
+        std::size_t concurrency() const
+        {
+            return _threads.size();
+        }
+
+        // Calls |task_| for every index of [0, |count_|) on the compiler threads and returns
+        // once all calls are done and the objects they made are complete for every context.
+        // Blocks the caller, so it is meant for the libuv pool rather than the JavaScript thread.
+        void run(std::size_t count_, const std::function<void(std::size_t)> &task_);
+    private:
+        std::vector<GLFWwindow*> _contexts;
+
+        std::vector<std::thread> _threads;
+
+        std::mutex _mutex;
+
+        std::condition_variable _wake;
+
+        std::deque<std::function<void()>> _tasks;
+
+        bool _stopping = false;
+
+        void _run(GLFWwindow *context_);
+    };
+}
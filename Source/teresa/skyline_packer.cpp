@@ -0,0 +1,94 @@
+
+#include "skyline_packer.h"
+#include <algorithm>
+#include <limits>
+
+namespace teresa
+{
+    skyline_packer::skyline_packer(GLsizei width_, GLsizei height_)
+        :_width(width_), _height(height_)
+    {
+        reset();
+    }
+
+    void skyline_packer::reset()
+    {
+        _skyline.assign(1, { 0, 0, _width });
+        _usedArea = 0;
+    }
+
+    GLint skyline_packer::_fit(std::size_t index_, GLsizei width_, GLsizei height_) const
+    {
+        if (_skyline[index_].x + width_ > _width) {
+            return -1;
+        }
+        GLint y = 0;
+        GLsizei remaining = width_;
+        for (auto i = index_; remaining > 0; ++i) {
+            y = std::max(y, _skyline[i].y);
+            if (y + height_ > _height) {
+                return -1;
+            }
+            remaining -= _skyline[i].width;
+        }
+        return y;
+    }
+
+    bool skyline_packer::insert(GLsizei width_, GLsizei height_, GLint &x_, GLint &y_)
+    {
+        if (width_ <= 0 || height_ <= 0) {
+            return false;
+        }
+        auto bestIndex = _skyline.size();
+        auto bestBottom = std::numeric_limits<GLint>::max();
+        auto bestWidth = std::numeric_limits<GLsizei>::max();
+        for (std::size_t i = 0; i < _skyline.size(); ++i) {
+            auto y = _fit(i, width_, height_);
+            if (y < 0) {
+                continue;
+            }
+            if (y + height_ < bestBottom || (y + height_ == bestBottom && _skyline[i].width < bestWidth)) {
+                bestIndex = i;
+                bestBottom = y + height_;
+                bestWidth = _skyline[i].width;
+            }
+        }
+        if (bestIndex == _skyline.size()) {
+            return false;
+        }
+
+        x_ = _skyline[bestIndex].x;
+        y_ = bestBottom - height_;
+        _skyline.insert(_skyline.begin() + bestIndex, { x_, bestBottom, width_ });
+
+        // Trim the segments now lying under the new one.
+        for (auto i = bestIndex + 1; i < _skyline.size();) {
+            auto &previous = _skyline[i - 1];
+            auto &segment = _skyline[i];
+            auto overlap = previous.x + previous.width - segment.x;
+            if (overlap <= 0) {
+                break;
+            }
+            if (overlap < segment.width) {
+                segment.x += overlap;
+                segment.width -= overlap;
+                break;
+            }
+            _skyline.erase(_skyline.begin() + i);
+        }
+
+        // Merge neighbours of the same height.
+        for (std::size_t i = 0; i + 1 < _skyline.size();) {
+            if (_skyline[i].y == _skyline[i + 1].y) {
+                _skyline[i].width += _skyline[i + 1].width;
+                _skyline.erase(_skyline.begin() + i + 1);
+            }
+            else {
+                ++i;
+            }
+        }
+
+        _usedArea += static_cast<std::uint64_t>(width_) * height_;
+        return true;
+    }
+}
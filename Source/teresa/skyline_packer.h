@@ -0,0 +1,47 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+
+namespace teresa
+{
+    // Bottom-left skyline rectangle packer. The top edge of everything packed so far
+    // is kept as a list of horizontal segments; a rectangle goes where its bottom
+    // would be lowest, ties broken by the narrower segment to keep the skyline flat.
+    class skyline_packer
+    {
+    public:
+        skyline_packer(GLsizei width_, GLsizei height_);
+
+        // Finds room for a |width_| x |height_| rectangle, returns false if there is none.
+        bool insert(GLsizei width_, GLsizei height_, GLint &x_, GLint &y_);
+
+        void reset();
+
+        // Area covered by the inserted rectangles.
+        std::uint64_t used_area() const
+        {
+            return _usedArea;
+        }
+    private:
+        struct _segment
+        {
+            GLint x;
+            GLint y;
+            GLsizei width;
+        };
+
+        GLsizei _width;
+
+        GLsizei _height;
+
+        std::vector<_segment> _skyline;
+
+        std::uint64_t _usedArea = 0;
+
+        // The y a rectangle placed at the start of segment |index_| would get, or -1 if it does not fit.
+        GLint _fit(std::size_t index_, GLsizei width_, GLsizei height_) const;
+    };
+}
@@ -0,0 +1,111 @@
+
+#include "staging_ring.h"
+#include <stdexcept>
+
+namespace teresa
+{
+    namespace
+    {
+        constexpr GLbitfield storage_flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    }
+
+    staging_ring::staging_ring(std::size_t capacity_)
+        :_capacity(capacity_)
+    {
+        if (!capacity_) {
+            throw std::runtime_error("Staging rings must not be empty.");
+        }
+        glCreateBuffers(1, &_glHandle);
+        glNamedBufferStorage(_glHandle, static_cast<GLsizeiptr>(_capacity), nullptr, storage_flags);
+        _data = static_cast<std::uint8_t*>(glMapNamedBufferRange(_glHandle, 0, static_cast<GLsizeiptr>(_capacity), storage_flags));
+        if (!_data) {
+            glDeleteBuffers(1, &_glHandle);
+            throw std::runtime_error("Failed to map staging ring.");
+        }
+    }
+
+    staging_ring::~staging_ring()
+    {
+        for (auto &frame : _frames) {
+            glDeleteSync(frame.fence);
+        }
+        glUnmapNamedBuffer(_glHandle);
+        glDeleteBuffers(1, &_glHandle);
+    }
+
+    staging_ring::allocation staging_ring::allocate(std::size_t size_, std::size_t alignment_)
+    {
+        if (!size_ || size_ > _capacity) {
+            return allocation();
+        }
+
+        std::size_t start = 0;
+        std::size_t needed = 0;
+        while (true) {
+            if (!_used) {
+                _head = 0;
+            }
+            start = (_head + alignment_ - 1) / alignment_ * alignment_;
+            if (start + size_ > _capacity) {
+                // Skip the tail end of the ring and start over.
+                start = 0;
+                needed = _capacity - _head + size_;
+            }
+            else {
+                needed = start - _head + size_;
+            }
+            if (_capacity - _used >= needed) {
+                break;
+            }
+            if (_frames.empty()) {
+                // The current frame alone fills the ring.
+                end_frame();
+                if (_frames.empty()) {
+                    continue;
+                }
+            }
+            ++_stats.stalls;
+            _retire_oldest_frame();
+        }
+
+        _head = start + size_;
+        _used += needed;
+        _currentFrameSize += needed;
+        ++_stats.allocations;
+        _stats.uploaded_bytes += size_;
+
+        allocation result;
+        result.data = _data + start;
+        result.offset = static_cast<GLintptr>(start);
+        return result;
+    }
+
+    void staging_ring::end_frame()
+    {
+        if (!_currentFrameSize) {
+            return;
+        }
+        _frames.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), _currentFrameSize });
+        _currentFrameSize = 0;
+
+        // Reclaim whatever the GPU is already done with.
+        while (!_frames.empty()) {
+            auto status = glClientWaitSync(_frames.front().fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                break;
+            }
+            _retire_oldest_frame();
+        }
+    }
+
+    void staging_ring::_retire_oldest_frame()
+    {
+        auto frame = _frames.front();
+        _frames.pop_front();
+        while (glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+
+        }
+        glDeleteSync(frame.fence);
+        _used -= frame.size;
+    }
+}
@@ -0,0 +1,98 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <deque>
+
+namespace teresa
+{
+    // Linear allocator over one persistently and coherently mapped GL buffer,
+    // used as the copy source of uploads. Allocations of a frame are fenced
+    // together when the frame ends; their space is reclaimed once the GPU has
+    // passed the fence, so the CPU only ever waits when the ring is full.
+    class staging_ring
+    {
+    public:
+        struct allocation
+        {
+            void *data = nullptr;
+
+            // Where |data| lies within the ring buffer.
+            GLintptr offset = 0;
+
+            explicit operator bool() const
+            {
+                return data != nullptr;
+            }
+        };
+
+        struct statistics
+        {
+            std::uint64_t uploaded_bytes = 0;
+
+            std::uint64_t allocations = 0;
+
+            // Times allocate() had to wait for the GPU.
+            std::uint64_t stalls = 0;
+        };
+
+        explicit staging_ring(std::size_t capacity_);
+
+        staging_ring(const staging_ring &) = delete;
+
+        staging_ring& operator=(const staging_ring &) = delete;
+
+        ~staging_ring();
+
+        GLuint gl_handle() const
+        {
+            return _glHandle;
+        }
+
+        std::size_t capacity() const
+        {
+            return _capacity;
+        }
+
+        // |size_| bytes starting at a multiple of |alignment_|, or an empty
+        // allocation if |size_| does not fit into the ring at all.
+        allocation allocate(std::size_t size_, std::size_t alignment_);
+
+        // Fences the allocations made since the previous call.
+        void end_frame();
+
+        const statistics& stats() const
+        {
+            return _stats;
+        }
+    private:
+        struct _frame
+        {
+            GLsync fence;
+
+            // Bytes of the ring the frame holds, padding included.
+            std::size_t size;
+        };
+
+        GLuint _glHandle = 0;
+
+        std::uint8_t *_data = nullptr;
+
+        std::size_t _capacity;
+
+        // Where the next allocation starts looking.
+        std::size_t _head = 0;
+
+        // Bytes held by the fenced frames and the current one.
+        std::size_t _used = 0;
+
+        std::size_t _currentFrameSize = 0;
+
+        std::deque<_frame> _frames;
+
+        statistics _stats;
+
+        void _retire_oldest_frame();
+    };
+}
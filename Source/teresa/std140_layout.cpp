@@ -0,0 +1,99 @@
+
+#include "std140_layout.h"
+#include <stdexcept>
+
+namespace teresa
+{
+    namespace
+    {
+        struct type_shape
+        {
+            // Components of a column, and columns, 1 for vectors and scalars.
+            std::size_t rows;
+
+            std::size_t columns;
+        };
+
+        type_shape shape_of(GLenum type_)
+        {
+            switch (type_) {
+            case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT: case GL_BOOL:
+                return { 1, 1 };
+            case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2:
+                return { 2, 1 };
+            case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3:
+                return { 3, 1 };
+            case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4:
+                return { 4, 1 };
+            case GL_FLOAT_MAT2:
+                return { 2, 2 };
+            case GL_FLOAT_MAT2x3:
+                return { 3, 2 };
+            case GL_FLOAT_MAT2x4:
+                return { 4, 2 };
+            case GL_FLOAT_MAT3x2:
+                return { 2, 3 };
+            case GL_FLOAT_MAT3:
+                return { 3, 3 };
+            case GL_FLOAT_MAT3x4:
+                return { 4, 3 };
+            case GL_FLOAT_MAT4x2:
+                return { 2, 4 };
+            case GL_FLOAT_MAT4x3:
+                return { 3, 4 };
+            case GL_FLOAT_MAT4:
+                return { 4, 4 };
+            default:
+                throw std::runtime_error("Unsupported type in a std140 block.");
+            }
+        }
+
+        constexpr std::size_t component_size = 4;
+
+        constexpr std::size_t vec4_size = 4 * component_size;
+
+        std::size_t round_up(std::size_t value_, std::size_t alignment_)
+        {
+            return (value_ + alignment_ - 1) / alignment_ * alignment_;
+        }
+    }
+
+    std140_layout layout_std140(const std::vector<std140_member> &members_)
+    {
+        std140_layout result;
+        std::size_t offset = 0;
+        for (auto &member : members_) {
+            auto shape = shape_of(member.type);
+            // Rules 1 to 3: scalars and vectors align to themselves, three components to four.
+            auto vectorSize = shape.rows * component_size;
+            auto alignment = shape.rows == 3 ? vec4_size : vectorSize;
+
+            std140_member_layout layout;
+            layout.name = member.name;
+            layout.type = member.type;
+            // Rules 4 to 8: columns of matrices and elements of arrays are padded to a vec4.
+            if (shape.columns > 1) {
+                layout.matrix_stride = vec4_size;
+                alignment = vec4_size;
+            }
+            auto elementSize = shape.columns > 1 ? shape.columns * vec4_size : vectorSize;
+            if (member.array_length) {
+                alignment = vec4_size;
+                layout.array_stride = round_up(elementSize, vec4_size);
+                layout.size = layout.array_stride * member.array_length;
+            }
+            else {
+                layout.size = elementSize;
+            }
+            layout.offset = round_up(offset, alignment);
+            offset = layout.offset + layout.size;
+            // Rule 4 and 9: whatever follows an array or a matrix starts on a vec4 boundary.
+            if (member.array_length || shape.columns > 1) {
+                offset = round_up(offset, vec4_size);
+            }
+            result.members.push_back(std::move(layout));
+        }
+        result.size = round_up(offset, vec4_size);
+        return result;
+    }
+}
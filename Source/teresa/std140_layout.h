@@ -0,0 +1,51 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace teresa
+{
+    struct std140_member
+    {
+        std::string name;
+
+        // A GLSL type as reported by getActiveUniform(), e.g. GL_FLOAT_VEC3 or GL_FLOAT_MAT4.
+        GLenum type = GL_FLOAT;
+
+        // Elements if the member is an array, 0 if it is not; an array of one is laid out differently.
+        std::size_t array_length = 0;
+    };
+
+    struct std140_member_layout
+    {
+        std::string name;
+
+        GLenum type = GL_FLOAT;
+
+        std::size_t offset = 0;
+
+        // Bytes from the offset to the end of the last element.
+        std::size_t size = 0;
+
+        // 0 for members which are not arrays.
+        std::size_t array_stride = 0;
+
+        // Between columns, 0 for members which are not matrices.
+        std::size_t matrix_stride = 0;
+    };
+
+    struct std140_layout
+    {
+        std::vector<std140_member_layout> members;
+
+        // Of the whole block, rounded up to a vec4 like GL_UNIFORM_BLOCK_DATA_SIZE.
+        std::size_t size = 0;
+    };
+
+    // Lays |members_| out in order by the std140 rules of the GL 3.1 specification,
+    // section 2.11.4, so that one buffer serves every program declaring the block.
+    std140_layout layout_std140(const std::vector<std140_member> &members_);
+}
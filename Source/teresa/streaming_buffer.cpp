@@ -0,0 +1,62 @@
+
+#include "streaming_buffer.h"
+#include <stdexcept>
+
+namespace teresa
+{
+    namespace
+    {
+        constexpr GLbitfield storage_flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    }
+
+    streaming_buffer::streaming_buffer(std::size_t frame_size_)
+        :_frameSize(frame_size_),
+        _frameStride((frame_size_ + frame_alignment - 1) / frame_alignment * frame_alignment)
+    {
+        if (!frame_size_) {
+            throw std::runtime_error("Streaming buffers must not be empty.");
+        }
+        auto size = static_cast<GLsizeiptr>(this->size());
+        glCreateBuffers(1, &_glHandle);
+        glNamedBufferStorage(_glHandle, size, nullptr, storage_flags);
+        _data = glMapNamedBufferRange(_glHandle, 0, size, storage_flags);
+        if (!_data) {
+            glDeleteBuffers(1, &_glHandle);
+            throw std::runtime_error("Failed to map streaming buffer.");
+        }
+    }
+
+    streaming_buffer::~streaming_buffer()
+    {
+        for (auto fence : _fences) {
+            if (fence) {
+                glDeleteSync(fence);
+            }
+        }
+        glUnmapNamedBuffer(_glHandle);
+        glDeleteBuffers(1, &_glHandle);
+    }
+
+    void streaming_buffer::advance()
+    {
+        if (_fences[_frame]) {
+            glDeleteSync(_fences[_frame]);
+        }
+        _fences[_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        _frame = (_frame + 1) % frame_count;
+        auto fence = _fences[_frame];
+        if (!fence) {
+            return;
+        }
+        auto status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            ++_stallCount;
+            do {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        _fences[_frame] = nullptr;
+    }
+}
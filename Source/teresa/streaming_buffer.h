@@ -0,0 +1,85 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+#include <cstdint>
+
+namespace teresa
+{
+    // Ring of |frame_count| equally sized frames in one persistently and coherently
+    // mapped GL buffer. The CPU writes the current frame in place while the GPU
+    // still reads the previous ones; every frame is fenced when it is left behind
+    // and waited for only when the ring comes around to it again.
+    class streaming_buffer
+    {
+    public:
+        constexpr static std::size_t frame_count = 3;
+
+        // Frames start at multiples of this, which satisfies any attribute or index alignment.
+        constexpr static std::size_t frame_alignment = 256;
+
+        explicit streaming_buffer(std::size_t frame_size_);
+
+        streaming_buffer(const streaming_buffer &) = delete;
+
+        streaming_buffer& operator=(const streaming_buffer &) = delete;
+
+        ~streaming_buffer();
+
+        GLuint gl_handle() const
+        {
+            return _glHandle;
+        }
+
+        // The whole mapping, valid until destruction.
+        void* data() const
+        {
+            return _data;
+        }
+
+        std::size_t size() const
+        {
+            return _frameStride * frame_count;
+        }
+
+        std::size_t frame_size() const
+        {
+            return _frameSize;
+        }
+
+        std::size_t frame() const
+        {
+            return _frame;
+        }
+
+        GLintptr frame_offset() const
+        {
+            return static_cast<GLintptr>(_frame * _frameStride);
+        }
+
+        // Times advance() had to wait for the GPU.
+        std::uint64_t stall_count() const
+        {
+            return _stallCount;
+        }
+
+        // Fences the commands issued for the current frame and moves on to the next
+        // one, waiting until the GPU has finished reading it.
+        void advance();
+    private:
+        GLuint _glHandle = 0;
+
+        void *_data = nullptr;
+
+        std::size_t _frameSize;
+
+        std::size_t _frameStride;
+
+        std::size_t _frame = 0;
+
+        std::array<GLsync, frame_count> _fences = {};
+
+        std::uint64_t _stallCount = 0;
+    };
+}
@@ -0,0 +1,319 @@
+
+#include "texture_atlas.h"
+#include "pixel_format.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace teresa
+{
+    texture_atlas::texture_atlas(GLsizei width_, GLsizei height_, GLenum format_, std::size_t max_pages_, GLsizei padding_)
+        :_width(width_), _height(height_), _format(format_),
+        _internalFormat(sized_internal_format(format_, GL_UNSIGNED_BYTE)),
+        _pixelSize(bytes_per_pixel(format_, GL_UNSIGNED_BYTE)),
+        _maxPages(std::max<std::size_t>(1, max_pages_)), _padding(std::max<GLsizei>(0, padding_))
+    {
+        if (width_ <= 0 || height_ <= 0) {
+            throw std::runtime_error("Invalid atlas size.");
+        }
+        if (!_internalFormat || !_pixelSize) {
+            throw std::runtime_error("Unsupported atlas format.");
+        }
+    }
+
+    texture_atlas::~texture_atlas()
+    {
+        destroy();
+    }
+
+    std::size_t texture_atlas::_add_page()
+    {
+        _pages.emplace_back(_width, _height);
+        auto &page = _pages.back();
+        glCreateTextures(GL_TEXTURE_2D, 1, &page.gl_handle);
+        glTextureStorage2D(page.gl_handle, 1, _internalFormat, _width, _height);
+        glTextureParameteri(page.gl_handle, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(page.gl_handle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(page.gl_handle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        page.pixels.assign(static_cast<std::size_t>(_width) * _height * _pixelSize, 0);
+        return _pages.size() - 1;
+    }
+
+    std::size_t texture_atlas::_allocate(GLsizei width_, GLsizei height_, GLint &x_, GLint &y_)
+    {
+        for (std::size_t i = 0; i < _pages.size(); ++i) {
+            if (_pages[i].packer.insert(width_, height_, x_, y_)) {
+                return i;
+            }
+        }
+        std::size_t page = 0;
+        if (_pages.size() < _maxPages) {
+            page = _add_page();
+        }
+        else {
+            auto lru = std::min_element(_pages.begin(), _pages.end(), [](const _page &a_, const _page &b_) {
+                return a_.last_used < b_.last_used;
+            });
+            page = lru - _pages.begin();
+            _evict_page(page);
+        }
+        // An empty page always fits what add() let through.
+        _pages[page].packer.insert(width_, height_, x_, y_);
+        return page;
+    }
+
+    void texture_atlas::_evict_page(std::size_t page_)
+    {
+        for (auto i = _regions.begin(); i != _regions.end();) {
+            if (i->second.page == page_) {
+                _evicted.push_back(i->first);
+                ++_stats.evictions;
+                i = _regions.erase(i);
+            }
+            else {
+                ++i;
+            }
+        }
+        _pages[page_].regions = 0;
+        _pages[page_].packer.reset();
+    }
+
+    void texture_atlas::_extrude(_page &page_, const atlas_region &region_)
+    {
+        if (!_padding) {
+            return;
+        }
+        auto pitch = static_cast<std::size_t>(_width) * _pixelSize;
+        auto texel = [&](GLint x_, GLint y_) {
+            return page_.pixels.data() + y_ * pitch + x_ * _pixelSize;
+        };
+        auto right = region_.x + region_.width - 1;
+        for (auto y = region_.y; y < region_.y + region_.height; ++y) {
+            for (GLint k = 1; k <= _padding; ++k) {
+                std::memcpy(texel(region_.x - k, y), texel(region_.x, y), _pixelSize);
+                std::memcpy(texel(right + k, y), texel(right, y), _pixelSize);
+            }
+        }
+        auto rowBytes = static_cast<std::size_t>(region_.width + 2 * _padding) * _pixelSize;
+        auto bottom = region_.y + region_.height - 1;
+        for (GLint k = 1; k <= _padding; ++k) {
+            std::memcpy(texel(region_.x - _padding, region_.y - k), texel(region_.x - _padding, region_.y), rowBytes);
+            std::memcpy(texel(region_.x - _padding, bottom + k), texel(region_.x - _padding, bottom), rowBytes);
+        }
+    }
+
+    void texture_atlas::_mark_dirty(_page &page_, GLint x0_, GLint y0_, GLint x1_, GLint y1_)
+    {
+        if (page_.dirty_x0 >= page_.dirty_x1) {
+            page_.dirty_x0 = x0_;
+            page_.dirty_y0 = y0_;
+            page_.dirty_x1 = x1_;
+            page_.dirty_y1 = y1_;
+            return;
+        }
+        page_.dirty_x0 = std::min(page_.dirty_x0, x0_);
+        page_.dirty_y0 = std::min(page_.dirty_y0, y0_);
+        page_.dirty_x1 = std::max(page_.dirty_x1, x1_);
+        page_.dirty_y1 = std::max(page_.dirty_y1, y1_);
+    }
+
+    atlas_region texture_atlas::add(GLsizei width_, GLsizei height_, const void *pixels_, std::size_t source_pitch_)
+    {
+        if (width_ <= 0 || height_ <= 0) {
+            throw std::runtime_error("Invalid image size.");
+        }
+        auto paddedWidth = width_ + 2 * _padding;
+        auto paddedHeight = height_ + 2 * _padding;
+        if (paddedWidth > _width || paddedHeight > _height) {
+            throw std::runtime_error("Image is larger than the atlas pages.");
+        }
+
+        GLint x = 0;
+        GLint y = 0;
+        atlas_region region;
+        region.id = _nextId++;
+        region.page = _allocate(paddedWidth, paddedHeight, x, y);
+        region.x = x + _padding;
+        region.y = y + _padding;
+        region.width = width_;
+        region.height = height_;
+
+        auto &page = _pages[region.page];
+        auto pitch = static_cast<std::size_t>(_width) * _pixelSize;
+        auto rowBytes = static_cast<std::size_t>(width_) * _pixelSize;
+        auto source = static_cast<const std::uint8_t*>(pixels_);
+        for (GLsizei row = 0; row < height_; ++row) {
+            std::memcpy(page.pixels.data() + (region.y + row) * pitch + region.x * _pixelSize, source + row * source_pitch_, rowBytes);
+        }
+        _extrude(page, region);
+        _mark_dirty(page, x, y, x + paddedWidth, y + paddedHeight);
+        ++page.regions;
+        page.last_used = ++_clock;
+        _regions.emplace(region.id, region);
+        return region;
+    }
+
+    bool texture_atlas::remove(std::uint32_t id_)
+    {
+        auto found = _regions.find(id_);
+        if (found == _regions.end()) {
+            return false;
+        }
+        auto &page = _pages[found->second.page];
+        // The skyline cannot free single rectangles, but an empty page starts over.
+        if (--page.regions == 0) {
+            page.packer.reset();
+        }
+        _regions.erase(found);
+        return true;
+    }
+
+    bool texture_atlas::touch(std::uint32_t id_)
+    {
+        auto found = _regions.find(id_);
+        if (found == _regions.end()) {
+            return false;
+        }
+        _pages[found->second.page].last_used = ++_clock;
+        return true;
+    }
+
+    std::optional<atlas_region> texture_atlas::region(std::uint32_t id_) const
+    {
+        auto found = _regions.find(id_);
+        if (found == _regions.end()) {
+            return std::nullopt;
+        }
+        return found->second;
+    }
+
+    std::vector<atlas_region> texture_atlas::regions() const
+    {
+        std::vector<atlas_region> result;
+        result.reserve(_regions.size());
+        for (auto &[id, region] : _regions) {
+            result.push_back(region);
+        }
+        return result;
+    }
+
+    std::vector<std::uint32_t> texture_atlas::take_evicted()
+    {
+        std::vector<std::uint32_t> result;
+        result.swap(_evicted);
+        return result;
+    }
+
+    void texture_atlas::flush(GLint unpack_alignment_)
+    {
+        auto dirty = std::any_of(_pages.begin(), _pages.end(), [](const _page &page_) {
+            return page_.dirty_x0 < page_.dirty_x1;
+        });
+        if (!dirty) {
+            return;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, _width);
+        for (auto &page : _pages) {
+            if (page.dirty_x0 >= page.dirty_x1) {
+                continue;
+            }
+            auto width = page.dirty_x1 - page.dirty_x0;
+            auto height = page.dirty_y1 - page.dirty_y0;
+            auto offset = (static_cast<std::size_t>(page.dirty_y0) * _width + page.dirty_x0) * _pixelSize;
+            glTextureSubImage2D(page.gl_handle, 0, page.dirty_x0, page.dirty_y0, width, height, _format, GL_UNSIGNED_BYTE, page.pixels.data() + offset);
+            ++_stats.uploads;
+            _stats.uploaded_bytes += static_cast<std::uint64_t>(width) * height * _pixelSize;
+            page.dirty_x0 = page.dirty_x1 = 0;
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment_);
+    }
+
+    void texture_atlas::defragment()
+    {
+        std::vector<atlas_region> live = regions();
+        std::sort(live.begin(), live.end(), [](const atlas_region &a_, const atlas_region &b_) {
+            return a_.height != b_.height ? a_.height > b_.height : a_.width > b_.width;
+        });
+
+        std::vector<std::vector<std::uint8_t>> oldPixels;
+        std::vector<std::uint64_t> oldLastUsed;
+        for (auto &page : _pages) {
+            oldPixels.push_back(std::move(page.pixels));
+            oldLastUsed.push_back(page.last_used);
+            page.pixels.assign(oldPixels.back().size(), 0);
+            page.packer.reset();
+            page.regions = 0;
+            page.last_used = 0;
+        }
+
+        auto pitch = static_cast<std::size_t>(_width) * _pixelSize;
+        for (auto &region : live) {
+            auto paddedWidth = region.width + 2 * _padding;
+            auto paddedHeight = region.height + 2 * _padding;
+            GLint x = 0;
+            GLint y = 0;
+            auto page = _pages.size();
+            for (std::size_t i = 0; i < _pages.size(); ++i) {
+                if (_pages[i].packer.insert(paddedWidth, paddedHeight, x, y)) {
+                    page = i;
+                    break;
+                }
+            }
+            if (page == _pages.size() && _pages.size() < _maxPages) {
+                page = _add_page();
+                _pages[page].packer.insert(paddedWidth, paddedHeight, x, y);
+            }
+            if (page == _pages.size()) {
+                _evicted.push_back(region.id);
+                ++_stats.evictions;
+                _regions.erase(region.id);
+                continue;
+            }
+
+            auto &from = oldPixels[region.page];
+            auto &to = _pages[page];
+            auto rowBytes = static_cast<std::size_t>(paddedWidth) * _pixelSize;
+            for (GLsizei row = 0; row < paddedHeight; ++row) {
+                std::memcpy(to.pixels.data() + (y + row) * pitch + x * _pixelSize,
+                    from.data() + (region.y - _padding + row) * pitch + (region.x - _padding) * _pixelSize, rowBytes);
+            }
+            ++to.regions;
+            to.last_used = std::max(to.last_used, oldLastUsed[region.page]);
+
+            auto &moved = _regions[region.id];
+            moved.page = page;
+            moved.x = x + _padding;
+            moved.y = y + _padding;
+        }
+
+        for (auto &page : _pages) {
+            _mark_dirty(page, 0, 0, _width, _height);
+        }
+    }
+
+    void texture_atlas::destroy()
+    {
+        for (auto &page : _pages) {
+            glDeleteTextures(1, &page.gl_handle);
+        }
+        _pages.clear();
+        _regions.clear();
+    }
+
+    texture_atlas::statistics texture_atlas::stats() const
+    {
+        auto result = _stats;
+        result.pages = _pages.size();
+        result.regions = _regions.size();
+        std::uint64_t used = 0;
+        for (auto &[id, region] : _regions) {
+            used += static_cast<std::uint64_t>(region.width + 2 * _padding) * (region.height + 2 * _padding);
+        }
+        if (!_pages.empty()) {
+            result.occupancy = static_cast<double>(used) / (static_cast<double>(_width) * _height * _pages.size());
+        }
+        return result;
+    }
+}
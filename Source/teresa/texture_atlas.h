@@ -0,0 +1,177 @@
+
+#pragma once
+
+#include "skyline_packer.h"
+#include <glad/glad.h>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace teresa
+{
+    struct atlas_region
+    {
+        std::uint32_t id = 0;
+
+        std::size_t page = 0;
+
+        // Excludes the padding.
+        GLint x = 0;
+
+        GLint y = 0;
+
+        GLsizei width = 0;
+
+        GLsizei height = 0;
+    };
+
+    // Packs many small images of one format into a few large textures, the pages.
+    // Images are kept in a CPU copy of every page, so additions are uploaded in one
+    // call per page by flush(), and defragment() can move them around. When all
+    // pages are full, the least recently used page is emptied to make room.
+    class texture_atlas
+    {
+    public:
+        struct statistics
+        {
+            std::size_t pages = 0;
+
+            std::size_t regions = 0;
+
+            // Share of the page area covered by live regions, padding included.
+            double occupancy = 0;
+
+            std::uint64_t evictions = 0;
+
+            std::uint64_t uploads = 0;
+
+            std::uint64_t uploaded_bytes = 0;
+        };
+
+        // |format_| is a client format of unsigned bytes with a sized internal format.
+        // Every region is surrounded by |padding_| texels copied from its edges.
+        texture_atlas(GLsizei width_, GLsizei height_, GLenum format_, std::size_t max_pages_, GLsizei padding_);
+
+        texture_atlas(const texture_atlas &) = delete;
+
+        texture_atlas& operator=(const texture_atlas &) = delete;
+
+        ~texture_atlas();
+
+        GLsizei width() const
+        {
+            return _width;
+        }
+
+        GLsizei height() const
+        {
+            return _height;
+        }
+
+        std::size_t page_count() const
+        {
+            return _pages.size();
+        }
+
+        GLuint page_handle(std::size_t page_) const
+        {
+            return _pages[page_].gl_handle;
+        }
+
+        // Copies |width_| x |height_| pixels with rows |source_pitch_| bytes apart into
+        // the atlas. Throws if the image cannot fit into an empty page.
+        atlas_region add(GLsizei width_, GLsizei height_, const void *pixels_, std::size_t source_pitch_);
+
+        bool remove(std::uint32_t id_);
+
+        // Marks the region as used, which keeps its page from being evicted.
+        bool touch(std::uint32_t id_);
+
+        std::optional<atlas_region> region(std::uint32_t id_) const;
+
+        std::vector<atlas_region> regions() const;
+
+        // Ids of the regions evicted since the previous call.
+        std::vector<std::uint32_t> take_evicted();
+
+        // Uploads what changed since the previous flush, then sets the unpack
+        // alignment back to |unpack_alignment_|.
+        void flush(GLint unpack_alignment_);
+
+        // Repacks the live regions, tallest first, and reuploads every page on the
+        // next flush. Regions that no longer fit are evicted.
+        void defragment();
+
+        // Deletes the pages.
+        void destroy();
+
+        statistics stats() const;
+    private:
+        struct _page
+        {
+            GLuint gl_handle = 0;
+
+            skyline_packer packer;
+
+            std::vector<std::uint8_t> pixels;
+
+            std::size_t regions = 0;
+
+            std::uint64_t last_used = 0;
+
+            // Rectangle to upload, empty when x0 >= x1.
+            GLint dirty_x0 = 0;
+
+            GLint dirty_y0 = 0;
+
+            GLint dirty_x1 = 0;
+
+            GLint dirty_y1 = 0;
+
+            _page(GLsizei width_, GLsizei height_)
+                :packer(width_, height_)
+            {
+
+            }
+        };
+
+        GLsizei _width;
+
+        GLsizei _height;
+
+        GLenum _format;
+
+        GLenum _internalFormat;
+
+        std::size_t _pixelSize;
+
+        std::size_t _maxPages;
+
+        GLsizei _padding;
+
+        std::vector<_page> _pages;
+
+        std::unordered_map<std::uint32_t, atlas_region> _regions;
+
+        std::uint32_t _nextId = 1;
+
+        std::uint64_t _clock = 0;
+
+        std::vector<std::uint32_t> _evicted;
+
+        statistics _stats;
+
+        std::size_t _add_page();
+
+        // Finds room for a padded rectangle, evicting a page if needed.
+        std::size_t _allocate(GLsizei width_, GLsizei height_, GLint &x_, GLint &y_);
+
+        void _evict_page(std::size_t page_);
+
+        // Fills the padding around |region_| from its edge texels.
+        void _extrude(_page &page_, const atlas_region &region_);
+
+        void _mark_dirty(_page &page_, GLint x0_, GLint y0_, GLint x1_, GLint y1_);
+    };
+}
@@ -0,0 +1,108 @@
+
+#include "texture_pool.h"
+#include <algorithm>
+
+namespace teresa
+{
+    void texture_pool::configure(std::size_t memory_cap_, std::size_t max_idle_frames_)
+    {
+        _memoryCap = memory_cap_;
+        _maxIdleFrames = max_idle_frames_;
+        _evict_over_cap();
+    }
+
+    webgl::Texture* texture_pool::acquire(const texture_desc &desc_)
+    {
+        ++_stats.in_use_count;
+        auto idle = _idle.find(desc_);
+        if (idle == _idle.end() || idle->second.empty()) {
+            ++_stats.misses;
+            return nullptr;
+        }
+        ++_stats.hits;
+        auto entry = idle->second.back();
+        idle->second.pop_back();
+        --_stats.idle_count;
+        _stats.idle_bytes -= entry.size;
+        return entry.texture;
+    }
+
+    void texture_pool::release(webgl::Texture *texture_, const texture_desc &desc_, std::size_t size_)
+    {
+        --_stats.in_use_count;
+        _idle[desc_].push_back({ texture_, size_, _frame });
+        ++_stats.idle_count;
+        _stats.idle_bytes += size_;
+        _evict_over_cap();
+    }
+
+    void texture_pool::forget(webgl::Texture *texture_, const texture_desc &desc_)
+    {
+        auto idle = _idle.find(desc_);
+        if (idle != _idle.end()) {
+            auto &entries = idle->second;
+            auto entry = std::find_if(entries.begin(), entries.end(), [texture_](auto &entry_) { return entry_.texture == texture_; });
+            if (entry != entries.end()) {
+                --_stats.idle_count;
+                _stats.idle_bytes -= entry->size;
+                entries.erase(entry);
+                return;
+            }
+        }
+        --_stats.in_use_count;
+    }
+
+    void texture_pool::end_frame()
+    {
+        ++_frame;
+        for (auto &[desc, entries] : _idle) {
+            // Entries are ordered by release, so the stale ones lead.
+            auto stale = std::find_if(entries.begin(), entries.end(), [this](auto &entry_) {
+                return _frame - entry_.released_frame <= _maxIdleFrames;
+            });
+            for (auto entry = entries.begin(); entry != stale; ++entry) {
+                _evicted.push_back(entry->texture);
+                --_stats.idle_count;
+                _stats.idle_bytes -= entry->size;
+                ++_stats.evictions;
+            }
+            entries.erase(entries.begin(), stale);
+        }
+    }
+
+    std::vector<webgl::Texture*> texture_pool::take_evicted()
+    {
+        std::vector<webgl::Texture*> result;
+        result.swap(_evicted);
+        return result;
+    }
+
+    texture_pool::statistics texture_pool::stats() const
+    {
+        auto result = _stats;
+        auto requests = result.hits + result.misses;
+        if (requests) {
+            result.hit_rate = static_cast<double>(result.hits) / requests;
+        }
+        return result;
+    }
+
+    void texture_pool::_evict_over_cap()
+    {
+        // Least recently released first.
+        while (_stats.idle_bytes > _memoryCap) {
+            std::vector<_idle_texture> *oldest = nullptr;
+            for (auto &[desc, entries] : _idle) {
+                if (!entries.empty() && (!oldest || entries.front().released_frame < oldest->front().released_frame)) {
+                    oldest = &entries;
+                }
+            }
+            auto entry = oldest->front();
+            oldest->erase(oldest->begin());
+            _evicted.push_back(entry.texture);
+            --_stats.idle_count;
+            _stats.idle_bytes -= entry.size;
+            ++_stats.evictions;
+        }
+    }
+}
@@ -0,0 +1,124 @@
+
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace webgl
+{
+    struct Texture;
+}
+
+namespace teresa
+{
+    struct texture_desc
+    {
+        GLsizei width = 0;
+        GLsizei height = 0;
+        GLenum format = GL_RGBA;
+        GLenum type = GL_UNSIGNED_BYTE;
+        GLint levels = 1;
+
+        bool operator==(const texture_desc &other_) const
+        {
+            return width == other_.width && height == other_.height && format == other_.format &&
+                type == other_.type && levels == other_.levels;
+        }
+    };
+
+    // Textures released by their users are kept for reuse by the next acquire of the
+    // same description. The pool only does the bookkeeping; creating and destroying
+    // textures is up to the caller, which collects the evicted ones with take_evicted().
+    class texture_pool
+    {
+    public:
+        constexpr static std::size_t default_memory_cap = 256 * 1024 * 1024;
+
+        constexpr static std::size_t default_max_idle_frames = 3;
+
+        struct statistics
+        {
+            std::uint64_t hits = 0;
+
+            std::uint64_t misses = 0;
+
+            std::uint64_t evictions = 0;
+
+            std::size_t idle_count = 0;
+
+            std::size_t idle_bytes = 0;
+
+            std::size_t in_use_count = 0;
+
+            double hit_rate = 0;
+        };
+
+        // Idle textures beyond |memory_cap_| bytes or unused for more than |max_idle_frames_| frames are evicted.
+        void configure(std::size_t memory_cap_, std::size_t max_idle_frames_);
+
+        std::size_t memory_cap() const
+        {
+            return _memoryCap;
+        }
+
+        std::size_t max_idle_frames() const
+        {
+            return _maxIdleFrames;
+        }
+
+        // An idle texture of |desc_|, or null if the caller has to create one.
+        webgl::Texture* acquire(const texture_desc &desc_);
+
+        // Hands a texture of |desc_| holding |size_| bytes back to the pool.
+        void release(webgl::Texture *texture_, const texture_desc &desc_, std::size_t size_);
+
+        // A pooled texture is being deleted by hand.
+        void forget(webgl::Texture *texture_, const texture_desc &desc_);
+
+        // Ages the idle textures.
+        void end_frame();
+
+        // Textures evicted since the last call, to be destroyed by the caller.
+        std::vector<webgl::Texture*> take_evicted();
+
+        statistics stats() const;
+    private:
+        struct _desc_hash
+        {
+            std::size_t operator()(const texture_desc &desc_) const
+            {
+                auto h = std::hash<GLsizei>()(desc_.width);
+                h ^= std::hash<GLsizei>()(desc_.height) + 0x9e3779b9 + (h << 6) + (h >> 2);
+                h ^= std::hash<GLenum>()(desc_.format) + 0x9e3779b9 + (h << 6) + (h >> 2);
+                h ^= std::hash<GLenum>()(desc_.type) + 0x9e3779b9 + (h << 6) + (h >> 2);
+                h ^= std::hash<GLint>()(desc_.levels) + 0x9e3779b9 + (h << 6) + (h >> 2);
+                return h;
+            }
+        };
+
+        struct _idle_texture
+        {
+            webgl::Texture *texture;
+            std::size_t size;
+            std::uint64_t released_frame;
+        };
+
+        std::size_t _memoryCap = default_memory_cap;
+
+        std::size_t _maxIdleFrames = default_max_idle_frames;
+
+        std::uint64_t _frame = 0;
+
+        // Idle textures per description, most recently released last.
+        std::unordered_map<texture_desc, std::vector<_idle_texture>, _desc_hash> _idle;
+
+        std::vector<webgl::Texture*> _evicted;
+
+        statistics _stats;
+
+        void _evict_over_cap();
+    };
+}
@@ -0,0 +1,422 @@
+
+#include "virtual_context.h"
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+
+namespace teresa
+{
+    namespace
+    {
+        // The capabilities WebGL can enable, by their bit in virtual_state::capabilities.
+        constexpr GLenum capability_enums[] = {
+            GL_BLEND,
+            GL_CULL_FACE,
+            GL_DEPTH_TEST,
+            GL_DITHER,
+            GL_POLYGON_OFFSET_FILL,
+            GL_SAMPLE_ALPHA_TO_COVERAGE,
+            GL_SAMPLE_COVERAGE,
+            GL_SCISSOR_TEST,
+            GL_STENCIL_TEST,
+        };
+
+        const std::array<GLint, 2> no_textures = {};
+
+        const virtual_state::uniform_buffer_binding no_uniform_buffer;
+
+        const std::array<GLfloat, 4> default_vertex_attrib = { 0, 0, 0, 1 };
+
+        template <typename Ty>
+        const Ty& at_or(const std::vector<Ty> &values_, std::size_t index_, const Ty &default_)
+        {
+            return index_ < values_.size() ? values_[index_] : default_;
+        }
+
+        auto tie(const virtual_state::stencil_face &face_)
+        {
+            return std::tie(face_.func, face_.ref, face_.value_mask, face_.writemask,
+                face_.fail, face_.pass_depth_fail, face_.pass_depth_pass);
+        }
+
+        void capture_stencil_face(virtual_state::stencil_face &face_, bool back_)
+        {
+            glGetIntegerv(back_ ? GL_STENCIL_BACK_FUNC : GL_STENCIL_FUNC, &face_.func);
+            glGetIntegerv(back_ ? GL_STENCIL_BACK_REF : GL_STENCIL_REF, &face_.ref);
+            glGetIntegerv(back_ ? GL_STENCIL_BACK_VALUE_MASK : GL_STENCIL_VALUE_MASK, &face_.value_mask);
+            glGetIntegerv(back_ ? GL_STENCIL_BACK_WRITEMASK : GL_STENCIL_WRITEMASK, &face_.writemask);
+            glGetIntegerv(back_ ? GL_STENCIL_BACK_FAIL : GL_STENCIL_FAIL, &face_.fail);
+            glGetIntegerv(back_ ? GL_STENCIL_BACK_PASS_DEPTH_FAIL : GL_STENCIL_PASS_DEPTH_FAIL, &face_.pass_depth_fail);
+            glGetIntegerv(back_ ? GL_STENCIL_BACK_PASS_DEPTH_PASS : GL_STENCIL_PASS_DEPTH_PASS, &face_.pass_depth_pass);
+        }
+
+        void apply_stencil_face(const virtual_state::stencil_face &from_, const virtual_state::stencil_face &to_, GLenum face_)
+        {
+            if (std::tie(from_.func, from_.ref, from_.value_mask) != std::tie(to_.func, to_.ref, to_.value_mask)) {
+                glStencilFuncSeparate(face_, to_.func, to_.ref, static_cast<GLuint>(to_.value_mask));
+            }
+            if (from_.writemask != to_.writemask) {
+                glStencilMaskSeparate(face_, static_cast<GLuint>(to_.writemask));
+            }
+            if (std::tie(from_.fail, from_.pass_depth_fail, from_.pass_depth_pass) != std::tie(to_.fail, to_.pass_depth_fail, to_.pass_depth_pass)) {
+                glStencilOpSeparate(face_, to_.fail, to_.pass_depth_fail, to_.pass_depth_pass);
+            }
+        }
+    }
+
+    void virtual_state::set_capability(GLenum capability_, bool enabled_)
+    {
+        auto found = std::find(std::begin(capability_enums), std::end(capability_enums), capability_);
+        if (found == std::end(capability_enums)) {
+            return;
+        }
+        auto bit = 1u << (found - std::begin(capability_enums));
+        capabilities = enabled_ ? (capabilities | bit) : (capabilities & ~bit);
+    }
+
+    void virtual_state::bind_texture(GLenum target_, GLint texture_)
+    {
+        if (target_ != GL_TEXTURE_2D && target_ != GL_TEXTURE_CUBE_MAP) {
+            return;
+        }
+        auto unit = static_cast<std::size_t>(active_texture - GL_TEXTURE0);
+        if (unit >= textures.size()) {
+            textures.resize(unit + 1);
+        }
+        textures[unit][target_ == GL_TEXTURE_2D ? 0 : 1] = texture_;
+    }
+
+    void virtual_state::bind_uniform_buffer_range(GLuint index_, GLint buffer_, GLint64 offset_, GLint64 size_)
+    {
+        if (index_ >= uniform_buffers.size()) {
+            uniform_buffers.resize(index_ + 1);
+        }
+        uniform_buffers[index_] = { buffer_, offset_, size_ };
+        // Indexed bindings set the generic binding as well.
+        uniform_buffer = buffer_;
+    }
+
+    void virtual_state::set_vertex_attrib(GLuint index_, const std::array<GLfloat, 4> &value_)
+    {
+        if (index_ >= vertex_attribs.size()) {
+            vertex_attribs.resize(index_ + 1, default_vertex_attrib);
+        }
+        vertex_attribs[index_] = value_;
+    }
+
+    void virtual_state::on_buffer_deleted(GLint buffer_)
+    {
+        if (array_buffer == buffer_) {
+            array_buffer = 0;
+        }
+        if (uniform_buffer == buffer_) {
+            uniform_buffer = 0;
+        }
+        for (auto &binding : uniform_buffers) {
+            if (binding.buffer == buffer_) {
+                binding = no_uniform_buffer;
+            }
+        }
+    }
+
+    void virtual_state::on_texture_deleted(GLint texture_)
+    {
+        for (auto &unit : textures) {
+            for (auto &texture : unit) {
+                if (texture == texture_) {
+                    texture = 0;
+                }
+            }
+        }
+    }
+
+    void virtual_state::on_renderbuffer_deleted(GLint renderbuffer_)
+    {
+        if (renderbuffer == renderbuffer_) {
+            renderbuffer = 0;
+        }
+    }
+
+    std::shared_ptr<virtual_context> virtual_context::acquire()
+    {
+        static std::mutex mutex;
+        static std::weak_ptr<virtual_context> shared;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto result = shared.lock();
+        if (!result) {
+            result = std::make_shared<virtual_context>();
+            shared = result;
+        }
+        return result;
+    }
+
+    virtual_context::virtual_context()
+    {
+        _context.load_gl();
+        glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &_maxVertexAttribs);
+    }
+
+    void virtual_context::make_current() const
+    {
+        _context.make_current();
+    }
+
+    void virtual_context::switch_to(virtual_state &state_)
+    {
+        if (_resident == &state_) {
+            return;
+        }
+        if (!_resident) {
+            // Nobody has used the context yet, so what the next state needs is all there is to read.
+            _capture(_released, state_.textures.size(), state_.uniform_buffers.size());
+            _resident = &_released;
+        }
+        _apply(*_resident, state_);
+        _resident = &state_;
+    }
+
+    void virtual_context::release(const virtual_state &state_)
+    {
+        if (_resident == &state_) {
+            _released = state_;
+            _resident = &_released;
+        }
+    }
+
+    void virtual_context::_capture(virtual_state &state_, std::size_t texture_units_, std::size_t uniform_buffers_) const
+    {
+        state_.capabilities = 0;
+        for (std::size_t i = 0; i < std::size(capability_enums); ++i) {
+            if (glIsEnabled(capability_enums[i])) {
+                state_.capabilities |= 1u << i;
+            }
+        }
+
+        glGetFloatv(GL_BLEND_COLOR, state_.blend_color.data());
+        glGetIntegerv(GL_BLEND_EQUATION_RGB, &state_.blend_equation_rgb);
+        glGetIntegerv(GL_BLEND_EQUATION_ALPHA, &state_.blend_equation_alpha);
+        glGetIntegerv(GL_BLEND_SRC_RGB, &state_.blend_src_rgb);
+        glGetIntegerv(GL_BLEND_DST_RGB, &state_.blend_dst_rgb);
+        glGetIntegerv(GL_BLEND_SRC_ALPHA, &state_.blend_src_alpha);
+        glGetIntegerv(GL_BLEND_DST_ALPHA, &state_.blend_dst_alpha);
+
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, state_.clear_color.data());
+        glGetFloatv(GL_DEPTH_CLEAR_VALUE, &state_.clear_depth);
+        glGetIntegerv(GL_STENCIL_CLEAR_VALUE, &state_.clear_stencil);
+
+        glGetBooleanv(GL_COLOR_WRITEMASK, state_.color_writemask.data());
+        glGetBooleanv(GL_DEPTH_WRITEMASK, &state_.depth_writemask);
+
+        glGetIntegerv(GL_CULL_FACE_MODE, &state_.cull_face_mode);
+        glGetIntegerv(GL_FRONT_FACE, &state_.front_face);
+        glGetIntegerv(GL_DEPTH_FUNC, &state_.depth_func);
+        glGetFloatv(GL_DEPTH_RANGE, state_.depth_range.data());
+        glGetFloatv(GL_LINE_WIDTH, &state_.line_width);
+        glGetFloatv(GL_POLYGON_OFFSET_FACTOR, &state_.polygon_offset_factor);
+        glGetFloatv(GL_POLYGON_OFFSET_UNITS, &state_.polygon_offset_units);
+        glGetFloatv(GL_SAMPLE_COVERAGE_VALUE, &state_.sample_coverage_value);
+        glGetBooleanv(GL_SAMPLE_COVERAGE_INVERT, &state_.sample_coverage_invert);
+        glGetIntegerv(GL_GENERATE_MIPMAP_HINT, &state_.generate_mipmap_hint);
+
+        glGetIntegerv(GL_SCISSOR_BOX, state_.scissor_box.data());
+        glGetIntegerv(GL_VIEWPORT, state_.viewport.data());
+
+        capture_stencil_face(state_.stencil_front, false);
+        capture_stencil_face(state_.stencil_back, true);
+
+        glGetIntegerv(GL_PACK_ALIGNMENT, &state_.pack_alignment);
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &state_.unpack_alignment);
+
+        glGetIntegerv(GL_CURRENT_PROGRAM, &state_.program);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &state_.draw_framebuffer);
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &state_.read_framebuffer);
+        glGetIntegerv(GL_RENDERBUFFER_BINDING, &state_.renderbuffer);
+        glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &state_.array_buffer);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &state_.vertex_array);
+        glGetIntegerv(GL_UNIFORM_BUFFER_BINDING, &state_.uniform_buffer);
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &state_.active_texture);
+
+        state_.textures.resize(texture_units_);
+        for (std::size_t unit = 0; unit < texture_units_; ++unit) {
+            glActiveTexture(static_cast<GLenum>(GL_TEXTURE0 + unit));
+            glGetIntegerv(GL_TEXTURE_BINDING_2D, &state_.textures[unit][0]);
+            glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, &state_.textures[unit][1]);
+        }
+        if (texture_units_) {
+            glActiveTexture(state_.active_texture);
+        }
+
+        state_.uniform_buffers.resize(uniform_buffers_);
+        for (std::size_t index = 0; index < uniform_buffers_; ++index) {
+            auto &binding = state_.uniform_buffers[index];
+            auto i = static_cast<GLuint>(index);
+            glGetIntegeri_v(GL_UNIFORM_BUFFER_BINDING, i, &binding.buffer);
+            glGetInteger64i_v(GL_UNIFORM_BUFFER_START, i, &binding.offset);
+            glGetInteger64i_v(GL_UNIFORM_BUFFER_SIZE, i, &binding.size);
+        }
+
+        // Generic attribute 0 aliases the vertex position of a compatibility context, which has no value
+        // to read; a context nobody has used has the default there.
+        state_.vertex_attribs.resize(_maxVertexAttribs, default_vertex_attrib);
+        for (GLint index = 1; index < _maxVertexAttribs; ++index) {
+            glGetVertexAttribfv(index, GL_CURRENT_VERTEX_ATTRIB, state_.vertex_attribs[index].data());
+        }
+    }
+
+    void virtual_context::_apply(const virtual_state &from_, const virtual_state &to_) const
+    {
+        if (auto changed = from_.capabilities ^ to_.capabilities) {
+            for (std::size_t i = 0; i < std::size(capability_enums); ++i) {
+                if (changed & (1u << i)) {
+                    (to_.capabilities & (1u << i)) ? glEnable(capability_enums[i]) : glDisable(capability_enums[i]);
+                }
+            }
+        }
+
+        if (from_.blend_color != to_.blend_color) {
+            glBlendColor(to_.blend_color[0], to_.blend_color[1], to_.blend_color[2], to_.blend_color[3]);
+        }
+        if (std::tie(from_.blend_equation_rgb, from_.blend_equation_alpha) != std::tie(to_.blend_equation_rgb, to_.blend_equation_alpha)) {
+            glBlendEquationSeparate(to_.blend_equation_rgb, to_.blend_equation_alpha);
+        }
+        if (std::tie(from_.blend_src_rgb, from_.blend_dst_rgb, from_.blend_src_alpha, from_.blend_dst_alpha) !=
+            std::tie(to_.blend_src_rgb, to_.blend_dst_rgb, to_.blend_src_alpha, to_.blend_dst_alpha)) {
+            glBlendFuncSeparate(to_.blend_src_rgb, to_.blend_dst_rgb, to_.blend_src_alpha, to_.blend_dst_alpha);
+        }
+
+        if (from_.clear_color != to_.clear_color) {
+            glClearColor(to_.clear_color[0], to_.clear_color[1], to_.clear_color[2], to_.clear_color[3]);
+        }
+        if (from_.clear_depth != to_.clear_depth) {
+            glClearDepth(to_.clear_depth);
+        }
+        if (from_.clear_stencil != to_.clear_stencil) {
+            glClearStencil(to_.clear_stencil);
+        }
+
+        if (from_.color_writemask != to_.color_writemask) {
+            glColorMask(to_.color_writemask[0], to_.color_writemask[1], to_.color_writemask[2], to_.color_writemask[3]);
+        }
+        if (from_.depth_writemask != to_.depth_writemask) {
+            glDepthMask(to_.depth_writemask);
+        }
+
+        if (from_.cull_face_mode != to_.cull_face_mode) {
+            glCullFace(to_.cull_face_mode);
+        }
+        if (from_.front_face != to_.front_face) {
+            glFrontFace(to_.front_face);
+        }
+        if (from_.depth_func != to_.depth_func) {
+            glDepthFunc(to_.depth_func);
+        }
+        if (from_.depth_range != to_.depth_range) {
+            glDepthRange(to_.depth_range[0], to_.depth_range[1]);
+        }
+        if (from_.line_width != to_.line_width) {
+            glLineWidth(to_.line_width);
+        }
+        if (std::tie(from_.polygon_offset_factor, from_.polygon_offset_units) != std::tie(to_.polygon_offset_factor, to_.polygon_offset_units)) {
+            glPolygonOffset(to_.polygon_offset_factor, to_.polygon_offset_units);
+        }
+        if (std::tie(from_.sample_coverage_value, from_.sample_coverage_invert) != std::tie(to_.sample_coverage_value, to_.sample_coverage_invert)) {
+            glSampleCoverage(to_.sample_coverage_value, to_.sample_coverage_invert);
+        }
+        if (from_.generate_mipmap_hint != to_.generate_mipmap_hint) {
+            glHint(GL_GENERATE_MIPMAP_HINT, to_.generate_mipmap_hint);
+        }
+
+        if (from_.scissor_box != to_.scissor_box) {
+            glScissor(to_.scissor_box[0], to_.scissor_box[1], to_.scissor_box[2], to_.scissor_box[3]);
+        }
+        if (from_.viewport != to_.viewport) {
+            glViewport(to_.viewport[0], to_.viewport[1], to_.viewport[2], to_.viewport[3]);
+        }
+
+        if (tie(from_.stencil_front) != tie(to_.stencil_front)) {
+            apply_stencil_face(from_.stencil_front, to_.stencil_front, GL_FRONT);
+        }
+        if (tie(from_.stencil_back) != tie(to_.stencil_back)) {
+            apply_stencil_face(from_.stencil_back, to_.stencil_back, GL_BACK);
+        }
+
+        if (from_.pack_alignment != to_.pack_alignment) {
+            glPixelStorei(GL_PACK_ALIGNMENT, to_.pack_alignment);
+        }
+        if (from_.unpack_alignment != to_.unpack_alignment) {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, to_.unpack_alignment);
+        }
+
+        if (from_.program != to_.program) {
+            glUseProgram(to_.program);
+        }
+        if (from_.draw_framebuffer != to_.draw_framebuffer) {
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, to_.draw_framebuffer);
+        }
+        if (from_.read_framebuffer != to_.read_framebuffer) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, to_.read_framebuffer);
+        }
+        if (from_.renderbuffer != to_.renderbuffer) {
+            glBindRenderbuffer(GL_RENDERBUFFER, to_.renderbuffer);
+        }
+        if (from_.vertex_array != to_.vertex_array) {
+            glBindVertexArray(to_.vertex_array);
+        }
+        if (from_.array_buffer != to_.array_buffer) {
+            glBindBuffer(GL_ARRAY_BUFFER, to_.array_buffer);
+        }
+
+        // Indexed bindings set the generic binding and texture bindings need their unit active,
+        // so both are settled before the generic binding and the active unit.
+        auto activeTexture = from_.active_texture;
+        auto textureUnits = std::max(from_.textures.size(), to_.textures.size());
+        for (std::size_t unit = 0; unit < textureUnits; ++unit) {
+            auto &from = at_or(from_.textures, unit, no_textures);
+            auto &to = at_or(to_.textures, unit, no_textures);
+            if (from == to) {
+                continue;
+            }
+            activeTexture = static_cast<GLint>(GL_TEXTURE0 + unit);
+            glActiveTexture(activeTexture);
+            if (from[0] != to[0]) {
+                glBindTexture(GL_TEXTURE_2D, to[0]);
+            }
+            if (from[1] != to[1]) {
+                glBindTexture(GL_TEXTURE_CUBE_MAP, to[1]);
+            }
+        }
+        if (activeTexture != to_.active_texture) {
+            glActiveTexture(to_.active_texture);
+        }
+
+        auto uniformBuffers = std::max(from_.uniform_buffers.size(), to_.uniform_buffers.size());
+        auto uniformBufferTouched = false;
+        for (std::size_t index = 0; index < uniformBuffers; ++index) {
+            auto &from = at_or(from_.uniform_buffers, index, no_uniform_buffer);
+            auto &to = at_or(to_.uniform_buffers, index, no_uniform_buffer);
+            if (std::tie(from.buffer, from.offset, from.size) == std::tie(to.buffer, to.offset, to.size)) {
+                continue;
+            }
+            auto i = static_cast<GLuint>(index);
+            if (to.buffer && to.size) {
+                glBindBufferRange(GL_UNIFORM_BUFFER, i, to.buffer, to.offset, to.size);
+            }
+            else {
+                glBindBufferBase(GL_UNIFORM_BUFFER, i, to.buffer);
+            }
+            uniformBufferTouched = true;
+        }
+        if (uniformBufferTouched || from_.uniform_buffer != to_.uniform_buffer) {
+            glBindBuffer(GL_UNIFORM_BUFFER, to_.uniform_buffer);
+        }
+
+        auto vertexAttribs = std::max(from_.vertex_attribs.size(), to_.vertex_attribs.size());
+        for (std::size_t index = 0; index < vertexAttribs; ++index) {
+            auto &to = at_or(to_.vertex_attribs, index, default_vertex_attrib);
+            if (at_or(from_.vertex_attribs, index, default_vertex_attrib) != to) {
+                glVertexAttrib4fv(static_cast<GLuint>(index), to.data());
+            }
+        }
+    }
+}
@@ -0,0 +1,150 @@
+
+#pragma once
+
+#include "egl_context.h"
+#include "native_webgl.h"
+#include <glad/glad.h>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace teresa
+{
+    // The GL state of one virtualized canvas, which the entry points changing it keep up to date,
+    // so that switching canvases reads nothing back. Initialized to what GL starts with, apart from
+    // what the canvas sets up itself.
+    struct virtual_state
+    {
+        struct stencil_face
+        {
+            GLint func = GL_ALWAYS;
+            GLint ref = 0;
+            GLint value_mask = -1;
+            GLint writemask = -1;
+            GLint fail = GL_KEEP;
+            GLint pass_depth_fail = GL_KEEP;
+            GLint pass_depth_pass = GL_KEEP;
+        };
+
+        struct uniform_buffer_binding
+        {
+            GLint buffer = 0;
+            GLint64 offset = 0;
+            GLint64 size = 0;
+        };
+
+        // One bit per capability WebGL can enable, DITHER alone initially.
+        std::uint32_t capabilities = 1u << 3;
+
+        std::array<GLfloat, 4> blend_color = {};
+        GLint blend_equation_rgb = GL_FUNC_ADD;
+        GLint blend_equation_alpha = GL_FUNC_ADD;
+        GLint blend_src_rgb = GL_ONE;
+        GLint blend_dst_rgb = GL_ZERO;
+        GLint blend_src_alpha = GL_ONE;
+        GLint blend_dst_alpha = GL_ZERO;
+
+        std::array<GLfloat, 4> clear_color = {};
+        GLfloat clear_depth = 1;
+        GLint clear_stencil = 0;
+
+        std::array<GLboolean, 4> color_writemask = { GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE };
+        GLboolean depth_writemask = GL_TRUE;
+
+        GLint cull_face_mode = GL_BACK;
+        GLint front_face = GL_CCW;
+        GLint depth_func = GL_LESS;
+        std::array<GLfloat, 2> depth_range = { 0, 1 };
+        GLfloat line_width = 1;
+        GLfloat polygon_offset_factor = 0;
+        GLfloat polygon_offset_units = 0;
+        GLfloat sample_coverage_value = 1;
+        GLboolean sample_coverage_invert = GL_FALSE;
+        GLint generate_mipmap_hint = GL_DONT_CARE;
+
+        std::array<GLint, 4> scissor_box = {};
+        std::array<GLint, 4> viewport = {};
+
+        stencil_face stencil_front;
+        stencil_face stencil_back;
+
+        GLint pack_alignment = 4;
+        GLint unpack_alignment = 4;
+
+        GLint program = 0;
+        GLint draw_framebuffer = 0;
+        GLint read_framebuffer = 0;
+        GLint renderbuffer = 0;
+        GLint array_buffer = 0;
+        GLint vertex_array = 0;
+        GLint uniform_buffer = 0;
+        GLint active_texture = GL_TEXTURE0;
+
+        // TEXTURE_2D and TEXTURE_CUBE_MAP of each unit up to the last one the canvas used.
+        std::vector<std::array<GLint, 2>> textures;
+
+        std::vector<uniform_buffer_binding> uniform_buffers;
+
+        // The current values of the generic vertex attributes; no entry means (0, 0, 0, 1).
+        std::vector<std::array<GLfloat, 4>> vertex_attribs;
+
+        // Capabilities WebGL can not enable are left alone.
+        void set_capability(GLenum capability_, bool enabled_);
+
+        // Targets other than TEXTURE_2D and TEXTURE_CUBE_MAP are left alone.
+        void bind_texture(GLenum target_, GLint texture_);
+
+        // An empty range stands for the whole buffer.
+        void bind_uniform_buffer_range(GLuint index_, GLint buffer_, GLint64 offset_, GLint64 size_);
+
+        void set_vertex_attrib(GLuint index_, const std::array<GLfloat, 4> &value_);
+
+        // Drops the bindings of a deleted object, as GL does in the context it is deleted in.
+        void on_buffer_deleted(GLint buffer_);
+
+        void on_texture_deleted(GLint texture_);
+
+        void on_renderbuffer_deleted(GLint renderbuffer_);
+    };
+
+    // One physical GL context which any number of canvases render on in turn. Each canvas keeps
+    // its own virtual_state; when another canvas starts issuing calls, only what differs between
+    // the states of the two is set.
+    class virtual_context
+    {
+    public:
+        // The context every virtualized canvas of the process shares, created on first use.
+        static std::shared_ptr<virtual_context> acquire();
+
+        virtual_context();
+
+        virtual_context(const virtual_context &) = delete;
+
+        virtual_context& operator=(const virtual_context &) = delete;
+
+        // Makes the physical context current, whatever state it is in.
+        void make_current() const;
+
+        // Gives the physical context the state of |state_|, which stays tracked from then on.
+        void switch_to(virtual_state &state_);
+
+        // Forgets |state_|, which is about to go. The physical context keeps whatever state it is in.
+        void release(const virtual_state &state_);
+    private:
+        egl_context _context;
+
+        // The state the physical context is in, as tracked by the canvas of the state, or |_released|.
+        const virtual_state *_resident = nullptr;
+
+        // The state of the physical context while no canvas has it: as read back on first use, or
+        // as the last canvas released left it.
+        virtual_state _released;
+
+        GLint _maxVertexAttribs = 0;
+
+        void _capture(virtual_state &state_, std::size_t texture_units_, std::size_t uniform_buffers_) const;
+
+        void _apply(const virtual_state &from_, const virtual_state &to_) const;
+    };
+}
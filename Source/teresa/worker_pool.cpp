@@ -0,0 +1,90 @@
+
+#include "worker_pool.h"
+#include <algorithm>
+
+namespace teresa
+{
+    worker_pool& worker_pool::shared()
+    {
+        // Never destroyed: joining threads while the module unloads can deadlock.
+        static auto pool = new worker_pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return *pool;
+    }
+
+    worker_pool::worker_pool(std::size_t threads_)
+    {
+        for (std::size_t i = 0; i < threads_; ++i) {
+            _threads.emplace_back([this]() { _run(); });
+            _threads.back().detach();
+        }
+    }
+
+    void worker_pool::_run()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wake.wait(lock, [this]() { return !_tasks.empty(); });
+                task = std::move(_tasks.front());
+                _tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    bool worker_pool::_run_one()
+    {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_tasks.empty()) {
+                return false;
+            }
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+        task();
+        return true;
+    }
+
+    void worker_pool::parallel_for(std::size_t count_, std::size_t grain_, const std::function<void(std::size_t, std::size_t)> &body_)
+    {
+        auto chunks = std::min(concurrency(), count_ / std::max<std::size_t>(1, grain_));
+        if (chunks <= 1) {
+            if (count_) {
+                body_(0, count_);
+            }
+            return;
+        }
+
+        std::mutex doneMutex;
+        std::condition_variable done;
+        auto remaining = chunks - 1;
+        auto chunkSize = (count_ + chunks - 1) / chunks;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (std::size_t i = 1; i < chunks; ++i) {
+                auto begin = i * chunkSize;
+                auto end = std::min(count_, begin + chunkSize);
+                _tasks.emplace_back([&, begin, end]() {
+                    if (begin < end) {
+                        body_(begin, end);
+                    }
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    if (--remaining == 0) {
+                        done.notify_one();
+                    }
+                });
+            }
+        }
+        _wake.notify_all();
+
+        body_(0, std::min(count_, chunkSize));
+        // Help with whatever is still queued, which also keeps nested calls from deadlocking.
+        while (_run_one()) {
+        }
+        std::unique_lock<std::mutex> lock(doneMutex);
+        done.wait(lock, [&]() { return remaining == 0; });
+    }
+}
@@ -0,0 +1,51 @@
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace teresa
+{
+    // Threads for splitting CPU-bound work of a single call, such as converting a large
+    // upload, across cores. Unlike the libuv pool, the caller waits and takes part.
+    class worker_pool
+    {
+    public:
+        // One thread per core but the calling one.
+        static worker_pool& shared();
+
+        worker_pool(const worker_pool &) = delete;
+
+        worker_pool& operator=(const worker_pool &) = delete;
+
+        // Threads working on a parallel_for(), the calling one included.
+        std::size_t concurrency() const
+        {
+            return _threads.size() + 1;
+        }
+
+        // Calls |body_| on consecutive ranges covering [0, |count_|), each at least |grain_| long
+        // unless it is the only one, and returns once all of them are done.
+        void parallel_for(std::size_t count_, std::size_t grain_, const std::function<void(std::size_t, std::size_t)> &body_);
+    private:
+        std::vector<std::thread> _threads;
+
+        std::mutex _mutex;
+
+        std::condition_variable _wake;
+
+        std::deque<std::function<void()>> _tasks;
+
+        explicit worker_pool(std::size_t threads_);
+
+        void _run();
+
+        // Runs one queued task on the calling thread, returns false if there was none.
+        bool _run_one();
+    };
+}
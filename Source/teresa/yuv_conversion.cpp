@@ -0,0 +1,174 @@
+
+#include "yuv_conversion.h"
+#include "cpu_features.h"
+#include <algorithm>
+
+namespace teresa
+{
+    namespace
+    {
+        // BT.601 in 7 bits, so that coefficients and sums fit into the signed bytes and
+        // shorts of the SIMD multiply-adds; the scalar code uses the same, to agree with them.
+        inline std::uint8_t luma(unsigned r_, unsigned g_, unsigned b_)
+        {
+            return static_cast<std::uint8_t>(((33 * r_ + 65 * g_ + 13 * b_ + 64) >> 7) + 16);
+        }
+
+        inline std::uint8_t chroma_u(int r_, int g_, int b_)
+        {
+            return static_cast<std::uint8_t>(((-19 * r_ - 37 * g_ + 56 * b_) >> 7) + 128);
+        }
+
+        inline std::uint8_t chroma_v(int r_, int g_, int b_)
+        {
+            return static_cast<std::uint8_t>(((56 * r_ - 47 * g_ - 9 * b_) >> 7) + 128);
+        }
+
+        // Rounds up like _mm_avg_epu8(), averaging vertically first.
+        inline int average(int a_, int b_)
+        {
+            return (a_ + b_ + 1) >> 1;
+        }
+
+        void luma_row_scalar(std::uint8_t *y_, const std::uint8_t *rgba_, std::size_t begin_, std::size_t end_)
+        {
+            for (auto x = begin_; x < end_; ++x) {
+                auto p = rgba_ + x * 4;
+                y_[x] = luma(p[0], p[1], p[2]);
+            }
+        }
+
+        // |below_| is |rgba_| itself for the last row of an image of odd height.
+        void chroma_row_scalar(std::uint8_t *u_, std::uint8_t *v_, const std::uint8_t *rgba_, const std::uint8_t *below_,
+            std::size_t width_, std::size_t begin_, std::size_t end_)
+        {
+            for (auto x = begin_; x < end_; ++x) {
+                auto left = x * 2 * 4;
+                auto right = std::min(x * 2 + 1, width_ - 1) * 4;
+                int means[3];
+                for (int c = 0; c < 3; ++c) {
+                    means[c] = average(average(rgba_[left + c], below_[left + c]), average(rgba_[right + c], below_[right + c]));
+                }
+                u_[x] = chroma_u(means[0], means[1], means[2]);
+                v_[x] = chroma_v(means[0], means[1], means[2]);
+            }
+        }
+
+#if defined(TERESA_X86)
+        // Sums of the weighted R, G, B of 4 pixels, as shorts in the lanes of each pixel pair.
+        TERESA_TARGET("sse4.1")
+        inline __m128i weigh_sse41(__m128i pixels_, __m128i weights_)
+        {
+            return _mm_maddubs_epi16(pixels_, weights_);
+        }
+
+        TERESA_TARGET("sse4.1")
+        std::size_t luma_row_sse41(std::uint8_t *y_, const std::uint8_t *rgba_, std::size_t width_)
+        {
+            auto weights = _mm_setr_epi8(33, 65, 13, 0, 33, 65, 13, 0, 33, 65, 13, 0, 33, 65, 13, 0);
+            auto rounding = _mm_set1_epi16(64);
+            auto offset = _mm_set1_epi16(16);
+            std::size_t x = 0;
+            for (; x + 16 <= width_; x += 16) {
+                auto source = reinterpret_cast<const __m128i*>(rgba_ + x * 4);
+                auto p0 = weigh_sse41(_mm_loadu_si128(source), weights);
+                auto p1 = weigh_sse41(_mm_loadu_si128(source + 1), weights);
+                auto p2 = weigh_sse41(_mm_loadu_si128(source + 2), weights);
+                auto p3 = weigh_sse41(_mm_loadu_si128(source + 3), weights);
+                // Adding the pairs gives one short per pixel, 8 pixels per register.
+                auto lo = _mm_hadd_epi16(p0, p1);
+                auto hi = _mm_hadd_epi16(p2, p3);
+                lo = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(lo, rounding), 7), offset);
+                hi = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(hi, rounding), 7), offset);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(y_ + x), _mm_packus_epi16(lo, hi));
+            }
+            return x;
+        }
+
+        // The 2x2 averages of 8 pixels of two rows, as 4 pixels.
+        TERESA_TARGET("sse4.1")
+        inline __m128i average_blocks_sse41(const std::uint8_t *rgba_, const std::uint8_t *below_)
+        {
+            auto a = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba_)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(below_)));
+            auto b = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba_ + 16)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(below_ + 16)));
+            auto even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+            auto odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+            return _mm_avg_epu8(even, odd);
+        }
+
+        TERESA_TARGET("sse4.1")
+        inline __m128i chroma_sse41(__m128i blocks0_, __m128i blocks1_, __m128i weights_)
+        {
+            auto sums = _mm_hadd_epi16(weigh_sse41(blocks0_, weights_), weigh_sse41(blocks1_, weights_));
+            return _mm_add_epi16(_mm_srai_epi16(sums, 7), _mm_set1_epi16(128));
+        }
+
+        TERESA_TARGET("sse4.1")
+        std::size_t chroma_row_sse41(std::uint8_t *u_, std::uint8_t *v_, const std::uint8_t *rgba_, const std::uint8_t *below_,
+            std::size_t width_)
+        {
+            auto uWeights = _mm_setr_epi8(-19, -37, 56, 0, -19, -37, 56, 0, -19, -37, 56, 0, -19, -37, 56, 0);
+            auto vWeights = _mm_setr_epi8(56, -47, -9, 0, 56, -47, -9, 0, 56, -47, -9, 0, 56, -47, -9, 0);
+            // 8 chroma samples from 16 pixels, all of them within the row.
+            std::size_t x = 0;
+            for (; x * 2 + 16 <= width_; x += 8) {
+                auto blocks0 = average_blocks_sse41(rgba_ + x * 8, below_ + x * 8);
+                auto blocks1 = average_blocks_sse41(rgba_ + x * 8 + 32, below_ + x * 8 + 32);
+                auto u = chroma_sse41(blocks0, blocks1, uWeights);
+                auto v = chroma_sse41(blocks0, blocks1, vWeights);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(u_ + x), _mm_packus_epi16(u, u));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(v_ + x), _mm_packus_epi16(v, v));
+            }
+            return x;
+        }
+#endif
+    }
+
+    std::size_t yuv420_size(std::size_t width_, std::size_t height_)
+    {
+        auto chromaWidth = (width_ + 1) / 2;
+        auto chromaHeight = (height_ + 1) / 2;
+        return width_ * height_ + chromaWidth * chromaHeight * 2;
+    }
+
+    void rgba_to_yuv420(std::uint8_t *destination_, const std::uint8_t *source_, std::ptrdiff_t pitch_,
+        std::size_t width_, std::size_t height_)
+    {
+        if (!width_ || !height_) {
+            return;
+        }
+        auto chromaWidth = (width_ + 1) / 2;
+        auto chromaHeight = (height_ + 1) / 2;
+        auto yPlane = destination_;
+        auto uPlane = yPlane + width_ * height_;
+        auto vPlane = uPlane + chromaWidth * chromaHeight;
+#if defined(TERESA_X86)
+        auto simd = cpu_features::get().sse41;
+#endif
+        for (std::size_t row = 0; row < height_; ++row) {
+            auto rgba = source_ + static_cast<std::ptrdiff_t>(row) * pitch_;
+            std::size_t done = 0;
+#if defined(TERESA_X86)
+            if (simd) {
+                done = luma_row_sse41(yPlane + row * width_, rgba, width_);
+            }
+#endif
+            luma_row_scalar(yPlane + row * width_, rgba, done, width_);
+        }
+        for (std::size_t row = 0; row < chromaHeight; ++row) {
+            auto rgba = source_ + static_cast<std::ptrdiff_t>(row * 2) * pitch_;
+            auto below = row * 2 + 1 < height_ ? rgba + pitch_ : rgba;
+            auto u = uPlane + row * chromaWidth;
+            auto v = vPlane + row * chromaWidth;
+            std::size_t done = 0;
+#if defined(TERESA_X86)
+            if (simd) {
+                done = chroma_row_sse41(u, v, rgba, below, width_);
+            }
+#endif
+            chroma_row_scalar(u, v, rgba, below, width_, done, chromaWidth);
+        }
+    }
+}
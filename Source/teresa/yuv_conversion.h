@@ -0,0 +1,17 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace teresa
+{
+    // Bytes of an I420 image: a full size Y plane, then U and V planes of half the width and
+    // height, rounded up.
+    std::size_t yuv420_size(std::size_t width_, std::size_t height_);
+
+    // Converts RGBA8 pixels to I420 with BT.601 limited range coefficients, averaging the chroma
+    // of each 2x2 block; alpha is ignored. |pitch_| may be negative to read rows bottom up.
+    void rgba_to_yuv420(std::uint8_t *destination_, const std::uint8_t *source_, std::ptrdiff_t pitch_,
+        std::size_t width_, std::size_t height_);
+}
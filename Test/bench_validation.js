@@ -0,0 +1,102 @@
+const NativeWebGL = require('./native-webgl');
+
+//
+// Measures the cost every validation level adds to a draw call.
+//
+// Usage: node bench_validation.js [drawsPerFrame] [frames]
+//
+
+const drawsPerFrame = Number(process.argv[2] || 10000);
+const frames = Number(process.argv[3] || 50);
+
+const vsSource = `
+    attribute vec2 aVertexPosition;
+
+    void main(void) {
+      gl_Position = vec4(aVertexPosition, 0.0, 1.0);
+    }
+  `;
+
+const fsSource = `
+    void main(void) {
+      gl_FragColor = vec4(1.0, 1.0, 1.0, 1.0);
+    }
+  `;
+
+function loadShader(gl, type, source) {
+    const shader = gl.createShader(type);
+    gl.shaderSource(shader, source);
+    gl.compileShader(shader);
+    if (!gl.getShaderParameter(shader, gl.COMPILE_STATUS)) {
+        throw new Error('An error occurred compiling the shaders: ' + gl.getShaderInfoLog(shader));
+    }
+    return shader;
+}
+
+function setupScene(gl) {
+    const program = gl.createProgram();
+    gl.attachShader(program, loadShader(gl, gl.VERTEX_SHADER, vsSource));
+    gl.attachShader(program, loadShader(gl, gl.FRAGMENT_SHADER, fsSource));
+    gl.linkProgram(program);
+    if (!gl.getProgramParameter(program, gl.LINK_STATUS)) {
+        throw new Error('Unable to initialize the shader program: ' + gl.getProgramInfoLog(program));
+    }
+    gl.useProgram(program);
+
+    const positionBuffer = gl.createBuffer();
+    gl.bindBuffer(gl.ARRAY_BUFFER, positionBuffer);
+    gl.bufferData(gl.ARRAY_BUFFER, new Float32Array([
+        -0.01, -0.01,
+         0.01, -0.01,
+         0.01,  0.01,
+        -0.01,  0.01,
+    ]), gl.STATIC_DRAW);
+
+    const location = gl.getAttribLocation(program, 'aVertexPosition');
+    gl.vertexAttribPointer(location, 2, gl.FLOAT, false, 0, 0);
+    gl.enableVertexAttribArray(location);
+
+    const indexBuffer = gl.createBuffer();
+    gl.bindBuffer(gl.ELEMENT_ARRAY_BUFFER, indexBuffer);
+    gl.bufferData(gl.ELEMENT_ARRAY_BUFFER, new Uint16Array([0, 1, 2, 0, 2, 3]), gl.STATIC_DRAW);
+}
+
+function run(validation) {
+    const gl = NativeWebGL.createCanvas({ validation: validation });
+    setupScene(gl);
+
+    // Warm up caches before measuring.
+    for (let i = 0; i < drawsPerFrame; ++i) {
+        gl.drawElements(gl.TRIANGLES, 6, gl.UNSIGNED_SHORT, 0);
+    }
+    gl.finish();
+
+    let elapsed = 0n;
+    for (let frame = 0; frame < frames; ++frame) {
+        gl.clear(gl.COLOR_BUFFER_BIT);
+        const start = process.hrtime.bigint();
+        for (let i = 0; i < drawsPerFrame; ++i) {
+            gl.drawElements(gl.TRIANGLES, 6, gl.UNSIGNED_SHORT, 0);
+        }
+        elapsed += process.hrtime.bigint() - start;
+        gl.flush();
+    }
+
+    const error = gl.getError();
+    if (error !== gl.NO_ERROR) {
+        throw new Error(`Validation "${validation}" rejected the benchmark draws: ${error}`);
+    }
+
+    NativeWebGL.destroyCanvas(gl);
+    return Number(elapsed) / (drawsPerFrame * frames);
+}
+
+const results = {};
+for (const validation of ['none', 'fast', 'strict']) {
+    results[validation] = run(validation);
+}
+
+for (const validation of Object.keys(results)) {
+    const overhead = results[validation] - results.none;
+    console.log(`${validation.padEnd(6)} ${results[validation].toFixed(1)} ns/drawElements (+${overhead.toFixed(1)} ns)`);
+}